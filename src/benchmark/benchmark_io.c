@@ -1,9 +1,15 @@
 #include "benchmark_io.h"
-#include "../bmp/bmp_io.h"
 #include "../config/files.h"
 #include "../config/kernel.h"
+#include "../convolution/convolution.h"
 #include "../file_utils/file_utils.h"
-#include <limits.h>
+#include "../history/history.h"
+#include "../memory/numa.h"
+#include "../planner/planner.h"
+#include "../roofline/roofline.h"
+#include "../temporal/temporal.h"
+#include "kernel_run.h"
+#include <mpi.h>
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -26,75 +32,230 @@ app_error init_csv_files(BenchmarkConfig config, bool run_all) {
     if (!err && config.run_task_pool)
       err = init_benchmark_csv(TASK_POOL_CSV_FILE, SINGLE_RUN_CSV_HEADER);
   }
+  // The FFT and planned modes are not part of -all and always have their own
+  // file
+  if (!err && config.run_fft)
+    err = init_benchmark_csv(FFT_CSV_FILE, SINGLE_RUN_CSV_HEADER);
+  if (!err && config.run_fft_distributed)
+    err = init_benchmark_csv(FFT_DISTRIBUTED_CSV_FILE, SINGLE_RUN_CSV_HEADER);
+  if (!err && config.run_planned)
+    err = init_benchmark_csv(PLANNED_CSV_FILE, SINGLE_RUN_CSV_HEADER);
+  if (!err)
+    err = init_benchmark_csv(PHASES_CSV_FILE, PHASES_CSV_HEADER);
+  if (!err && config.perf_counters)
+    err = init_benchmark_csv(COUNTERS_CSV_FILE, COUNTERS_CSV_HEADER);
+  if (!err && config.float_accumulation)
+    err = init_benchmark_csv(PRECISION_CSV_FILE, PRECISION_CSV_HEADER);
+  if (!err)
+    err = init_benchmark_csv(THROUGHPUT_CSV_FILE, THROUGHPUT_CSV_HEADER);
   return err;
 }
 
-app_error log_kernel_results(int file_number, int kernel_number, int comm_size,
+// Name of the engine a mode ran with: the variant selected by -taskgraph,
+// -stream or -overlap, or "default", so that the history and the CSVs never
+// pool the times of different engines
+static const char *get_mode_engine(int mode, BenchmarkConfig config) {
+  if (mode == MODE_MULTITHREADED && config.taskgraph)
+    return "taskgraph";
+  if (mode == MODE_DISTRIBUTED && config.stream)
+    return "stream";
+  if (mode == MODE_DISTRIBUTED && config.overlap) {
+    // Without thread support the blocking engine ran instead
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided >= MPI_THREAD_FUNNELED)
+      return "overlap";
+  }
+  return "default";
+}
+
+app_error log_kernel_results(int f, int k, int comm_size,
                              BenchmarkConfig config, bool run_all, int width,
                              int height) {
   app_error err = SUCCESS;
+  int kernel_size = benchmark_kernels[k].size;
+  long long pixels = (long long)width * height;
+
   double serial_time = -1;
   if (config.run_serial)
-    serial_time = benchmark_data[0][file_number][kernel_number];
+    serial_time = get_benchmark_result(MODE_SERIAL, f, k)->time;
 
   double multithreaded_time = -1;
   if (config.run_multithreaded)
-    multithreaded_time = benchmark_data[1][file_number][kernel_number];
+    multithreaded_time = get_benchmark_result(MODE_MULTITHREADED, f, k)->time;
 
   double distributed_time = -1;
   if (config.run_distributed)
-    distributed_time = benchmark_data[2][file_number][kernel_number];
+    distributed_time = get_benchmark_result(MODE_DISTRIBUTED, f, k)->time;
 
   double shared_time = -1;
   if (config.run_shared)
-    shared_time = benchmark_data[3][file_number][kernel_number];
+    shared_time = get_benchmark_result(MODE_SHARED, f, k)->time;
 
   double task_pool_time = -1;
   if (config.run_task_pool)
-    task_pool_time = benchmark_data[4][file_number][kernel_number];
+    task_pool_time = get_benchmark_result(MODE_TASK_POOL, f, k)->time;
 
   if (run_all) {
     err = append_benchmark_result(
-        MULTI_RUN_CSV_FILE, width * height, CONV_KERNELS[kernel_number].size,
-        comm_size, config.omp_threads, serial_time, multithreaded_time,
-        distributed_time, shared_time, task_pool_time);
+        MULTI_RUN_CSV_FILE, pixels, kernel_size, comm_size, config.omp_threads,
+        config.iterations, get_mode_engine(MODE_MULTITHREADED, config),
+        get_mode_engine(MODE_DISTRIBUTED, config), serial_time,
+        multithreaded_time, distributed_time, shared_time, task_pool_time);
     if (err != SUCCESS)
       return err;
   } else {
     if (config.run_serial) {
       err = append_single_benchmark_result(
-          SERIAL_CSV_FILE, width * height, CONV_KERNELS[kernel_number].size,
-          comm_size, config.omp_threads, serial_time);
+          SERIAL_CSV_FILE, pixels, kernel_size, comm_size, config.omp_threads,
+          config.iterations, get_mode_engine(MODE_SERIAL, config),
+          serial_time);
       if (err != SUCCESS)
         return err;
     }
     if (config.run_multithreaded) {
       err = append_single_benchmark_result(
-          MULTITHREADED_CSV_FILE, width * height,
-          CONV_KERNELS[kernel_number].size, comm_size, config.omp_threads,
-          multithreaded_time);
+          MULTITHREADED_CSV_FILE, pixels, kernel_size, comm_size,
+          config.omp_threads, config.iterations,
+          get_mode_engine(MODE_MULTITHREADED, config), multithreaded_time);
       if (err != SUCCESS)
         return err;
     }
     if (config.run_distributed) {
-      err = append_single_benchmark_result(DISTRIBUTED_CSV_FILE, width * height,
-                                           CONV_KERNELS[kernel_number].size,
-                                           comm_size, config.omp_threads,
-                                           distributed_time);
+      err = append_single_benchmark_result(
+          DISTRIBUTED_CSV_FILE, pixels, kernel_size, comm_size,
+          config.omp_threads, config.iterations,
+          get_mode_engine(MODE_DISTRIBUTED, config), distributed_time);
       if (err != SUCCESS)
         return err;
     }
     if (config.run_shared) {
       err = append_single_benchmark_result(
-          SHARED_CSV_FILE, width * height, CONV_KERNELS[kernel_number].size,
-          comm_size, config.omp_threads, shared_time);
+          SHARED_CSV_FILE, pixels, kernel_size, comm_size, config.omp_threads,
+          config.iterations, get_mode_engine(MODE_SHARED, config),
+          shared_time);
       if (err != SUCCESS)
         return err;
     }
     if (config.run_task_pool) {
       err = append_single_benchmark_result(
-          TASK_POOL_CSV_FILE, width * height, CONV_KERNELS[kernel_number].size,
-          comm_size, config.omp_threads, task_pool_time);
+          TASK_POOL_CSV_FILE, pixels, kernel_size, comm_size,
+          config.omp_threads, config.iterations,
+          get_mode_engine(MODE_TASK_POOL, config), task_pool_time);
+      if (err != SUCCESS)
+        return err;
+    }
+  }
+
+  if (config.run_fft) {
+    err = append_single_benchmark_result(
+        FFT_CSV_FILE, pixels, kernel_size, comm_size, config.omp_threads,
+        config.iterations, get_mode_engine(MODE_FFT, config),
+        get_benchmark_result(MODE_FFT, f, k)->time);
+    if (err != SUCCESS)
+      return err;
+  }
+  if (config.run_fft_distributed) {
+    err = append_single_benchmark_result(
+        FFT_DISTRIBUTED_CSV_FILE, pixels, kernel_size, comm_size,
+        config.omp_threads, config.iterations,
+        get_mode_engine(MODE_FFT_DISTRIBUTED, config),
+        get_benchmark_result(MODE_FFT_DISTRIBUTED, f, k)->time);
+    if (err != SUCCESS)
+      return err;
+  }
+  if (config.run_planned) {
+    err = append_single_benchmark_result(
+        PLANNED_CSV_FILE, pixels, kernel_size, comm_size, config.omp_threads,
+        config.iterations, get_mode_engine(MODE_PLANNED, config),
+        get_benchmark_result(MODE_PLANNED, f, k)->time);
+    if (err != SUCCESS)
+      return err;
+  }
+  return SUCCESS;
+}
+
+// Name of the algorithm a mode ran with: the planner's choice, or the
+// algorithm the mode is fixed to
+static const char *get_mode_algorithm(int mode, const BenchmarkResult *result) {
+  if (result->algorithm != ALGO_UNPLANNED)
+    return get_algorithm_name(result->algorithm);
+  if (mode == MODE_FFT || mode == MODE_FFT_DISTRIBUTED)
+    return get_algorithm_name(ALGO_FFT);
+  return get_algorithm_name(ALGO_DIRECT);
+}
+
+// Writes the per-mode detail rows (phases, throughput, counters, history)
+app_error log_mode_results(int f, int k, int comm_size, BenchmarkConfig config,
+                           const RunMetadata *meta, int width, int height) {
+  unsigned int executed[CONVOLUTION_MODES] = {
+      config.run_serial,    config.run_multithreaded, config.run_distributed,
+      config.run_shared,    config.run_task_pool,     config.run_fft,
+      config.run_fft_distributed, config.run_planned};
+  int kernel_size = benchmark_kernels[k].size;
+  long long pixels = (long long)width * height;
+
+  for (int m = 0; m < CONVOLUTION_MODES; m++) {
+    if (!executed[m])
+      continue;
+
+    const BenchmarkResult *result = get_benchmark_result(m, f, k);
+    const char *engine = get_mode_engine(m, config);
+    app_error err = append_phase_benchmark_result(
+        PHASES_CSV_FILE, pixels, kernel_size, comm_size, config.omp_threads,
+        config.iterations, IMPLEMENTATION_FOLDERS[m], engine, &result->phases);
+    if (err != SUCCESS)
+      return err;
+
+    // The serial mode only ever uses one thread of one rank
+    MachinePeak peak;
+    KernelThroughput throughput;
+    roofline_get_peak(result->ranks, m == MODE_SERIAL ? 1 : config.omp_threads,
+                      &peak);
+    // Every iteration convolves the whole image again
+    compute_kernel_throughput(pixels * get_kernel_iterations(), kernel_size,
+                              result->time, &peak, &throughput);
+    const char *precision = get_precision_name(
+        is_direct_mode(m) ? get_accumulation_precision() : PRECISION_DOUBLE);
+    err = append_throughput_benchmark_result(
+        THROUGHPUT_CSV_FILE, pixels, kernel_size, comm_size,
+        config.omp_threads, config.iterations, IMPLEMENTATION_FOLDERS[m],
+        engine, get_mode_algorithm(m, result), precision, numa_node_count(),
+        get_bind_policy_name(config.bind), result->time, &peak, &throughput);
+    if (err != SUCCESS)
+      return err;
+
+    HistoryRecord record = {IMPLEMENTATION_FOLDERS[m],
+                            engine,
+                            get_mode_algorithm(m, result),
+                            precision,
+                            benchmark_kernels[k].name,
+                            benchmark_files[f].name,
+                            width,
+                            height,
+                            config.iterations,
+                            config.halo_depth,
+                            numa_node_count(),
+                            get_bind_policy_name(config.bind),
+                            result->time};
+    err = append_history_record(RUN_HISTORY_FILE, meta, &record);
+    if (err != SUCCESS)
+      return err;
+
+    if (result->divergent_pixels >= 0) {
+      err = append_precision_result(
+          PRECISION_CSV_FILE, pixels, benchmark_kernels[k].name,
+          benchmark_files[f].name, IMPLEMENTATION_FOLDERS[m], result->time,
+          result->divergent_pixels, result->divergence_max_error);
+      if (err != SUCCESS)
+        return err;
+    }
+
+    if (config.perf_counters) {
+      err = append_counter_benchmark_result(
+          COUNTERS_CSV_FILE, pixels, kernel_size, comm_size,
+          config.omp_threads, config.iterations, IMPLEMENTATION_FOLDERS[m],
+          engine, result->time, &result->counters);
       if (err != SUCCESS)
         return err;
     }
@@ -104,11 +265,14 @@ app_error log_kernel_results(int file_number, int kernel_number, int comm_size,
 
 app_error log_speedup_results(int f, int k, int comm_size,
                               BenchmarkConfig config, int width, int height) {
-  double serial_time = benchmark_data[0][f][k];
-  double multithreaded_time = benchmark_data[1][f][k];
-  double distributed_time = benchmark_data[2][f][k];
-  double shared_time = benchmark_data[3][f][k];
-  double task_pool_time = benchmark_data[4][f][k];
+  double serial_time = get_benchmark_result(MODE_SERIAL, f, k)->time;
+  double multithreaded_time =
+      get_benchmark_result(MODE_MULTITHREADED, f, k)->time;
+  double distributed_time =
+      get_benchmark_result(MODE_DISTRIBUTED, f, k)->time;
+  double shared_time = get_benchmark_result(MODE_SHARED, f, k)->time;
+  double task_pool_time = get_benchmark_result(MODE_TASK_POOL, f, k)->time;
+  long long pixels = (long long)width * height;
 
   // Calculate speedups
   // Speedup = Serial Time / Parallel Time
@@ -129,9 +293,12 @@ app_error log_speedup_results(int f, int k, int comm_size,
     task_pool_speedup = serial_time / task_pool_time;
 
   return append_benchmark_result(
-      SPEEDUP_CSV_FILE, width * height, CONV_KERNELS[k].size, comm_size,
-      config.omp_threads, serial_speedup, multithreaded_speedup,
-      distributed_speedup, shared_speedup, task_pool_speedup);
+      SPEEDUP_CSV_FILE, pixels, benchmark_kernels[k].size, comm_size,
+      config.omp_threads, config.iterations,
+      get_mode_engine(MODE_MULTITHREADED, config),
+      get_mode_engine(MODE_DISTRIBUTED, config), serial_speedup,
+      multithreaded_speedup, distributed_speedup, shared_speedup,
+      task_pool_speedup);
 }
 
 app_error write_benchmark_results(int comm_size, BenchmarkConfig config) {
@@ -148,43 +315,48 @@ app_error write_benchmark_results(int comm_size, BenchmarkConfig config) {
     return err;
   }
 
-  for (int f = 0; f < BENCHMARK_FILES; f++) {
-    // Read file to get dimensions
-    char input_path[PATH_MAX];
-    snprintf(input_path, PATH_MAX, "%s/%s/%s", IMAGES_FOLDER, BASE_FOLDER,
-             files[f]);
-    Image *img = NULL;
-    if (read_BMP(&img, input_path) == SUCCESS) {
-      int width = img->width;
-      int height = img->height;
+  // Environment of the run, stored with every measurement of the history
+  RunMetadata meta;
+  collect_run_metadata(&meta, config.run_label, comm_size, config.omp_threads);
+
+  // Dimensions were recorded when the inputs were read by the benchmark
+  for (int f = 0; f < num_benchmark_files; f++) {
+    const InputFile *input = &benchmark_files[f];
+    int width = input->width;
+    int height = input->height;
+    if (width <= 0 || height <= 0) {
+      fprintf(stderr, "No dimensions recorded for %s, skipping\n",
+              input->name);
+      continue;
+    }
+
+    for (int k = 0; k < num_benchmark_kernels; k++) {
+      err = log_kernel_results(f, k, comm_size, config, run_all, width, height);
+      if (err != SUCCESS) {
+        fprintf(stderr, "Failed to append result for file %s, kernel %d: %s\n",
+                input->name, k, get_error_string(err));
+        return err;
+      }
 
-      for (int k = 0; k < KERNEL_TYPES; k++) {
-        err =
-            log_kernel_results(f, k, comm_size, config, run_all, width, height);
+      err = log_mode_results(f, k, comm_size, config, &meta, width, height);
+      if (err != SUCCESS) {
+        fprintf(stderr,
+                "Failed to append detail results for file %s, kernel %d: "
+                "%s\n",
+                input->name, k, get_error_string(err));
+        return err;
+      }
 
+      if (run_all) {
+        err = log_speedup_results(f, k, comm_size, config, width, height);
         if (err != SUCCESS) {
           fprintf(stderr,
-                  "Failed to append result for file %s, kernel %d: %s\n",
-                  files[f], k, get_error_string(err));
-          free_BMP(img);
+                  "Failed to append speedup result for file %s, kernel %d: "
+                  "%s\n",
+                  input->name, k, get_error_string(err));
           return err;
         }
-
-        if (run_all) {
-          err = log_speedup_results(f, k, comm_size, config, width, height);
-          if (err != SUCCESS) {
-            fprintf(stderr,
-                    "Failed to append speedup result for file %s, kernel %d: "
-                    "%s\n",
-                    files[f], k, get_error_string(err));
-            free_BMP(img);
-            return err;
-          }
-        }
       }
-      free_BMP(img);
-    } else {
-      fprintf(stderr, "Failed to read image %s for info\n", input_path);
     }
   }
 
@@ -195,6 +367,13 @@ app_error write_benchmark_results(int comm_size, BenchmarkConfig config) {
     printf("\nBenchmark results written to separate files based on executed "
            "modes.\n");
   }
+  printf("Phase breakdown written to %s\n", PHASES_CSV_FILE);
+  printf("Throughput and roofline metrics written to %s\n",
+         THROUGHPUT_CSV_FILE);
+  if (config.perf_counters)
+    printf("Hardware counters written to %s\n", COUNTERS_CSV_FILE);
+  if (config.float_accumulation)
+    printf("Float divergence written to %s\n", PRECISION_CSV_FILE);
 
   return err;
 }
@@ -1,49 +1,121 @@
 #include "benchmark_run.h"
 #include "../bmp/bmp_io.h"
+#include "../bmp/image_diff.h"
 #include "../config/files.h"
 #include "../config/kernel.h"
 #include "../convolution/convolution.h"
+#include "../convolution/fft_convolution.h"
+#include "../file_utils/file_utils.h"
+#include "../overlap/overlap.h"
+#include "../planner/planner.h"
+#include "../temporal/temporal.h"
+#include "../workpool/work_pool.h"
 #include "kernel_run.h"
 #include <limits.h>
+#include <math.h>
 #include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #define GREEN "\033[0;32m"
 #define RED "\033[0;31m"
 #define RESET "\033[0m"
 
+// Smallest PSNR accepted from the engines that may round differently
+#define APPROXIMATE_MIN_PSNR 50.0
+
+/**
+ * Quality an engine must reach against the serial output.
+ */
+typedef struct {
+  int max_error;   // Largest absolute error of any channel
+  double min_psnr; // Smallest PSNR in dB (INFINITY: bit-exact)
+} EngineTolerance;
+
+// Appends the hashes of the serial outputs to the reference manifest. The
+// last entry of a kernel and file wins, so older entries may stay behind
+static app_error save_reference_hashes(void) {
+  app_error err =
+      init_benchmark_csv(REFERENCE_HASH_CSV_FILE, REFERENCE_HASH_CSV_HEADER);
+  if (err)
+    return err;
+
+  FILE *fp = fopen(REFERENCE_HASH_CSV_FILE, "a");
+  if (!fp)
+    return ERR_FILE_OPEN;
+  for (int f = 0; f < num_benchmark_files; f++) {
+    for (int k = 0; k < num_benchmark_kernels; k++) {
+      // The file name goes last, so that it may contain commas
+      fprintf(fp, "%s,%d,%d,%016llx,%s\n", benchmark_kernels[k].name,
+              benchmark_files[f].width, benchmark_files[f].height,
+              get_benchmark_result(MODE_SERIAL, f, k)->hash,
+              benchmark_files[f].name);
+    }
+  }
+  fclose(fp);
+  return SUCCESS;
+}
+
 app_error run_benchmark_serial(void) {
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   if (rank == 0) {
     printf("\n--- Starting Serial Benchmark ---\n");
-    app_error err =
-        run_all_files(SERIAL_FOLDER, convolve_serial, benchmark_data[0]);
+    app_error err = run_all_files(MODE_SERIAL, SERIAL_FOLDER, convolve_serial,
+                                  MPI_COMM_SELF);
+    // A missing manifest only makes the next verification read the BMPs.
+    // The references are the double results, float runs are diffed in full
+    if (!err && get_accumulation_precision() == PRECISION_DOUBLE &&
+        save_reference_hashes() != SUCCESS)
+      fprintf(stderr, "Warning: Could not write %s\n",
+              REFERENCE_HASH_CSV_FILE);
     return err;
   }
   return SUCCESS;
 }
 
-app_error run_benchmark_parallel_multithreaded(void) {
+app_error run_benchmark_parallel_multithreaded(BenchmarkConfig config) {
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   if (rank == 0) {
     printf("\n--- Starting Parallel Benchmark (Multithreaded) ---\n");
-    return run_all_files(MULTITHREADED_FOLDER, convolve_parallel_multithreaded,
-                         benchmark_data[1]);
+    if (config.taskgraph)
+      return run_all_files_taskgraph(MODE_MULTITHREADED, MULTITHREADED_FOLDER,
+                                     config.tile_rows);
+    return run_all_files(MODE_MULTITHREADED, MULTITHREADED_FOLDER,
+                         convolve_parallel_multithreaded, MPI_COMM_SELF);
   }
   return SUCCESS;
 }
 
-app_error run_benchmark_parallel_distributed_fs(void) {
+app_error run_benchmark_parallel_distributed_fs(BenchmarkConfig config) {
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   if (rank == 0) {
     printf("\n--- Starting Parallel Benchmark (Distributed Filesystem) ---\n");
   }
   // All ranks participate in Distributed FS benchmark
-  return run_all_files(DISTRIBUTED_FOLDER,
+  if (config.stream && config.iterations > 1) {
+    if (rank == 0)
+      fprintf(stderr, "-stream applies every kernel once, -iterations is not "
+                      "supported\n");
+    return ERR_INVALID_ARGS;
+  }
+  if (config.stream)
+    return run_all_files_streamed(MODE_DISTRIBUTED, DISTRIBUTED_FOLDER,
+                                  config.band_rows);
+  if (config.overlap)
+    return run_all_files(MODE_DISTRIBUTED, DISTRIBUTED_FOLDER,
+                         convolve_distributed_overlap, MPI_COMM_WORLD);
+  // Iterations exchange deep halos instead of scattering every iteration
+  if (config.iterations > 1)
+    return run_all_files_iterated(MODE_DISTRIBUTED, DISTRIBUTED_FOLDER,
+                                  convolve_distributed_iterated,
+                                  MPI_COMM_WORLD);
+  return run_all_files(MODE_DISTRIBUTED, DISTRIBUTED_FOLDER,
                        convolve_parallel_distributed_filesystem,
-                       benchmark_data[2]);
+                       MPI_COMM_WORLD);
 }
 
 app_error run_benchmark_parallel_shared_fs(void) {
@@ -51,8 +123,8 @@ app_error run_benchmark_parallel_shared_fs(void) {
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   if (rank == 0) {
     printf("\n--- Starting Parallel Benchmark (Shared Filesystem) ---\n");
-    return run_all_files(SHARED_FOLDER, convolve_parallel_shared_filesystem,
-                         benchmark_data[3]);
+    return run_all_files(MODE_SHARED, SHARED_FOLDER,
+                         convolve_parallel_shared_filesystem, MPI_COMM_SELF);
   }
   return SUCCESS;
 }
@@ -60,100 +132,297 @@ app_error run_benchmark_parallel_shared_fs(void) {
 app_error run_benchmark_task_pool(void) {
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  if (rank == 0) {
+  if (rank == 0)
     printf("\n--- Starting Parallel Benchmark (Task Pool) ---\n");
-    // Placeholder: using multithreaded implementation
-    return run_all_files(TASK_POOL_FOLDER, convolve_parallel_multithreaded,
-                         benchmark_data[4]);
+
+  // All ranks claim chunks from the pool
+  return run_all_files(MODE_TASK_POOL, TASK_POOL_FOLDER, convolve_work_pool,
+                       MPI_COMM_WORLD);
+}
+
+app_error run_benchmark_fft(void) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank == 0) {
+    printf("\n--- Starting Parallel Benchmark (FFT) ---\n");
+    return run_all_files(MODE_FFT, FFT_FOLDER, convolve_fft, MPI_COMM_SELF);
+  }
+  return SUCCESS;
+}
+
+app_error run_benchmark_fft_distributed(void) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank == 0) {
+    printf("\n--- Starting Parallel Benchmark (Distributed FFT) ---\n");
+  }
+  // All ranks convolve their own strip
+  return run_all_files(MODE_FFT_DISTRIBUTED, FFT_DISTRIBUTED_FOLDER,
+                       convolve_fft_distributed, MPI_COMM_WORLD);
+}
+
+app_error run_benchmark_planned(BenchmarkConfig config) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  if (rank == 0) {
+    printf("\n--- Starting Parallel Benchmark (Planned) ---\n");
+    app_error err = planner_init(config.omp_threads, config.recalibrate);
+    if (err)
+      return err;
+    return run_all_files(MODE_PLANNED, PLANNED_FOLDER, convolve_planned,
+                         MPI_COMM_SELF);
   }
   return SUCCESS;
 }
 
+// Looks up the serial reference hash of every file and kernel of the
+// benchmark (found[f * kernels + k] is 0 when the manifest has none)
+static void load_reference_hashes(unsigned long long *hashes, int *found) {
+  for (int i = 0; i < num_benchmark_files * num_benchmark_kernels; i++)
+    found[i] = 0;
+
+  FILE *fp = fopen(REFERENCE_HASH_CSV_FILE, "r");
+  if (!fp)
+    return;
+
+  char line[PATH_MAX + 256];
+  while (fgets(line, sizeof(line), fp)) {
+    char kernel[128];
+    int width, height, name_offset;
+    unsigned long long hash;
+    if (sscanf(line, "%127[^,],%d,%d,%llx,%n", kernel, &width, &height, &hash,
+               &name_offset) != 4)
+      continue;
+    char *name = line + name_offset;
+    name[strcspn(name, "\r\n")] = '\0';
+
+    for (int f = 0; f < num_benchmark_files; f++) {
+      if (strcmp(benchmark_files[f].name, name) != 0 ||
+          benchmark_files[f].width != width ||
+          benchmark_files[f].height != height)
+        continue;
+      for (int k = 0; k < num_benchmark_kernels; k++) {
+        if (strcmp(benchmark_kernels[k].name, kernel) == 0) {
+          hashes[f * num_benchmark_kernels + k] = hash;
+          found[f * num_benchmark_kernels + k] = 1;
+        }
+      }
+    }
+  }
+  fclose(fp);
+}
+
+// Quality every engine must reach against the serial output: the direct
+// engines are exact, the FFT and planned engines round differently
+static const EngineTolerance ENGINE_TOLERANCES[CONVOLUTION_MODES] = {
+    {0, INFINITY},
+    {0, INFINITY},
+    {0, INFINITY},
+    {0, INFINITY},
+    {0, INFINITY},
+    {FFT_TOLERANCE, APPROXIMATE_MIN_PSNR},
+    {FFT_TOLERANCE, APPROXIMATE_MIN_PSNR},
+    {PLANNED_TOLERANCE, APPROXIMATE_MIN_PSNR}};
+
+// Full diff of the output of a mode against the serial output on disk. With
+// a report, the statistics cover the whole image (and the map is saved when
+// map_path is set); otherwise the comparison stops at the first pixel beyond
+// the tolerance
 app_error verify_implementation(const char *kernel_dir, const char *impl_folder,
-                                const char *img_name, Image *img_serial,
-                                int *mismatches) {
+                                const char *img_name, int tolerance,
+                                ImageDiff *report, const char *map_path) {
+  char serial_path[PATH_MAX];
   char path[PATH_MAX];
+  snprintf(serial_path, PATH_MAX, "%s/%s/%s/%s", IMAGES_FOLDER, kernel_dir,
+           SERIAL_FOLDER, img_name);
   snprintf(path, PATH_MAX, "%s/%s/%s/%s", IMAGES_FOLDER, kernel_dir,
            impl_folder, img_name);
 
-  Image *img_parallel = NULL;
+  Image *img_serial = NULL;
+  app_error err = read_BMP(&img_serial, serial_path);
+  if (err) {
+    fprintf(stderr, "\tError reading serial output: %s | ERROR CODE: %s\n",
+            serial_path, get_error_string(err));
+    return err;
+  }
 
-  app_error err = read_BMP(&img_parallel, path);
+  Image *img_parallel = NULL;
+  err = read_BMP(&img_parallel, path);
   if (err) {
     fprintf(stderr, "\tError reading %s output: %s\n", impl_folder, path);
-    (*mismatches)++;
+    free_BMP(img_serial);
     return err;
   }
 
-  err = check_images_match(img_serial, img_parallel);
-
-  if (err) {
-    fprintf(stderr, RED "\tMismatch found in kernel %s (%s)\n" RESET,
-            kernel_dir, impl_folder);
-    (*mismatches)++;
+  if (report) {
+    err = compute_image_diff(img_serial, img_parallel, report);
+    if (!err && map_path && report->differing_pixels > 0)
+      err = save_diff_map(img_serial, img_parallel, map_path);
   } else {
-    printf(GREEN "\t%s (%s): Match\n" RESET, kernel_dir, impl_folder);
+    err = tolerance ? check_images_within(img_serial, img_parallel, tolerance)
+                    : check_images_match(img_serial, img_parallel);
   }
 
+  free_BMP(img_serial);
   free_BMP(img_parallel);
   return err;
 }
 
-app_error verify_implmentations(BenchmarkConfig config, const char *kernel_dir,
-                                const char *img_name, int *mismatches) {
-  char serial_path[PATH_MAX];
-
-  snprintf(serial_path, PATH_MAX, "%s/%s/%s/%s", IMAGES_FOLDER, kernel_dir,
-           SERIAL_FOLDER, img_name);
-
-  Image *img_serial = NULL;
+// Path of the diff map of a mode: images/<kernel>/diff/<mode>_<image>
+static app_error get_diff_map_path(const char *kernel_dir,
+                                   const char *impl_folder,
+                                   const char *img_name, char *path) {
+  snprintf(path, PATH_MAX, "%s/%s/%s", IMAGES_FOLDER, kernel_dir, DIFF_FOLDER);
+  app_error err = create_directory(path);
+  if (err)
+    return err;
+  if (snprintf(path, PATH_MAX, "%s/%s/%s/%s_%s", IMAGES_FOLDER, kernel_dir,
+               DIFF_FOLDER, impl_folder, img_name) >= PATH_MAX)
+    return ERR_PATH_TOO_LONG;
+  return SUCCESS;
+}
 
-  app_error err = read_BMP(&img_serial, serial_path);
+// Quantitative check of one mode: the error statistics are computed (or
+// known to be zero when the hash matches the reference), printed, checked
+// against the tolerance of the engine and logged to the verification CSV
+static app_error report_implementation(BenchmarkConfig config, int m, int f,
+                                       int k, int hash_match,
+                                       int *mismatches) {
+  const char *kernel_dir = benchmark_kernels[k].name;
+  const char *img_name = benchmark_files[f].name;
+  const char *impl_folder = IMPLEMENTATION_FOLDERS[m];
+  const EngineTolerance *limit = &ENGINE_TOLERANCES[m];
+  long long pixels =
+      (long long)benchmark_files[f].width * benchmark_files[f].height;
 
-  if (err) {
-    fprintf(stderr, "\tError reading serial output: %s | ERROR CODE: %s\n",
-            serial_path, get_error_string(err));
-    // If we can't read serial output, we can't verify anything
+  ImageDiff diff;
+  app_error err = SUCCESS;
+  char map_path[PATH_MAX];
+  if (hash_match) {
+    identical_image_diff(pixels, &diff);
+  } else {
+    if (config.diff_map)
+      err = get_diff_map_path(kernel_dir, impl_folder, img_name, map_path);
+    if (!err)
+      err = verify_implementation(kernel_dir, impl_folder, img_name,
+                                  limit->max_error, &diff,
+                                  config.diff_map ? map_path : NULL);
+  }
+  if (err)
     return err;
+
+  int passed =
+      get_max_error(&diff) <= limit->max_error && diff.psnr >= limit->min_psnr;
+  if (passed) {
+    printf(GREEN "\t%s (%s): Match\n" RESET, kernel_dir, impl_folder);
+  } else {
+    fprintf(stderr, RED "\tMismatch found in kernel %s (%s)\n" RESET,
+            kernel_dir, impl_folder);
+    (*mismatches)++;
   }
+  print_image_diff(&diff, stdout);
+  if (config.diff_map && diff.differing_pixels > 0)
+    printf("\t\tDiff map saved to: %s\n", map_path);
 
-  if (config.run_multithreaded)
-    (void)verify_implementation(kernel_dir, MULTITHREADED_FOLDER, img_name,
-                                img_serial, mismatches);
+  return append_verification_result(VERIFICATION_CSV_FILE, pixels, kernel_dir,
+                                    img_name, impl_folder, &diff,
+                                    limit->max_error, limit->min_psnr, passed);
+}
 
-  if (config.run_distributed)
-    (void)verify_implementation(kernel_dir, DISTRIBUTED_FOLDER, img_name,
-                                img_serial, mismatches);
+// Verifies the outputs of every mode that ran for one file and kernel: a
+// mode whose hash equals the serial reference matches, any other is diffed
+// in full against the serial BMP (the FFT engines rarely match bit for bit)
+app_error verify_implmentations(BenchmarkConfig config, int f, int k,
+                                const unsigned long long *reference,
+                                const int *has_reference, int *mismatches) {
+  unsigned int selected[CONVOLUTION_MODES] = {
+      0,
+      config.run_multithreaded,
+      config.run_distributed,
+      config.run_shared,
+      config.run_task_pool,
+      config.run_fft,
+      config.run_fft_distributed,
+      config.run_planned};
+  const char *kernel_dir = benchmark_kernels[k].name;
+  const char *img_name = benchmark_files[f].name;
+  int index = f * num_benchmark_kernels + k;
 
-  if (config.run_shared)
-    (void)verify_implementation(kernel_dir, SHARED_FOLDER, img_name, img_serial,
-                                mismatches);
+  for (int m = 0; m < CONVOLUTION_MODES; m++) {
+    if (!selected[m])
+      continue;
 
-  if (config.run_task_pool)
-    (void)verify_implementation(kernel_dir, TASK_POOL_FOLDER, img_name,
-                                img_serial, mismatches);
+    const char *impl_folder = IMPLEMENTATION_FOLDERS[m];
+    int hash_match = has_reference[index] &&
+                     get_benchmark_result(m, f, k)->hash == reference[index];
 
-  free_BMP(img_serial);
-  return err;
+    app_error err;
+    if (config.diff_report) {
+      err = report_implementation(config, m, f, k, hash_match, mismatches);
+    } else if (hash_match) {
+      printf(GREEN "\t%s (%s): Match\n" RESET, kernel_dir, impl_folder);
+      continue;
+    } else {
+      err = verify_implementation(kernel_dir, impl_folder, img_name,
+                                  ENGINE_TOLERANCES[m].max_error, NULL, NULL);
+      if (err == SUCCESS) {
+        printf(GREEN "\t%s (%s): Match (full diff)\n" RESET, kernel_dir,
+               impl_folder);
+      } else if (err == ERR_IMAGE_DIFFERENCE) {
+        fprintf(stderr, RED "\tMismatch found in kernel %s (%s)\n" RESET,
+                kernel_dir, impl_folder);
+        (*mismatches)++;
+        err = SUCCESS;
+      }
+    }
+
+    if (err == SUCCESS)
+      continue;
+    // Without the serial output nothing can be verified
+    if (!has_reference[index])
+      return err;
+    (*mismatches)++;
+  }
+  return SUCCESS;
 }
 
 app_error run_verification(BenchmarkConfig config) {
   printf("\n--- Starting Verification ---\n");
 
+  int count = num_benchmark_files * num_benchmark_kernels;
+  unsigned long long *reference =
+      (unsigned long long *)malloc(count * sizeof(unsigned long long));
+  int *has_reference = (int *)malloc(count * sizeof(int));
+  if (!reference || !has_reference) {
+    free(reference);
+    free(has_reference);
+    return ERR_MEM_ALLOC;
+  }
+  load_reference_hashes(reference, has_reference);
+
+  if (config.diff_report) {
+    app_error err =
+        init_benchmark_csv(VERIFICATION_CSV_FILE, VERIFICATION_CSV_HEADER);
+    if (err) {
+      free(reference);
+      free(has_reference);
+      return err;
+    }
+  }
+
   int mismatches = 0;
   app_error err = SUCCESS;
-  for (int f = 0; f < BENCHMARK_FILES; f++) {
-    const char *img_name = files[f];
-    printf("\nVerifying file: %s\n", img_name);
+  for (int f = 0; !err && f < num_benchmark_files; f++) {
+    printf("\nVerifying file: %s\n", benchmark_files[f].name);
 
-    for (int k = 0; k < KERNEL_TYPES; k++) {
-      err = verify_implmentations(config, CONV_KERNELS[k].name, img_name,
+    for (int k = 0; !err && k < num_benchmark_kernels; k++)
+      err = verify_implmentations(config, f, k, reference, has_reference,
                                   &mismatches);
-      if (err) {
-        return err;
-      }
-    }
   }
+  free(reference);
+  free(has_reference);
+  if (err)
+    return err;
 
   if (mismatches > 0) {
     fprintf(stderr, "\nVerification completed with %d mismatches\n",
@@ -2,15 +2,56 @@
 #define __BENCHMARK_RUN_H__
 
 #include "../errors/errors.h"
+#include "../memory/numa.h"
+
+// OpenMP threads per rank when -t is not given
+#define DEFAULT_THREAD_COUNT 1
 
 typedef struct {
   int omp_threads;
+  const char *input_source;   // Directory, glob, BMP or manifest (NULL: base)
+  const char *kernel_list;    // Comma-separated kernel names (NULL: all)
+  const char *generate_sizes; // Synthetic inputs, "WxH,..." (NULL: none)
+  unsigned long long seed;    // Seed of the synthetic inputs
+  const char *transform_operations; // -transform/-batch: kernel chain
+  const char *transform_input;      // -transform: input BMP, -batch: source
+  const char *transform_output;     // -transform: output BMP, -batch: dir
+  int queue_depth;                  // -batch: images between two stages
+  int sweep_series;          // -sweep: SWEEP_STRONG and/or SWEEP_WEAK (0: off)
+  const char *sweep_size;    // -sweep: strong image, weak image per PE
+  const char *sweep_threads; // -sweep: thread counts (NULL: powers of two)
+  int sweep_repetitions;     // -sweep, -autotune: timed runs per point
+  const char *tune_sizes;    // -autotune: representative image of a class
+  int tune_cores;            // -autotune: cores per node (0: detected)
+  const char *run_label;         // Label of the run in the history
+  const char *compare_baseline;  // -compare: runs of the baseline
+  const char *compare_candidate; // -compare: runs compared (NULL: last run)
+  int band_rows;                 // -stream: rows per band read by rank 0
+  int tile_rows;                 // -taskgraph, -overlap: rows per tile
+  int chunk_rows;                // -task_pool: rows per chunk
+  int iterations;                // Applications of every kernel in a row
+  int halo_depth;                // Kernels between two halo exchanges
+  bind_policy bind;                 // Placement of the OpenMP threads
   unsigned int run_serial : 1;
   unsigned int run_multithreaded : 1;
   unsigned int run_distributed : 1;
   unsigned int run_shared : 1;
   unsigned int run_task_pool : 1;
+  unsigned int run_fft : 1;
+  unsigned int run_fft_distributed : 1;
+  unsigned int run_planned : 1;
+  unsigned int recalibrate : 1; // Ignore the planner calibration cache
+  unsigned int batch : 1;       // -batch instead of -transform
   unsigned int verify : 1;
+  unsigned int diff_report : 1; // Error statistics of every verified output
+  unsigned int diff_map : 1;    // Heat maps of the outputs that differ
+  unsigned int perf_counters : 1;
+  unsigned int huge_pages : 1; // Back large pooled buffers with huge pages
+  unsigned int float_accumulation : 1; // Float accumulators (direct engines)
+  unsigned int stream : 1; // Distributed mode streams its input in bands
+  unsigned int tune : 1;   // Search the rank x thread split and exit
+  unsigned int taskgraph : 1; // Multithreaded mode and -batch as task graph
+  unsigned int overlap : 1;   // Distributed mode with a communication thread
 } BenchmarkConfig;
 
 /**
@@ -29,17 +70,26 @@ app_error run_benchmark_serial(void);
 
 /**
  * @brief Runs the parallel version of the image processing benchmark.
- * Uses OpenMP for shared memory parallelism.
+ * Uses OpenMP for shared memory parallelism, one kernel and file at a time,
+ * or every kernel and file as one task graph with config.taskgraph.
+ * @param config Benchmark configuration (taskgraph, tile_rows)
  * @return app_error code
  */
-app_error run_benchmark_parallel_multithreaded(void);
+app_error run_benchmark_parallel_multithreaded(BenchmarkConfig config);
 
 /**
  * @brief Runs the parallel version of the image processing benchmark.
- * Uses MPI and OpenMP for distributed memory parallelism.
+ * Uses MPI and OpenMP for distributed memory parallelism. With -stream, rank
+ * 0 streams every input and output in bands instead of reading and writing
+ * them whole. With -overlap, one thread per rank communicates while the
+ * others compute (see convolve_distributed_overlap()). With -iterations,
+ * the ranks exchange deep halos once per -halo_depth iterations (see
+ * convolve_distributed_iterated()).
+ * @param config Benchmark configuration (stream, band_rows, overlap,
+ * iterations)
  * @return app_error code
  */
-app_error run_benchmark_parallel_distributed_fs(void);
+app_error run_benchmark_parallel_distributed_fs(BenchmarkConfig config);
 
 /**
  * @brief Runs the parallel benchmark optimized for Shared Filesystem.
@@ -51,13 +101,44 @@ app_error run_benchmark_parallel_shared_fs(void);
 
 /**
  * @brief Runs the parallel benchmark using a Task Pool approach.
- * Currently uses multithreaded implementation as a placeholder.
+ * Every rank claims chunks of rows from an RMA work pool on rank 0 and
+ * fetches and stores them with one-sided operations (see
+ * convolve_work_pool()).
  * @return app_error code
  */
 app_error run_benchmark_task_pool(void);
 
+/**
+ * @brief Runs the FFT convolution benchmark on rank 0.
+ * Overlap-save tiles processed in parallel with OpenMP.
+ * @return app_error code
+ */
+app_error run_benchmark_fft(void);
+
+/**
+ * @brief Runs the distributed FFT convolution benchmark.
+ * Every rank convolves its strip of rows (plus halos) with FFT tiles.
+ * @return app_error code
+ */
+app_error run_benchmark_fft_distributed(void);
+
+/**
+ * @brief Runs the planned convolution benchmark on rank 0.
+ * The planner picks the fastest algorithm for every kernel and image from a
+ * calibration of this host (loaded from the cache or measured first).
+ * @param config Benchmark configuration (thread count, recalibration)
+ * @return app_error code
+ */
+app_error run_benchmark_planned(BenchmarkConfig config);
+
 /**
  * @brief Verifies that the serial and parallel outputs match.
+ * The direct engines must match exactly, the FFT engines within
+ * FFT_TOLERANCE and the planned mode within PLANNED_TOLERANCE per channel.
+ * With config.diff_report, the error statistics (max error per channel,
+ * differing pixels, histogram, PSNR) of every output are printed, checked
+ * against the PSNR floor of the approximate engines as well and logged to
+ * VERIFICATION_CSV_FILE; config.diff_map also saves heat maps.
  * @param config Benchmark configuration to determine which verifications to run
  * @return app_error code
  */
@@ -1,9 +1,19 @@
 #include "kernel_run.h"
+#include "../bmp/image_diff.h"
+#include "../bmp/image_hash.h"
 #include "../config/files.h"
+#include "../convolution/convolution.h"
 #include "../file_utils/file_utils.h"
+#include "../perf/perf_counters.h"
+#include "../planner/planner.h"
+#include "../stream/stream.h"
+#include "../taskgraph/taskgraph.h"
+#include "../temporal/temporal.h"
+#include "../timing/phase_timer.h"
 #include <limits.h>
 #include <mpi.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 app_error create_implementation_directories(const char *kernel_dir) {
 
@@ -44,67 +54,160 @@ app_error create_directories(void) {
   if (err)
     return err;
 
-  for (int k = 0; k < NUM_KERNELS; k++) {
-    err = create_implementation_directories(CONV_KERNELS[k].name);
+  for (int k = 0; k < num_benchmark_kernels; k++) {
+    err = create_implementation_directories(benchmark_kernels[k].name);
     if (err)
       return err;
   }
   return SUCCESS;
 }
 
+// Reduces the phase breakdown and counters of a run across the ranks that
+// took part
+static void reduce_kernel_run(MPI_Comm comm, BenchmarkResult *result) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(comm, &result->ranks);
+  phase_timer_reduce(comm, &result->phases);
+  perf_counters_reduce(comm, &result->counters);
+  if (rank == 0) {
+    BlockingStats blocking;
+    get_blocking_stats(&blocking);
+    print_blocking_stats(&blocking, stdout);
+    print_phase_stats(&result->phases, stdout);
+    printf("\n");
+  }
+}
+
+// Hashes and saves the output of a run on rank 0, then reduces its phase
+// breakdown and counters
+static app_error finish_kernel_run(Image *img, const char *img_name,
+                                   Kernel kernel,
+                                   const char *benchmark_type_folder,
+                                   MPI_Comm comm, BenchmarkResult *result) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  // Only rank 0 hashes and saves the image and logs
+  if (rank == 0) {
+    result->hash = hash_image(img);
+    printf("\tTime: %.6f s\n", result->time);
+    if (result->algorithm != ALGO_UNPLANNED)
+      printf("\tAlgorithm: %s\n", get_algorithm_name(result->algorithm));
+    char output_path[PATH_MAX];
+    snprintf(output_path, PATH_MAX, "%s/%s/%s/%s", IMAGES_FOLDER, kernel.name,
+             benchmark_type_folder, img_name);
+
+    phase_timer_begin(PHASE_WRITE);
+    app_error err = save_BMP(img, output_path);
+    phase_timer_end(PHASE_WRITE);
+    if (err) {
+      fprintf(stderr, "\t\tError: Could not save to %s: %s\n", output_path,
+              get_error_string(err));
+      return err;
+    }
+
+    printf("\t\tSaved to: %s\n", output_path);
+  }
+
+  reduce_kernel_run(comm, result);
+  return SUCCESS;
+}
+
 // Level 1: Run a single kernel on a single file
 app_error run_single_kernel(Image *img, const char *img_name, Kernel kernel,
                             const char *benchmark_type_folder,
-                            convolve_function cv_fn, double *elapsed_time) {
+                            convolve_function cv_fn, int passes,
+                            MPI_Comm comm, BenchmarkResult *result) {
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
   if (rank == 0)
     printf("\tApplying kernel: %s\n", kernel.name);
 
-  app_error err = cv_fn(img, kernel, elapsed_time);
+  app_error err = passes < 1 ? ERR_INVALID_ARGS : SUCCESS;
+
+  planner_clear_choice();
+  perf_counters_start();
+  result->time = 0.0;
+  for (int i = 0; i < passes && !err; i++) {
+    double time = 0.0;
+    err = cv_fn(img, kernel, &time);
+    result->time += time;
+  }
+  perf_counters_stop();
+  result->algorithm = planner_get_choice();
   if (err) {
     if (rank == 0)
       fprintf(stderr, "\tError executing kernel %s: %d\n", kernel.name, err);
     return err;
   }
 
-  // Only rank 0 saves the image and logs
-  if (rank == 0) {
-    printf("\tTime: %.6f s\n", *elapsed_time);
-    char output_path[PATH_MAX];
-    snprintf(output_path, PATH_MAX, "%s/%s/%s/%s", IMAGES_FOLDER, kernel.name,
-             benchmark_type_folder, img_name);
+  return finish_kernel_run(img, img_name, kernel, benchmark_type_folder, comm,
+                           result);
+}
 
-    err = save_BMP(img, output_path);
-    if (err) {
-      fprintf(stderr, "\t\tError: Could not save to %s: %s\n", output_path,
-              get_error_string(err));
-      return err;
-    }
+int is_direct_mode(int mode) {
+  return mode == MODE_SERIAL || mode == MODE_MULTITHREADED ||
+         mode == MODE_DISTRIBUTED || mode == MODE_SHARED ||
+         mode == MODE_TASK_POOL;
+}
+
+// Compares the output of a float run with the double result of the
+// multithreaded engine, computed on rank 0 after the run was timed
+static app_error measure_float_divergence(const Image *base_img, Kernel kernel,
+                                          const Image *output,
+                                          BenchmarkResult *result) {
+  Image *reference = NULL;
+  app_error err = copy_image(base_img, &reference);
+  if (err)
+    return err;
 
-    printf("\t\tSaved to: %s\n\n", output_path);
+  set_accumulation_precision(PRECISION_DOUBLE);
+  for (int i = 0; i < get_kernel_iterations() && !err; i++)
+    err = convolve_parallel_multithreaded(reference, kernel, NULL);
+  set_accumulation_precision(PRECISION_FLOAT);
+
+  ImageDiff diff;
+  if (!err)
+    err = compute_image_diff(reference, output, &diff);
+  if (!err) {
+    result->divergent_pixels = diff.differing_pixels;
+    result->divergence_max_error = get_max_error(&diff);
+    printf("\tFloat divergence: %lld pixels (%.4f%%) differ from double, max "
+           "error %d\n\n",
+           diff.differing_pixels,
+           diff.pixels > 0 ? 100.0 * diff.differing_pixels / diff.pixels : 0.0,
+           result->divergence_max_error);
   }
-  return SUCCESS;
+  free_BMP(reference);
+  return err;
 }
 
 // Level 2: Run all kernels on a single file
-app_error run_all_kernels(Image *base_img, const char *img_name,
+app_error run_all_kernels(int mode, Image *base_img, const char *img_name,
                           const char *benchmark_type_folder,
-                          convolve_function cv_fn,
-                          double elapsed_time[KERNEL_TYPES]) {
+                          convolve_function cv_fn, int passes, MPI_Comm comm,
+                          double read_time, BenchmarkResult *results) {
   app_error err = SUCCESS;
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-  for (int k = 0; k < KERNEL_TYPES; k++) {
+  for (int k = 0; k < num_benchmark_kernels; k++) {
     Image *working_img = NULL;
 
+    // The base image read is shared by every kernel of this file
+    phase_timer_reset();
+    phase_timer_add(PHASE_READ, read_time);
+    blocking_stats_reset();
+
     // Rank 0 creates a copy, others just pass NULL (or whatever they possess)
     // Actually, cv_fn needs to handle NULL input for non-root ranks if the
     // logic is fully distributed. But for simplicity, we let rank 0 copy.
     if (rank == 0) {
+      phase_timer_begin(PHASE_READ);
       err = copy_image(base_img, &working_img);
+      phase_timer_end(PHASE_READ);
       if (err) {
         fprintf(stderr, "\tError: Could not copy image: %s\n",
                 get_error_string(err));
@@ -119,8 +222,15 @@ app_error run_all_kernels(Image *base_img, const char *img_name,
       working_img = NULL;
     }
 
-    err = run_single_kernel(working_img, img_name, CONV_KERNELS[k],
-                            benchmark_type_folder, cv_fn, &elapsed_time[k]);
+    err = run_single_kernel(working_img, img_name, benchmark_kernels[k],
+                            benchmark_type_folder, cv_fn, passes, comm,
+                            &results[k]);
+
+    results[k].divergent_pixels = -1;
+    if (!err && rank == 0 && is_direct_mode(mode) &&
+        get_accumulation_precision() == PRECISION_FLOAT)
+      err = measure_float_divergence(base_img, benchmark_kernels[k],
+                                     working_img, &results[k]);
 
     // Always free the working copy
     if (rank == 0)
@@ -132,10 +242,11 @@ app_error run_all_kernels(Image *base_img, const char *img_name,
   return SUCCESS;
 }
 
-// Level 3: Run on all existing files
-app_error run_all_files(const char *benchmark_type_folder,
-                        convolve_function cv_fn,
-                        double elapsed_time[BENCHMARK_FILES][KERNEL_TYPES]) {
+// Level 3: Run on all selected files
+// Runs all kernels on all files, calling cv_fn passes times per kernel
+static app_error run_files(int mode, const char *benchmark_type_folder,
+                           convolve_function cv_fn, int passes,
+                           MPI_Comm comm) {
   app_error err = create_directories();
   if (err)
     return err;
@@ -143,34 +254,35 @@ app_error run_all_files(const char *benchmark_type_folder,
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-  for (int f = 0; f < BENCHMARK_FILES; f++) {
-    const char *img_name = files[f];
+  for (int f = 0; f < num_benchmark_files; f++) {
+    InputFile *input = &benchmark_files[f];
 
-    if (rank == 0) {
-      char input_path[PATH_MAX];
-      snprintf(input_path, PATH_MAX, "%s/%s/%s", IMAGES_FOLDER, BASE_FOLDER,
-               img_name);
-      printf("\nProcessing file: %s\n", input_path);
-    }
+    if (rank == 0)
+      printf("\nProcessing file: %s\n", input->path);
 
     // Load base image once per file
     Image *base_img = NULL;
+    double read_time = 0.0;
 
     if (rank == 0) {
-      char input_path[PATH_MAX];
-      snprintf(input_path, PATH_MAX, "%s/%s/%s", IMAGES_FOLDER, BASE_FOLDER,
-               img_name);
-      err = read_BMP(&base_img, input_path);
+      double read_start = MPI_Wtime();
+      err = read_BMP(&base_img, input->path);
       if (err) {
         fprintf(stderr, "\tError: Could not read base file %s: %s\n",
-                input_path, get_error_string(err));
+                input->path, get_error_string(err));
         return err;
       }
+      read_time = MPI_Wtime() - read_start;
+
+      // Remember the dimensions for the CSV output
+      input->width = base_img->width;
+      input->height = base_img->height;
     }
 
     // Run all kernels on this file
-    err = run_all_kernels(base_img, img_name, benchmark_type_folder, cv_fn,
-                          elapsed_time[f]);
+    err = run_all_kernels(mode, base_img, input->name, benchmark_type_folder,
+                          cv_fn, passes, comm, read_time,
+                          get_benchmark_result(mode, f, 0));
 
     // Free base image
     if (rank == 0)
@@ -181,3 +293,192 @@ app_error run_all_files(const char *benchmark_type_folder,
   }
   return SUCCESS;
 }
+
+app_error run_all_files(int mode, const char *benchmark_type_folder,
+                        convolve_function cv_fn, MPI_Comm comm) {
+  return run_files(mode, benchmark_type_folder, cv_fn, get_kernel_iterations(),
+                   comm);
+}
+
+app_error run_all_files_iterated(int mode, const char *benchmark_type_folder,
+                                 convolve_function cv_fn, MPI_Comm comm) {
+  return run_files(mode, benchmark_type_folder, cv_fn, 1, comm);
+}
+
+app_error run_all_files_streamed(int mode, const char *benchmark_type_folder,
+                                 int band_rows) {
+  app_error err = create_directories();
+  if (err)
+    return err;
+
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  for (int f = 0; f < num_benchmark_files; f++) {
+    InputFile *input = &benchmark_files[f];
+
+    if (rank == 0)
+      printf("\nProcessing file: %s\n", input->path);
+
+    // Every kernel streams the file again, its read and write are part of
+    // its time
+    for (int k = 0; k < num_benchmark_kernels; k++) {
+      BenchmarkResult *result = get_benchmark_result(mode, f, k);
+      char output_path[PATH_MAX];
+      snprintf(output_path, PATH_MAX, "%s/%s/%s/%s", IMAGES_FOLDER,
+               benchmark_kernels[k].name, benchmark_type_folder, input->name);
+      StreamRequest request = {input->path, output_path, benchmark_kernels[k],
+                               band_rows};
+
+      if (rank == 0)
+        printf("\tApplying kernel: %s (streamed)\n", request.kernel.name);
+
+      phase_timer_reset();
+      perf_counters_start();
+      err = run_stream_convolution(&request, &input->width, &input->height,
+                                   &result->time);
+      perf_counters_stop();
+      result->algorithm = ALGO_UNPLANNED;
+      result->divergent_pixels = -1;
+      // The output is never whole in memory; verification diffs the file
+      result->hash = 0;
+      if (err) {
+        if (rank == 0)
+          fprintf(stderr, "\tError executing kernel %s: %s\n",
+                  request.kernel.name, get_error_string(err));
+        return err;
+      }
+
+      if (rank == 0) {
+        printf("\tTime: %.6f s\n", result->time);
+        printf("\t\tSaved to: %s\n", output_path);
+      }
+      reduce_kernel_run(MPI_COMM_WORLD, result);
+    }
+  }
+  return SUCCESS;
+}
+
+// Rank 0 reads every selected file, for the task graph
+static app_error read_all_files(Image **images, double *read_times) {
+  for (int f = 0; f < num_benchmark_files; f++) {
+    InputFile *input = &benchmark_files[f];
+    printf("\nReading file: %s\n", input->path);
+    double read_start = MPI_Wtime();
+    app_error err = read_BMP(&images[f], input->path);
+    if (err) {
+      fprintf(stderr, "\tError: Could not read base file %s: %s\n",
+              input->path, get_error_string(err));
+      return err;
+    }
+    read_times[f] = MPI_Wtime() - read_start;
+    input->width = images[f]->width;
+    input->height = images[f]->height;
+  }
+  return SUCCESS;
+}
+
+// Saves and records the output of every job of the task graph
+static app_error finish_task_graph(int mode, const char *benchmark_type_folder,
+                                   Image **images, const double *read_times,
+                                   TaskGraphJob *jobs,
+                                   const TaskGraphStats *stats) {
+  for (int f = 0; f < num_benchmark_files; f++) {
+    printf("\nProcessing file: %s\n", benchmark_files[f].path);
+    for (int k = 0; k < num_benchmark_kernels; k++) {
+      TaskGraphJob *job = &jobs[f * num_benchmark_kernels + k];
+      BenchmarkResult *result = get_benchmark_result(mode, f, k);
+      printf("\tApplying kernel: %s (task graph, done after %.6f s)\n",
+             benchmark_kernels[k].name, job->finish_time);
+
+      // The wall time of the graph is shared by the jobs in proportion to
+      // the compute time of their tiles
+      result->time = stats->busy_time > 0.0 ? stats->wall_time *
+                                                  job->busy_time /
+                                                  stats->busy_time
+                                            : 0.0;
+      result->algorithm = ALGO_UNPLANNED;
+      result->divergent_pixels = -1;
+      phase_timer_reset();
+      phase_timer_add(PHASE_READ, read_times[f]);
+      phase_timer_add(PHASE_COMPUTE, result->time);
+      // The counters of the team cannot be split by job: report none
+      perf_counters_start();
+      perf_counters_stop();
+
+      app_error err =
+          finish_kernel_run(job->output, benchmark_files[f].name,
+                            benchmark_kernels[k], benchmark_type_folder,
+                            MPI_COMM_SELF, result);
+      if (!err && is_direct_mode(mode) &&
+          get_accumulation_precision() == PRECISION_FLOAT)
+        err = measure_float_divergence(images[f], benchmark_kernels[k],
+                                       job->output, result);
+      if (err)
+        return err;
+    }
+  }
+  return SUCCESS;
+}
+
+app_error run_all_files_taskgraph(int mode, const char *benchmark_type_folder,
+                                  int tile_rows) {
+  app_error err = create_directories();
+  if (err)
+    return err;
+
+  int num_jobs = num_benchmark_files * num_benchmark_kernels;
+  int iterations = get_kernel_iterations();
+  if (iterations < 1)
+    return ERR_INVALID_ARGS;
+  Image **images = (Image **)calloc(num_benchmark_files, sizeof(Image *));
+  double *read_times = (double *)calloc(num_benchmark_files, sizeof(double));
+  TaskGraphJob *jobs =
+      (TaskGraphJob *)calloc(num_jobs > 0 ? num_jobs : 1, sizeof(TaskGraphJob));
+  // Every kernel applied iterations times is a chain of as many stages
+  Kernel *chains = (Kernel *)malloc(
+      (num_benchmark_kernels > 0 ? num_benchmark_kernels : 1) * iterations *
+      sizeof(Kernel));
+  if (!images || !read_times || !jobs || !chains)
+    err = ERR_MEM_ALLOC;
+  if (!err)
+    err = read_all_files(images, read_times);
+
+  TaskGraphStats stats;
+  if (!err) {
+    for (int k = 0; k < num_benchmark_kernels; k++)
+      for (int i = 0; i < iterations; i++)
+        chains[k * iterations + i] = benchmark_kernels[k];
+    for (int f = 0; f < num_benchmark_files; f++) {
+      for (int k = 0; k < num_benchmark_kernels; k++) {
+        TaskGraphJob *job = &jobs[f * num_benchmark_kernels + k];
+        job->source = images[f];
+        job->kernels = &chains[k * iterations];
+        job->count = iterations;
+      }
+    }
+    printf("\nRunning %d kernel(s) on %d file(s) as one task graph\n",
+           num_benchmark_kernels, num_benchmark_files);
+    err = run_task_graph(jobs, num_jobs, tile_rows, &stats);
+    if (err)
+      fprintf(stderr, "\tError executing the task graph: %s\n",
+              get_error_string(err));
+  }
+  if (!err) {
+    print_task_graph_stats(&stats, stdout);
+    err = finish_task_graph(mode, benchmark_type_folder, images, read_times,
+                            jobs, &stats);
+  }
+
+  for (int j = 0; jobs && j < num_jobs; j++)
+    if (jobs[j].output)
+      free_BMP(jobs[j].output);
+  for (int f = 0; images && f < num_benchmark_files; f++)
+    if (images[f])
+      free_BMP(images[f]);
+  free(jobs);
+  free(chains);
+  free(images);
+  free(read_times);
+  return err;
+}
@@ -5,13 +5,24 @@
 #include "../config/files.h"
 #include "../config/kernel.h"
 #include "../errors/errors.h"
+#include <mpi.h>
 
 // Callback type for convolution functions
 typedef app_error (*convolve_function)(Image *img, Kernel ker,
                                        double *elapsed_time);
 
 /**
- * @brief Runs a single kernel on an image and saves the output.
+ * @brief Whether a mode runs one of the direct engines, which follow the
+ * accumulator precision (serial, multithreaded, distributed, shared and task
+ * pool).
+ * @param mode The mode index (MODE_*).
+ * @return Non-zero for the direct modes.
+ */
+int is_direct_mode(int mode);
+
+/**
+ * @brief Runs a single kernel on an image and saves the output. cv_fn is
+ * called passes times; the time covers all of them.
  *
  * @param img The image to process.
  * @param img_name The name of the original image file.
@@ -19,35 +30,98 @@ typedef app_error (*convolve_function)(Image *img, Kernel ker,
  * @param benchmark_type_folder The subfolder name (Serial or Parallel) to save
  * validation output.
  * @param cv_fn The convolution function to use.
+ * @param passes Calls of cv_fn (1 if it applies every iteration itself).
+ * @param comm Communicator of the ranks taking part in the run (used to
+ * reduce the phase breakdown).
+ * @param result Output: elapsed time and phase breakdown of the run.
  * @return app_error
  */
 app_error run_single_kernel(Image *img, const char *img_name, Kernel kernel,
                             const char *benchmark_type_folder,
-                            convolve_function cv_fn, double *elapsed_time);
+                            convolve_function cv_fn, int passes,
+                            MPI_Comm comm, BenchmarkResult *result);
 
 /**
- * @brief Runs all defined kernels on an image.
+ * @brief Runs all selected kernels on an image. In a float-accumulation run
+ * of a direct mode, rank 0 then compares every output with a double
+ * reference computed outside the timed region.
  *
+ * @param mode The mode index (MODE_*) of the run.
  * @param base_img The source image.
  * @param img_name The name of the image file.
  * @param benchmark_type_folder The subfolder name to save validation output.
  * @param cv_fn The convolution function to use.
+ * @param passes Calls of cv_fn per kernel, see run_single_kernel().
+ * @param comm Communicator of the ranks taking part in the run.
+ * @param read_time Time spent reading the base image from disk.
+ * @param results Output: one result per selected kernel.
  * @return app_error
  */
-app_error run_all_kernels(Image *img, const char *img_name,
+app_error run_all_kernels(int mode, Image *img, const char *img_name,
                           const char *benchmark_type_folder,
-                          convolve_function cv_fn,
-                          double elapsed_time[KERNEL_TYPES]);
+                          convolve_function cv_fn, int passes, MPI_Comm comm,
+                          double read_time, BenchmarkResult *results);
 
 /**
- * @brief Runs all defined kernels on all images in the base folder.
+ * @brief Runs all selected kernels on all selected input images, calling
+ * cv_fn get_kernel_iterations() times per kernel.
+ * Results are stored with get_benchmark_result(mode, file, kernel).
  *
+ * @param mode The mode index (MODE_*) the results are stored under.
  * @param benchmark_type_folder The subfolder name to save validation output.
  * @param cv_fn The convolution function to use.
+ * @param comm Communicator of the ranks taking part in the run
+ * (MPI_COMM_SELF for the root-only modes).
+ * @return app_error
+ */
+app_error run_all_files(int mode, const char *benchmark_type_folder,
+                        convolve_function cv_fn, MPI_Comm comm);
+
+/**
+ * @brief Like run_all_files(), for an engine that applies every iteration
+ * of a kernel itself (e.g. convolve_distributed_iterated()): cv_fn is
+ * called once per kernel instead of get_kernel_iterations() times.
+ *
+ * @param mode The mode index (MODE_*) the results are stored under.
+ * @param benchmark_type_folder The subfolder name to save validation output.
+ * @param cv_fn The convolution function to use.
+ * @param comm Communicator of the ranks taking part in the run.
+ * @return app_error
+ */
+app_error run_all_files_iterated(int mode, const char *benchmark_type_folder,
+                                 convolve_function cv_fn, MPI_Comm comm);
+
+/**
+ * @brief Runs all selected kernels on all selected input images with the
+ * streamed distributed engine (see run_stream_convolution()): every kernel
+ * streams its input from the file and its output to the file, so no rank
+ * holds a whole image. The outputs are not hashed (verification diffs the
+ * files) and the float divergence is not measured, as there is no image to
+ * compare. Collective over MPI_COMM_WORLD.
+ *
+ * @param mode The mode index (MODE_*) the results are stored under.
+ * @param benchmark_type_folder The subfolder name to save validation output.
+ * @param band_rows Rows per band read and sent by rank 0.
+ * @return app_error
+ */
+app_error run_all_files_streamed(int mode, const char *benchmark_type_folder,
+                                 int band_rows);
+
+/**
+ * @brief Runs all selected kernels on all selected input images with the
+ * task graph of the multithreaded engine (see run_task_graph()): rank 0
+ * reads every file first, then the tiles of every kernel and file run as
+ * one graph on one OpenMP team, without a barrier between kernels or files.
+ * Every run is credited with a share of the wall time of the graph in
+ * proportion to the compute time of its tiles; hardware counters are not
+ * split by run and stay empty. Call on rank 0 only.
+ *
+ * @param mode The mode index (MODE_*) the results are stored under.
+ * @param benchmark_type_folder The subfolder name to save validation output.
+ * @param tile_rows Rows of a tile of the graph.
  * @return app_error
  */
-app_error run_all_files(const char *benchmark_type_folder,
-                        convolve_function cv_fn,
-                        double elapsed_time[BENCHMARK_FILES][KERNEL_TYPES]);
+app_error run_all_files_taskgraph(int mode, const char *benchmark_type_folder,
+                                  int tile_rows);
 
 #endif
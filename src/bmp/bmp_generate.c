@@ -0,0 +1,236 @@
+#include "bmp_generate.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BMP_HEADER_SIZE 54
+
+// Side of the blocks that are inverted to create hard edges. Fixed in pixels,
+// so the edge density does not change with the image size.
+#define EDGE_BLOCK 64
+
+// Amplitude of the per-pixel noise (+/- half of it)
+#define NOISE_RANGE 32
+
+// Upper bound on the bytes generated and written per slab by each rank
+#define SLAB_BYTES (64L << 20)
+
+// Distinct hash streams for the block pattern and the noise
+#define BLOCK_STREAM 0x9E3779B97F4A7C15ULL
+#define NOISE_STREAM 0xD1B54A32D192ED03ULL
+
+// SplitMix64 finalizer
+static unsigned long long mix64(unsigned long long z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+// Counter-based generator: the value only depends on its inputs, never on
+// the order in which pixels are produced
+static unsigned long long hash_coords(unsigned long long seed,
+                                      unsigned long long x,
+                                      unsigned long long y) {
+  return mix64(seed ^ mix64((x << 32) ^ y));
+}
+
+static unsigned char clamp_channel(int value) {
+  if (value < 0)
+    return 0;
+  if (value > 255)
+    return 255;
+  return (unsigned char)value;
+}
+
+static Pixel synthetic_pixel(int x, int y, int width, int height,
+                             unsigned long long seed) {
+  // Smooth gradients across the whole image
+  long long span_x = width > 1 ? width - 1 : 1;
+  long long span_y = height > 1 ? height - 1 : 1;
+  int r = (int)(x * 255LL / span_x);
+  int g = (int)(y * 255LL / span_y);
+  int b = (int)(((long long)x + y) * 255LL / (span_x + span_y));
+
+  // About half of the blocks are inverted
+  if (hash_coords(seed ^ BLOCK_STREAM, x / EDGE_BLOCK, y / EDGE_BLOCK) & 1) {
+    r = 255 - r;
+    g = 255 - g;
+    b = 255 - b;
+  }
+
+  unsigned long long noise = hash_coords(seed ^ NOISE_STREAM, x, y);
+  r += (int)(noise % NOISE_RANGE) - NOISE_RANGE / 2;
+  g += (int)((noise >> 16) % NOISE_RANGE) - NOISE_RANGE / 2;
+  b += (int)((noise >> 32) % NOISE_RANGE) - NOISE_RANGE / 2;
+
+  Pixel pixel = {clamp_channel(r), clamp_channel(g), clamp_channel(b)};
+  return pixel;
+}
+
+app_error parse_image_sizes(const char *list, ImageSize **sizes, int *count) {
+  *sizes = NULL;
+  *count = 0;
+  if (!list || list[0] == '\0')
+    return ERR_INVALID_ARGS;
+
+  int capacity = 1;
+  for (const char *c = list; *c; c++)
+    if (*c == ',')
+      capacity++;
+
+  *sizes = (ImageSize *)malloc(capacity * sizeof(ImageSize));
+  if (!*sizes)
+    return ERR_MEM_ALLOC;
+
+  const char *cursor = list;
+  while (*cursor) {
+    char *end;
+    long width = strtol(cursor, &end, 10);
+    if (end == cursor || (*end != 'x' && *end != 'X'))
+      break;
+    cursor = end + 1;
+    long height = strtol(cursor, &end, 10);
+    if (end == cursor || (*end != ',' && *end != '\0'))
+      break;
+    if (width <= 0 || height <= 0 || width > 0x7FFFFFFFL ||
+        height > 0x7FFFFFFFL)
+      break;
+
+    (*sizes)[(*count)++] = (ImageSize){(int)width, (int)height};
+    cursor = *end ? end + 1 : end;
+  }
+
+  if (*cursor != '\0' || *count == 0) {
+    fprintf(stderr, "Error: Invalid image size list %s (expected WxH,...)\n",
+            list);
+    free(*sizes);
+    *sizes = NULL;
+    *count = 0;
+    return ERR_INVALID_ARGS;
+  }
+  return SUCCESS;
+}
+
+app_error generate_image(Image **img, int width, int height,
+                         unsigned long long seed) {
+  Pixel *data = alloc_pixel(width, height);
+  if (!data)
+    return ERR_MEM_ALLOC;
+
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < height; y++)
+    for (int x = 0; x < width; x++)
+      data[(size_t)y * width + x] = synthetic_pixel(x, y, width, height, seed);
+
+  *img = alloc_image(data, width, height);
+  if (!*img) {
+    free_pixel(data);
+    return ERR_MEM_ALLOC;
+  }
+  return SUCCESS;
+}
+
+app_error generate_BMP(const char *filename, int width, int height,
+                       unsigned long long seed, MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  MPI_Offset row_padded = ((MPI_Offset)width * 3 + 3) & ~(MPI_Offset)3;
+  MPI_Offset file_size = BMP_HEADER_SIZE + row_padded * height;
+
+  // A single row must fit in one MPI write
+  if (row_padded > 0x7FFFFFFF)
+    return ERR_INVALID_ARGS;
+
+  // Contiguous band of file rows (bottom-up) written by this rank
+  int first_row = (int)((long long)height * rank / size);
+  int end_row = (int)((long long)height * (rank + 1) / size);
+
+  int slab_rows = (int)(SLAB_BYTES / row_padded);
+  if (slab_rows < 1)
+    slab_rows = 1;
+  if (slab_rows > end_row - first_row)
+    slab_rows = end_row - first_row > 0 ? end_row - first_row : 1;
+
+  // Every rank takes part in every collective write, even with an empty slab
+  int slabs = (end_row - first_row + slab_rows - 1) / slab_rows;
+  int max_slabs;
+  MPI_Allreduce(&slabs, &max_slabs, 1, MPI_INT, MPI_MAX, comm);
+
+  unsigned char *buffer =
+      (unsigned char *)calloc((size_t)slab_rows, (size_t)row_padded);
+  int local_err = buffer ? SUCCESS : ERR_MEM_ALLOC;
+  int global_err;
+  MPI_Allreduce(&local_err, &global_err, 1, MPI_INT, MPI_MAX, comm);
+  if (global_err) {
+    free(buffer);
+    return (app_error)global_err;
+  }
+
+  MPI_File fh;
+  if (MPI_File_open(comm, filename, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                    MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+    if (rank == 0)
+      fprintf(stderr, "Error: Could not create file %s\n", filename);
+    free(buffer);
+    return ERR_FILE_OPEN;
+  }
+
+  // Drops the tail of a larger file with the same name
+  if (MPI_File_set_size(fh, file_size) != MPI_SUCCESS)
+    local_err = ERR_FILE_WRITE;
+
+  if (rank == 0) {
+    unsigned char header[BMP_HEADER_SIZE] = {
+        'B', 'M', 0, 0, 0, 0, 0, 0, 0, 0, 54, 0, 0, 0, 40, 0, 0, 0,
+        0,   0,   0, 0, 0, 0, 0, 0, 1, 0, 24, 0, 0, 0, 0,  0, 0, 0,
+        0,   0,   0, 0, 0, 0, 0, 0, 0, 0, 0,  0, 0, 0, 0,  0, 0, 0};
+
+    // The size field is 32-bit; readers rely on the offsets for larger files
+    *(unsigned int *)&header[2] =
+        file_size > 0xFFFFFFFFLL ? 0 : (unsigned int)file_size;
+    *(int *)&header[18] = width;
+    *(int *)&header[22] = height;
+
+    MPI_Status status;
+    if (MPI_File_write_at(fh, 0, header, BMP_HEADER_SIZE, MPI_BYTE,
+                          &status) != MPI_SUCCESS)
+      local_err = ERR_FILE_WRITE;
+  }
+
+  for (int s = 0; s < max_slabs; s++) {
+    int slab_start = first_row + s * slab_rows;
+    int rows = end_row - slab_start;
+    if (rows > slab_rows)
+      rows = slab_rows;
+    if (rows < 0)
+      rows = 0;
+
+    // File row fr holds image row height - 1 - fr
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < rows; i++) {
+      int y = height - 1 - (slab_start + i);
+      unsigned char *row_ptr = buffer + (size_t)i * row_padded;
+      for (int x = 0; x < width; x++) {
+        Pixel pixel = synthetic_pixel(x, y, width, height, seed);
+        row_ptr[x * 3] = pixel.b;
+        row_ptr[x * 3 + 1] = pixel.g;
+        row_ptr[x * 3 + 2] = pixel.r;
+      }
+    }
+
+    MPI_Offset offset =
+        BMP_HEADER_SIZE + (MPI_Offset)(rows ? slab_start : 0) * row_padded;
+    MPI_Status status;
+    if (MPI_File_write_at_all(fh, offset, buffer, (int)(rows * row_padded),
+                              MPI_BYTE, &status) != MPI_SUCCESS)
+      local_err = ERR_FILE_WRITE;
+  }
+
+  MPI_File_close(&fh);
+  free(buffer);
+
+  MPI_Allreduce(&local_err, &global_err, 1, MPI_INT, MPI_MAX, comm);
+  return (app_error)global_err;
+}
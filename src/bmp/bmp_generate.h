@@ -0,0 +1,61 @@
+#ifndef __BMP_GENERATE_H__
+#define __BMP_GENERATE_H__
+
+#include "bmp_io.h"
+#include <mpi.h>
+
+/**
+ * Width and height of an image to generate.
+ */
+typedef struct {
+  int width;
+  int height;
+} ImageSize;
+
+/**
+ * Parses a comma-separated list of image sizes, e.g. "1024x768,4096x4096".
+ * @param list Size list
+ * @param sizes Output: allocated array of sizes (free with free())
+ * @param count Output: number of sizes
+ * @return app_error code:
+ *         - SUCCESS: List parsed
+ *         - ERR_INVALID_ARGS: Malformed entry or non-positive dimension
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error parse_image_sizes(const char *list, ImageSize **sizes, int *count);
+
+/**
+ * Fills an in-memory image with synthetic content: colour gradients, blocks
+ * with hard edges and per-pixel noise. Every pixel is a pure function of
+ * (seed, x, y), so the result does not depend on the thread count.
+ * @param img Pointer to Image pointer. Will be allocated.
+ * @param width Image width
+ * @param height Image height
+ * @param seed Seed of the pattern
+ * @return app_error code:
+ *         - SUCCESS: Image generated
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error generate_image(Image **img, int width, int height,
+                         unsigned long long seed);
+
+/**
+ * Writes a synthetic 24-bit BMP directly to disk using MPI I/O, without
+ * holding the image in memory. Collective over comm: each rank generates a
+ * band of rows with OpenMP and writes it in bounded slabs, so the output is
+ * byte-identical for any number of ranks and threads.
+ * @param filename Output file
+ * @param width Image width
+ * @param height Image height
+ * @param seed Seed of the pattern
+ * @param comm Communicator of the ranks that write the file
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: File written
+ *         - ERR_FILE_OPEN: Could not create the file
+ *         - ERR_FILE_WRITE: Write failed
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error generate_BMP(const char *filename, int width, int height,
+                       unsigned long long seed, MPI_Comm comm);
+
+#endif
@@ -1,9 +1,10 @@
 #include "bmp_io.h"
+#include "../memory/buffer_pool.h"
 #include <stdlib.h>
 #include <string.h>
 
 Pixel *alloc_pixel(int width, int height) {
-  Pixel *data = (Pixel *)malloc(width * height * sizeof(Pixel));
+  Pixel *data = (Pixel *)pool_alloc((size_t)width * height * sizeof(Pixel));
 
   if (!data) {
     fprintf(stderr, "Error: Memory allocation failed for pixels\n");
@@ -13,6 +14,8 @@ Pixel *alloc_pixel(int width, int height) {
   return data;
 }
 
+void free_pixel(Pixel *data) { pool_free(data); }
+
 Image *alloc_image(Pixel *data, int width, int height) {
   Image *img = (Image *)malloc(sizeof(Image));
 
@@ -27,8 +30,24 @@ Image *alloc_image(Pixel *data, int width, int height) {
   return img;
 }
 
-/* Read BMP file, build and return Image struct */
-app_error read_BMP(Image **img, const char *filename) {
+void decode_BMP_row(const unsigned char *row, Pixel *dst, int width) {
+  for (int x = 0; x < width; x++) {
+    dst[x].b = row[x * 3];
+    dst[x].g = row[x * 3 + 1];
+    dst[x].r = row[x * 3 + 2];
+  }
+}
+
+void encode_BMP_row(const Pixel *src, unsigned char *row, int width) {
+  for (int x = 0; x < width; x++) {
+    row[x * 3] = src[x].b;
+    row[x * 3 + 1] = src[x].g;
+    row[x * 3 + 2] = src[x].r;
+  }
+}
+
+app_error open_BMP(FILE **file, const char *filename, int *width,
+                   int *height) {
   FILE *f = fopen(filename, "rb");
   if (!f) {
     fprintf(stderr, "Error: Could not open file %s\n", filename);
@@ -48,8 +67,6 @@ app_error read_BMP(Image **img, const char *filename) {
     return ERR_BMP_HEADER;
   }
 
-  int width = *(int *)&header[18];
-  int height = *(int *)&header[22];
   int bitsPerPixel = *(short *)&header[28];
 
   if (bitsPerPixel != 24) {
@@ -58,6 +75,20 @@ app_error read_BMP(Image **img, const char *filename) {
     return ERR_BMP_HEADER;
   }
 
+  *file = f;
+  *width = *(int *)&header[18];
+  *height = *(int *)&header[22];
+  return SUCCESS;
+}
+
+/* Read BMP file, build and return Image struct */
+app_error read_BMP(Image **img, const char *filename) {
+  FILE *f;
+  int width, height;
+  app_error err = open_BMP(&f, filename, &width, &height);
+  if (err)
+    return err;
+
   int row_padded = (width * 3 + 3) & (~3);
   unsigned char *row = (unsigned char *)malloc(row_padded);
   Pixel *data = alloc_pixel(width, height);
@@ -65,7 +96,7 @@ app_error read_BMP(Image **img, const char *filename) {
   if (!data || !row) {
     fprintf(stderr, "Error: Memory allocation failed\n");
     if (data)
-      free(data);
+      free_pixel(data);
     if (row)
       free(row);
     fclose(f);
@@ -74,11 +105,7 @@ app_error read_BMP(Image **img, const char *filename) {
 
   for (int y = 0; y < height; y++) {
     fread(row, sizeof(unsigned char), row_padded, f);
-    for (int x = 0; x < width; x++) {
-      data[(height - 1 - y) * width + x].b = row[x * 3];
-      data[(height - 1 - y) * width + x].g = row[x * 3 + 1];
-      data[(height - 1 - y) * width + x].r = row[x * 3 + 2];
-    }
+    decode_BMP_row(row, data + (size_t)(height - 1 - y) * width, width);
   }
 
   free(row);
@@ -86,7 +113,7 @@ app_error read_BMP(Image **img, const char *filename) {
 
   *img = alloc_image(data, width, height);
   if (!*img) {
-    free(data);
+    free_pixel(data);
     return ERR_MEM_ALLOC;
   }
 
@@ -105,30 +132,22 @@ app_error copy_image(const Image *src, Image **dest) {
   }
 
   // Copy pixel data
-  memcpy(new_data, src->data, src->width * src->height * sizeof(Pixel));
+  memcpy(new_data, src->data,
+         (size_t)src->width * src->height * sizeof(Pixel));
 
   // Allocate new image struct
   *dest = alloc_image(new_data, src->width, src->height);
   if (!*dest) {
-    free(new_data);
+    free_pixel(new_data);
     return ERR_MEM_ALLOC;
   }
 
   return SUCCESS;
 }
 
-/* Save Image in file in BMP format */
-app_error save_BMP(const Image *img, const char *filename) {
-  FILE *f = fopen(filename, "wb");
-  if (!f) {
-    fprintf(stderr, "Error: Could not create file %s\n", filename);
-    return ERR_FILE_OPEN;
-  }
-
-  int width = img->width;
-  int height = img->height;
+app_error write_BMP_header(FILE *f, int width, int height) {
   int row_padded = (width * 3 + 3) & (~3);
-  int fileSize = 54 + row_padded * height;
+  long long fileSize = 54 + (long long)row_padded * height;
 
   unsigned char header[54] = {
       'B', 'M',       // Signature
@@ -149,11 +168,30 @@ app_error save_BMP(const Image *img, const char *filename) {
   };
 
   // Fill in width, height, and file size
-  *(int *)&header[2] = fileSize;
+  // The size field has 32 bits; 0 marks a larger file
+  *(unsigned int *)&header[2] =
+      fileSize > 0xFFFFFFFFLL ? 0 : (unsigned int)fileSize;
   *(int *)&header[18] = width;
   *(int *)&header[22] = height;
 
-  fwrite(header, sizeof(unsigned char), 54, f);
+  if (fwrite(header, sizeof(unsigned char), 54, f) != 54)
+    return ERR_FILE_WRITE;
+  return SUCCESS;
+}
+
+/* Save Image in file in BMP format */
+app_error save_BMP(const Image *img, const char *filename) {
+  FILE *f = fopen(filename, "wb");
+  if (!f) {
+    fprintf(stderr, "Error: Could not create file %s\n", filename);
+    return ERR_FILE_OPEN;
+  }
+
+  int width = img->width;
+  int height = img->height;
+  int row_padded = (width * 3 + 3) & (~3);
+
+  write_BMP_header(f, width, height);
 
   unsigned char *row = (unsigned char *)calloc(1, row_padded);
   if (!row) {
@@ -164,12 +202,7 @@ app_error save_BMP(const Image *img, const char *filename) {
 
   // Write pixel data bottom-to-top
   for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      Pixel pixel = img->data[(height - 1 - y) * width + x];
-      row[x * 3] = pixel.b;
-      row[x * 3 + 1] = pixel.g;
-      row[x * 3 + 2] = pixel.r;
-    }
+    encode_BMP_row(img->data + (size_t)(height - 1 - y) * width, row, width);
     fwrite(row, sizeof(unsigned char), row_padded, f);
   }
 
@@ -179,7 +212,7 @@ app_error save_BMP(const Image *img, const char *filename) {
 }
 
 void free_BMP(Image *img) {
-  free(img->data);
+  free_pixel(img->data);
   free(img);
 }
 
@@ -193,7 +226,7 @@ void print_pixel(const Pixel pixel, FILE *fp) {
 }
 
 void print_BMP_pixel(const Image *img, int x, int y, FILE *fp) {
-  print_pixel(img->data[y * img->width + x], fp);
+  print_pixel(img->data[(size_t)y * img->width + x], fp);
 }
 
 void print_BMP_pixels(const Image *img, FILE *fp) {
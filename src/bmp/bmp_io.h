@@ -23,6 +23,22 @@ typedef struct {
   Pixel *data;
 } Image; // a BMP image as an array of RGB points
 
+/**
+ * Opens a BMP file and reads its header. The file is left at the first row
+ * of pixel data (the bottom row of the image), so the rows can be read one
+ * at a time with decode_BMP_row().
+ * @param file Output: the open file, to be closed by the caller
+ * @param filename Path to the input BMP file
+ * @param width Output: image width
+ * @param height Output: image height
+ * @return app_error code:
+ *         - SUCCESS: Header read, file open
+ *         - ERR_FILE_OPEN: Could not open file
+ *         - ERR_BMP_HEADER: Invalid or unsupported BMP header
+ */
+app_error open_BMP(FILE **file, const char *filename, int *width,
+                   int *height);
+
 /* Read BMP file, build and return Image struct via pointer */
 /**
  * Reads a BMP file and creates an Image structure.
@@ -45,6 +61,18 @@ app_error read_BMP(Image **img, const char *filename);
  */
 app_error copy_image(const Image *src, Image **dest);
 
+/**
+ * Writes the header of a 24-bit BMP. The rows follow bottom-up, each padded
+ * to a multiple of 4 bytes (see encode_BMP_row()).
+ * @param f File open for writing, at its start
+ * @param width Image width
+ * @param height Image height
+ * @return app_error code:
+ *         - SUCCESS: Header written
+ *         - ERR_FILE_WRITE: The write failed
+ */
+app_error write_BMP_header(FILE *f, int width, int height);
+
 /**
  * Saves an Image structure to a BMP file.
  * @param filename Path to the output BMP file
@@ -56,15 +84,40 @@ app_error copy_image(const Image *src, Image **dest);
  */
 app_error save_BMP(const Image *img, const char *filename);
 
+/* Row conversion */
+/**
+ * Converts one row of a 24-bit BMP file (BGR byte triplets) to pixels.
+ * @param row Row of the file (at least width * 3 bytes)
+ * @param dst Output pixels (width pixels)
+ * @param width Number of pixels of the row
+ */
+void decode_BMP_row(const unsigned char *row, Pixel *dst, int width);
+
+/**
+ * Converts pixels to one row of a 24-bit BMP file (BGR byte triplets). The
+ * row padding is left untouched.
+ * @param src Pixels (width pixels)
+ * @param row Output row (at least width * 3 bytes)
+ * @param width Number of pixels of the row
+ */
+void encode_BMP_row(const Pixel *src, unsigned char *row, int width);
+
 /* Allocators */
 /**
- * Allocates memory for an array of pixels.
+ * Allocates memory for an array of pixels from the buffer pool (64-byte
+ * aligned, reused across kernels and files, see buffer_pool.h).
  * @param width Image width
  * @param height Image height
  * @return Pointer to allocated Pixel array or NULL on failure
  */
 Pixel *alloc_pixel(int width, int height);
 
+/**
+ * Returns a pixel array allocated by alloc_pixel() to the buffer pool.
+ * @param data Pixel array (NULL is ignored)
+ */
+void free_pixel(Pixel *data);
+
 /**
  * Allocates memory for an Image structure.
  * @param width Image width
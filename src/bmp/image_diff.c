@@ -0,0 +1,139 @@
+#include "image_diff.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int channel_error(unsigned char a, unsigned char b) {
+  return a > b ? a - b : b - a;
+}
+
+void identical_image_diff(long long pixels, ImageDiff *diff) {
+  memset(diff, 0, sizeof(*diff));
+  diff->pixels = pixels;
+  diff->histogram[0] = pixels;
+  diff->psnr = INFINITY;
+}
+
+app_error compute_image_diff(const Image *reference, const Image *candidate,
+                             ImageDiff *diff) {
+  if (reference->width != candidate->width ||
+      reference->height != candidate->height)
+    return ERR_IMAGE_DIFFERENCE;
+
+  long long pixels = (long long)reference->width * reference->height;
+  identical_image_diff(pixels, diff);
+  diff->histogram[0] = 0;
+  double squared_sum = 0.0;
+
+#pragma omp parallel
+  {
+    // Private statistics, merged once per thread
+    long long histogram[DIFF_HISTOGRAM_BINS] = {0};
+    int max_error[3] = {0, 0, 0};
+    double local_sum = 0.0;
+
+#pragma omp for schedule(static)
+    for (long long i = 0; i < pixels; i++) {
+      Pixel a = reference->data[i];
+      Pixel b = candidate->data[i];
+      int er = channel_error(a.r, b.r);
+      int eg = channel_error(a.g, b.g);
+      int eb = channel_error(a.b, b.b);
+      max_error[0] = er > max_error[0] ? er : max_error[0];
+      max_error[1] = eg > max_error[1] ? eg : max_error[1];
+      max_error[2] = eb > max_error[2] ? eb : max_error[2];
+      int e = er > eg ? er : eg;
+      histogram[e > eb ? e : eb]++;
+      local_sum += (double)(er * er + eg * eg + eb * eb);
+    }
+
+#pragma omp critical
+    {
+      for (int c = 0; c < 3; c++)
+        if (max_error[c] > diff->max_error[c])
+          diff->max_error[c] = max_error[c];
+      for (int e = 0; e < DIFF_HISTOGRAM_BINS; e++)
+        diff->histogram[e] += histogram[e];
+      squared_sum += local_sum;
+    }
+  }
+
+  diff->differing_pixels = pixels - diff->histogram[0];
+  diff->mse = pixels > 0 ? squared_sum / (3.0 * pixels) : 0.0;
+  diff->psnr =
+      diff->mse > 0 ? 10.0 * log10(255.0 * 255.0 / diff->mse) : INFINITY;
+  return SUCCESS;
+}
+
+int get_max_error(const ImageDiff *diff) {
+  int max = diff->max_error[0];
+  for (int c = 1; c < 3; c++)
+    if (diff->max_error[c] > max)
+      max = diff->max_error[c];
+  return max;
+}
+
+// Black -> blue -> red -> yellow over [0, 255]
+static Pixel heat_color(int value) {
+  Pixel p = {0, 0, 0};
+  if (value <= 0)
+    return p;
+  if (value < 85) {
+    p.b = (unsigned char)(85 + 2 * value);
+  } else if (value < 170) {
+    p.r = (unsigned char)(3 * (value - 85));
+    p.b = (unsigned char)(255 - 3 * (value - 85));
+  } else {
+    p.r = 255;
+    p.g = (unsigned char)(3 * (value - 170));
+  }
+  return p;
+}
+
+app_error save_diff_map(const Image *reference, const Image *candidate,
+                        const char *filename) {
+  if (reference->width != candidate->width ||
+      reference->height != candidate->height)
+    return ERR_IMAGE_DIFFERENCE;
+
+  long long pixels = (long long)reference->width * reference->height;
+  Pixel *map = alloc_pixel(reference->width, reference->height);
+  if (!map)
+    return ERR_MEM_ALLOC;
+
+#pragma omp parallel for schedule(static)
+  for (long long i = 0; i < pixels; i++) {
+    Pixel a = reference->data[i];
+    Pixel b = candidate->data[i];
+    int e = channel_error(a.r, b.r);
+    int eg = channel_error(a.g, b.g);
+    int eb = channel_error(a.b, b.b);
+    e = eg > e ? eg : e;
+    e = eb > e ? eb : e;
+    int value = e * DIFF_MAP_GAIN;
+    map[i] = heat_color(value > 255 ? 255 : value);
+  }
+
+  Image image = {reference->width, reference->height, map};
+  app_error err = save_BMP(&image, filename);
+  free_pixel(map);
+  return err;
+}
+
+void print_image_diff(const ImageDiff *diff, FILE *fp) {
+  double percent =
+      diff->pixels > 0 ? 100.0 * diff->differing_pixels / diff->pixels : 0.0;
+  fprintf(fp,
+          "\t\tMax error R %d G %d B %d | %lld pixels differ (%.3f%%) | "
+          "PSNR %.2f dB\n",
+          diff->max_error[0], diff->max_error[1], diff->max_error[2],
+          diff->differing_pixels, percent, diff->psnr);
+  if (diff->differing_pixels == 0)
+    return;
+
+  fprintf(fp, "\t\tError histogram:");
+  for (int e = 0; e < DIFF_HISTOGRAM_BINS; e++)
+    if (diff->histogram[e] > 0)
+      fprintf(fp, " %d:%lld", e, diff->histogram[e]);
+  fprintf(fp, "\n");
+}
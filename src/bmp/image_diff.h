@@ -0,0 +1,74 @@
+#ifndef __IMAGE_DIFF_H__
+#define __IMAGE_DIFF_H__
+
+#include "bmp_io.h"
+#include <stdio.h>
+
+// One histogram bin per possible per-pixel error (0-255)
+#define DIFF_HISTOGRAM_BINS 256
+
+// Factor applied to the errors of the diff map, so that +-1 is visible
+#define DIFF_MAP_GAIN 32
+
+/**
+ * Quantitative difference between a reference image and a candidate.
+ * The error of a pixel is the largest absolute difference of its channels.
+ */
+typedef struct {
+  long long pixels;                           // Pixels compared
+  int max_error[3];                           // Largest error per channel (RGB)
+  long long differing_pixels;                 // Pixels with a non-zero error
+  long long histogram[DIFF_HISTOGRAM_BINS];   // Pixels per error value
+  double mse;                                 // Mean squared error (channels)
+  double psnr;                                // dB, INFINITY when identical
+} ImageDiff;
+
+/**
+ * Compares two images of the same size in parallel.
+ * @param reference The reference image
+ * @param candidate The image to compare
+ * @param diff Output statistics
+ * @return app_error code:
+ *         - SUCCESS: Statistics computed
+ *         - ERR_IMAGE_DIFFERENCE: The sizes differ
+ */
+app_error compute_image_diff(const Image *reference, const Image *candidate,
+                             ImageDiff *diff);
+
+/**
+ * Fills the statistics of two identical images of the given size without
+ * comparing them (e.g. when their hashes already match).
+ * @param pixels Number of pixels of the images
+ * @param diff Output statistics
+ */
+void identical_image_diff(long long pixels, ImageDiff *diff);
+
+/**
+ * Returns the largest per-channel error of a difference.
+ */
+int get_max_error(const ImageDiff *diff);
+
+/**
+ * Saves a heat map of the per-pixel error: black where the images match,
+ * then blue, red and yellow as the error (times DIFF_MAP_GAIN) grows.
+ * @param reference The reference image
+ * @param candidate The image compared (same size)
+ * @param filename Path of the BMP to write
+ * @return app_error code:
+ *         - SUCCESS: Map saved
+ *         - ERR_IMAGE_DIFFERENCE: The sizes differ
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ *         - ERR_FILE_OPEN: Could not create the file
+ */
+app_error save_diff_map(const Image *reference, const Image *candidate,
+                        const char *filename);
+
+/**
+ * Prints the statistics on one line and the non-empty histogram bins on a
+ * second one.
+ * @param diff The statistics to print
+ * @param fp File stream to write to
+ */
+void print_image_diff(const ImageDiff *diff, FILE *fp);
+
+#endif
@@ -0,0 +1,94 @@
+#include "image_hash.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// xxHash64 primes
+#define PRIME1 0x9E3779B185EBCA87ULL
+#define PRIME2 0xC2B2AE3D27D4EB4FULL
+#define PRIME3 0x165667B19E3779F9ULL
+#define PRIME4 0x85EBCA77C2B2AE63ULL
+#define PRIME5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+  acc += input * PRIME2;
+  acc = rotl64(acc, 31);
+  return acc * PRIME1;
+}
+
+static inline uint64_t hash_merge(uint64_t acc, uint64_t value) {
+  acc ^= hash_round(0, value);
+  return acc * PRIME1 + PRIME4;
+}
+
+static inline uint64_t hash_avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  h ^= h >> 32;
+  return h;
+}
+
+static uint64_t hash_block(const unsigned char *data, size_t bytes,
+                           uint64_t seed) {
+  const size_t stride = HASH_LANES * sizeof(uint64_t);
+  uint64_t acc[HASH_LANES];
+  for (int i = 0; i < HASH_LANES; i++)
+    acc[i] = seed + PRIME5 * (uint64_t)(i + 1);
+
+  // The lanes are independent, so one iteration is a single vector round
+  size_t full = bytes - bytes % stride;
+  for (size_t offset = 0; offset < full; offset += stride) {
+    uint64_t words[HASH_LANES];
+    memcpy(words, data + offset, stride);
+#pragma omp simd
+    for (int i = 0; i < HASH_LANES; i++)
+      acc[i] = hash_round(acc[i], words[i]);
+  }
+
+  uint64_t h = (uint64_t)bytes;
+  for (int i = 0; i < HASH_LANES; i++)
+    h = hash_merge(h, acc[i]);
+  for (size_t offset = full; offset < bytes; offset++)
+    h = rotl64(h ^ (data[offset] * PRIME5), 11) * PRIME1;
+  return hash_avalanche(h);
+}
+
+// Hash of block b of the pixel data
+static uint64_t hash_block_at(const unsigned char *data, size_t bytes,
+                              long b) {
+  size_t offset = (size_t)b * HASH_BLOCK_SIZE;
+  size_t length =
+      bytes - offset < HASH_BLOCK_SIZE ? bytes - offset : HASH_BLOCK_SIZE;
+  return hash_block(data + offset, length, (uint64_t)b);
+}
+
+unsigned long long hash_image(const Image *img) {
+  const unsigned char *data = (const unsigned char *)img->data;
+  size_t bytes = (size_t)img->width * img->height * sizeof(Pixel);
+  long blocks = (long)((bytes + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE);
+
+  uint64_t h = hash_merge(PRIME5, ((uint64_t)img->width << 32) |
+                                      (uint32_t)img->height);
+  uint64_t *block_hashes = (uint64_t *)malloc(blocks * sizeof(uint64_t));
+  if (!block_hashes) {
+    // Same value, computed by a single thread
+    for (long b = 0; b < blocks; b++)
+      h = hash_merge(h, hash_block_at(data, bytes, b));
+    return hash_avalanche(h);
+  }
+
+#pragma omp parallel for schedule(static)
+  for (long b = 0; b < blocks; b++)
+    block_hashes[b] = hash_block_at(data, bytes, b);
+
+  for (long b = 0; b < blocks; b++)
+    h = hash_merge(h, block_hashes[b]);
+  free(block_hashes);
+  return hash_avalanche(h);
+}
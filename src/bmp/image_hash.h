@@ -0,0 +1,24 @@
+#ifndef __IMAGE_HASH_H__
+#define __IMAGE_HASH_H__
+
+#include "bmp_io.h"
+
+// Bytes of pixel data hashed independently before the blocks are combined
+#define HASH_BLOCK_SIZE (64 * 1024)
+
+// Independent 64-bit accumulators per block (one SIMD register on AVX2)
+#define HASH_LANES 4
+
+/**
+ * Computes a 64-bit content hash of an image (dimensions and pixels).
+ * The pixel data is cut into HASH_BLOCK_SIZE blocks hashed in parallel with
+ * xxHash64-style rounds over HASH_LANES interleaved lanes, and the block
+ * hashes are folded in order, so the value does not depend on the number of
+ * threads. Equal images always have equal hashes; different images have
+ * equal hashes with negligible probability.
+ * @param img The image to hash
+ * @return The hash
+ */
+unsigned long long hash_image(const Image *img);
+
+#endif
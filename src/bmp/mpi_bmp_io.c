@@ -1,8 +1,31 @@
 #include "mpi_bmp_io.h"
+#include "../memory/buffer_pool.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+app_error mpi_read_BMP_dimensions(const char *filename, int *width,
+                                  int *height) {
+  MPI_File fh;
+  MPI_Status status;
+  unsigned char header[54];
+
+  int err = MPI_File_open(MPI_COMM_WORLD, filename, MPI_MODE_RDONLY,
+                          MPI_INFO_NULL, &fh);
+  if (err != MPI_SUCCESS)
+    return ERR_FILE_OPEN;
+
+  err = MPI_File_read_at(fh, 0, header, 54, MPI_BYTE, &status);
+  MPI_File_close(&fh);
+  if (err != MPI_SUCCESS || header[0] != 'B' || header[1] != 'M' ||
+      *(short *)&header[28] != 24)
+    return ERR_BMP_HEADER;
+
+  *width = *(int *)&header[18];
+  *height = *(int *)&header[22];
+  return SUCCESS;
+}
+
 app_error mpi_read_BMP_chunk(Image **img, const char *filename, int start_row,
                              int num_rows, int *total_width,
                              int *total_height) {
@@ -84,21 +107,25 @@ app_error mpi_read_BMP_chunk(Image **img, const char *filename, int start_row,
   // Offset in bytes
   MPI_Offset file_offset = 54 + (MPI_Offset)first_file_row_to_read * row_padded;
 
-  // Size to read
-  int bytes_to_read = num_rows * row_padded;
+  // Size to read; the read counts padded rows so that chunks of more than
+  // INT_MAX bytes fit its int count
+  size_t bytes_to_read = (size_t)num_rows * row_padded;
 
-  unsigned char *buffer = (unsigned char *)malloc(bytes_to_read);
+  unsigned char *buffer = (unsigned char *)pool_alloc(bytes_to_read);
   if (!buffer) {
-    free(data);
+    free_pixel(data);
     MPI_File_close(&fh);
     return ERR_MEM_ALLOC;
   }
 
-  err = MPI_File_read_at(fh, file_offset, buffer, bytes_to_read, MPI_BYTE,
-                         &status);
+  MPI_Datatype row_type;
+  MPI_Type_contiguous(row_padded, MPI_BYTE, &row_type);
+  MPI_Type_commit(&row_type);
+  err = MPI_File_read_at(fh, file_offset, buffer, num_rows, row_type, &status);
+  MPI_Type_free(&row_type);
   if (err != MPI_SUCCESS) {
-    free(buffer);
-    free(data);
+    pool_free(buffer);
+    free_pixel(data);
     MPI_File_close(&fh);
     return ERR_FILE_OPEN; // Or read error
   }
@@ -126,21 +153,17 @@ app_error mpi_read_BMP_chunk(Image **img, const char *filename, int start_row,
     // start_row = num_rows - 1.
 
     int target_data_row = (num_rows - 1) - i;
-    unsigned char *row_ptr = buffer + i * row_padded;
+    unsigned char *row_ptr = buffer + (size_t)i * row_padded;
 
-    for (int x = 0; x < width; x++) {
-      data[target_data_row * width + x].b = row_ptr[x * 3];
-      data[target_data_row * width + x].g = row_ptr[x * 3 + 1];
-      data[target_data_row * width + x].r = row_ptr[x * 3 + 2];
-    }
+    decode_BMP_row(row_ptr, data + (size_t)target_data_row * width, width);
   }
 
-  free(buffer);
+  pool_free(buffer);
   MPI_File_close(&fh);
 
   *img = alloc_image(data, width, num_rows);
   if (!*img) {
-    free(data);
+    free_pixel(data);
     return ERR_MEM_ALLOC;
   }
 
@@ -162,20 +185,25 @@ app_error mpi_write_BMP_chunk(const Image *img, const char *filename,
     return ERR_FILE_OPEN;
   }
 
+  int row_padded = (total_width * 3 + 3) & (~3);
+
+  // Drop the tail of a larger file that is being overwritten
+  MPI_File_set_size(fh, 54 + (MPI_Offset)row_padded * total_height);
+
   // Rank 0 writes header
   int rank;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-  int row_padded = (total_width * 3 + 3) & (~3);
-
   if (rank == 0) {
-    int fileSize = 54 + row_padded * total_height;
+    long long fileSize = 54 + (long long)row_padded * total_height;
     unsigned char header[54] = {'B', 'M', 0, 0, 0, 0, 0, 0, 0, 0, 54, 0, 0, 0,
                                 40,  0,   0, 0, 0, 0, 0, 0, 0, 0, 0,  0, 1, 0,
                                 24,  0,   0, 0, 0, 0, 0, 0, 0, 0, 0,  0, 0, 0,
                                 0,   0,   0, 0, 0, 0, 0, 0, 0, 0, 0,  0};
 
-    *(int *)&header[2] = fileSize;
+    // The size field has 32 bits; 0 marks a larger file
+    *(unsigned int *)&header[2] =
+        fileSize > 0xFFFFFFFFLL ? 0 : (unsigned int)fileSize;
     *(int *)&header[18] = total_width;
     *(int *)&header[22] = total_height;
 
@@ -203,12 +231,13 @@ app_error mpi_write_BMP_chunk(const Image *img, const char *filename,
   // Row: Height - start_row - 1.
 
   int num_local_rows = img->height;
-  int bytes_to_write = num_local_rows * row_padded;
-  unsigned char *buffer = (unsigned char *)calloc(1, bytes_to_write);
+  size_t bytes_to_write = (size_t)num_local_rows * row_padded;
+  unsigned char *buffer = (unsigned char *)pool_alloc(bytes_to_write);
   if (!buffer) {
     MPI_File_close(&fh);
     return ERR_MEM_ALLOC;
   }
+  memset(buffer, 0, bytes_to_write);
 
   // Fill buffer
   // Buffer runs from Smallest File Row to Largest.
@@ -221,14 +250,10 @@ app_error mpi_write_BMP_chunk(const Image *img, const char *filename,
     // Buffer index i corresponds to Data row (h - 1 - i).
 
     int data_row_idx = (num_local_rows - 1) - i;
-    unsigned char *row_ptr = buffer + i * row_padded;
-
-    for (int x = 0; x < img->width; x++) {
-      Pixel pixel = img->data[data_row_idx * img->width + x];
-      row_ptr[x * 3] = pixel.b;
-      row_ptr[x * 3 + 1] = pixel.g;
-      row_ptr[x * 3 + 2] = pixel.r;
-    }
+    unsigned char *row_ptr = buffer + (size_t)i * row_padded;
+
+    encode_BMP_row(img->data + (size_t)data_row_idx * img->width, row_ptr,
+                   img->width);
   }
 
   // Calculate write offset
@@ -238,10 +263,14 @@ app_error mpi_write_BMP_chunk(const Image *img, const char *filename,
   MPI_Offset file_offset =
       54 + (MPI_Offset)first_file_row_to_write * row_padded;
 
-  err = MPI_File_write_at(fh, file_offset, buffer, bytes_to_write, MPI_BYTE,
+  MPI_Datatype row_type;
+  MPI_Type_contiguous(row_padded, MPI_BYTE, &row_type);
+  MPI_Type_commit(&row_type);
+  err = MPI_File_write_at(fh, file_offset, buffer, num_local_rows, row_type,
                           &status);
+  MPI_Type_free(&row_type);
 
-  free(buffer);
+  pool_free(buffer);
   MPI_File_close(&fh);
 
   if (err != MPI_SUCCESS)
@@ -4,6 +4,19 @@
 #include "bmp_io.h"
 #include <mpi.h>
 
+/**
+ * @brief Reads the dimensions of a BMP file using MPI I/O.
+ * Collective over MPI_COMM_WORLD: every rank reads the header itself, so no
+ * message is needed to share the dimensions.
+ *
+ * @param filename File to read.
+ * @param width Output parameter: width of the image.
+ * @param height Output parameter: height of the image.
+ * @return app_error
+ */
+app_error mpi_read_BMP_dimensions(const char *filename, int *width,
+                                  int *height);
+
 /**
  * @brief Reads a chunk of a BMP file using MPI I/O.
  *
@@ -1,4 +1,11 @@
 #include "files.h"
+#include "../bmp/bmp_generate.h"
+#include "../file_utils/file_utils.h"
+#include "../memory/buffer_pool.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
 
 // Fallback in case the compiler flag isn't set
 #ifndef PROJECT_ROOT
@@ -7,7 +14,7 @@
 
 // CSV Header for the single-run data file
 const char *SINGLE_RUN_CSV_HEADER =
-    "Pixel Count,Kernel Size,Clusters,Threads,Time";
+    "Pixel Count,Kernel Size,Clusters,Threads,Iterations,Engine,Time";
 
 #define _DATA_FOLDER PROJECT_ROOT "data/chronos"
 const char *SERIAL_CSV_FILE = _DATA_FOLDER "/serial_data.csv";
@@ -15,43 +22,258 @@ const char *MULTITHREADED_CSV_FILE = _DATA_FOLDER "/multithreaded_data.csv";
 const char *DISTRIBUTED_CSV_FILE = _DATA_FOLDER "/distributed_data.csv";
 const char *SHARED_CSV_FILE = _DATA_FOLDER "/shared_data.csv";
 const char *TASK_POOL_CSV_FILE = _DATA_FOLDER "/task_pool_data.csv";
+const char *FFT_CSV_FILE = _DATA_FOLDER "/fft_data.csv";
+const char *FFT_DISTRIBUTED_CSV_FILE = _DATA_FOLDER "/fft_distributed_data.csv";
+const char *PLANNED_CSV_FILE = _DATA_FOLDER "/planned_data.csv";
 
 // CSV Header for the multi-run data file
 const char *MULTI_RUN_CSV_FILE = _DATA_FOLDER "/time_data.csv";
 const char *MULTI_RUN_CSV_HEADER =
-    "Pixel Count,Kernel Size,Clusters,Threads,Serial "
-    "Time,Multithreaded "
+    "Pixel Count,Kernel Size,Clusters,Threads,Iterations,"
+    "Multithreaded Engine,Distributed Engine,Serial Time,Multithreaded "
     "Time,Distributed Time,Shared Time,Task Pool Time";
 
 // CSV Header for the speedup data file
 const char *SPEEDUP_CSV_FILE = _DATA_FOLDER "/speedups_data.csv";
 const char *SPEEDUP_CSV_HEADER =
-    "Pixel Count,Kernel Size,Clusters,Threads,Serial "
-    "Speedup,Multithreaded "
+    "Pixel Count,Kernel Size,Clusters,Threads,Iterations,"
+    "Multithreaded Engine,Distributed Engine,Serial Speedup,Multithreaded "
     "Speedup,Distributed Speedup,Shared Speedup,Task Pool Speedup";
 
+// CSV Header for the per-phase breakdown (min/max/avg across ranks)
+const char *PHASES_CSV_FILE = _DATA_FOLDER "/phases_data.csv";
+const char *PHASES_CSV_HEADER =
+    "Pixel Count,Kernel Size,Clusters,Threads,Iterations,Mode,Engine,"
+    "Read Min,Read Max,Read Avg,"
+    "Bcast Min,Bcast Max,Bcast Avg,"
+    "Scatter Min,Scatter Max,Scatter Avg,"
+    "Halo Min,Halo Max,Halo Avg,"
+    "Compute Min,Compute Max,Compute Avg,"
+    "Gather Min,Gather Max,Gather Avg,"
+    "Write Min,Write Max,Write Avg";
+
+// CSV Header for the hardware counters (summed over threads and ranks)
+const char *COUNTERS_CSV_FILE = _DATA_FOLDER "/counters_data.csv";
+const char *COUNTERS_CSV_HEADER =
+    "Pixel Count,Kernel Size,Clusters,Threads,Iterations,Mode,Engine,Time,"
+    "Cycles,Instructions,L1D Misses,LLC Misses,Branch Misses,"
+    "IPC,L1D Misses Per Pixel,LLC Misses Per Pixel,Bytes Per Pixel";
+
+// CSV Header for the throughput and roofline metrics
+const char *THROUGHPUT_CSV_FILE = _DATA_FOLDER "/throughput_data.csv";
+const char *THROUGHPUT_CSV_HEADER =
+    "Pixel Count,Kernel Size,Clusters,Threads,Iterations,Mode,Engine,"
+    "Algorithm,Precision,"
+    "NUMA Nodes,Binding,Time,"
+    "Mpixel/s,GFLOP/s,GB/s,Arithmetic Intensity,"
+    "Peak GFLOP/s,Peak GB/s,Attainable GFLOP/s,Roofline Efficiency,Bound";
+
+// CSV Header for the planner calibration cache (seconds per unit of work of
+// every algorithm, one line per host and thread count)
+const char *CALIBRATION_CSV_FILE = _DATA_FOLDER "/calibration.csv";
+const char *CALIBRATION_CSV_HEADER =
+    "Host,Threads,Direct,Unrolled,Separable,Running Sum,FFT,Unrolled Integer";
+const char *VERIFICATION_CSV_FILE = _DATA_FOLDER "/verification_data.csv";
+const char *VERIFICATION_CSV_HEADER =
+    "Pixel Count,Kernel,File,Mode,Max Error R,Max Error G,Max Error B,"
+    "Differing Pixels,MSE,PSNR,Max Error Limit,Min PSNR,Passed";
+const char *PRECISION_CSV_FILE = _DATA_FOLDER "/precision_data.csv";
+const char *PRECISION_CSV_HEADER =
+    "Pixel Count,Kernel,File,Mode,Precision,Time,Differing Pixels,"
+    "Differing %,Max Error";
+// History of every measurement with the metadata of its run (JSON lines)
+const char *RUN_HISTORY_FILE = _DATA_FOLDER "/runs.jsonl";
+
+// One file per scaling sweep, named after its start time
+const char *SWEEP_FOLDER = _DATA_FOLDER "/sweeps";
+const char *SWEEP_CSV_HEADER =
+    "Series,Kernel,Width,Height,Ranks,Threads,PEs,Time,Speedup,Efficiency,"
+    "Karp-Flatt,Model,Serial Fraction,Model Speedup";
+// Fastest rank x thread split of every image-size class, per host
+const char *TUNING_CSV_FILE = _DATA_FOLDER "/tuning.csv";
+const char *TUNING_CSV_HEADER =
+    "Host,Nodes,Cores,Sockets,NUMA Nodes,Kernel,Width,Height,Ranks,"
+    "Ranks per Node,Threads,Time";
+const char *REFERENCE_HASH_CSV_FILE = _DATA_FOLDER "/reference_hashes.csv";
+const char *REFERENCE_HASH_CSV_HEADER = "Kernel,Width,Height,Hash,File";
+
 // Image directories
 #define _IMAGES_FOLDER PROJECT_ROOT "images"
 #define _BASE_FOLDER "base"
+#define _GENERATED_FOLDER "generated"
 #define _SERIAL_FOLDER "serial"
 #define _MULTITHREADED_FOLDER "multithreaded"
 #define _DISTRIBUTED_FOLDER "distributed"
 #define _SHARED_FOLDER "shared"
 #define _TASK_POOL_FOLDER "task_pool"
+#define _FFT_FOLDER "fft"
+#define _FFT_DISTRIBUTED_FOLDER "fft_distributed"
+#define _PLANNED_FOLDER "planned"
 
 const char *IMAGES_FOLDER = _IMAGES_FOLDER;
 const char *BASE_FOLDER = _BASE_FOLDER;
+const char *GENERATED_FOLDER = _GENERATED_FOLDER;
 const char *SERIAL_FOLDER = _SERIAL_FOLDER;
 const char *MULTITHREADED_FOLDER = _MULTITHREADED_FOLDER;
 const char *DISTRIBUTED_FOLDER = _DISTRIBUTED_FOLDER;
 const char *SHARED_FOLDER = _SHARED_FOLDER;
 const char *TASK_POOL_FOLDER = _TASK_POOL_FOLDER;
-const char *IMPLEMENTATION_FOLDERS[] = {_SERIAL_FOLDER, _MULTITHREADED_FOLDER,
-                                        _DISTRIBUTED_FOLDER, _SHARED_FOLDER,
-                                        _TASK_POOL_FOLDER};
+const char *FFT_FOLDER = _FFT_FOLDER;
+const char *FFT_DISTRIBUTED_FOLDER = _FFT_DISTRIBUTED_FOLDER;
+const char *PLANNED_FOLDER = _PLANNED_FOLDER;
+const char *DIFF_FOLDER = "diff";
+const char *IMPLEMENTATION_FOLDERS[] = {
+    _SERIAL_FOLDER,    _MULTITHREADED_FOLDER, _DISTRIBUTED_FOLDER,
+    _SHARED_FOLDER,    _TASK_POOL_FOLDER,     _FFT_FOLDER,
+    _FFT_DISTRIBUTED_FOLDER, _PLANNED_FOLDER};
+
+// Input files and kernels (selected at runtime, see init_benchmark_set)
+InputFile *benchmark_files = NULL;
+int num_benchmark_files = 0;
+Kernel *benchmark_kernels = NULL;
+int num_benchmark_kernels = 0;
+
+// Result data for each convolution mode, file, and kernel type
+static BenchmarkResult *benchmark_data = NULL;
+
+// Generates the synthetic inputs that do not exist yet and, on rank 0,
+// appends them to the input list
+static app_error generate_inputs(const char *generate_sizes,
+                                 unsigned long long seed) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  ImageSize *sizes;
+  int count;
+  app_error err = parse_image_sizes(generate_sizes, &sizes, &count);
+  if (err)
+    return err;
+
+  char dir[PATH_MAX];
+  snprintf(dir, PATH_MAX, "%s/%s", IMAGES_FOLDER, GENERATED_FOLDER);
+  int dir_err = SUCCESS;
+  if (rank == 0) {
+    dir_err = create_directory(IMAGES_FOLDER);
+    if (!dir_err)
+      dir_err = create_directory(dir);
+  }
+  MPI_Bcast(&dir_err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (dir_err) {
+    free(sizes);
+    return (app_error)dir_err;
+  }
+
+  app_error append_err = SUCCESS;
+  for (int i = 0; !err && i < count; i++) {
+    char path[PATH_MAX];
+    snprintf(path, PATH_MAX, "%s/%s/synthetic_%dx%d_s%llu.bmp", IMAGES_FOLDER,
+             GENERATED_FOLDER, sizes[i].width, sizes[i].height, seed);
+
+    // The content is fully determined by the name, so a file of the right
+    // size can be reused
+    int exists = 0;
+    if (rank == 0) {
+      struct stat st;
+      long long row_padded = ((long long)sizes[i].width * 3 + 3) & ~3LL;
+      exists = stat(path, &st) == 0 &&
+               st.st_size == 54 + row_padded * sizes[i].height;
+    }
+    MPI_Bcast(&exists, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (!exists) {
+      double start = MPI_Wtime();
+      err = generate_BMP(path, sizes[i].width, sizes[i].height, seed,
+                         MPI_COMM_WORLD);
+      double elapsed = MPI_Wtime() - start;
+      if (rank == 0 && !err) {
+        double gigabytes = 3.0 * sizes[i].width * sizes[i].height / 1e9;
+        printf("Generated %s in %.3f s (%.2f GB/s)\n", path, elapsed,
+               elapsed > 0 ? gigabytes / elapsed : 0.0);
+      }
+    } else if (rank == 0) {
+      printf("Reusing %s\n", path);
+    }
+
+    // Kept apart from err so that every rank runs the same collectives
+    if (rank == 0 && !err && !append_err)
+      append_err = append_input(&benchmark_files, &num_benchmark_files, path);
+  }
+
+  free(sizes);
+  return err ? err : append_err;
+}
+
+app_error init_benchmark_set(const char *input_source, const char *kernel_list,
+                             const char *generate_sizes,
+                             unsigned long long seed) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  // Kernel names come from the command line, which every rank has
+  app_error err = select_kernels(kernel_list, &benchmark_kernels,
+                                 &num_benchmark_kernels);
+  if (err)
+    return err;
+
+  // Only the synthetic inputs unless a source is also given
+  int discover_err = SUCCESS;
+  if (rank == 0 && (input_source || !generate_sizes))
+    discover_err =
+        discover_inputs(input_source, &benchmark_files, &num_benchmark_files);
+
+  MPI_Bcast(&discover_err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (discover_err) {
+    free_benchmark_set();
+    return (app_error)discover_err;
+  }
+
+  if (generate_sizes) {
+    err = generate_inputs(generate_sizes, seed);
+    int generate_err = err;
+    MPI_Bcast(&generate_err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (generate_err) {
+      free_benchmark_set();
+      return (app_error)generate_err;
+    }
+  }
+
+  MPI_Bcast(&num_benchmark_files, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (rank != 0) {
+    benchmark_files =
+        (InputFile *)malloc(num_benchmark_files * sizeof(InputFile));
+    if (!benchmark_files)
+      return ERR_MEM_ALLOC;
+  }
+  MPI_Bcast(benchmark_files, num_benchmark_files * (int)sizeof(InputFile),
+            MPI_BYTE, 0, MPI_COMM_WORLD);
+
+  benchmark_data = (BenchmarkResult *)calloc(
+      (size_t)CONVOLUTION_MODES * num_benchmark_files * num_benchmark_kernels,
+      sizeof(BenchmarkResult));
+  if (!benchmark_data) {
+    free_benchmark_set();
+    return ERR_MEM_ALLOC;
+  }
+
+  return SUCCESS;
+}
 
-// Input files (located in images/base)
-const char *files[] = {"Large.bmp", "XL.bmp", "XXL.bmp"};
+void free_benchmark_set(void) {
+  free(benchmark_files);
+  free(benchmark_kernels);
+  free_generated_kernels();
+  free(benchmark_data);
+  benchmark_files = NULL;
+  benchmark_kernels = NULL;
+  benchmark_data = NULL;
+  num_benchmark_files = 0;
+  num_benchmark_kernels = 0;
+  pool_release();
+}
 
-// Elapsed time data for each convolution mode, file, and kernel type
-double benchmark_data[CONVOLUTION_MODES][BENCHMARK_FILES][KERNEL_TYPES];
+BenchmarkResult *get_benchmark_result(int mode, int file, int kernel) {
+  size_t index =
+      ((size_t)mode * num_benchmark_files + file) * num_benchmark_kernels +
+      kernel;
+  return &benchmark_data[index];
+}
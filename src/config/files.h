@@ -2,24 +2,95 @@
 #define __FILES_H__
 
 // Constants for benchmarking
-#define CONVOLUTION_MODES 5
-#define BENCHMARK_FILES 3
-#define KERNEL_TYPES 7
+#define CONVOLUTION_MODES 8
 
-// Stores the elapsed times for each mode, file, and kernel
-extern double benchmark_data[CONVOLUTION_MODES][BENCHMARK_FILES][KERNEL_TYPES];
+// Indices of the convolution modes (same order as IMPLEMENTATION_FOLDERS)
+#define MODE_SERIAL 0
+#define MODE_MULTITHREADED 1
+#define MODE_DISTRIBUTED 2
+#define MODE_SHARED 3
+#define MODE_TASK_POOL 4
+#define MODE_FFT 5
+#define MODE_FFT_DISTRIBUTED 6
+#define MODE_PLANNED 7
 
-// Constants for file paths and names
-extern const char *files[];
+#include "../errors/errors.h"
+#include "../perf/perf_counters.h"
+#include "../timing/phase_timer.h"
+#include "inputs.h"
+#include "kernel.h"
+
+/**
+ * Result of a single kernel run on a single file.
+ * Holds the total elapsed time, the number of ranks that took part, the
+ * per-phase breakdown across ranks, the hardware counter totals (when
+ * enabled with -perf), the algorithm chosen by the planner (ALGO_UNPLANNED
+ * for the fixed engines), the hash of the output image and, for the float
+ * runs of the direct engines, how far the output is from double precision.
+ */
+typedef struct {
+  double time;
+  int ranks;
+  int algorithm;
+  unsigned long long hash; // Content hash of the output (see image_hash.h)
+  long long divergent_pixels; // Pixels that differ from double (-1: not run)
+  int divergence_max_error;   // Largest channel difference from double
+  PhaseStats phases;
+  PerfCounts counters;
+} BenchmarkResult;
+
+// Input images and kernels selected at runtime
+extern InputFile *benchmark_files;
+extern int num_benchmark_files;
+extern Kernel *benchmark_kernels;
+extern int num_benchmark_kernels;
+
+/**
+ * Selects the input images and kernels of the benchmark and allocates the
+ * result storage for every mode, file, and kernel.
+ * Collective over MPI_COMM_WORLD: rank 0 discovers the inputs and broadcasts
+ * the list, so that all ranks iterate over the same files. Synthetic inputs
+ * are generated by all ranks into images/generated (skipped when a file of
+ * the same size and seed already exists) and appended to the list.
+ * @param input_source Directory, glob, single BMP or manifest (NULL for
+ * images/base, or for no other input when generate_sizes is set)
+ * @param kernel_list Comma-separated kernel names (NULL for all kernels)
+ * @param generate_sizes Synthetic input sizes "WxH,..." (NULL for none)
+ * @param seed Seed of the synthetic inputs
+ * @return app_error code (identical on all ranks)
+ */
+app_error init_benchmark_set(const char *input_source, const char *kernel_list,
+                             const char *generate_sizes,
+                             unsigned long long seed);
+
+/**
+ * Frees the input list, kernel list and result storage.
+ */
+void free_benchmark_set(void);
+
+/**
+ * Returns the stored result of a mode, file, and kernel.
+ * The results of one mode and file are contiguous over the kernels.
+ * @param mode Mode index (MODE_*)
+ * @param file Index into benchmark_files
+ * @param kernel Index into benchmark_kernels
+ * @return Pointer to the result
+ */
+BenchmarkResult *get_benchmark_result(int mode, int file, int kernel);
 
 // Directories
 extern const char *IMAGES_FOLDER;
 extern const char *BASE_FOLDER;
+extern const char *GENERATED_FOLDER;
 extern const char *SERIAL_FOLDER;
 extern const char *MULTITHREADED_FOLDER;
 extern const char *DISTRIBUTED_FOLDER;
 extern const char *SHARED_FOLDER;
 extern const char *TASK_POOL_FOLDER;
+extern const char *FFT_FOLDER;
+extern const char *FFT_DISTRIBUTED_FOLDER;
+extern const char *PLANNED_FOLDER;
+extern const char *DIFF_FOLDER;
 extern const char *IMPLEMENTATION_FOLDERS[];
 
 // CSV Files
@@ -30,6 +101,9 @@ extern const char *MULTITHREADED_CSV_FILE;
 extern const char *DISTRIBUTED_CSV_FILE;
 extern const char *SHARED_CSV_FILE;
 extern const char *TASK_POOL_CSV_FILE;
+extern const char *FFT_CSV_FILE;
+extern const char *FFT_DISTRIBUTED_CSV_FILE;
+extern const char *PLANNED_CSV_FILE;
 
 // CSV Headers
 extern const char *SINGLE_RUN_CSV_HEADER;
@@ -39,4 +113,43 @@ extern const char *MULTI_RUN_CSV_HEADER;
 extern const char *SPEEDUP_CSV_FILE;
 extern const char *SPEEDUP_CSV_HEADER;
 
+// CSV Headers for the per-phase breakdown
+extern const char *PHASES_CSV_FILE;
+extern const char *PHASES_CSV_HEADER;
+
+// CSV Headers for the hardware counters
+extern const char *COUNTERS_CSV_FILE;
+extern const char *COUNTERS_CSV_HEADER;
+
+// CSV Headers for the throughput and roofline metrics
+extern const char *THROUGHPUT_CSV_FILE;
+extern const char *THROUGHPUT_CSV_HEADER;
+
+// CSV Headers for the planner calibration cache
+extern const char *CALIBRATION_CSV_FILE;
+extern const char *CALIBRATION_CSV_HEADER;
+
+// CSV Headers for the quantitative verification report
+extern const char *VERIFICATION_CSV_FILE;
+extern const char *VERIFICATION_CSV_HEADER;
+
+// CSV Headers for the divergence of the float accumulation from double
+extern const char *PRECISION_CSV_FILE;
+extern const char *PRECISION_CSV_HEADER;
+
+// History of the measurements and run metadata (JSON lines, see history.h)
+extern const char *RUN_HISTORY_FILE;
+
+// Folder and CSV Header of the scaling sweep results
+extern const char *SWEEP_FOLDER;
+extern const char *SWEEP_CSV_HEADER;
+
+// CSV Headers for the rank x thread tuning
+extern const char *TUNING_CSV_FILE;
+extern const char *TUNING_CSV_HEADER;
+
+// Manifest of the hashes of the serial outputs (verification references)
+extern const char *REFERENCE_HASH_CSV_FILE;
+extern const char *REFERENCE_HASH_CSV_HEADER;
+
 #endif
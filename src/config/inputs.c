@@ -0,0 +1,246 @@
+#define _DEFAULT_SOURCE
+#include "inputs.h"
+#include "files.h"
+#include <dirent.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static int has_bmp_extension(const char *path) {
+  size_t len = strlen(path);
+  if (len < 4)
+    return 0;
+  const char *ext = path + len - 4;
+  return ext[0] == '.' && (ext[1] == 'b' || ext[1] == 'B') &&
+         (ext[2] == 'm' || ext[2] == 'M') && (ext[3] == 'p' || ext[3] == 'P');
+}
+
+static int compare_inputs(const void *a, const void *b) {
+  return strcmp(((const InputFile *)a)->path, ((const InputFile *)b)->path);
+}
+
+// Appends a path to the growing input list
+static app_error add_input(InputFile **inputs, int *count, int *capacity,
+                           const char *path) {
+  if (*count == *capacity) {
+    int new_capacity = *capacity ? *capacity * 2 : 8;
+    InputFile *grown =
+        (InputFile *)realloc(*inputs, new_capacity * sizeof(InputFile));
+    if (!grown)
+      return ERR_MEM_ALLOC;
+    *inputs = grown;
+    *capacity = new_capacity;
+  }
+
+  if (strlen(path) >= PATH_MAX)
+    return ERR_PATH_TOO_LONG;
+
+  InputFile *input = &(*inputs)[*count];
+  snprintf(input->path, PATH_MAX, "%s", path);
+  const char *slash = strrchr(path, '/');
+  snprintf(input->name, sizeof(input->name), "%s", slash ? slash + 1 : path);
+  input->width = 0;
+  input->height = 0;
+  (*count)++;
+  return SUCCESS;
+}
+
+app_error append_input(InputFile **inputs, int *count, const char *path) {
+  // A full list: add_input grows it on demand
+  int capacity = *count;
+  return add_input(inputs, count, &capacity, path);
+}
+
+static app_error discover_directory(const char *dir_path, InputFile **inputs,
+                                    int *count, int *capacity) {
+  DIR *dir = opendir(dir_path);
+  if (!dir) {
+    fprintf(stderr, "Error: Could not open input directory %s\n", dir_path);
+    return ERR_FILE_OPEN;
+  }
+
+  app_error err = SUCCESS;
+  struct dirent *entry;
+  while (!err && (entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.' || !has_bmp_extension(entry->d_name))
+      continue;
+    char path[PATH_MAX];
+    if (snprintf(path, PATH_MAX, "%s/%s", dir_path, entry->d_name) >= PATH_MAX)
+      err = ERR_PATH_TOO_LONG;
+    else
+      err = add_input(inputs, count, capacity, path);
+  }
+
+  closedir(dir);
+  if (!err)
+    qsort(*inputs, *count, sizeof(InputFile), compare_inputs);
+  return err;
+}
+
+static app_error discover_glob(const char *pattern, InputFile **inputs,
+                               int *count, int *capacity) {
+  glob_t matches;
+  int ret = glob(pattern, 0, NULL, &matches);
+  if (ret == GLOB_NOMATCH)
+    return SUCCESS;
+  if (ret != 0)
+    return ERR_FILE_OPEN;
+
+  // glob(3) already sorts its results
+  app_error err = SUCCESS;
+  for (size_t i = 0; !err && i < matches.gl_pathc; i++)
+    err = add_input(inputs, count, capacity, matches.gl_pathv[i]);
+
+  globfree(&matches);
+  return err;
+}
+
+static app_error discover_manifest(const char *manifest, InputFile **inputs,
+                                   int *count, int *capacity) {
+  FILE *fp = fopen(manifest, "r");
+  if (!fp) {
+    fprintf(stderr, "Error: Could not open manifest %s\n", manifest);
+    return ERR_FILE_OPEN;
+  }
+
+  // Directory of the manifest, for relative entries
+  char base_dir[PATH_MAX];
+  snprintf(base_dir, PATH_MAX, "%s", manifest);
+  char *slash = strrchr(base_dir, '/');
+  if (slash)
+    *slash = '\0';
+  else
+    snprintf(base_dir, PATH_MAX, ".");
+
+  app_error err = SUCCESS;
+  char line[PATH_MAX];
+  while (!err && fgets(line, sizeof(line), fp)) {
+    // Strip comments and surrounding whitespace
+    char *hash = strchr(line, '#');
+    if (hash)
+      *hash = '\0';
+    char *start = line;
+    while (*start == ' ' || *start == '\t')
+      start++;
+    char *end = start + strlen(start);
+    while (end > start && (end[-1] == '\n' || end[-1] == '\r' ||
+                           end[-1] == ' ' || end[-1] == '\t'))
+      *--end = '\0';
+    if (*start == '\0')
+      continue;
+
+    if (start[0] == '/') {
+      err = add_input(inputs, count, capacity, start);
+    } else {
+      char path[PATH_MAX];
+      if (snprintf(path, PATH_MAX, "%s/%s", base_dir, start) >= PATH_MAX)
+        err = ERR_PATH_TOO_LONG;
+      else
+        err = add_input(inputs, count, capacity, path);
+    }
+  }
+
+  fclose(fp);
+  return err;
+}
+
+app_error discover_inputs(const char *source, InputFile **inputs, int *count) {
+  *inputs = NULL;
+  *count = 0;
+  int capacity = 0;
+  app_error err;
+
+  char default_dir[PATH_MAX];
+  if (!source || source[0] == '\0') {
+    snprintf(default_dir, PATH_MAX, "%s/%s", IMAGES_FOLDER, BASE_FOLDER);
+    source = default_dir;
+  }
+
+  struct stat st;
+  if (strpbrk(source, "*?[")) {
+    err = discover_glob(source, inputs, count, &capacity);
+  } else if (stat(source, &st) != 0) {
+    fprintf(stderr, "Error: Input source %s does not exist\n", source);
+    err = ERR_FILE_OPEN;
+  } else if (S_ISDIR(st.st_mode)) {
+    err = discover_directory(source, inputs, count, &capacity);
+  } else if (has_bmp_extension(source)) {
+    err = add_input(inputs, count, &capacity, source);
+  } else {
+    err = discover_manifest(source, inputs, count, &capacity);
+  }
+
+  if (!err && *count == 0) {
+    fprintf(stderr, "Error: No input images found in %s\n", source);
+    err = ERR_INVALID_ARGS;
+  }
+
+  if (err) {
+    free(*inputs);
+    *inputs = NULL;
+    *count = 0;
+  }
+  return err;
+}
+
+app_error select_kernels(const char *list, Kernel **kernels, int *count) {
+  *kernels = NULL;
+  *count = 0;
+
+  if (!list || list[0] == '\0') {
+    *kernels = (Kernel *)malloc(NUM_KERNELS * sizeof(Kernel));
+    if (!*kernels)
+      return ERR_MEM_ALLOC;
+    memcpy(*kernels, CONV_KERNELS, NUM_KERNELS * sizeof(Kernel));
+    *count = NUM_KERNELS;
+    return SUCCESS;
+  }
+
+  // Upper bound on the number of entries
+  int capacity = 1;
+  for (const char *c = list; *c; c++)
+    if (*c == ',')
+      capacity++;
+
+  *kernels = (Kernel *)malloc(capacity * sizeof(Kernel));
+  if (!*kernels)
+    return ERR_MEM_ALLOC;
+
+  const char *start = list;
+  while (*start) {
+    const char *end = strchr(start, ',');
+    size_t len = end ? (size_t)(end - start) : strlen(start);
+
+    if (len > 0) {
+      char name[PATH_MAX];
+      if (len >= sizeof(name))
+        len = sizeof(name) - 1;
+      memcpy(name, start, len);
+      name[len] = '\0';
+
+      app_error err = resolve_kernel(name, &(*kernels)[*count]);
+      if (err) {
+        if (err == ERR_INVALID_ARGS)
+          fprintf(stderr, "Error: Unknown kernel %s\n", name);
+        free(*kernels);
+        *kernels = NULL;
+        *count = 0;
+        return err;
+      }
+      (*count)++;
+    }
+
+    if (!end)
+      break;
+    start = end + 1;
+  }
+
+  if (*count == 0) {
+    free(*kernels);
+    *kernels = NULL;
+    return ERR_INVALID_ARGS;
+  }
+  return SUCCESS;
+}
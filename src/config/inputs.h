@@ -0,0 +1,67 @@
+#ifndef __INPUTS_H__
+#define __INPUTS_H__
+
+#include "../errors/errors.h"
+#include "kernel.h"
+#include <limits.h>
+
+/**
+ * An input image discovered at runtime.
+ * The dimensions are filled in the first time the image is read, so that the
+ * results can be written without reading the image again.
+ */
+typedef struct {
+  char path[PATH_MAX]; // Full path of the input BMP
+  char name[256];      // File name, used for the output files
+  int width;
+  int height;
+} InputFile;
+
+/**
+ * Builds the list of input images from a source specification:
+ * - NULL or empty: every *.bmp in images/base
+ * - a directory: every *.bmp in that directory
+ * - a pattern containing '*', '?' or '[': every file matching the glob
+ * - a file ending in .bmp: that single image
+ * - any other file: a manifest with one image path per line ('#' starts a
+ *   comment, relative paths are resolved against the manifest's directory)
+ * The list is sorted by path (except for manifests, which keep their order).
+ * @param source Source specification
+ * @param inputs Output: allocated array of inputs (free with free())
+ * @param count Output: number of inputs
+ * @return app_error code:
+ *         - SUCCESS: At least one input was found
+ *         - ERR_FILE_OPEN: Directory or manifest could not be opened
+ *         - ERR_INVALID_ARGS: No inputs matched the source
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error discover_inputs(const char *source, InputFile **inputs, int *count);
+
+/**
+ * Appends a single image path to an input list.
+ * @param inputs Input array, reallocated to hold the new entry
+ * @param count Number of inputs, incremented
+ * @param path Path of the image
+ * @return app_error code:
+ *         - SUCCESS: Input appended
+ *         - ERR_PATH_TOO_LONG: Path does not fit in an InputFile
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error append_input(InputFile **inputs, int *count, const char *path);
+
+/**
+ * Builds the list of kernels from a comma-separated list of kernel names
+ * (case-insensitive, e.g. "ridge,GAUSSBLUR3,gaussblur51", see
+ * resolve_kernel() for the generated kernels).
+ * @param list Kernel names, NULL or empty selects every built-in kernel
+ * @param kernels Output: allocated array of kernels (free with free())
+ * @param count Output: number of kernels
+ * @return app_error code:
+ *         - SUCCESS: Kernels selected
+ *         - ERR_INVALID_ARGS: Unknown kernel name
+ *         - ERR_FILE_OPEN / ERR_FILE_READ: PSF file could not be loaded
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error select_kernels(const char *list, Kernel **kernels, int *count);
+
+#endif
@@ -1,4 +1,13 @@
 #include "kernel.h"
+#include <ctype.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Largest generated kernel accepted (a 1001x1001 kernel is already 8 MB)
+#define MAX_GENERATED_KERNEL_SIZE 1001
 
 const double RIDGE_DATA[9] = {0, -1, 0, -1, 4, -1, 0, -1, 0};
 const Kernel RIDGE_KERNEL = {"ridge", 3, RIDGE_DATA};
@@ -39,3 +48,185 @@ const Kernel CONV_KERNELS[] = {
     GAUSSIAN3_KERNEL, GAUSSIAN5_KERNEL, UNSHARP5_KERNEL};
 
 const int NUM_KERNELS = sizeof(CONV_KERNELS) / sizeof(CONV_KERNELS[0]);
+
+const Kernel *find_kernel(const char *name) {
+  for (int k = 0; k < NUM_KERNELS; k++) {
+    const char *a = name;
+    const char *b = CONV_KERNELS[k].name;
+    while (*a && tolower((unsigned char)*a) == *b) {
+      a++;
+      b++;
+    }
+    if (*a == '\0' && *b == '\0')
+      return &CONV_KERNELS[k];
+  }
+  return NULL;
+}
+
+// Name and data of the kernels built by resolve_kernel
+typedef struct {
+  char *name;
+  double *data;
+} GeneratedKernel;
+
+static GeneratedKernel *generated_kernels = NULL;
+static int num_generated_kernels = 0;
+
+static app_error register_kernel(const char *name, int size, double *data,
+                                 Kernel *kernel) {
+  GeneratedKernel *grown = (GeneratedKernel *)realloc(
+      generated_kernels, (num_generated_kernels + 1) * sizeof(GeneratedKernel));
+  char *name_copy = (char *)malloc(strlen(name) + 1);
+  if (!grown || !name_copy) {
+    if (grown)
+      generated_kernels = grown;
+    free(name_copy);
+    free(data);
+    return ERR_MEM_ALLOC;
+  }
+  strcpy(name_copy, name);
+
+  generated_kernels = grown;
+  generated_kernels[num_generated_kernels].name = name_copy;
+  generated_kernels[num_generated_kernels].data = data;
+  num_generated_kernels++;
+
+  kernel->name = name_copy;
+  kernel->size = size;
+  kernel->data = data;
+  return SUCCESS;
+}
+
+// Parses "<prefix>N" (case-insensitive), returns N or 0 if it does not match
+static int parse_sized_name(const char *name, const char *prefix) {
+  size_t len = strlen(prefix);
+  for (size_t i = 0; i < len; i++)
+    if (tolower((unsigned char)name[i]) != prefix[i])
+      return 0;
+
+  const char *digits = name + len;
+  if (!isdigit((unsigned char)*digits))
+    return 0;
+  char *end;
+  long size = strtol(digits, &end, 10);
+  if (*end != '\0' || size > MAX_GENERATED_KERNEL_SIZE)
+    return 0;
+  return (int)size;
+}
+
+static app_error make_gaussian_kernel(int size, Kernel *kernel) {
+  double *data = (double *)malloc((size_t)size * size * sizeof(double));
+  if (!data)
+    return ERR_MEM_ALLOC;
+
+  // +-3 sigma spans the kernel
+  double sigma = size / 6.0;
+  int half = size / 2;
+  double sum = 0.0;
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      double dy = y - half, dx = x - half;
+      double value = exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+      data[y * size + x] = value;
+      sum += value;
+    }
+  }
+  for (int i = 0; i < size * size; i++)
+    data[i] /= sum;
+
+  char name[32];
+  snprintf(name, sizeof(name), "gaussblur%d", size);
+  return register_kernel(name, size, data, kernel);
+}
+
+static app_error make_box_kernel(int size, Kernel *kernel) {
+  double *data = (double *)malloc((size_t)size * size * sizeof(double));
+  if (!data)
+    return ERR_MEM_ALLOC;
+  for (int i = 0; i < size * size; i++)
+    data[i] = 1.0 / (size * size);
+
+  char name[32];
+  snprintf(name, sizeof(name), "boxblur%d", size);
+  return register_kernel(name, size, data, kernel);
+}
+
+static app_error load_psf_kernel(const char *path, Kernel *kernel) {
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    fprintf(stderr, "Error: Could not open PSF file %s\n", path);
+    return ERR_FILE_OPEN;
+  }
+
+  int capacity = 64, count = 0;
+  double *data = (double *)malloc(capacity * sizeof(double));
+  double value;
+  while (data && fscanf(fp, "%lf", &value) == 1) {
+    if (count == capacity) {
+      capacity *= 2;
+      double *grown = (double *)realloc(data, capacity * sizeof(double));
+      if (!grown) {
+        free(data);
+        data = NULL;
+        break;
+      }
+      data = grown;
+    }
+    data[count++] = value;
+  }
+  int complete = feof(fp);
+  fclose(fp);
+  if (!data)
+    return ERR_MEM_ALLOC;
+
+  int size = (int)lround(sqrt((double)count));
+  if (!complete || count == 0 || size * size != count || size % 2 == 0) {
+    fprintf(stderr,
+            "Error: PSF file %s must hold an odd NxN matrix of numbers\n",
+            path);
+    free(data);
+    return ERR_FILE_READ;
+  }
+
+  // psf_<file name without directory and extension>
+  const char *base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  char name[64];
+  snprintf(name, sizeof(name), "psf_%s", base);
+  char *dot = strrchr(name, '.');
+  if (dot && dot > name + 4)
+    *dot = '\0';
+
+  return register_kernel(name, size, data, kernel);
+}
+
+app_error resolve_kernel(const char *name, Kernel *kernel) {
+  const Kernel *builtin = find_kernel(name);
+  if (builtin) {
+    *kernel = *builtin;
+    return SUCCESS;
+  }
+
+  if (strncmp(name, "psf:", 4) == 0)
+    return load_psf_kernel(name + 4, kernel);
+
+  int size = parse_sized_name(name, "gaussblur");
+  if (size)
+    return size % 2 ? make_gaussian_kernel(size, kernel) : ERR_INVALID_ARGS;
+
+  size = parse_sized_name(name, "boxblur");
+  if (size)
+    return size % 2 ? make_box_kernel(size, kernel) : ERR_INVALID_ARGS;
+
+  return ERR_INVALID_ARGS;
+}
+
+void free_generated_kernels(void) {
+  for (int i = 0; i < num_generated_kernels; i++) {
+    free(generated_kernels[i].name);
+    free(generated_kernels[i].data);
+  }
+  free(generated_kernels);
+  generated_kernels = NULL;
+  num_generated_kernels = 0;
+}
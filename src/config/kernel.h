@@ -1,6 +1,8 @@
 #ifndef __KERNEL_H__
 #define __KERNEL_H__
 
+#include "../errors/errors.h"
+
 /**
  * Represents a square convolution kernel.
  * Contains the name, directory, size (dimension), and the flattened data array.
@@ -22,4 +24,36 @@ extern const Kernel UNSHARP5_KERNEL;
 extern const Kernel CONV_KERNELS[];
 extern const int NUM_KERNELS;
 
+/**
+ * Looks up a built-in kernel by name (case-insensitive).
+ * @param name Kernel name, e.g. "gaussblur3" or "GAUSSBLUR3"
+ * @return Pointer to the kernel or NULL if there is no such kernel
+ */
+const Kernel *find_kernel(const char *name);
+
+/**
+ * Resolves a kernel name to a kernel. Besides the built-in kernels this
+ * accepts generated kernels of any odd size:
+ * - gaussblurN: normalized Gaussian with sigma = N / 6
+ * - boxblurN: normalized box filter
+ * - psf:<file>: custom point spread function read from a text file holding
+ *   N*N whitespace-separated values in row-major order (used as given, not
+ *   normalized), named psf_<file name without extension>
+ * Generated kernels stay valid until free_generated_kernels() is called.
+ * @param name Kernel name (case-insensitive)
+ * @param kernel Output kernel
+ * @return app_error code:
+ *         - SUCCESS: Kernel resolved
+ *         - ERR_INVALID_ARGS: Unknown name or invalid size
+ *         - ERR_FILE_OPEN: PSF file could not be opened
+ *         - ERR_FILE_READ: PSF file is not a square matrix of numbers
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error resolve_kernel(const char *name, Kernel *kernel);
+
+/**
+ * Frees the data of every kernel created by resolve_kernel().
+ */
+void free_generated_kernels(void);
+
 #endif
@@ -1,9 +1,33 @@
 #include "convolution.h"
+#include "../timing/phase_timer.h"
 #include <mpi.h>
+#include <omp.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+// Pixels compared at a time by check_images_match() and check_images_within()
+#define COMPARE_BLOCK_PIXELS (16 * 1024)
+
+static accumulation_precision precision = PRECISION_DOUBLE;
+
+// Communicator of the distributed engine, MPI_COMM_WORLD when unset
+static MPI_Comm convolution_comm = MPI_COMM_NULL;
+
+void set_convolution_comm(MPI_Comm comm) { convolution_comm = comm; }
+
+MPI_Comm get_convolution_comm(void) {
+  return convolution_comm == MPI_COMM_NULL ? MPI_COMM_WORLD : convolution_comm;
+}
+
+void set_accumulation_precision(accumulation_precision p) { precision = p; }
+
+accumulation_precision get_accumulation_precision(void) { return precision; }
+
+const char *get_precision_name(accumulation_precision p) {
+  return p == PRECISION_FLOAT ? "float" : "double";
+}
+
 unsigned char cast_to_pixel_value(double val) {
   return (unsigned char)(val < 0 ? 0 : (val > 255 ? 255 : val));
 }
@@ -25,8 +49,143 @@ void clamp_to_boundary(int *px, int *py, int width, int height) {
     *py = height - 1;
 }
 
+// Float accumulation of output rows [row_begin, row_end) of a strip (see
+// strip_function). Every tap is added over the interior of the row at once,
+// which the compiler vectorizes with twice the lanes of double; only the
+// border columns take the clamped per-pixel path. Both paths add the taps in
+// the same order, so a pixel does not depend on the split between threads.
+static void convolve_rows_float_range(const Pixel *src, int width,
+                                      int src_height, int first_row,
+                                      int row_begin, int row_end,
+                                      const float *k, int k_size, Pixel *dst,
+                                      float *acc) {
+  int half_k = k_size / 2;
+  int lo = half_k < width ? half_k : width;
+  int hi = width - half_k > lo ? width - half_k : lo;
+  float *restrict acc_r = acc;
+  float *restrict acc_g = acc + width;
+  float *restrict acc_b = acc + 2 * width;
+
+  for (int y = row_begin; y < row_end; y++) {
+    for (int x = lo; x < hi; x++)
+      acc_r[x] = acc_g[x] = acc_b[x] = 0.0f;
+
+    for (int ky = 0; ky < k_size; ky++) {
+      int py = first_row + y + ky - half_k;
+      py = py < 0 ? 0 : (py >= src_height ? src_height - 1 : py);
+      for (int kx = 0; kx < k_size; kx++) {
+        const Pixel *restrict row = src + (size_t)py * width + kx - half_k;
+        float k_val = k[ky * k_size + kx];
+#pragma omp simd
+        for (int x = lo; x < hi; x++) {
+          acc_r[x] += row[x].r * k_val;
+          acc_g[x] += row[x].g * k_val;
+          acc_b[x] += row[x].b * k_val;
+        }
+      }
+    }
+
+    for (int x = 0; x < width; x++) {
+      float r_acc, g_acc, b_acc;
+      if (x >= lo && x < hi) {
+        r_acc = acc_r[x];
+        g_acc = acc_g[x];
+        b_acc = acc_b[x];
+      } else {
+        r_acc = g_acc = b_acc = 0.0f;
+        for (int ky = 0; ky < k_size; ky++) {
+          for (int kx = 0; kx < k_size; kx++) {
+            int py = first_row + y + ky - half_k;
+            int px = x + kx - half_k;
+            clamp_to_boundary(&px, &py, width, src_height);
+
+            Pixel p = src[(size_t)py * width + px];
+            float k_val = k[ky * k_size + kx];
+            r_acc += p.r * k_val;
+            g_acc += p.g * k_val;
+            b_acc += p.b * k_val;
+          }
+        }
+      }
+      clamp_pixel(&dst[(size_t)y * width + x], r_acc, g_acc, b_acc);
+    }
+  }
+}
+
+// Float strip computation with a team of the given size
+static app_error convolve_rows_float(const Pixel *src, int width,
+                                     int src_height, int first_row, int rows,
+                                     Kernel kernel, Pixel *dst, int threads) {
+  int k_size = kernel.size;
+  float *k = (float *)malloc(k_size * k_size * sizeof(float));
+  // Row accumulators of every thread
+  float *acc = (float *)malloc((size_t)threads * 3 * width * sizeof(float));
+  if (!k || !acc) {
+    free(k);
+    free(acc);
+    return ERR_MEM_ALLOC;
+  }
+  for (int i = 0; i < k_size * k_size; i++)
+    k[i] = (float)kernel.data[i];
+
+#pragma omp parallel num_threads(threads)
+  {
+    float *thread_acc = acc + (size_t)omp_get_thread_num() * 3 * width;
+    int t = omp_get_thread_num();
+    int n = omp_get_num_threads();
+    // Same blocks as schedule(static) over the rows
+    int begin = rows / n * t + (t < rows % n ? t : rows % n);
+    int end = begin + rows / n + (t < rows % n ? 1 : 0);
+    convolve_rows_float_range(src, width, src_height, first_row, begin, end,
+                              k, k_size, dst, thread_acc);
+  }
+
+  free(k);
+  free(acc);
+  return SUCCESS;
+}
+
+app_error convolve_rows_direct_float(const Pixel *src, int width,
+                                     int src_height, int first_row, int rows,
+                                     Kernel kernel, Pixel *dst) {
+  return convolve_rows_float(src, width, src_height, first_row, rows, kernel,
+                             dst, omp_get_max_threads());
+}
+
+// Whole-image float convolution shared by the serial and multithreaded modes
+static app_error convolve_image_float(Image *img, Kernel kernel,
+                                      double *elapsed_time, int threads) {
+  double start_time = MPI_Wtime();
+  phase_timer_begin(PHASE_COMPUTE);
+
+  Pixel *output = alloc_pixel(img->width, img->height);
+  if (!output) {
+    phase_timer_end(PHASE_COMPUTE);
+    return ERR_MEM_ALLOC;
+  }
+  app_error err = convolve_rows_float(img->data, img->width, img->height, 0,
+                                      img->height, kernel, output, threads);
+  if (err) {
+    free_pixel(output);
+    phase_timer_end(PHASE_COMPUTE);
+    return err;
+  }
+
+  free_pixel(img->data);
+  img->data = output;
+
+  phase_timer_end(PHASE_COMPUTE);
+  if (elapsed_time != NULL)
+    *elapsed_time = MPI_Wtime() - start_time;
+  return SUCCESS;
+}
+
 app_error convolve_serial(Image *img, Kernel kernel, double *elapsed_time) {
+  if (precision == PRECISION_FLOAT)
+    return convolve_image_float(img, kernel, elapsed_time, 1);
+
   double start_time = MPI_Wtime();
+  phase_timer_begin(PHASE_COMPUTE);
   int width = img->width;
   int height = img->height;
   int k_size = kernel.size;
@@ -34,6 +193,7 @@ app_error convolve_serial(Image *img, Kernel kernel, double *elapsed_time) {
 
   Pixel *output = alloc_pixel(width, height);
   if (!output) {
+    phase_timer_end(PHASE_COMPUTE);
     return ERR_MEM_ALLOC;
   }
 
@@ -48,7 +208,7 @@ app_error convolve_serial(Image *img, Kernel kernel, double *elapsed_time) {
 
           clamp_to_boundary(&px, &py, width, height);
 
-          Pixel p = img->data[py * width + px];
+          Pixel p = img->data[(size_t)py * width + px];
           double k_val = kernel.data[ky * k_size + kx];
 
           r_acc += p.r * k_val;
@@ -59,13 +219,14 @@ app_error convolve_serial(Image *img, Kernel kernel, double *elapsed_time) {
 
       Pixel out_p;
       clamp_pixel(&out_p, r_acc, g_acc, b_acc);
-      output[y * width + x] = out_p;
+      output[(size_t)y * width + x] = out_p;
     }
   }
 
-  free(img->data);
+  free_pixel(img->data);
   img->data = output;
 
+  phase_timer_end(PHASE_COMPUTE);
   double end_time = MPI_Wtime();
   if (elapsed_time != NULL) {
     *elapsed_time = end_time - start_time;
@@ -76,7 +237,12 @@ app_error convolve_serial(Image *img, Kernel kernel, double *elapsed_time) {
 
 app_error convolve_parallel_multithreaded(Image *img, Kernel kernel,
                                           double *elapsed_time) {
+  if (precision == PRECISION_FLOAT)
+    return convolve_image_float(img, kernel, elapsed_time,
+                                omp_get_max_threads());
+
   double start_time = MPI_Wtime();
+  phase_timer_begin(PHASE_COMPUTE);
   int width = img->width;
   int height = img->height;
   int k_size = kernel.size;
@@ -84,6 +250,7 @@ app_error convolve_parallel_multithreaded(Image *img, Kernel kernel,
 
   Pixel *output = alloc_pixel(width, height);
   if (!output) {
+    phase_timer_end(PHASE_COMPUTE);
     return ERR_MEM_ALLOC;
   }
 
@@ -91,7 +258,7 @@ app_error convolve_parallel_multithreaded(Image *img, Kernel kernel,
   const Pixel *restrict input_data = img->data;
   const double *restrict kernel_data = kernel.data;
 
-#pragma omp parallel for collapse(2) schedule(dynamic)
+#pragma omp parallel for schedule(static)
   for (int y = 0; y < height; y++) {
     for (int x = 0; x < width; x++) {
       double r_acc = 0, g_acc = 0, b_acc = 0;
@@ -103,7 +270,7 @@ app_error convolve_parallel_multithreaded(Image *img, Kernel kernel,
 
           clamp_to_boundary(&px, &py, width, height);
 
-          Pixel p = input_data[py * width + px];
+          Pixel p = input_data[(size_t)py * width + px];
           double k_val = kernel_data[ky * k_size + kx];
 
           r_acc += p.r * k_val;
@@ -114,13 +281,14 @@ app_error convolve_parallel_multithreaded(Image *img, Kernel kernel,
 
       Pixel out_p;
       clamp_pixel(&out_p, r_acc, g_acc, b_acc);
-      output_data[y * width + x] = out_p;
+      output_data[(size_t)y * width + x] = out_p;
     }
   }
 
-  free(img->data);
+  free_pixel(img->data);
   img->data = output;
 
+  phase_timer_end(PHASE_COMPUTE);
   double end_time = MPI_Wtime();
   if (elapsed_time != NULL)
     *elapsed_time = end_time - start_time;
@@ -142,47 +310,184 @@ void get_chunk_metadata(int height, int rank, int size, int *start_y,
   }
 }
 
+MPI_Datatype create_row_datatype(int width) {
+  MPI_Datatype pixel_type, row_type;
+  MPI_Type_contiguous(sizeof(Pixel), MPI_BYTE, &pixel_type);
+  MPI_Type_contiguous(width, pixel_type, &row_type);
+  MPI_Type_commit(&row_type);
+  MPI_Type_free(&pixel_type);
+  return row_type;
+}
+
 void exchange_halos(Pixel *data, int width, int local_h, int halo_size,
                     int rank, int size) {
   int top_neighbor = (rank == 0) ? MPI_PROC_NULL : rank - 1;
   int bottom_neighbor = (rank == size - 1) ? MPI_PROC_NULL : rank + 1;
+  MPI_Comm comm = get_convolution_comm();
+  MPI_Datatype row_type = create_row_datatype(width);
   MPI_Status status;
 
   // Send top real rows UP, Receive from bottom neighbor into bottom halo
   // We send 'halo_size' rows starting at data[halo_size * width].
   // We receive into data[(local_h + halo_size) * width].
-  MPI_Sendrecv(data + halo_size * width, halo_size * width * sizeof(Pixel),
-               MPI_BYTE, top_neighbor, 0, data + (local_h + halo_size) * width,
-               halo_size * width * sizeof(Pixel), MPI_BYTE, bottom_neighbor, 0,
-               MPI_COMM_WORLD, &status);
+  MPI_Sendrecv(data + (size_t)halo_size * width, halo_size, row_type,
+               top_neighbor, 0, data + (size_t)(local_h + halo_size) * width,
+               halo_size, row_type, bottom_neighbor, 0, comm, &status);
 
   // Send bottom real rows DOWN, Receive from top neighbor into top halo
   // We send 'halo_size' rows starting at data[(local_h) * width].
   // We receive into data[0].
-  MPI_Sendrecv(data + local_h * width, halo_size * width * sizeof(Pixel),
-               MPI_BYTE, bottom_neighbor, 1, data,
-               halo_size * width * sizeof(Pixel), MPI_BYTE, top_neighbor, 1,
-               MPI_COMM_WORLD, &status);
+  MPI_Sendrecv(data + (size_t)local_h * width, halo_size, row_type,
+               bottom_neighbor, 1, data, halo_size, row_type, top_neighbor, 1,
+               comm, &status);
+
+  MPI_Type_free(&row_type);
 }
 
-app_error convolve_parallel_distributed_filesystem(Image *img, Kernel kernel,
-                                                   double *elapsed_time) {
+// Halo exchange for halos deeper than the strips of the neighbours (large
+// kernels on many ranks): every rank sends to every other rank the part of
+// its strip that falls in that rank's halos
+void exchange_deep_halos(Pixel *data, int width, int height, int start_y,
+                         int local_h, int halo_size, int rank, int size) {
+  MPI_Comm comm = get_convolution_comm();
+  int *sendcounts = calloc(size, sizeof(int));
+  int *sdispls = calloc(size, sizeof(int));
+  int *recvcounts = calloc(size, sizeof(int));
+  int *rdispls = calloc(size, sizeof(int));
+  MPI_Datatype row_type = create_row_datatype(width);
+
+  for (int q = 0; q < size; q++) {
+    if (q == rank)
+      continue;
+    int q_start, q_h;
+    get_chunk_metadata(height, q, size, &q_start, &q_h);
+
+    // Rows of q's halo (above it if q is below this rank, else below it)
+    int need_begin = q > rank ? q_start - halo_size : q_start + q_h;
+    int need_end = q > rank ? q_start : q_start + q_h + halo_size;
+    int begin = need_begin > start_y ? need_begin : start_y;
+    int end = need_end < start_y + local_h ? need_end : start_y + local_h;
+    if (end > begin) {
+      sendcounts[q] = end - begin;
+      sdispls[q] = begin - start_y;
+    }
+
+    // Rows of q's strip in this rank's halo
+    need_begin = q < rank ? start_y - halo_size : start_y + local_h;
+    need_end = q < rank ? start_y : start_y + local_h + halo_size;
+    begin = need_begin > q_start ? need_begin : q_start;
+    end = need_end < q_start + q_h ? need_end : q_start + q_h;
+    if (end > begin) {
+      recvcounts[q] = end - begin;
+      rdispls[q] = begin - start_y + halo_size;
+    }
+  }
+
+  // Strip and halos are disjoint parts of the buffer; counts and
+  // displacements are in rows
+  MPI_Alltoallv(data + (size_t)halo_size * width, sendcounts, sdispls,
+                row_type, data, recvcounts, rdispls, row_type, comm);
+
+  MPI_Type_free(&row_type);
+  free(sendcounts);
+  free(sdispls);
+  free(recvcounts);
+  free(rdispls);
+}
+
+void fill_clamped_halos(Pixel *data, int width, int height, int start_y,
+                        int local_h, int halo_size) {
+  for (int h = 0; h < local_h + 2 * halo_size; h++) {
+    int global_row = start_y - halo_size + h;
+    int source_row = global_row < 0 ? 0 : (global_row >= height ? height - 1
+                                                                : global_row);
+    if (source_row != global_row)
+      memcpy(data + (size_t)h * width,
+             data + (size_t)(source_row - start_y + halo_size) * width,
+             (size_t)width * sizeof(Pixel));
+  }
+}
+
+// Double strip computation, on a team or on the calling thread alone
+static app_error convolve_rows_double(const Pixel *src, int width,
+                                      int src_height, int first_row, int rows,
+                                      Kernel kernel, Pixel *dst,
+                                      int parallel) {
+  int k_size = kernel.size;
+  int half_k = k_size / 2;
+  const double *restrict kernel_data = kernel.data;
+
+#pragma omp parallel for schedule(static) if (parallel)
+  for (int y = 0; y < rows; y++) {
+    for (int x = 0; x < width; x++) {
+      double r_acc = 0, g_acc = 0, b_acc = 0;
+
+      for (int ky = 0; ky < k_size; ky++) {
+        for (int kx = 0; kx < k_size; kx++) {
+          // Source row of the output row 'y' is 'first_row + y'. In a strip
+          // the halos already hold the neighbouring rows, so the clamp only
+          // applies at the edges of the image.
+          int py = first_row + y + ky - half_k;
+          int px = x + kx - half_k;
+
+          clamp_to_boundary(&px, &py, width, src_height);
+
+          Pixel p = src[(size_t)py * width + px];
+          double k_val = kernel_data[ky * k_size + kx];
+
+          r_acc += p.r * k_val;
+          g_acc += p.g * k_val;
+          b_acc += p.b * k_val;
+        }
+      }
+
+      Pixel out_p;
+      clamp_pixel(&out_p, r_acc, g_acc, b_acc);
+      dst[(size_t)y * width + x] = out_p;
+    }
+  }
+
+  return SUCCESS;
+}
+
+app_error convolve_rows_direct(const Pixel *src, int width, int src_height,
+                               int first_row, int rows, Kernel kernel,
+                               Pixel *dst) {
+  return convolve_rows_double(src, width, src_height, first_row, rows, kernel,
+                              dst, 1);
+}
+
+app_error convolve_rows_on_thread(const Pixel *src, int width, int src_height,
+                                  int first_row, int rows, Kernel kernel,
+                                  Pixel *dst) {
+  if (precision == PRECISION_FLOAT)
+    return convolve_rows_float(src, width, src_height, first_row, rows,
+                               kernel, dst, 1);
+  return convolve_rows_double(src, width, src_height, first_row, rows, kernel,
+                              dst, 0);
+}
+
+app_error convolve_distributed_strips(Image *img, Kernel kernel,
+                                      double *elapsed_time,
+                                      strip_function compute_strip) {
   double start_time = MPI_Wtime();
+  MPI_Comm comm = get_convolution_comm();
   int rank, size;
-  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
 
   int width, height, k_size;
 
   // 1. Broadcast Dimensions
+  phase_timer_begin(PHASE_BCAST);
   if (rank == 0) {
     width = img->width;
     height = img->height;
     k_size = kernel.size;
   }
-  MPI_Bcast(&width, 1, MPI_INT, 0, MPI_COMM_WORLD);
-  MPI_Bcast(&height, 1, MPI_INT, 0, MPI_COMM_WORLD);
-  MPI_Bcast(&k_size, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Bcast(&width, 1, MPI_INT, 0, comm);
+  MPI_Bcast(&height, 1, MPI_INT, 0, comm);
+  MPI_Bcast(&k_size, 1, MPI_INT, 0, comm);
 
   // Re-allocate kernel data on non-root (if kernel struct data pointer is null
   // or invalid) But Kernel struct is passed by value. Contains pointer.
@@ -196,13 +501,15 @@ app_error convolve_parallel_distributed_filesystem(Image *img, Kernel kernel,
     if (!local_kernel_data)
       return ERR_MEM_ALLOC;
   }
-  MPI_Bcast(local_kernel_data, k_size * k_size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  MPI_Bcast(local_kernel_data, k_size * k_size, MPI_DOUBLE, 0, comm);
+  phase_timer_end(PHASE_BCAST);
 
   // 2. Calculate Chunk Splits
   int local_h, start_y;
   get_chunk_metadata(height, rank, size, &start_y, &local_h);
 
-  // Prepare Scatterv counts
+  // Prepare Scatterv counts, in rows so they stay small for any image size
+  MPI_Datatype row_type = create_row_datatype(width);
   int *sendcounts = NULL;
   int *displs = NULL;
   if (rank == 0) {
@@ -212,7 +519,7 @@ app_error convolve_parallel_distributed_filesystem(Image *img, Kernel kernel,
     for (int r = 0; r < size; r++) {
       int r_h, r_xy;
       get_chunk_metadata(height, r, size, &r_xy, &r_h);
-      sendcounts[r] = r_h * width * sizeof(Pixel);
+      sendcounts[r] = r_h;
       displs[r] = current_disp;
       current_disp += sendcounts[r];
     }
@@ -221,94 +528,53 @@ app_error convolve_parallel_distributed_filesystem(Image *img, Kernel kernel,
   // 3. Allocate Local Buffer (w/ Halo)
   int halo_size = k_size / 2;
   int local_buffer_height = local_h + 2 * halo_size;
-  Pixel *local_data =
-      (Pixel *)malloc(local_buffer_height * width * sizeof(Pixel));
-  Pixel *local_output = (Pixel *)malloc(local_h * width * sizeof(Pixel));
+  Pixel *local_data = alloc_pixel(width, local_buffer_height);
+  Pixel *local_output = alloc_pixel(width, local_h);
 
   if (!local_data || !local_output) {
+    free_pixel(local_data);
+    free_pixel(local_output);
+    free(sendcounts);
+    free(displs);
+    MPI_Type_free(&row_type);
     if (rank != 0)
       free(local_kernel_data);
     return ERR_MEM_ALLOC;
   }
 
   // 4. Scatter Data (into the "middle" of local_data, skipping top halo)
-  Pixel *scatter_target = local_data + halo_size * width;
-  // Note: MPI_Scatterv sends bytes because we used sizeof(Pixel) in counts
-  MPI_Scatterv((rank == 0) ? img->data : NULL, sendcounts, displs, MPI_BYTE,
-               scatter_target, local_h * width * sizeof(Pixel), MPI_BYTE, 0,
-               MPI_COMM_WORLD);
+  phase_timer_begin(PHASE_SCATTER);
+  Pixel *scatter_target = local_data + (size_t)halo_size * width;
+  MPI_Scatterv((rank == 0) ? img->data : NULL, sendcounts, displs, row_type,
+               scatter_target, local_h, row_type, 0, comm);
 
   if (rank == 0) {
     free(sendcounts);
     free(displs);
   }
+  phase_timer_end(PHASE_SCATTER);
 
   // 5. Fill Boundaries / Exchange Halos
-  exchange_halos(local_data, width, local_h, halo_size, rank, size);
-
-  // Manual clamp fill for global boundaries
-  if (rank == 0) {
-    // Fill top halo with first row
-    for (int h = 0; h < halo_size; h++) {
-      memcpy(local_data + h * width, local_data + halo_size * width,
-             width * sizeof(Pixel));
-    }
-  }
-  if (rank == size - 1) {
-    // Fill bottom halo with last row
-    for (int h = 0; h < halo_size; h++) {
-      memcpy(local_data + (local_h + halo_size + h) * width,
-             local_data + (local_h + halo_size - 1) * width,
-             width * sizeof(Pixel));
-    }
-  }
-
-  // 6. Compute Convolution (OpenMP)
-  int half_k = halo_size;
-
-#pragma omp parallel for collapse(2) schedule(dynamic)
-  for (int y = 0; y < local_h; y++) {
-    for (int x = 0; x < width; x++) {
-      double r_acc = 0, g_acc = 0, b_acc = 0;
-
-      for (int ky = 0; ky < k_size; ky++) {
-        for (int kx = 0; kx < k_size; kx++) {
-          // Local buffer coordinates:
-          // Center row is 'y + halo_size'
-          // Neighbor row is 'y + halo_size + (ky - half_k)'
-          int py = y + halo_size + ky - half_k;
-          int px = x + kx - half_k;
-
-          // Clamp X coordinate
-          if (px < 0)
-            px = 0;
-          if (px >= width)
-            px = width - 1;
-
-          // Y coordinate is already safely inside local_data thanks to halos
-          // BUT: Are we sure 'py' is valid?
-          // py ranges from [0, local_buffer_height-1] essentially.
-          // y=0, ky=0 -> py = halo_size - half_k = 0. Valid.
-          // y=local_h-1, ky=k_size-1 -> py = local_h-1 + halo_size + half_k =
-          // local_h + 2*half_k - 1. Valid.
-
-          Pixel p = local_data[py * width + px];
-          double k_val = local_kernel_data[ky * k_size + kx];
-
-          r_acc += p.r * k_val;
-          g_acc += p.g * k_val;
-          b_acc += p.b * k_val;
-        }
-      }
-
-      Pixel out_p;
-      clamp_pixel(&out_p, r_acc, g_acc, b_acc);
-      local_output[y * width + x] = out_p;
-    }
-  }
+  phase_timer_begin(PHASE_HALO);
+  if (halo_size <= height / size)
+    exchange_halos(local_data, width, local_h, halo_size, rank, size);
+  else
+    exchange_deep_halos(local_data, width, height, start_y, local_h,
+                        halo_size, rank, size);
+
+  fill_clamped_halos(local_data, width, height, start_y, local_h, halo_size);
+  phase_timer_end(PHASE_HALO);
+
+  // 6. Compute Convolution on the strip
+  phase_timer_begin(PHASE_COMPUTE);
+  Kernel local_kernel = {kernel.name, k_size, local_kernel_data};
+  app_error err = compute_strip(local_data, width, local_buffer_height,
+                                halo_size, local_h, local_kernel, local_output);
+  phase_timer_end(PHASE_COMPUTE);
 
   // 7. Gather Results
   // Re-calculate counts for Gatherv
+  phase_timer_begin(PHASE_GATHER);
   int *recvcounts = NULL;
   int *rdispls = NULL;
   if (rank == 0) {
@@ -318,19 +584,20 @@ app_error convolve_parallel_distributed_filesystem(Image *img, Kernel kernel,
     for (int r = 0; r < size; r++) {
       int r_h, r_xy;
       get_chunk_metadata(height, r, size, &r_xy, &r_h);
-      recvcounts[r] = r_h * width * sizeof(Pixel);
+      recvcounts[r] = r_h;
       rdispls[r] = current_disp;
       current_disp += recvcounts[r];
     }
   }
 
-  MPI_Gatherv(local_output, local_h * width * sizeof(Pixel), MPI_BYTE,
-              (rank == 0) ? img->data : NULL, recvcounts, rdispls, MPI_BYTE, 0,
-              MPI_COMM_WORLD);
+  MPI_Gatherv(local_output, local_h, row_type, (rank == 0) ? img->data : NULL,
+              recvcounts, rdispls, row_type, 0, comm);
+  phase_timer_end(PHASE_GATHER);
 
   // 8. Cleanup
-  free(local_data);
-  free(local_output);
+  MPI_Type_free(&row_type);
+  free_pixel(local_data);
+  free_pixel(local_output);
   if (rank != 0)
     free(local_kernel_data);
   if (rank == 0) {
@@ -342,7 +609,16 @@ app_error convolve_parallel_distributed_filesystem(Image *img, Kernel kernel,
   if (elapsed_time != NULL)
     *elapsed_time = end_time - start_time;
 
-  return SUCCESS;
+  // A failed strip still took part in the gather, so no rank is left waiting
+  return err;
+}
+
+app_error convolve_parallel_distributed_filesystem(Image *img, Kernel kernel,
+                                                   double *elapsed_time) {
+  return convolve_distributed_strips(img, kernel, elapsed_time,
+                                     precision == PRECISION_FLOAT
+                                         ? convolve_rows_direct_float
+                                         : convolve_rows_direct);
 }
 
 app_error convolve_parallel_shared_filesystem(Image *img, Kernel kernel,
@@ -350,21 +626,45 @@ app_error convolve_parallel_shared_filesystem(Image *img, Kernel kernel,
   return convolve_parallel_multithreaded(img, kernel, elapsed_time);
 }
 
-app_error check_images_match(Image *img1, Image *img2) {
+// Whether the pixels [begin, end) of two images differ by at most tolerance
+static int pixels_within(const Pixel *a, const Pixel *b, long begin, long end,
+                         int tolerance) {
+  if (tolerance == 0)
+    return memcmp(a + begin, b + begin, (end - begin) * sizeof(Pixel)) == 0;
+  for (long i = begin; i < end; i++) {
+    if (abs(a[i].r - b[i].r) > tolerance || abs(a[i].g - b[i].g) > tolerance ||
+        abs(a[i].b - b[i].b) > tolerance)
+      return 0;
+  }
+  return 1;
+}
+
+// The images are compared in blocks so that, once a thread finds a
+// difference, every thread stops after its current block instead of
+// scanning the rest of its share
+static app_error compare_images(const Image *img1, const Image *img2,
+                                int tolerance) {
   if (img1->width != img2->width || img1->height != img2->height) {
     return ERR_IMAGE_DIFFERENCE;
   }
 
+  long pixels = (long)img1->width * img1->height;
+  long blocks = (pixels + COMPARE_BLOCK_PIXELS - 1) / COMPARE_BLOCK_PIXELS;
   int match = 1;
 
-#pragma omp parallel for shared(match)
-  for (int i = 0; i < img1->width * img1->height; i++) {
-    if (!match)
-      continue; // Early exit
-
-    if (img1->data[i].r != img2->data[i].r ||
-        img1->data[i].g != img2->data[i].g ||
-        img1->data[i].b != img2->data[i].b) {
+#pragma omp parallel for schedule(dynamic)
+  for (long blk = 0; blk < blocks; blk++) {
+    int still_match;
+#pragma omp atomic read
+    still_match = match;
+    if (!still_match)
+      continue;
+
+    long begin = blk * COMPARE_BLOCK_PIXELS;
+    long end = begin + COMPARE_BLOCK_PIXELS < pixels
+                   ? begin + COMPARE_BLOCK_PIXELS
+                   : pixels;
+    if (!pixels_within(img1->data, img2->data, begin, end, tolerance)) {
 #pragma omp atomic write
       match = 0;
     }
@@ -372,3 +672,11 @@ app_error check_images_match(Image *img1, Image *img2) {
 
   return match ? SUCCESS : ERR_IMAGE_DIFFERENCE;
 }
+
+app_error check_images_match(Image *img1, Image *img2) {
+  return compare_images(img1, img2, 0);
+}
+
+app_error check_images_within(Image *img1, Image *img2, int tolerance) {
+  return compare_images(img1, img2, tolerance);
+}
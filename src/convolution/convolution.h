@@ -4,6 +4,182 @@
 #include "../bmp/bmp_io.h"
 #include "../config/kernel.h"
 #include "../errors/errors.h"
+#include <mpi.h>
+
+/**
+ * Computes a band of output rows from a source buffer of whole rows.
+ * Output row y (0 <= y < rows) is centred on source row first_row + y; source
+ * rows outside [0, src_height) and columns outside [0, width) are clamped.
+ * @param src Source pixels (src_height rows of width pixels)
+ * @param width Image width
+ * @param src_height Number of rows in src
+ * @param first_row Source row of the first output row
+ * @param rows Number of output rows
+ * @param kernel The convolution kernel to apply
+ * @param dst Output pixels (rows rows of width pixels)
+ * @return app_error code
+ */
+typedef app_error (*strip_function)(const Pixel *src, int width,
+                                    int src_height, int first_row, int rows,
+                                    Kernel kernel, Pixel *dst);
+
+/**
+ * Precision of the accumulators of the direct engines (serial,
+ * multithreaded, distributed and shared). The FFT and planned engines always
+ * accumulate in double.
+ */
+typedef enum { PRECISION_DOUBLE = 0, PRECISION_FLOAT } accumulation_precision;
+
+/**
+ * Selects the accumulator precision of the direct engines.
+ * @param p The precision
+ */
+void set_accumulation_precision(accumulation_precision p);
+
+/**
+ * Returns the accumulator precision of the direct engines.
+ */
+accumulation_precision get_accumulation_precision(void);
+
+/**
+ * Returns the name of a precision ("double" or "float").
+ */
+const char *get_precision_name(accumulation_precision p);
+
+/**
+ * Selects the communicator of the distributed engine and of the halo
+ * exchanges (MPI_COMM_WORLD until set, or after setting MPI_COMM_NULL).
+ * Ranks outside of the communicator must not call them.
+ * @param comm The communicator
+ */
+void set_convolution_comm(MPI_Comm comm);
+
+/**
+ * Returns the communicator of the distributed engine.
+ */
+MPI_Comm get_convolution_comm(void);
+
+/**
+ * Converts an accumulated channel value to a pixel value, clamped to
+ * [0, 255] and truncated.
+ */
+unsigned char cast_to_pixel_value(double val);
+
+/**
+ * Stores the three accumulated channels in a pixel with
+ * cast_to_pixel_value().
+ */
+void clamp_pixel(Pixel *p, double r, double g, double b);
+
+/**
+ * Splits the rows of an image into one contiguous strip per rank (the first
+ * height % size ranks get one extra row).
+ * @param height Image height
+ * @param rank Rank of the strip
+ * @param size Number of ranks
+ * @param start_y Output: first row of the strip
+ * @param local_h Output: number of rows of the strip
+ */
+void get_chunk_metadata(int height, int rank, int size, int *start_y,
+                        int *local_h);
+
+/**
+ * Creates and commits the MPI datatype of one image row, so that transfers
+ * of the distributed engine count rows rather than bytes and stay within
+ * the int counts of MPI for any image size. Free it with MPI_Type_free().
+ * @param width Image width in pixels
+ * @return The committed row datatype
+ */
+MPI_Datatype create_row_datatype(int width);
+
+/**
+ * Fills the halo rows of a strip that lie outside the image with the nearest
+ * row of the image (clamp to edge), as the serial engine does.
+ * @param data Strip with its halos (local_h + 2 * halo_size rows)
+ * @param width Image width
+ * @param height Image height
+ * @param start_y First image row of the strip
+ * @param local_h Number of rows of the strip
+ * @param halo_size Rows of each halo
+ */
+void fill_clamped_halos(Pixel *data, int width, int height, int start_y,
+                        int local_h, int halo_size);
+
+/**
+ * Exchanges halo rows with the neighbouring ranks of the communicator of
+ * the distributed engine. The buffer holds halo_size rows above the strip,
+ * the local_h rows of the strip and halo_size rows below it; the first and
+ * last rank skip the missing neighbour.
+ * @param data Strip with its halos (local_h + 2 * halo_size rows)
+ * @param width Image width
+ * @param local_h Number of rows of the strip
+ * @param halo_size Rows sent to and received from each neighbour
+ * @param rank Rank of the caller
+ * @param size Number of ranks
+ */
+void exchange_halos(Pixel *data, int width, int local_h, int halo_size,
+                    int rank, int size);
+
+/**
+ * Halo exchange for halos deeper than the strips of the neighbours: every
+ * rank sends to every other rank the rows of its strip that fall in that
+ * rank's halos (one MPI_Alltoallv over the communicator of the distributed
+ * engine). Halo rows outside the image are left to fill_clamped_halos().
+ * @param data Strip with its halos (local_h + 2 * halo_size rows)
+ * @param width Image width
+ * @param height Image height
+ * @param start_y First image row of the strip
+ * @param local_h Number of rows of the strip
+ * @param halo_size Rows of each halo
+ * @param rank Rank of the caller
+ * @param size Number of ranks
+ */
+void exchange_deep_halos(Pixel *data, int width, int height, int start_y,
+                         int local_h, int halo_size, int rank, int size);
+
+/**
+ * Direct O(k^2) per pixel strip computation, parallelized with OpenMP.
+ * See strip_function.
+ */
+app_error convolve_rows_direct(const Pixel *src, int width, int src_height,
+                               int first_row, int rows, Kernel kernel,
+                               Pixel *dst);
+
+/**
+ * Same as convolve_rows_direct() with float accumulators: the interior of
+ * every row is summed tap by tap with SIMD, only the border columns are
+ * clamped per pixel. Results may differ from the double engines by one in
+ * some channels when a sum lands next to an integer.
+ * See strip_function.
+ */
+app_error convolve_rows_direct_float(const Pixel *src, int width,
+                                     int src_height, int first_row, int rows,
+                                     Kernel kernel, Pixel *dst);
+
+/**
+ * Same as convolve_rows_direct(), or convolve_rows_direct_float() when the
+ * accumulators are float, on the calling thread only. For callers that
+ * already run inside a parallel region, such as the tiles of the task graph.
+ * See strip_function.
+ */
+app_error convolve_rows_on_thread(const Pixel *src, int width, int src_height,
+                                  int first_row, int rows, Kernel kernel,
+                                  Pixel *dst);
+
+/**
+ * Distributed convolution over the communicator selected with
+ * set_convolution_comm(): rank 0 scatters strips of rows, the ranks exchange
+ * halos of kernel.size / 2 rows, compute their strip with compute_strip and
+ * rank 0 gathers the result into img.
+ * @param img Image on rank 0 (ignored on the other ranks)
+ * @param kernel The convolution kernel (only read on rank 0)
+ * @param elapsed_time Output: elapsed time of the whole operation
+ * @param compute_strip Computation applied to every strip
+ * @return app_error code
+ */
+app_error convolve_distributed_strips(Image *img, Kernel kernel,
+                                      double *elapsed_time,
+                                      strip_function compute_strip);
 
 /**
  * Applies a convolution kernel to an image.
@@ -21,6 +197,22 @@ app_error convolve_parallel_distributed_filesystem(Image *img, Kernel kernel,
 app_error convolve_parallel_shared_filesystem(Image *img, Kernel kernel,
                                               double *elapsed_time);
 
+/**
+ * Checks that two images are identical. The comparison stops shortly after
+ * the first difference is found.
+ * @param img1 First image
+ * @param img2 Second image
+ * @return SUCCESS or ERR_IMAGE_DIFFERENCE
+ */
 app_error check_images_match(Image *img1, Image *img2);
 
+/**
+ * Checks that two images differ by at most tolerance in every channel.
+ * @param img1 First image
+ * @param img2 Second image
+ * @param tolerance Largest accepted absolute difference per channel
+ * @return SUCCESS or ERR_IMAGE_DIFFERENCE
+ */
+app_error check_images_within(Image *img1, Image *img2, int tolerance);
+
 #endif
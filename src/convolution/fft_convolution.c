@@ -0,0 +1,268 @@
+#include "fft_convolution.h"
+#include "../memory/buffer_pool.h"
+#include "../timing/phase_timer.h"
+#include "convolution.h"
+#include <complex.h>
+#include <math.h>
+#include <mpi.h>
+#include <stdlib.h>
+#include <string.h>
+
+// FFT tiles are at least this many times the kernel footprint, so that most
+// of every transform produces valid output
+#define FFT_TILE_FACTOR 4
+#define FFT_MIN_SIZE 32
+#define FFT_MAX_SIZE 1024
+
+// Pushes results that should be exact integers (e.g. 99.9999999) over the
+// boundary before they are truncated
+#define FFT_ROUNDING_BIAS 1e-6
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+typedef double complex cplx;
+
+/**
+ * Twiddle factors and bit reversal permutation of a radix-2 FFT.
+ */
+typedef struct {
+  int n;
+  cplx *twiddles; // exp(-2*pi*i*j/n) for j < n/2
+  int *bit_reverse;
+} FFTPlan;
+
+static app_error fft_plan_init(FFTPlan *plan, int n) {
+  plan->n = n;
+  plan->twiddles = (cplx *)malloc((n / 2) * sizeof(cplx));
+  plan->bit_reverse = (int *)malloc(n * sizeof(int));
+  if (!plan->twiddles || !plan->bit_reverse) {
+    free(plan->twiddles);
+    free(plan->bit_reverse);
+    return ERR_MEM_ALLOC;
+  }
+
+  for (int j = 0; j < n / 2; j++)
+    plan->twiddles[j] = cexp(-2.0 * M_PI * I * j / n);
+
+  int bits = 0;
+  while ((1 << bits) < n)
+    bits++;
+  for (int j = 0; j < n; j++) {
+    int reversed = 0;
+    for (int b = 0; b < bits; b++)
+      if (j & (1 << b))
+        reversed |= 1 << (bits - 1 - b);
+    plan->bit_reverse[j] = reversed;
+  }
+  return SUCCESS;
+}
+
+static void fft_plan_free(FFTPlan *plan) {
+  free(plan->twiddles);
+  free(plan->bit_reverse);
+}
+
+// In-place iterative radix-2 FFT (unnormalized)
+static void fft_1d(const FFTPlan *plan, cplx *data, int inverse) {
+  int n = plan->n;
+  for (int j = 0; j < n; j++) {
+    int r = plan->bit_reverse[j];
+    if (r > j) {
+      cplx tmp = data[j];
+      data[j] = data[r];
+      data[r] = tmp;
+    }
+  }
+
+  for (int len = 2; len <= n; len <<= 1) {
+    int half = len / 2;
+    int step = n / len;
+    for (int start = 0; start < n; start += len) {
+      for (int j = 0; j < half; j++) {
+        cplx w = plan->twiddles[j * step];
+        if (inverse)
+          w = conj(w);
+        cplx u = data[start + j];
+        cplx v = data[start + j + half] * w;
+        data[start + j] = u + v;
+        data[start + j + half] = u - v;
+      }
+    }
+  }
+}
+
+static void transpose(cplx *data, int n) {
+  for (int i = 0; i < n; i++) {
+    for (int j = i + 1; j < n; j++) {
+      cplx tmp = data[i * n + j];
+      data[i * n + j] = data[j * n + i];
+      data[j * n + i] = tmp;
+    }
+  }
+}
+
+// 2D FFT as rows, transpose, rows. The forward transform leaves the spectrum
+// transposed, which is harmless for a pointwise product with a spectrum
+// computed the same way, and the inverse transform undoes the transposition.
+static void fft_2d(const FFTPlan *plan, cplx *data, int inverse) {
+  int n = plan->n;
+  for (int i = 0; i < n; i++)
+    fft_1d(plan, data + i * n, inverse);
+  transpose(data, n);
+  for (int i = 0; i < n; i++)
+    fft_1d(plan, data + i * n, inverse);
+}
+
+int fft_transform_size(int k_size) {
+  int n = FFT_MIN_SIZE;
+  while (n < FFT_TILE_FACTOR * (k_size - 1) && n < FFT_MAX_SIZE)
+    n *= 2;
+  while (n <= 2 * (k_size - 1))
+    n *= 2;
+  return n;
+}
+
+// The engines compute a correlation (out = sum k(j) * in(y - half + j)), so
+// the kernel is flipped to turn the FFT's convolution into the same sum. The
+// 1 / n^2 of the inverse transform is folded into the spectrum.
+static app_error kernel_spectrum(const FFTPlan *plan, Kernel kernel,
+                                 cplx **spectrum) {
+  int n = plan->n;
+  int k_size = kernel.size;
+  *spectrum = (cplx *)pool_alloc((size_t)n * n * sizeof(cplx));
+  if (!*spectrum)
+    return ERR_MEM_ALLOC;
+  memset(*spectrum, 0, (size_t)n * n * sizeof(cplx));
+
+  for (int ky = 0; ky < k_size; ky++)
+    for (int kx = 0; kx < k_size; kx++)
+      (*spectrum)[(k_size - 1 - ky) * n + (k_size - 1 - kx)] =
+          kernel.data[ky * k_size + kx];
+
+  fft_2d(plan, *spectrum, 0);
+  double scale = 1.0 / ((double)n * n);
+  for (int i = 0; i < n * n; i++)
+    (*spectrum)[i] *= scale;
+  return SUCCESS;
+}
+
+app_error fft_convolve_rows(const Pixel *src, int width, int src_height,
+                            int first_row, int rows, Kernel kernel,
+                            Pixel *dst) {
+  int k_size = kernel.size;
+  int half_k = k_size / 2;
+  int n = fft_transform_size(k_size);
+
+  // Overlap-save: the first k_size - 1 rows and columns of every circular
+  // convolution wrap around and are discarded
+  int tile = n - (k_size - 1);
+  int tiles_x = (width + tile - 1) / tile;
+  int tiles_y = (rows + tile - 1) / tile;
+
+  FFTPlan plan;
+  app_error err = fft_plan_init(&plan, n);
+  if (err)
+    return err;
+
+  cplx *spectrum;
+  err = kernel_spectrum(&plan, kernel, &spectrum);
+  if (err) {
+    fft_plan_free(&plan);
+    return err;
+  }
+
+#pragma omp parallel
+  {
+    // Red and green share one complex transform (real and imaginary parts):
+    // the kernel is real, so the two convolutions do not mix
+    cplx *rg = (cplx *)pool_alloc((size_t)n * n * sizeof(cplx));
+    cplx *b = (cplx *)pool_alloc((size_t)n * n * sizeof(cplx));
+    if (!rg || !b) {
+#pragma omp atomic write
+      err = ERR_MEM_ALLOC;
+    }
+
+#pragma omp for schedule(dynamic)
+    for (int t = 0; t < tiles_x * tiles_y; t++) {
+      if (!rg || !b)
+        continue;
+      int out_y = (t / tiles_x) * tile;
+      int out_x = (t % tiles_x) * tile;
+
+      for (int i = 0; i < n; i++) {
+        int py = first_row + out_y - half_k + i;
+        py = py < 0 ? 0 : (py >= src_height ? src_height - 1 : py);
+        const Pixel *src_row = src + (size_t)py * width;
+        for (int j = 0; j < n; j++) {
+          int px = out_x - half_k + j;
+          px = px < 0 ? 0 : (px >= width ? width - 1 : px);
+          Pixel p = src_row[px];
+          rg[i * n + j] = p.r + p.g * I;
+          b[i * n + j] = p.b;
+        }
+      }
+
+      fft_2d(&plan, rg, 0);
+      fft_2d(&plan, b, 0);
+      for (int i = 0; i < n * n; i++) {
+        rg[i] *= spectrum[i];
+        b[i] *= spectrum[i];
+      }
+      fft_2d(&plan, rg, 1);
+      fft_2d(&plan, b, 1);
+
+      int tile_h = rows - out_y < tile ? rows - out_y : tile;
+      int tile_w = width - out_x < tile ? width - out_x : tile;
+      for (int i = 0; i < tile_h; i++) {
+        for (int j = 0; j < tile_w; j++) {
+          int index = (i + k_size - 1) * n + (j + k_size - 1);
+          clamp_pixel(&dst[(size_t)(out_y + i) * width + out_x + j],
+                      creal(rg[index]) + FFT_ROUNDING_BIAS,
+                      cimag(rg[index]) + FFT_ROUNDING_BIAS,
+                      creal(b[index]) + FFT_ROUNDING_BIAS);
+        }
+      }
+    }
+
+    pool_free(rg);
+    pool_free(b);
+  }
+
+  pool_free(spectrum);
+  fft_plan_free(&plan);
+  return err;
+}
+
+app_error convolve_fft(Image *img, Kernel kernel, double *elapsed_time) {
+  double start_time = MPI_Wtime();
+  phase_timer_begin(PHASE_COMPUTE);
+
+  Pixel *output = alloc_pixel(img->width, img->height);
+  if (!output)
+    return ERR_MEM_ALLOC;
+
+  app_error err = fft_convolve_rows(img->data, img->width, img->height, 0,
+                                    img->height, kernel, output);
+  if (err) {
+    free_pixel(output);
+    return err;
+  }
+
+  free_pixel(img->data);
+  img->data = output;
+
+  phase_timer_end(PHASE_COMPUTE);
+  double end_time = MPI_Wtime();
+  if (elapsed_time != NULL)
+    *elapsed_time = end_time - start_time;
+
+  return SUCCESS;
+}
+
+app_error convolve_fft_distributed(Image *img, Kernel kernel,
+                                   double *elapsed_time) {
+  return convolve_distributed_strips(img, kernel, elapsed_time,
+                                     fft_convolve_rows);
+}
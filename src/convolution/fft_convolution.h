@@ -0,0 +1,65 @@
+#ifndef __FFT_CONVOLUTION_H__
+#define __FFT_CONVOLUTION_H__
+
+#include "../bmp/bmp_io.h"
+#include "../config/kernel.h"
+#include "../errors/errors.h"
+
+// Largest per-channel difference from the direct engines accepted by the
+// verification. The FFT result differs from the direct sum by floating point
+// round-off, which can move a value across an integer boundary before it is
+// truncated by cast_to_pixel_value.
+#define FFT_TOLERANCE 1
+
+/**
+ * Returns the FFT size used for the tiles of a kernel. Every tile produces
+ * (size - kernel_size + 1)^2 output pixels.
+ * @param k_size Size of the kernel
+ * @return Transform size (a power of two)
+ */
+int fft_transform_size(int k_size);
+
+/**
+ * Computes a band of output rows with FFT-based convolution (overlap-save).
+ * The output is cut into square tiles; every tile is transformed with a
+ * zero-padded power-of-two FFT of a few times the kernel size, multiplied by
+ * the kernel spectrum and transformed back, so memory stays bounded by the
+ * tile size whatever the image size. Tiles are processed in parallel with
+ * OpenMP. Source coordinates are clamped exactly as in the direct engines.
+ * Same contract as strip_function in convolution.h.
+ * @param src Source pixels (src_height rows of width pixels)
+ * @param width Image width
+ * @param src_height Number of rows in src
+ * @param first_row Source row of the first output row
+ * @param rows Number of output rows
+ * @param kernel The convolution kernel to apply
+ * @param dst Output pixels (rows rows of width pixels)
+ * @return app_error code:
+ *         - SUCCESS: Rows computed
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error fft_convolve_rows(const Pixel *src, int width, int src_height,
+                            int first_row, int rows, Kernel kernel,
+                            Pixel *dst);
+
+/**
+ * FFT convolution of a whole image with OpenMP-parallel tiles.
+ * @param img Pointer to the Image structure to modify
+ * @param kernel The convolution kernel to apply
+ * @param elapsed_time Output: elapsed time
+ * @return app_error code
+ */
+app_error convolve_fft(Image *img, Kernel kernel, double *elapsed_time);
+
+/**
+ * FFT convolution distributed over MPI_COMM_WORLD: every rank convolves its
+ * strip of rows (with halos of kernel.size / 2 rows) with fft_convolve_rows.
+ * @param img Image on rank 0 (ignored on the other ranks)
+ * @param kernel The convolution kernel to apply
+ * @param elapsed_time Output: elapsed time
+ * @return app_error code
+ */
+app_error convolve_fft_distributed(Image *img, Kernel kernel,
+                                   double *elapsed_time);
+
+#endif
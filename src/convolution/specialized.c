@@ -0,0 +1,382 @@
+#include "specialized.h"
+#include "../memory/buffer_pool.h"
+#include <math.h>
+#include <stdlib.h>
+
+// Output rows per block of the two-pass algorithms. Every block recomputes
+// the k - 1 rows of horizontal pass it shares with its neighbours.
+#define PASS_BLOCK_ROWS 32
+
+// Relative tolerance of the rank-1 check of separable kernels
+#define SEPARABLE_EPSILON 1e-9
+
+// Largest kernel handled by the unrolled variant
+#define MAX_UNROLLED_SIZE 5
+
+static inline int clamp_index(int value, int limit) {
+  return value < 0 ? 0 : (value >= limit ? limit - 1 : value);
+}
+
+app_error convolve_rows_sparse(const Pixel *src, int width, int src_height,
+                               int first_row, int rows, Kernel kernel,
+                               Pixel *dst) {
+  int k_size = kernel.size;
+  int half_k = k_size / 2;
+
+  int taps = 0;
+  for (int i = 0; i < k_size * k_size; i++)
+    if (kernel.data[i] != 0.0)
+      taps++;
+
+  int *tap_y = (int *)malloc((taps + 1) * sizeof(int));
+  int *tap_x = (int *)malloc((taps + 1) * sizeof(int));
+  double *tap_w = (double *)malloc((taps + 1) * sizeof(double));
+  if (!tap_y || !tap_x || !tap_w) {
+    free(tap_y);
+    free(tap_x);
+    free(tap_w);
+    return ERR_MEM_ALLOC;
+  }
+
+  // Same order as the direct loops, so the sums are identical
+  int t = 0;
+  for (int ky = 0; ky < k_size; ky++) {
+    for (int kx = 0; kx < k_size; kx++) {
+      double value = kernel.data[ky * k_size + kx];
+      if (value != 0.0) {
+        tap_y[t] = ky - half_k;
+        tap_x[t] = kx - half_k;
+        tap_w[t] = value;
+        t++;
+      }
+    }
+  }
+
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < rows; y++) {
+    for (int x = 0; x < width; x++) {
+      double r_acc = 0, g_acc = 0, b_acc = 0;
+      for (int i = 0; i < taps; i++) {
+        int py = clamp_index(first_row + y + tap_y[i], src_height);
+        int px = clamp_index(x + tap_x[i], width);
+        Pixel p = src[(size_t)py * width + px];
+        r_acc += p.r * tap_w[i];
+        g_acc += p.g * tap_w[i];
+        b_acc += p.b * tap_w[i];
+      }
+      clamp_pixel(&dst[(size_t)y * width + x], r_acc, g_acc, b_acc);
+    }
+  }
+
+  free(tap_y);
+  free(tap_x);
+  free(tap_w);
+  return SUCCESS;
+}
+
+// One output pixel of a K x K kernel from K source rows and K source columns.
+// Called with constant K and integer, so the compiler unrolls the loops.
+static inline Pixel unrolled_pixel(const Pixel *const *src_rows,
+                                   const int *cols, const double *weights,
+                                   const int *int_weights, const int K,
+                                   const int integer) {
+  Pixel out;
+  if (integer) {
+    int r_acc = 0, g_acc = 0, b_acc = 0;
+    for (int ky = 0; ky < K; ky++) {
+      for (int kx = 0; kx < K; kx++) {
+        Pixel p = src_rows[ky][cols[kx]];
+        int w = int_weights[ky * K + kx];
+        r_acc += p.r * w;
+        g_acc += p.g * w;
+        b_acc += p.b * w;
+      }
+    }
+    clamp_pixel(&out, r_acc, g_acc, b_acc);
+  } else {
+    double r_acc = 0, g_acc = 0, b_acc = 0;
+    for (int ky = 0; ky < K; ky++) {
+      for (int kx = 0; kx < K; kx++) {
+        Pixel p = src_rows[ky][cols[kx]];
+        double w = weights[ky * K + kx];
+        r_acc += p.r * w;
+        g_acc += p.g * w;
+        b_acc += p.b * w;
+      }
+    }
+    clamp_pixel(&out, r_acc, g_acc, b_acc);
+  }
+  return out;
+}
+
+static inline void unrolled_rows(const Pixel *src, int width, int src_height,
+                                 int first_row, int rows,
+                                 const double *weights, const int *int_weights,
+                                 Pixel *dst, const int K, const int integer) {
+  const int half = K / 2;
+
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < rows; y++) {
+    const Pixel *src_rows[MAX_UNROLLED_SIZE];
+    for (int ky = 0; ky < K; ky++)
+      src_rows[ky] = src + (size_t)clamp_index(first_row + y + ky - half,
+                                               src_height) *
+                               width;
+
+    Pixel *out_row = dst + (size_t)y * width;
+    int cols[MAX_UNROLLED_SIZE];
+    for (int x = 0; x < width; x++) {
+      // Only the first and last half columns need clamping
+      if (x >= half && x < width - half) {
+        for (int kx = 0; kx < K; kx++)
+          cols[kx] = x + kx - half;
+      } else {
+        for (int kx = 0; kx < K; kx++)
+          cols[kx] = clamp_index(x + kx - half, width);
+      }
+      out_row[x] =
+          unrolled_pixel(src_rows, cols, weights, int_weights, K, integer);
+    }
+  }
+}
+
+int is_integer_kernel(Kernel kernel) {
+  for (int i = 0; i < kernel.size * kernel.size; i++) {
+    double value = kernel.data[i];
+    if (value != floor(value) || fabs(value) > 1 << 20)
+      return 0;
+  }
+  return 1;
+}
+
+app_error convolve_rows_unrolled(const Pixel *src, int width, int src_height,
+                                 int first_row, int rows, Kernel kernel,
+                                 Pixel *dst) {
+  int k_size = kernel.size;
+  if (k_size != 3 && k_size != 5)
+    return ERR_INVALID_ARGS;
+
+  int int_weights[MAX_UNROLLED_SIZE * MAX_UNROLLED_SIZE];
+  int integer = is_integer_kernel(kernel);
+  for (int i = 0; i < k_size * k_size; i++)
+    int_weights[i] = integer ? (int)kernel.data[i] : 0;
+
+  if (k_size == 3 && integer)
+    unrolled_rows(src, width, src_height, first_row, rows, kernel.data,
+                  int_weights, dst, 3, 1);
+  else if (k_size == 3)
+    unrolled_rows(src, width, src_height, first_row, rows, kernel.data,
+                  int_weights, dst, 3, 0);
+  else if (integer)
+    unrolled_rows(src, width, src_height, first_row, rows, kernel.data,
+                  int_weights, dst, 5, 1);
+  else
+    unrolled_rows(src, width, src_height, first_row, rows, kernel.data,
+                  int_weights, dst, 5, 0);
+  return SUCCESS;
+}
+
+int factor_separable_kernel(Kernel kernel, double *col, double *row) {
+  int k_size = kernel.size;
+  const double *data = kernel.data;
+
+  // Largest tap as the pivot, for numerical stability
+  int pivot = 0;
+  for (int i = 1; i < k_size * k_size; i++)
+    if (fabs(data[i]) > fabs(data[pivot]))
+      pivot = i;
+  if (data[pivot] == 0.0)
+    return 0;
+
+  int pivot_row = pivot / k_size;
+  int pivot_col = pivot % k_size;
+  double tolerance = SEPARABLE_EPSILON * fabs(data[pivot]);
+  for (int i = 0; i < k_size; i++) {
+    for (int j = 0; j < k_size; j++) {
+      double product =
+          data[i * k_size + pivot_col] * data[pivot_row * k_size + j];
+      if (fabs(data[i * k_size + j] - product / data[pivot]) > tolerance)
+        return 0;
+    }
+  }
+
+  for (int i = 0; i < k_size; i++) {
+    if (col)
+      col[i] = data[i * k_size + pivot_col];
+    if (row)
+      row[i] = data[pivot_row * k_size + i] / data[pivot];
+  }
+  return 1;
+}
+
+app_error convolve_rows_separable(const Pixel *src, int width, int src_height,
+                                  int first_row, int rows, Kernel kernel,
+                                  Pixel *dst) {
+  int k_size = kernel.size;
+  int half_k = k_size / 2;
+
+  double *col = (double *)malloc(k_size * sizeof(double));
+  double *row = (double *)malloc(k_size * sizeof(double));
+  if (!col || !row) {
+    free(col);
+    free(row);
+    return ERR_MEM_ALLOC;
+  }
+  if (!factor_separable_kernel(kernel, col, row)) {
+    free(col);
+    free(row);
+    return ERR_INVALID_ARGS;
+  }
+
+  int blocks = (rows + PASS_BLOCK_ROWS - 1) / PASS_BLOCK_ROWS;
+  size_t row_values = (size_t)width * 3;
+  app_error err = SUCCESS;
+
+#pragma omp parallel
+  {
+    // Horizontal pass of the source rows of one block (RGB interleaved)
+    double *pass = (double *)pool_alloc((PASS_BLOCK_ROWS + k_size - 1) *
+                                        row_values * sizeof(double));
+    if (!pass) {
+#pragma omp atomic write
+      err = ERR_MEM_ALLOC;
+    }
+
+#pragma omp for schedule(static)
+    for (int block = 0; block < blocks; block++) {
+      if (!pass)
+        continue;
+      int y0 = block * PASS_BLOCK_ROWS;
+      int block_rows =
+          rows - y0 < PASS_BLOCK_ROWS ? rows - y0 : PASS_BLOCK_ROWS;
+
+      for (int i = 0; i < block_rows + k_size - 1; i++) {
+        int py = clamp_index(first_row + y0 - half_k + i, src_height);
+        const Pixel *src_row = src + (size_t)py * width;
+        double *pass_row = pass + i * row_values;
+        for (int x = 0; x < width; x++) {
+          double r_acc = 0, g_acc = 0, b_acc = 0;
+          for (int j = 0; j < k_size; j++) {
+            Pixel p = src_row[clamp_index(x + j - half_k, width)];
+            r_acc += p.r * row[j];
+            g_acc += p.g * row[j];
+            b_acc += p.b * row[j];
+          }
+          pass_row[3 * x] = r_acc;
+          pass_row[3 * x + 1] = g_acc;
+          pass_row[3 * x + 2] = b_acc;
+        }
+      }
+
+      for (int i = 0; i < block_rows; i++) {
+        Pixel *out_row = dst + (size_t)(y0 + i) * width;
+        for (int x = 0; x < width; x++) {
+          double r_acc = 0, g_acc = 0, b_acc = 0;
+          for (int j = 0; j < k_size; j++) {
+            const double *value = pass + (i + j) * row_values + 3 * x;
+            r_acc += value[0] * col[j];
+            g_acc += value[1] * col[j];
+            b_acc += value[2] * col[j];
+          }
+          clamp_pixel(&out_row[x], r_acc, g_acc, b_acc);
+        }
+      }
+    }
+
+    pool_free(pass);
+  }
+
+  free(col);
+  free(row);
+  return err;
+}
+
+app_error convolve_rows_running_sum(const Pixel *src, int width,
+                                    int src_height, int first_row, int rows,
+                                    Kernel kernel, Pixel *dst) {
+  int k_size = kernel.size;
+  int half_k = k_size / 2;
+  double scale = kernel.data[0];
+  for (int i = 1; i < k_size * k_size; i++)
+    if (kernel.data[i] != scale)
+      return ERR_INVALID_ARGS;
+
+  int blocks = (rows + PASS_BLOCK_ROWS - 1) / PASS_BLOCK_ROWS;
+  size_t row_values = (size_t)width * 3;
+  app_error err = SUCCESS;
+
+#pragma omp parallel
+  {
+    // Horizontal window sums of the source rows of one block, and the
+    // vertical window sum of the current output row
+    int *pass = (int *)pool_alloc((PASS_BLOCK_ROWS + k_size - 1) *
+                                  row_values * sizeof(int));
+    int *window = (int *)pool_alloc(row_values * sizeof(int));
+    if (!pass || !window) {
+#pragma omp atomic write
+      err = ERR_MEM_ALLOC;
+    }
+
+#pragma omp for schedule(static)
+    for (int block = 0; block < blocks; block++) {
+      if (!pass || !window)
+        continue;
+      int y0 = block * PASS_BLOCK_ROWS;
+      int block_rows =
+          rows - y0 < PASS_BLOCK_ROWS ? rows - y0 : PASS_BLOCK_ROWS;
+
+      for (int i = 0; i < block_rows + k_size - 1; i++) {
+        int py = clamp_index(first_row + y0 - half_k + i, src_height);
+        const Pixel *src_row = src + (size_t)py * width;
+        int *pass_row = pass + i * row_values;
+
+        int r_sum = 0, g_sum = 0, b_sum = 0;
+        for (int j = 0; j < k_size; j++) {
+          Pixel p = src_row[clamp_index(j - half_k, width)];
+          r_sum += p.r;
+          g_sum += p.g;
+          b_sum += p.b;
+        }
+        for (int x = 0; x < width; x++) {
+          pass_row[3 * x] = r_sum;
+          pass_row[3 * x + 1] = g_sum;
+          pass_row[3 * x + 2] = b_sum;
+
+          // Slide the window one column to the right
+          Pixel in = src_row[clamp_index(x + 1 + k_size - 1 - half_k, width)];
+          Pixel out = src_row[clamp_index(x - half_k, width)];
+          r_sum += in.r - out.r;
+          g_sum += in.g - out.g;
+          b_sum += in.b - out.b;
+        }
+      }
+
+      for (size_t v = 0; v < row_values; v++) {
+        int sum = 0;
+        for (int j = 0; j < k_size; j++)
+          sum += pass[j * row_values + v];
+        window[v] = sum;
+      }
+
+      for (int i = 0; i < block_rows; i++) {
+        Pixel *out_row = dst + (size_t)(y0 + i) * width;
+        for (int x = 0; x < width; x++)
+          clamp_pixel(&out_row[x], window[3 * x] * scale,
+                      window[3 * x + 1] * scale, window[3 * x + 2] * scale);
+
+        // Slide the window one row down
+        if (i + 1 < block_rows) {
+          const int *in = pass + (i + k_size) * row_values;
+          const int *out = pass + i * row_values;
+          for (size_t v = 0; v < row_values; v++)
+            window[v] += in[v] - out[v];
+        }
+      }
+    }
+
+    pool_free(pass);
+    pool_free(window);
+  }
+
+  return err;
+}
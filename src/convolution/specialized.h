@@ -0,0 +1,75 @@
+#ifndef __SPECIALIZED_H__
+#define __SPECIALIZED_H__
+
+#include "convolution.h"
+
+/*
+ * Specialised strip computations (see strip_function in convolution.h) that
+ * exploit properties of the kernel. All of them clamp source coordinates like
+ * the direct engines.
+ */
+
+/**
+ * Direct convolution over the non-zero taps only. Skipping zero taps does not
+ * change the sum, so the result is identical to the direct engines.
+ */
+app_error convolve_rows_sparse(const Pixel *src, int width, int src_height,
+                               int first_row, int rows, Kernel kernel,
+                               Pixel *dst);
+
+/**
+ * Returns non-zero if every tap of kernel is an integer small enough for the
+ * unrolled engine to accumulate in integers (at most 2^20 in magnitude).
+ */
+int is_integer_kernel(Kernel kernel);
+
+/**
+ * Fully unrolled 3x3 and 5x5 convolution with a branch-free interior.
+ * Integer kernels accumulate in integers. The result is identical to the
+ * direct engines.
+ * @return app_error code:
+ *         - SUCCESS: Rows computed
+ *         - ERR_INVALID_ARGS: The kernel is not 3x3 or 5x5
+ */
+app_error convolve_rows_unrolled(const Pixel *src, int width, int src_height,
+                                 int first_row, int rows, Kernel kernel,
+                                 Pixel *dst);
+
+/**
+ * Separable convolution: a horizontal and a vertical 1D pass, 2k instead of
+ * k^2 multiply-adds per pixel. Rows are processed in blocks so that the
+ * intermediate buffer stays bounded. The summation order differs from the
+ * direct engines (results within +-1 per channel).
+ * @return app_error code:
+ *         - SUCCESS: Rows computed
+ *         - ERR_INVALID_ARGS: The kernel is not separable
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error convolve_rows_separable(const Pixel *src, int width, int src_height,
+                                  int first_row, int rows, Kernel kernel,
+                                  Pixel *dst);
+
+/**
+ * Running-sum (box) convolution for kernels whose taps are all equal: window
+ * sums are updated incrementally in integers, so the cost per pixel does not
+ * depend on the kernel size. The final scaling is a single multiplication
+ * (results within +-1 per channel of the direct engines).
+ * @return app_error code:
+ *         - SUCCESS: Rows computed
+ *         - ERR_INVALID_ARGS: The taps are not all equal
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error convolve_rows_running_sum(const Pixel *src, int width,
+                                    int src_height, int first_row, int rows,
+                                    Kernel kernel, Pixel *dst);
+
+/**
+ * Factors a kernel into a column and a row vector (kernel = col * row^T).
+ * @param kernel The kernel to factor
+ * @param col Output: kernel.size values (may be NULL)
+ * @param row Output: kernel.size values (may be NULL)
+ * @return 1 if the kernel is separable, 0 otherwise
+ */
+int factor_separable_kernel(Kernel kernel, double *col, double *row);
+
+#endif
@@ -34,6 +34,10 @@ const char *get_error_string(app_error err) {
     return "OpenMP error";
   case ERR_IMAGE_DIFFERENCE:
     return "Image difference error";
+  case ERR_PERF:
+    return "Hardware performance counters unavailable";
+  case ERR_REGRESSION:
+    return "Performance regression against the baseline";
   case ERR_UNKNOWN:
     return "Unknown error";
   default:
@@ -18,6 +18,8 @@ typedef enum {
   ERR_MPI,
   ERR_OPENMP,
   ERR_IMAGE_DIFFERENCE,
+  ERR_PERF,
+  ERR_REGRESSION,
   ERR_UNKNOWN
 } app_error;
 
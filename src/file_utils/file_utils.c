@@ -2,7 +2,12 @@
 #include "../config/files.h"
 #include <errno.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <time.h>
+
+// Longest header line compared by init_benchmark_csv
+#define CSV_HEADER_LENGTH 1024
 
 app_error create_directory(const char *path) {
   if (mkdir(path, 0777) == -1) {
@@ -14,6 +19,32 @@ app_error create_directory(const char *path) {
   return SUCCESS;
 }
 
+// Whether the first line of fp is header
+static int has_header(FILE *fp, const char *header) {
+  char line[CSV_HEADER_LENGTH];
+  rewind(fp);
+  if (!fgets(line, sizeof(line), fp))
+    return 0;
+  line[strcspn(line, "\r\n")] = '\0';
+  return strcmp(line, header) == 0;
+}
+
+// Moves a CSV of another layout aside, to <filename>.<date>.old
+static app_error rotate_csv(const char *filename) {
+  char rotated[CSV_HEADER_LENGTH];
+  char stamp[32];
+  time_t now = time(NULL);
+  strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%S", localtime(&now));
+  snprintf(rotated, sizeof(rotated), "%s.%s.old", filename, stamp);
+  if (rename(filename, rotated) != 0) {
+    perror("Error moving CSV file of another layout");
+    return ERR_FILE_IO;
+  }
+  fprintf(stderr, "Warning: %s has another header, moved to %s\n", filename,
+          rotated);
+  return SUCCESS;
+}
+
 app_error init_benchmark_csv(const char *filename, const char *header) {
   FILE *fp = fopen(filename, "a+");
   if (fp == NULL) {
@@ -34,6 +65,21 @@ app_error init_benchmark_csv(const char *filename, const char *header) {
     return ERR_FILE_IO;
   }
 
+  // A file written with another layout would get rows under the wrong
+  // columns, so it is moved aside and started again
+  if (size > 0 && !has_header(fp, header)) {
+    fclose(fp);
+    app_error err = rotate_csv(filename);
+    if (err != SUCCESS)
+      return err;
+    fp = fopen(filename, "a");
+    if (fp == NULL) {
+      perror("Error opening CSV file");
+      return ERR_FILE_OPEN;
+    }
+    size = 0;
+  }
+
   // If file is empty, write csv header
   if (size == 0) {
     fprintf(fp, "%s\n", header);
@@ -43,8 +89,11 @@ app_error init_benchmark_csv(const char *filename, const char *header) {
   return SUCCESS;
 }
 
-app_error append_benchmark_result(const char *filename, int pixel_count,
+app_error append_benchmark_result(const char *filename, long long pixel_count,
                                   int kernel_size, int clusters, int threads,
+                                  int iterations,
+                                  const char *multithreaded_engine,
+                                  const char *distributed_engine,
                                   double serial_time, double multithreaded_time,
                                   double distributed_time, double shared_time,
                                   double task_pool_time) {
@@ -54,25 +103,156 @@ app_error append_benchmark_result(const char *filename, int pixel_count,
     return ERR_FILE_OPEN;
   }
 
-  fprintf(fp, "%d,%d,%d,%d,%.6f,%.6f,%.6f,%.6f,%.6f\n", pixel_count,
-          kernel_size, clusters, threads, serial_time, multithreaded_time,
-          distributed_time, shared_time, task_pool_time);
+  fprintf(fp, "%lld,%d,%d,%d,%d,%s,%s,%.6f,%.6f,%.6f,%.6f,%.6f\n",
+          pixel_count, kernel_size, clusters, threads, iterations,
+          multithreaded_engine, distributed_engine, serial_time,
+          multithreaded_time, distributed_time, shared_time, task_pool_time);
 
   fclose(fp);
   return SUCCESS;
 }
 
-app_error append_single_benchmark_result(const char *filename, int pixel_count,
+app_error append_single_benchmark_result(const char *filename,
+                                         long long pixel_count,
                                          int kernel_size, int clusters,
-                                         int threads, double time) {
+                                         int threads, int iterations,
+                                         const char *engine, double time) {
+  FILE *fp = fopen(filename, "a");
+  if (fp == NULL) {
+    perror("Error opening CSV file for appending");
+    return ERR_FILE_OPEN;
+  }
+
+  fprintf(fp, "%lld,%d,%d,%d,%d,%s,%.6f\n", pixel_count, kernel_size,
+          clusters, threads, iterations, engine, time);
+
+  fclose(fp);
+  return SUCCESS;
+}
+
+app_error append_phase_benchmark_result(const char *filename,
+                                        long long pixel_count,
+                                        int kernel_size, int clusters,
+                                        int threads, int iterations,
+                                        const char *mode, const char *engine,
+                                        const PhaseStats *stats) {
+  FILE *fp = fopen(filename, "a");
+  if (fp == NULL) {
+    perror("Error opening CSV file for appending");
+    return ERR_FILE_OPEN;
+  }
+
+  fprintf(fp, "%lld,%d,%d,%d,%d,%s,%s", pixel_count, kernel_size, clusters,
+          threads, iterations, mode, engine);
+  for (int p = 0; p < PHASE_COUNT; p++)
+    fprintf(fp, ",%.6f,%.6f,%.6f", stats->min[p], stats->max[p],
+            stats->avg[p]);
+  fprintf(fp, "\n");
+
+  fclose(fp);
+  return SUCCESS;
+}
+
+// Approximate number of bytes moved from memory per last-level cache miss
+#define CACHE_LINE_BYTES 64
+
+app_error append_counter_benchmark_result(const char *filename,
+                                          long long pixel_count,
+                                          int kernel_size, int clusters,
+                                          int threads, int iterations,
+                                          const char *mode, const char *engine,
+                                          double time,
+                                          const PerfCounts *counts) {
+  FILE *fp = fopen(filename, "a");
+  if (fp == NULL) {
+    perror("Error opening CSV file for appending");
+    return ERR_FILE_OPEN;
+  }
+
+  const long long *v = counts->values;
+  double ipc = -1, l1d_per_pixel = -1, llc_per_pixel = -1, bytes_per_pixel = -1;
+
+  if (v[COUNTER_CYCLES] > 0 && v[COUNTER_INSTRUCTIONS] >= 0)
+    ipc = (double)v[COUNTER_INSTRUCTIONS] / v[COUNTER_CYCLES];
+  if (pixel_count > 0 && v[COUNTER_L1D_MISSES] >= 0)
+    l1d_per_pixel = (double)v[COUNTER_L1D_MISSES] / pixel_count;
+  if (pixel_count > 0 && v[COUNTER_LLC_MISSES] >= 0) {
+    llc_per_pixel = (double)v[COUNTER_LLC_MISSES] / pixel_count;
+    bytes_per_pixel = llc_per_pixel * CACHE_LINE_BYTES;
+  }
+
+  fprintf(fp, "%lld,%d,%d,%d,%d,%s,%s,%.6f", pixel_count, kernel_size,
+          clusters, threads, iterations, mode, engine, time);
+  for (int c = 0; c < COUNTER_COUNT; c++)
+    fprintf(fp, ",%lld", v[c]);
+  fprintf(fp, ",%.4f,%.4f,%.4f,%.4f\n", ipc, l1d_per_pixel, llc_per_pixel,
+          bytes_per_pixel);
+
+  fclose(fp);
+  return SUCCESS;
+}
+
+app_error append_verification_result(const char *filename,
+                                     long long pixel_count, const char *kernel,
+                                     const char *file, const char *mode,
+                                     const ImageDiff *diff, int max_error_limit,
+                                     double min_psnr, int passed) {
+  FILE *fp = fopen(filename, "a");
+  if (fp == NULL) {
+    perror("Error opening CSV file for appending");
+    return ERR_FILE_OPEN;
+  }
+
+  fprintf(fp, "%lld,%s,%s,%s,%d,%d,%d,%lld,%.6f,%.3f,%d,%.3f,%s\n",
+          pixel_count, kernel, file, mode, diff->max_error[0],
+          diff->max_error[1], diff->max_error[2], diff->differing_pixels,
+          diff->mse, diff->psnr, max_error_limit, min_psnr,
+          passed ? "yes" : "no");
+
+  fclose(fp);
+  return SUCCESS;
+}
+
+app_error append_precision_result(const char *filename, long long pixel_count,
+                                  const char *kernel, const char *file,
+                                  const char *mode, double time,
+                                  long long differing_pixels, int max_error) {
+  FILE *fp = fopen(filename, "a");
+  if (fp == NULL) {
+    perror("Error opening CSV file for appending");
+    return ERR_FILE_OPEN;
+  }
+
+  fprintf(fp, "%lld,%s,%s,%s,float,%.6f,%lld,%.4f,%d\n", pixel_count, kernel,
+          file, mode, time, differing_pixels,
+          pixel_count > 0 ? 100.0 * differing_pixels / pixel_count : 0.0,
+          max_error);
+
+  fclose(fp);
+  return SUCCESS;
+}
+
+app_error append_throughput_benchmark_result(
+    const char *filename, long long pixel_count, int kernel_size, int clusters,
+    int threads, int iterations, const char *mode, const char *engine,
+    const char *algorithm, const char *precision, int numa_nodes,
+    const char *binding, double time, const MachinePeak *peak,
+    const KernelThroughput *throughput) {
   FILE *fp = fopen(filename, "a");
   if (fp == NULL) {
     perror("Error opening CSV file for appending");
     return ERR_FILE_OPEN;
   }
 
-  fprintf(fp, "%d,%d,%d,%d,%.6f\n", pixel_count, kernel_size, clusters, threads,
-          time);
+  fprintf(fp,
+          "%lld,%d,%d,%d,%d,%s,%s,%s,%s,%d,%s,%.6f,%.3f,%.3f,%.3f,%.3f,%.3f,"
+          "%.3f,%.3f,%.4f,%s\n",
+          pixel_count, kernel_size, clusters, threads, iterations, mode,
+          engine, algorithm, precision, numa_nodes, binding, time,
+          throughput->mpixels_per_sec, throughput->gflops,
+          throughput->bandwidth, throughput->intensity, peak->gflops,
+          peak->bandwidth, throughput->attainable, throughput->efficiency,
+          throughput->memory_bound ? "memory" : "compute");
 
   fclose(fp);
   return SUCCESS;
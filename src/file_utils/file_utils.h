@@ -1,15 +1,22 @@
 #ifndef __FILE_UTILS_H__
 #define __FILE_UTILS_H__
 
+#include "../bmp/image_diff.h"
 #include "../errors/errors.h"
+#include "../perf/perf_counters.h"
+#include "../roofline/roofline.h"
+#include "../timing/phase_timer.h"
 
 /**
  * Initializes the benchmark CSV file with headers if it doesn't exist.
+ * A file whose first line is not header was written with another layout; it
+ * is renamed to <filename>.<date>.old and a new file is started.
  * @param filename Name of the CSV file
+ * @param header Header line of the current layout
  * @return app_error code:
  *         - SUCCESS: File initialized successfully
  *         - ERR_FILE_OPEN: Could not open file
- *         - ERR_FILE_IO: Error seeking or telling file position
+ *         - ERR_FILE_IO: Error seeking, telling or renaming the file
  */
 app_error init_benchmark_csv(const char *filename, const char *header);
 
@@ -21,6 +28,9 @@ app_error init_benchmark_csv(const char *filename, const char *header);
  * @param kernel_size Size of the kernel
  * @param clusters Number of clusters (or processes)
  * @param threads Number of threads
+ * @param iterations Applications of the kernel timed together
+ * @param multithreaded_engine Name of the engine of the multithreaded mode
+ * @param distributed_engine Name of the engine of the distributed mode
  * @param serial_time Time taken for serial execution
  * @param multithreaded_time Time taken for multithreaded execution
  * @param distributed_time Time taken for distributed execution
@@ -29,15 +39,116 @@ app_error init_benchmark_csv(const char *filename, const char *header);
  *         - SUCCESS: Result appended successfully
  *         - ERR_FILE_OPEN: Could not open file for appending
  */
-app_error append_benchmark_result(const char *filename, int pixel_count,
+app_error append_benchmark_result(const char *filename, long long pixel_count,
                                   int kernel_size, int clusters, int threads,
+                                  int iterations,
+                                  const char *multithreaded_engine,
+                                  const char *distributed_engine,
                                   double serial_time, double multithreaded_time,
                                   double distributed_time, double shared_time,
                                   double task_pool_time);
 
-app_error append_single_benchmark_result(const char *filename, int pixel_count,
+app_error append_single_benchmark_result(const char *filename,
+                                         long long pixel_count,
                                          int kernel_size, int clusters,
-                                         int threads, double time);
+                                         int threads, int iterations,
+                                         const char *engine, double time);
+
+/**
+ * Appends a per-phase breakdown row (min/max/avg of every phase) to the CSV.
+ * @param filename Name of the CSV file
+ * @param pixel_count Number of pixels in the image
+ * @param kernel_size Size of the kernel
+ * @param clusters Number of clusters (or processes)
+ * @param threads Number of threads
+ * @param iterations Applications of the kernel timed together
+ * @param mode Name of the convolution mode
+ * @param engine Name of the engine the mode ran with
+ * @param stats Phase statistics reduced across ranks
+ * @return app_error code:
+ *         - SUCCESS: Result appended successfully
+ *         - ERR_FILE_OPEN: Could not open file for appending
+ */
+app_error append_phase_benchmark_result(const char *filename,
+                                        long long pixel_count,
+                                        int kernel_size, int clusters,
+                                        int threads, int iterations,
+                                        const char *mode, const char *engine,
+                                        const PhaseStats *stats);
+
+/**
+ * Appends a hardware counter row to the CSV.
+ * Derives IPC, misses per pixel and DRAM bytes per pixel (LLC misses times the
+ * cache line size) from the raw totals. Unavailable events are written as -1.
+ * @param filename Name of the CSV file
+ * @param pixel_count Number of pixels in the image
+ * @param kernel_size Size of the kernel
+ * @param clusters Number of clusters (or processes)
+ * @param threads Number of threads
+ * @param iterations Applications of the kernel timed together
+ * @param mode Name of the convolution mode
+ * @param engine Name of the engine the mode ran with
+ * @param time Elapsed time of the run
+ * @param counts Counter totals summed over threads and ranks
+ * @return app_error code:
+ *         - SUCCESS: Result appended successfully
+ *         - ERR_FILE_OPEN: Could not open file for appending
+ */
+app_error append_counter_benchmark_result(const char *filename,
+                                          long long pixel_count,
+                                          int kernel_size, int clusters,
+                                          int threads, int iterations,
+                                          const char *mode, const char *engine,
+                                          double time,
+                                          const PerfCounts *counts);
+
+/**
+ * Appends a throughput row (Mpixel/s, GFLOP/s, GB/s) and its position on the
+ * roofline of the resources used by the run.
+ * @param filename Name of the CSV file
+ * @param pixel_count Number of pixels in the image
+ * @param kernel_size Size of the kernel
+ * @param clusters Number of clusters (or processes)
+ * @param threads Number of threads
+ * @param iterations Applications of the kernel timed together
+ * @param mode Name of the convolution mode
+ * @param engine Name of the engine the mode ran with
+ * @param algorithm Name of the convolution algorithm used by the mode
+ * @param precision Name of the accumulator precision
+ * @param numa_nodes Number of NUMA nodes of the machine
+ * @param binding Name of the thread binding policy
+ * @param time Elapsed time of the run
+ * @param peak Peak of the resources used by the run
+ * @param throughput Throughput metrics of the run
+ * @return app_error code:
+ *         - SUCCESS: Result appended successfully
+ *         - ERR_FILE_OPEN: Could not open file for appending
+ */
+app_error append_throughput_benchmark_result(
+    const char *filename, long long pixel_count, int kernel_size, int clusters,
+    int threads, int iterations, const char *mode, const char *engine,
+    const char *algorithm, const char *precision, int numa_nodes,
+    const char *binding, double time, const MachinePeak *peak,
+    const KernelThroughput *throughput);
+
+/**
+ * Appends how far a float-accumulation run is from the double result.
+ * @param filename Name of the CSV file
+ * @param pixel_count Number of pixels in the image
+ * @param kernel Name of the kernel
+ * @param file Name of the input image
+ * @param mode Name of the convolution mode
+ * @param time Elapsed time of the float run
+ * @param differing_pixels Pixels that differ from the double result
+ * @param max_error Largest channel difference from the double result
+ * @return app_error code:
+ *         - SUCCESS: Result appended successfully
+ *         - ERR_FILE_OPEN: Could not open file for appending
+ */
+app_error append_precision_result(const char *filename, long long pixel_count,
+                                  const char *kernel, const char *file,
+                                  const char *mode, double time,
+                                  long long differing_pixels, int max_error);
 
 /**
  * Recursively creates all directories specified in the given path.
@@ -52,4 +163,25 @@ app_error append_single_benchmark_result(const char *filename, int pixel_count,
  */
 app_error create_directory(const char *path);
 
+/**
+ * Appends the error statistics of a verified output and the verdict.
+ * @param filename Name of the CSV file
+ * @param pixel_count Number of pixels in the image
+ * @param kernel Name of the kernel
+ * @param file Name of the input image
+ * @param mode Name of the convolution mode
+ * @param diff Error statistics against the serial output
+ * @param max_error_limit Largest error accepted from the mode
+ * @param min_psnr Smallest PSNR accepted from the mode
+ * @param passed Whether the output is within the limits
+ * @return app_error code:
+ *         - SUCCESS: Result appended successfully
+ *         - ERR_FILE_OPEN: Could not open file for appending
+ */
+app_error append_verification_result(const char *filename,
+                                     long long pixel_count, const char *kernel,
+                                     const char *file, const char *mode,
+                                     const ImageDiff *diff, int max_error_limit,
+                                     double min_psnr, int passed);
+
 #endif
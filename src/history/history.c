@@ -0,0 +1,567 @@
+#define _DEFAULT_SOURCE
+#include "history.h"
+#include "revision.h"
+#include <math.h>
+#include <mpi.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Fallback in case the build does not define it
+#ifndef BUILD_FLAGS
+#define BUILD_FLAGS "unknown"
+#endif
+
+#if defined(__clang__)
+#define COMPILER_NAME "clang " __clang_version__
+#elif defined(__GNUC__)
+#define COMPILER_NAME "gcc " __VERSION__
+#else
+#define COMPILER_NAME "unknown"
+#endif
+
+// Longest line of the history store
+#define HISTORY_LINE_LENGTH 4096
+
+// Length of the group fields read back from the store
+#define HISTORY_NAME_LENGTH 64
+
+// Copies the first line of src, without trailing spaces
+static void copy_line(char *dst, size_t size, const char *src) {
+  size_t len = strcspn(src, "\r\n");
+  while (len > 0 && (src[len - 1] == ' ' || src[len - 1] == '\t'))
+    len--;
+  if (len >= size)
+    len = size - 1;
+  memcpy(dst, src, len);
+  dst[len] = '\0';
+}
+
+static void read_cpu_model(char *cpu, size_t size) {
+  snprintf(cpu, size, "unknown");
+#ifdef __linux__
+  FILE *fp = fopen("/proc/cpuinfo", "r");
+  if (!fp)
+    return;
+  char line[HISTORY_LINE_LENGTH];
+  while (fgets(line, sizeof(line), fp)) {
+    if (strncmp(line, "model name", 10) == 0) {
+      const char *value = strchr(line, ':');
+      if (value) {
+        value++;
+        while (*value == ' ' || *value == '\t')
+          value++;
+        copy_line(cpu, size, value);
+      }
+      break;
+    }
+  }
+  fclose(fp);
+#endif
+}
+
+void collect_run_metadata(RunMetadata *meta, const char *label, int ranks,
+                          int threads) {
+  memset(meta, 0, sizeof(*meta));
+  meta->ranks = ranks;
+  meta->threads = threads;
+
+  time_t now = time(NULL);
+  struct tm *utc = gmtime(&now);
+  strftime(meta->date, sizeof(meta->date), "%Y-%m-%dT%H:%M:%SZ", utc);
+
+  if (gethostname(meta->host, sizeof(meta->host) - 1) != 0)
+    snprintf(meta->host, sizeof(meta->host), "unknown");
+  read_cpu_model(meta->cpu, sizeof(meta->cpu));
+  copy_line(meta->compiler, sizeof(meta->compiler), COMPILER_NAME);
+  snprintf(meta->flags, sizeof(meta->flags), "%s", BUILD_FLAGS);
+  snprintf(meta->revision, sizeof(meta->revision), "%s", GIT_REVISION);
+  snprintf(meta->label, sizeof(meta->label), "%s",
+           label ? label : meta->revision);
+
+  char version[MPI_MAX_LIBRARY_VERSION_STRING];
+  int len = 0;
+  MPI_Get_library_version(version, &len);
+  copy_line(meta->mpi, sizeof(meta->mpi), version);
+
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%Y%m%dT%H%M%SZ", utc);
+  snprintf(meta->run, sizeof(meta->run), "%s-%.200s-%ld", stamp, meta->host,
+           (long)getpid());
+}
+
+static void write_json_string(FILE *fp, const char *key, const char *value) {
+  fprintf(fp, "\"%s\":\"", key);
+  for (const unsigned char *c = (const unsigned char *)value; *c; c++) {
+    if (*c == '"' || *c == '\\')
+      fprintf(fp, "\\%c", *c);
+    else if (*c < 0x20)
+      fprintf(fp, "\\u%04x", *c);
+    else
+      fputc(*c, fp);
+  }
+  fputc('"', fp);
+}
+
+app_error append_history_record(const char *filename, const RunMetadata *meta,
+                                const HistoryRecord *record) {
+  FILE *fp = fopen(filename, "a");
+  if (fp == NULL) {
+    perror("Error opening history file for appending");
+    return ERR_FILE_OPEN;
+  }
+
+  fputc('{', fp);
+  write_json_string(fp, "run", meta->run);
+  fputc(',', fp);
+  write_json_string(fp, "label", meta->label);
+  fputc(',', fp);
+  write_json_string(fp, "date", meta->date);
+  fputc(',', fp);
+  write_json_string(fp, "host", meta->host);
+  fputc(',', fp);
+  write_json_string(fp, "cpu", meta->cpu);
+  fputc(',', fp);
+  write_json_string(fp, "compiler", meta->compiler);
+  fputc(',', fp);
+  write_json_string(fp, "flags", meta->flags);
+  fputc(',', fp);
+  write_json_string(fp, "revision", meta->revision);
+  fputc(',', fp);
+  write_json_string(fp, "mpi", meta->mpi);
+  fprintf(fp, ",\"ranks\":%d,\"threads\":%d,", meta->ranks, meta->threads);
+  write_json_string(fp, "mode", record->mode);
+  fputc(',', fp);
+  write_json_string(fp, "engine", record->engine);
+  fputc(',', fp);
+  write_json_string(fp, "algorithm", record->algorithm);
+  fputc(',', fp);
+  write_json_string(fp, "precision", record->precision);
+  fputc(',', fp);
+  write_json_string(fp, "kernel", record->kernel);
+  fputc(',', fp);
+  write_json_string(fp, "file", record->file);
+  fprintf(fp,
+          ",\"width\":%d,\"height\":%d,\"iterations\":%d,\"halo_depth\":%d,"
+          "\"numa_nodes\":%d,",
+          record->width, record->height, record->iterations,
+          record->halo_depth, record->numa_nodes);
+  write_json_string(fp, "binding", record->binding);
+  fprintf(fp, ",\"time\":%.9f}\n", record->time);
+
+  fclose(fp);
+  return SUCCESS;
+}
+
+/* Reading the store back */
+
+// Fields of a stored measurement used by the comparison
+typedef struct {
+  char run[METADATA_FIELD_LENGTH];
+  char label[METADATA_FIELD_LENGTH];
+  char revision[METADATA_FIELD_LENGTH];
+  char mode[HISTORY_NAME_LENGTH];
+  char engine[HISTORY_NAME_LENGTH];
+  char algorithm[HISTORY_NAME_LENGTH];
+  char precision[HISTORY_NAME_LENGTH];
+  char kernel[HISTORY_NAME_LENGTH];
+  int width;
+  int height;
+  int iterations;
+  int halo_depth;
+  int ranks;
+  int threads;
+  double time;
+} StoredRecord;
+
+static const char *skip_spaces(const char *p) {
+  while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    p++;
+  return p;
+}
+
+// Parses the JSON string starting at the opening quote p into out
+// (truncated to size). Returns the character after the closing quote, or
+// NULL if the string is malformed
+static const char *parse_json_string(const char *p, char *out, size_t size) {
+  if (*p != '"')
+    return NULL;
+  size_t len = 0;
+  for (p++; *p && *p != '"'; p++) {
+    char c = *p;
+    if (c == '\\') {
+      p++;
+      if (*p == 'u') {
+        // Only control characters are escaped this way by the writer
+        char hex[5] = {0};
+        for (int i = 0; i < 4; i++)
+          if (p[1 + i])
+            hex[i] = p[1 + i];
+        c = (char)strtol(hex, NULL, 16);
+        p += strlen(hex);
+      } else if (*p == 'n') {
+        c = '\n';
+      } else if (*p == 't') {
+        c = '\t';
+      } else if (*p) {
+        c = *p;
+      } else {
+        return NULL;
+      }
+    }
+    if (len + 1 < size)
+      out[len++] = c;
+  }
+  if (size > 0)
+    out[len] = '\0';
+  return *p == '"' ? p + 1 : NULL;
+}
+
+static void set_field(StoredRecord *r, const char *key, const char *text,
+                      double number) {
+  struct {
+    const char *key;
+    char *field;
+    size_t size;
+  } strings[] = {
+      {"run", r->run, sizeof(r->run)},
+      {"label", r->label, sizeof(r->label)},
+      {"revision", r->revision, sizeof(r->revision)},
+      {"mode", r->mode, sizeof(r->mode)},
+      {"engine", r->engine, sizeof(r->engine)},
+      {"algorithm", r->algorithm, sizeof(r->algorithm)},
+      {"precision", r->precision, sizeof(r->precision)},
+      {"kernel", r->kernel, sizeof(r->kernel)},
+  };
+  for (size_t i = 0; text && i < sizeof(strings) / sizeof(strings[0]); i++)
+    if (strcmp(key, strings[i].key) == 0)
+      snprintf(strings[i].field, strings[i].size, "%s", text);
+
+  if (text)
+    return;
+  if (strcmp(key, "width") == 0)
+    r->width = (int)number;
+  else if (strcmp(key, "height") == 0)
+    r->height = (int)number;
+  else if (strcmp(key, "iterations") == 0)
+    r->iterations = (int)number;
+  else if (strcmp(key, "halo_depth") == 0)
+    r->halo_depth = (int)number;
+  else if (strcmp(key, "ranks") == 0)
+    r->ranks = (int)number;
+  else if (strcmp(key, "threads") == 0)
+    r->threads = (int)number;
+  else if (strcmp(key, "time") == 0)
+    r->time = number;
+}
+
+// Parses one line of the store (a flat JSON object). Returns 1 on success
+static int parse_record(const char *line, StoredRecord *r) {
+  memset(r, 0, sizeof(*r));
+  r->time = -1.0;
+  // Records written before the iterations were stored applied every kernel
+  // once (and the halo depth did not exist yet)
+  r->iterations = 1;
+  const char *p = skip_spaces(line);
+  if (*p != '{')
+    return 0;
+  p = skip_spaces(p + 1);
+
+  char key[HISTORY_NAME_LENGTH];
+  char text[METADATA_FIELD_LENGTH];
+  while (*p && *p != '}') {
+    p = parse_json_string(p, key, sizeof(key));
+    if (!p)
+      return 0;
+    p = skip_spaces(p);
+    if (*p != ':')
+      return 0;
+    p = skip_spaces(p + 1);
+
+    if (*p == '"') {
+      p = parse_json_string(p, text, sizeof(text));
+      if (!p)
+        return 0;
+      set_field(r, key, text, 0.0);
+    } else {
+      char *end;
+      double number = strtod(p, &end);
+      if (end != p)
+        set_field(r, key, NULL, number);
+      p = end;
+      // Literals (true, false, null) are skipped
+      while (*p && *p != ',' && *p != '}')
+        p++;
+    }
+
+    p = skip_spaces(p);
+    if (*p == ',')
+      p = skip_spaces(p + 1);
+  }
+  // Records written before the engine was stored ran the default one
+  if (r->engine[0] == '\0')
+    snprintf(r->engine, sizeof(r->engine), "default");
+  return *p == '}' && r->time >= 0.0 && r->mode[0] != '\0';
+}
+
+static int matches(const StoredRecord *r, const char *selector) {
+  return strcmp(r->label, selector) == 0 ||
+         strcmp(r->revision, selector) == 0 || strcmp(r->run, selector) == 0;
+}
+
+// Running sums of the times of one side of a group
+typedef struct {
+  int n;
+  double sum;
+  double sum_sq;
+} Sample;
+
+typedef struct {
+  StoredRecord key; // Group fields (mode to threads)
+  Sample side[2];   // Baseline, candidate
+} CompareGroup;
+
+static int same_group(const StoredRecord *a, const StoredRecord *b) {
+  return strcmp(a->mode, b->mode) == 0 &&
+         strcmp(a->engine, b->engine) == 0 &&
+         strcmp(a->algorithm, b->algorithm) == 0 &&
+         strcmp(a->precision, b->precision) == 0 &&
+         strcmp(a->kernel, b->kernel) == 0 && a->width == b->width &&
+         a->height == b->height && a->iterations == b->iterations &&
+         a->halo_depth == b->halo_depth && a->ranks == b->ranks &&
+         a->threads == b->threads;
+}
+
+static double sample_mean(const Sample *s) { return s->sum / s->n; }
+
+static double sample_variance(const Sample *s) {
+  double mean = sample_mean(s);
+  double var = (s->sum_sq - s->n * mean * mean) / (s->n - 1);
+  return var > 0.0 ? var : 0.0;
+}
+
+// Continued fraction of the regularized incomplete beta function
+static double beta_fraction(double a, double b, double x) {
+  const double tiny = 1e-300;
+  double c = 1.0;
+  double d = 1.0 - (a + b) * x / (a + 1.0);
+  d = 1.0 / (fabs(d) < tiny ? tiny : d);
+  double h = d;
+  for (int m = 1; m <= 200; m++) {
+    double m2 = 2.0 * m;
+    double aa = m * (b - m) * x / ((a + m2 - 1.0) * (a + m2));
+    d = 1.0 + aa * d;
+    d = 1.0 / (fabs(d) < tiny ? tiny : d);
+    c = 1.0 + aa / c;
+    c = fabs(c) < tiny ? tiny : c;
+    h *= d * c;
+    aa = -(a + m) * (a + b + m) * x / ((a + m2) * (a + m2 + 1.0));
+    d = 1.0 + aa * d;
+    d = 1.0 / (fabs(d) < tiny ? tiny : d);
+    c = 1.0 + aa / c;
+    c = fabs(c) < tiny ? tiny : c;
+    double delta = d * c;
+    h *= delta;
+    if (fabs(delta - 1.0) < 1e-12)
+      break;
+  }
+  return h;
+}
+
+// Regularized incomplete beta function I_x(a, b)
+static double incomplete_beta(double a, double b, double x) {
+  if (x <= 0.0)
+    return 0.0;
+  if (x >= 1.0)
+    return 1.0;
+  double front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) +
+                     b * log(1.0 - x));
+  if (x < (a + 1.0) / (a + b + 2.0))
+    return front * beta_fraction(a, b, x) / a;
+  return 1.0 - front * beta_fraction(b, a, 1.0 - x) / b;
+}
+
+// P(T > t) for Student's t distribution with df degrees of freedom
+static double student_upper_tail(double t, double df) {
+  double tail = 0.5 * incomplete_beta(0.5 * df, 0.5, df / (df + t * t));
+  return t > 0.0 ? tail : 1.0 - tail;
+}
+
+// Welch's t-test of candidate slower than baseline. Returns the one-sided
+// p-value and the statistic and degrees of freedom
+static double welch_test(const Sample *baseline, const Sample *candidate,
+                         double *t, double *df) {
+  double vb = sample_variance(baseline) / baseline->n;
+  double vc = sample_variance(candidate) / candidate->n;
+  double diff = sample_mean(candidate) - sample_mean(baseline);
+  double se2 = vb + vc;
+  if (se2 <= 0.0) {
+    *t = diff > 0.0 ? INFINITY : (diff < 0.0 ? -INFINITY : 0.0);
+    *df = baseline->n + candidate->n - 2;
+    return diff > 0.0 ? 0.0 : (diff < 0.0 ? 1.0 : 0.5);
+  }
+  *t = diff / sqrt(se2);
+  *df = se2 * se2 / (vb * vb / (baseline->n - 1) +
+                     vc * vc / (candidate->n - 1));
+  return student_upper_tail(*t, *df);
+}
+
+// Label of the last measurement of the store
+static app_error find_last_label(FILE *fp, char *label, size_t size) {
+  char line[HISTORY_LINE_LENGTH];
+  StoredRecord r;
+  label[0] = '\0';
+  while (fgets(line, sizeof(line), fp))
+    if (parse_record(line, &r))
+      snprintf(label, size, "%s", r.label);
+  rewind(fp);
+  return label[0] ? SUCCESS : ERR_INVALID_ARGS;
+}
+
+static app_error load_groups(FILE *fp, const char *baseline,
+                             const char *candidate, CompareGroup **groups,
+                             int *num_groups) {
+  char line[HISTORY_LINE_LENGTH];
+  int capacity = 0;
+  *groups = NULL;
+  *num_groups = 0;
+
+  StoredRecord r;
+  while (fgets(line, sizeof(line), fp)) {
+    if (!parse_record(line, &r))
+      continue;
+    int side = matches(&r, baseline) ? 0 : (matches(&r, candidate) ? 1 : -1);
+    if (side < 0)
+      continue;
+
+    int g = 0;
+    while (g < *num_groups && !same_group(&(*groups)[g].key, &r))
+      g++;
+    if (g == *num_groups) {
+      if (*num_groups == capacity) {
+        capacity = capacity ? 2 * capacity : 16;
+        CompareGroup *grown = (CompareGroup *)realloc(
+            *groups, capacity * sizeof(CompareGroup));
+        if (!grown)
+          return ERR_MEM_ALLOC;
+        *groups = grown;
+      }
+      memset(&(*groups)[g], 0, sizeof(CompareGroup));
+      (*groups)[g].key = r;
+      (*num_groups)++;
+    }
+
+    Sample *s = &(*groups)[g].side[side];
+    s->n++;
+    s->sum += r.time;
+    s->sum_sq += r.time * r.time;
+  }
+  return SUCCESS;
+}
+
+app_error compare_history(const char *filename, const char *baseline,
+                          const char *candidate, FILE *out, int *regressions) {
+  *regressions = 0;
+  FILE *fp = fopen(filename, "r");
+  if (!fp) {
+    fprintf(stderr, "Error: Could not open history %s\n", filename);
+    return ERR_FILE_OPEN;
+  }
+
+  char last_label[METADATA_FIELD_LENGTH];
+  if (!candidate) {
+    if (find_last_label(fp, last_label, sizeof(last_label)) != SUCCESS) {
+      fclose(fp);
+      fprintf(stderr, "Error: History %s is empty\n", filename);
+      return ERR_INVALID_ARGS;
+    }
+    candidate = last_label;
+  }
+  if (strcmp(baseline, candidate) == 0) {
+    fclose(fp);
+    fprintf(stderr, "Error: Baseline and candidate are both %s\n", baseline);
+    return ERR_INVALID_ARGS;
+  }
+
+  CompareGroup *groups;
+  int num_groups;
+  app_error err = load_groups(fp, baseline, candidate, &groups, &num_groups);
+  fclose(fp);
+  if (err != SUCCESS) {
+    free(groups);
+    return err;
+  }
+
+  int found[2] = {0, 0};
+  for (int g = 0; g < num_groups; g++)
+    for (int s = 0; s < 2; s++)
+      found[s] += groups[g].side[s].n;
+  if (!found[0] || !found[1]) {
+    fprintf(stderr, "Error: No measurement matches %s\n",
+            found[0] ? candidate : baseline);
+    free(groups);
+    return ERR_INVALID_ARGS;
+  }
+
+  fprintf(out, "Comparing %s (%d measurements) against baseline %s (%d)\n",
+          candidate, found[1], baseline, found[0]);
+  fprintf(out,
+          "\t%-16s %-10s %-12s %-7s %-12s %5s %5s %-7s %18s %18s %8s %8s  "
+          "%s\n",
+          "Mode", "Engine", "Kernel", "Prec.", "Size", "Iter.", "Depth", "RxT",
+          "Baseline (n)", "Candidate (n)", "Change", "p", "Verdict");
+
+  int compared = 0, unmatched = 0;
+  for (int g = 0; g < num_groups; g++) {
+    const CompareGroup *group = &groups[g];
+    const Sample *b = &group->side[0];
+    const Sample *c = &group->side[1];
+    if (!b->n || !c->n) {
+      unmatched++;
+      continue;
+    }
+    compared++;
+
+    double change = sample_mean(c) / sample_mean(b) - 1.0;
+    const char *verdict = "too few runs";
+    double p = NAN;
+    if (b->n >= 2 && c->n >= 2) {
+      double t, df;
+      p = welch_test(b, c, &t, &df);
+      if (p < COMPARE_ALPHA && change >= COMPARE_MIN_CHANGE) {
+        verdict = "REGRESSION";
+        (*regressions)++;
+      } else if (1.0 - p < COMPARE_ALPHA && change <= -COMPARE_MIN_CHANGE) {
+        verdict = "faster";
+      } else {
+        verdict = "unchanged";
+      }
+    }
+
+    char size[32], config[16];
+    snprintf(size, sizeof(size), "%dx%d", group->key.width,
+             group->key.height);
+    snprintf(config, sizeof(config), "%dx%d", group->key.ranks,
+             group->key.threads);
+    fprintf(out,
+            "\t%-16s %-10s %-12s %-7s %-12s %5d %5d %-7s %12.6f (%3d) %12.6f "
+            "(%3d) %+7.1f%% ",
+            group->key.mode, group->key.engine, group->key.kernel,
+            group->key.precision, size, group->key.iterations,
+            group->key.halo_depth, config, sample_mean(b), b->n,
+            sample_mean(c), c->n, 100.0 * change);
+    if (isnan(p))
+      fprintf(out, "%8s  %s\n", "-", verdict);
+    else
+      fprintf(out, "%8.4f  %s\n", p, verdict);
+  }
+
+  fprintf(out, "%d group(s) compared, %d regression(s)", compared,
+          *regressions);
+  if (unmatched)
+    fprintf(out, ", %d group(s) measured on one side only", unmatched);
+  fprintf(out, "\n");
+  free(groups);
+  return SUCCESS;
+}
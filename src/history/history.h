@@ -0,0 +1,101 @@
+#ifndef __HISTORY_H__
+#define __HISTORY_H__
+
+#include "../errors/errors.h"
+#include <stdio.h>
+
+// Length of the text fields of the run metadata
+#define METADATA_FIELD_LENGTH 256
+
+// Largest one-sided p-value of a slowdown reported as significant
+#define COMPARE_ALPHA 0.05
+
+// Smallest relative slowdown reported as a regression, so that tiny but
+// consistent differences of long series are not flagged
+#define COMPARE_MIN_CHANGE 0.02
+
+/**
+ * Environment of a benchmark run, recorded with every result so that runs of
+ * different machines, builds and revisions can be told apart.
+ */
+typedef struct {
+  char run[METADATA_FIELD_LENGTH];      // Unique id: start time and host
+  char label[METADATA_FIELD_LENGTH];    // -label, or the revision
+  char date[METADATA_FIELD_LENGTH];     // ISO 8601, UTC
+  char host[METADATA_FIELD_LENGTH];
+  char cpu[METADATA_FIELD_LENGTH];      // Model name (Linux), else "unknown"
+  char compiler[METADATA_FIELD_LENGTH];
+  char flags[METADATA_FIELD_LENGTH];    // Build options given by meson
+  char revision[METADATA_FIELD_LENGTH]; // Git revision at build time
+  char mpi[METADATA_FIELD_LENGTH];      // MPI library version
+  int ranks;
+  int threads;
+} RunMetadata;
+
+/**
+ * One measurement of a run: a mode applying a kernel to an image.
+ */
+typedef struct {
+  const char *mode;
+  const char *engine; // Variant of the mode's engine, or "default"
+  const char *algorithm;
+  const char *precision;
+  const char *kernel;
+  const char *file;
+  int width;
+  int height;
+  int iterations; // Applications of the kernel timed together
+  int halo_depth; // Kernels between two halo exchanges (-halo_depth)
+  int numa_nodes;
+  const char *binding;
+  double time;
+} HistoryRecord;
+
+/**
+ * Fills the metadata of the current run. Rank-local, called on rank 0.
+ * @param meta Output metadata
+ * @param label Label of the run (NULL: the revision)
+ * @param ranks Number of MPI ranks
+ * @param threads OpenMP threads per rank
+ */
+void collect_run_metadata(RunMetadata *meta, const char *label, int ranks,
+                          int threads);
+
+/**
+ * Appends one measurement and the metadata of its run as a line of JSON to
+ * the history store (JSON lines, one object per measurement).
+ * @param filename Path of the store
+ * @param meta Metadata of the run
+ * @param record The measurement
+ * @return app_error code:
+ *         - SUCCESS: Record appended
+ *         - ERR_FILE_OPEN: Could not open the store
+ */
+app_error append_history_record(const char *filename, const RunMetadata *meta,
+                                const HistoryRecord *record);
+
+/**
+ * Compares the measurements of two sets of runs of the history store. A
+ * selector matches the runs whose label, revision or run id equals it. The
+ * measurements are grouped by mode, engine, algorithm, precision, kernel,
+ * image size, iterations, halo depth, ranks and threads; within every group
+ * present in both sets the mean times are compared with Welch's t-test, and
+ * a group is flagged as a regression when the candidate is slower by at
+ * least COMPARE_MIN_CHANGE with a one-sided p-value below COMPARE_ALPHA.
+ * Groups need two measurements on each side to be tested.
+ * @param filename Path of the store
+ * @param baseline Selector of the baseline runs
+ * @param candidate Selector of the candidate runs (NULL: the label of the
+ * last record of the store)
+ * @param fp Stream the comparison is printed to
+ * @param regressions Output: number of groups flagged
+ * @return app_error code:
+ *         - SUCCESS: Comparison printed
+ *         - ERR_FILE_OPEN: Could not open the store
+ *         - ERR_INVALID_ARGS: A selector matches no measurement
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error compare_history(const char *filename, const char *baseline,
+                          const char *candidate, FILE *fp, int *regressions);
+
+#endif
@@ -1,6 +1,22 @@
 
 #include "benchmark/benchmark_io.h"
 #include "benchmark/benchmark_run.h"
+#include "config/files.h"
+#include "convolution/convolution.h"
+#include "history/history.h"
+#include "memory/buffer_pool.h"
+#include "memory/numa.h"
+#include "overlap/overlap.h"
+#include "perf/perf_counters.h"
+#include "roofline/roofline.h"
+#include "stream/stream.h"
+#include "sweep/sweep.h"
+#include "taskgraph/taskgraph.h"
+#include "temporal/temporal.h"
+#include "transform/batch.h"
+#include "transform/transform.h"
+#include "tune/tune.h"
+#include "workpool/work_pool.h"
 #include <limits.h>
 #include <mpi.h>
 #include <omp.h>
@@ -9,8 +25,7 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define DEFAULT_THREAD_COUNT 1
-#define DEFAULT_THREAD_COUNT 1
+#define DEFAULT_SEED 1
 
 void print_usage(const char *prog_name) {
   printf("Usage: %s [options]\n", prog_name);
@@ -23,8 +38,89 @@ void print_usage(const char *prog_name) {
   printf("  -h      Run Parallel Shared Filesystem benchmark\n");
   printf("  -p      Run Parallel Task Pool benchmark\n");
   printf("  -a      Run All benchmarks\n");
+  printf("  -fft    Run FFT convolution benchmark (not part of -all)\n");
+  printf("  -fft_distributed  Run distributed FFT convolution benchmark (not "
+         "part of -all)\n");
+  printf("  -planned  Run the planned benchmark: the fastest algorithm per "
+         "kernel and image (not part of -all)\n");
+  printf("  -recalibrate  Re-measure the planner calibration instead of "
+         "using the cache\n");
   printf(
       "  -verify Verify the output images against the serial implementation\n");
+  printf("  -diff   Verify with error statistics (max error, differing "
+         "pixels, histogram, PSNR) against per-engine limits\n");
+  printf("  -diff_map  -diff and save a heat map of every output that "
+         "differs\n");
+  printf("  -input <src>     Input images: directory, glob, .bmp file or "
+         "manifest (default: images/base)\n");
+  printf("  -kernels <list>  Comma-separated kernels to run (default: all)\n");
+  printf("  -generate <WxH,...>  Generate synthetic inputs of these sizes "
+         "(without a mode flag, only generates them)\n");
+  printf("  -seed <n>        Seed of the synthetic inputs (default: %d)\n",
+         DEFAULT_SEED);
+  printf("  -perf   Collect hardware performance counters (Linux only)\n");
+  printf("  -bind <none|close|spread>  Pin the OpenMP threads of every rank "
+         "to its CPUs (default: none)\n");
+  printf("  -float  Accumulate in float instead of double in the serial, "
+         "multithreaded, distributed and task pool engines, and count the "
+         "pixels that differ from double\n");
+  printf("  -hugepages  Back the large image buffers with transparent huge "
+         "pages (Linux only)\n");
+  printf("  -stream  Distributed mode: rank 0 reads every input in bands "
+         "and sends each band to its ranks while reading the next, and "
+         "writes the output piece by piece as the strips arrive\n");
+  printf("  -band_rows <n>  Rows per band of -stream (default: %d)\n",
+         DEFAULT_STREAM_BAND_ROWS);
+  printf("  -taskgraph  Multithreaded mode and -batch: run the tiles of every "
+         "kernel, chain stage and image as one OpenMP task graph\n");
+  printf("  -overlap  Distributed mode: one thread per rank exchanges the "
+         "halos and returns the results while the others compute\n");
+  printf("  -tile_rows <n>  Rows per tile of -taskgraph and -overlap (default: "
+         "%d)\n",
+         DEFAULT_TASKGRAPH_TILE_ROWS);
+  printf("  -chunk_rows <n>  Rows per chunk claimed from the -task_pool work "
+         "pool (default: %d)\n",
+         DEFAULT_WORK_POOL_CHUNK_ROWS);
+  printf("  -iterations <n>  Apply every kernel (or -transform chain) n times "
+         "in a row (default: %d)\n",
+         DEFAULT_KERNEL_ITERATIONS);
+  printf("  -halo_depth <n>  Distributed mode: kernels applied between two "
+         "halo exchanges of an iterated kernel or chain (default: all)\n");
+  printf("  -transform <ops> <input> <output>  Apply a kernel or a chain "
+         "(comma-separated) to one file with one mode flag (default: -d) and "
+         "exit\n");
+  printf("  -batch <ops> <src> <dir>  Apply a kernel or a chain to every "
+         "image of a source into dir with a read/compute/write pipeline "
+         "(default mode: -m)\n");
+  printf("  -queue_depth <n>  Images buffered between two -batch stages "
+         "(default: %d)\n",
+         DEFAULT_BATCH_QUEUE_DEPTH);
+  printf("  -sweep <strong|weak|both>  Strong- and/or weak-scaling sweep of "
+         "the distributed engine over 1, 2, 4, ... ranks and the thread "
+         "counts, with efficiency, Karp-Flatt and Amdahl/Gustafson fits, and "
+         "exit\n");
+  printf("  -sweep_size <WxH>  Image of the strong series, and of one rank "
+         "with one thread in the weak series (default: %s)\n",
+         DEFAULT_SWEEP_SIZE);
+  printf("  -sweep_threads <list>  Thread counts of the sweep (default: "
+         "powers of two up to -threads)\n");
+  printf("  -sweep_reps <n>  Timed runs per sweep or tuning configuration "
+         "(default: %d)\n",
+         DEFAULT_SWEEP_REPETITIONS);
+  printf("  -autotune  Time the distributed engine with every split of the "
+         "cores of a node between ranks and threads, print and record the "
+         "fastest split per image-size class, and exit\n");
+  printf("  -autotune_sizes <WxH,...>  Representative images of the classes "
+         "of -autotune (default: %s)\n",
+         DEFAULT_TUNE_SIZES);
+  printf("  -autotune_cores <n>  Cores per node split by -autotune (default: "
+         "the detected physical cores)\n");
+  printf("  -label <name>  Label of the run in data/chronos/runs.jsonl "
+         "(default: the git revision)\n");
+  printf("  -compare <baseline>  Compare the runs of a label, revision or run "
+         "id of the history with Welch's t-test and exit\n");
+  printf("  -candidate <selector>  Runs compared with -compare (default: the "
+         "label of the last run)\n");
   printf("  --help  Show this help message\n");
   printf("\nIf no mode flags are provided, Distributed mode (-d) is run by "
          "default.\n");
@@ -32,12 +128,49 @@ void print_usage(const char *prog_name) {
 
 void parse_args(int argc, char **argv, BenchmarkConfig *config) {
   config->omp_threads = DEFAULT_THREAD_COUNT;
+  config->input_source = NULL;
+  config->kernel_list = NULL;
+  config->generate_sizes = NULL;
+  config->seed = DEFAULT_SEED;
+  config->transform_operations = NULL;
+  config->transform_input = NULL;
+  config->transform_output = NULL;
+  config->queue_depth = DEFAULT_BATCH_QUEUE_DEPTH;
+  config->sweep_series = 0;
+  config->sweep_size = DEFAULT_SWEEP_SIZE;
+  config->sweep_threads = NULL;
+  config->sweep_repetitions = DEFAULT_SWEEP_REPETITIONS;
+  config->tune_sizes = DEFAULT_TUNE_SIZES;
+  config->tune_cores = 0;
+  config->run_label = NULL;
+  config->compare_baseline = NULL;
+  config->compare_candidate = NULL;
+  config->band_rows = DEFAULT_STREAM_BAND_ROWS;
+  config->tile_rows = DEFAULT_TASKGRAPH_TILE_ROWS;
+  config->chunk_rows = DEFAULT_WORK_POOL_CHUNK_ROWS;
+  config->iterations = DEFAULT_KERNEL_ITERATIONS;
+  config->halo_depth = DEFAULT_HALO_DEPTH;
+  config->bind = BIND_NONE;
+  config->batch = 0;
   config->run_serial = 0;
   config->run_multithreaded = 0;
   config->run_distributed = 0;
   config->run_shared = 0;
   config->run_task_pool = 0;
+  config->run_fft = 0;
+  config->run_fft_distributed = 0;
+  config->run_planned = 0;
+  config->recalibrate = 0;
   config->verify = 0;
+  config->diff_report = 0;
+  config->diff_map = 0;
+  config->perf_counters = 0;
+  config->huge_pages = 0;
+  config->float_accumulation = 0;
+  config->stream = 0;
+  config->tune = 0;
+  config->taskgraph = 0;
+  config->overlap = 0;
 
   bool flags_set = false;
 
@@ -47,6 +180,49 @@ void parse_args(int argc, char **argv, BenchmarkConfig *config) {
       exit(0);
     } else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
       config->omp_threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-input") == 0 && i + 1 < argc) {
+      config->input_source = argv[++i];
+    } else if (strcmp(argv[i], "-kernels") == 0 && i + 1 < argc) {
+      config->kernel_list = argv[++i];
+    } else if (strcmp(argv[i], "-generate") == 0 && i + 1 < argc) {
+      config->generate_sizes = argv[++i];
+    } else if (strcmp(argv[i], "-seed") == 0 && i + 1 < argc) {
+      config->seed = strtoull(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "-transform") == 0 && i + 3 < argc) {
+      config->transform_operations = argv[++i];
+      config->transform_input = argv[++i];
+      config->transform_output = argv[++i];
+    } else if (strcmp(argv[i], "-batch") == 0 && i + 3 < argc) {
+      config->transform_operations = argv[++i];
+      config->transform_input = argv[++i];
+      config->transform_output = argv[++i];
+      config->batch = 1;
+    } else if (strcmp(argv[i], "-queue_depth") == 0 && i + 1 < argc) {
+      config->queue_depth = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-sweep") == 0 && i + 1 < argc) {
+      if (parse_sweep_series(argv[++i], &config->sweep_series) != SUCCESS) {
+        fprintf(stderr, "Unknown sweep series: %s\n", argv[i]);
+        print_usage(argv[0]);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "-sweep_size") == 0 && i + 1 < argc) {
+      config->sweep_size = argv[++i];
+    } else if (strcmp(argv[i], "-sweep_threads") == 0 && i + 1 < argc) {
+      config->sweep_threads = argv[++i];
+    } else if (strcmp(argv[i], "-sweep_reps") == 0 && i + 1 < argc) {
+      config->sweep_repetitions = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-autotune") == 0) {
+      config->tune = 1;
+    } else if (strcmp(argv[i], "-autotune_sizes") == 0 && i + 1 < argc) {
+      config->tune_sizes = argv[++i];
+    } else if (strcmp(argv[i], "-autotune_cores") == 0 && i + 1 < argc) {
+      config->tune_cores = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-label") == 0 && i + 1 < argc) {
+      config->run_label = argv[++i];
+    } else if (strcmp(argv[i], "-compare") == 0 && i + 1 < argc) {
+      config->compare_baseline = argv[++i];
+    } else if (strcmp(argv[i], "-candidate") == 0 && i + 1 < argc) {
+      config->compare_candidate = argv[++i];
     } else if (strcmp(argv[i], "-serial") == 0) {
       config->run_serial = 1;
       flags_set = true;
@@ -62,6 +238,43 @@ void parse_args(int argc, char **argv, BenchmarkConfig *config) {
     } else if (strcmp(argv[i], "-task_pool") == 0) {
       config->run_task_pool = 1;
       flags_set = true;
+    } else if (strcmp(argv[i], "-fft") == 0) {
+      config->run_fft = 1;
+      flags_set = true;
+    } else if (strcmp(argv[i], "-fft_distributed") == 0) {
+      config->run_fft_distributed = 1;
+      flags_set = true;
+    } else if (strcmp(argv[i], "-planned") == 0) {
+      config->run_planned = 1;
+      flags_set = true;
+    } else if (strcmp(argv[i], "-recalibrate") == 0) {
+      config->recalibrate = 1;
+    } else if (strcmp(argv[i], "-bind") == 0 && i + 1 < argc) {
+      if (parse_bind_policy(argv[++i], &config->bind) != SUCCESS) {
+        fprintf(stderr, "Unknown binding policy: %s\n", argv[i]);
+        print_usage(argv[0]);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "-float") == 0) {
+      config->float_accumulation = 1;
+    } else if (strcmp(argv[i], "-hugepages") == 0) {
+      config->huge_pages = 1;
+    } else if (strcmp(argv[i], "-stream") == 0) {
+      config->stream = 1;
+    } else if (strcmp(argv[i], "-band_rows") == 0 && i + 1 < argc) {
+      config->band_rows = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-taskgraph") == 0) {
+      config->taskgraph = 1;
+    } else if (strcmp(argv[i], "-overlap") == 0) {
+      config->overlap = 1;
+    } else if (strcmp(argv[i], "-tile_rows") == 0 && i + 1 < argc) {
+      config->tile_rows = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-chunk_rows") == 0 && i + 1 < argc) {
+      config->chunk_rows = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-iterations") == 0 && i + 1 < argc) {
+      config->iterations = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-halo_depth") == 0 && i + 1 < argc) {
+      config->halo_depth = atoi(argv[++i]);
     } else if (strcmp(argv[i], "-all") == 0) {
       config->run_serial = 1;
       config->run_multithreaded = 1;
@@ -71,6 +284,15 @@ void parse_args(int argc, char **argv, BenchmarkConfig *config) {
       flags_set = true;
     } else if (strcmp(argv[i], "-verify") == 0) {
       config->verify = 1;
+    } else if (strcmp(argv[i], "-diff") == 0) {
+      config->verify = 1;
+      config->diff_report = 1;
+    } else if (strcmp(argv[i], "-diff_map") == 0) {
+      config->verify = 1;
+      config->diff_report = 1;
+      config->diff_map = 1;
+    } else if (strcmp(argv[i], "-perf") == 0) {
+      config->perf_counters = 1;
     } else {
       fprintf(stderr, "Unknown argument: %s\n", argv[i]);
       print_usage(argv[0]);
@@ -78,8 +300,10 @@ void parse_args(int argc, char **argv, BenchmarkConfig *config) {
     }
   }
 
-  // exit if no flags set
-  if (!flags_set) {
+  // exit if no flags set (generating inputs, transforming, sweeping, tuning
+  // or comparing alone is allowed)
+  if (!flags_set && !config->generate_sizes && !config->transform_operations &&
+      !config->sweep_series && !config->tune && !config->compare_baseline) {
     print_usage(argv[0]);
     exit(1);
   }
@@ -87,13 +311,46 @@ void parse_args(int argc, char **argv, BenchmarkConfig *config) {
 
 void init_mpi(int argc, char **argv, int *comm_rank, int *comm_size,
               BenchmarkConfig *config) {
-  MPI_Init(&argc, &argv);
+  // Only the master thread of a team calls MPI (see -overlap)
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
   MPI_Comm_rank(MPI_COMM_WORLD, comm_rank);
   MPI_Comm_size(MPI_COMM_WORLD, comm_size);
 
   parse_args(argc, argv, config);
+  if (config->overlap && provided < MPI_THREAD_FUNNELED && *comm_rank == 0)
+    fprintf(stderr, "Warning: MPI provides no thread support, -overlap runs "
+                    "the blocking distributed engine\n");
 
   omp_set_num_threads(config->omp_threads);
+  pool_set_huge_pages(config->huge_pages);
+  pool_set_first_touch(config->omp_threads);
+  set_accumulation_precision(config->float_accumulation ? PRECISION_FLOAT
+                                                        : PRECISION_DOUBLE);
+  set_work_pool_chunk_rows(config->chunk_rows);
+  set_overlap_tile_rows(config->tile_rows);
+  set_kernel_iterations(config->iterations);
+  set_halo_depth(config->halo_depth);
+
+  // Pin the threads before the first buffer is touched
+  numa_init();
+  if (numa_bind_threads(config->bind) != SUCCESS) {
+    if (*comm_rank == 0)
+      fprintf(stderr, "Warning: could not bind the threads, continuing with "
+                      "-bind none\n");
+    numa_unbind_thread();
+    config->bind = BIND_NONE;
+  }
+
+  if (config->perf_counters) {
+    app_error err = perf_counters_init();
+    if (err != SUCCESS) {
+      if (*comm_rank == 0)
+        fprintf(stderr, "Warning: %s, continuing without -perf\n",
+                get_error_string(err));
+      config->perf_counters = 0;
+    }
+  }
 }
 
 app_error run_benchmarks(BenchmarkConfig config) {
@@ -112,7 +369,7 @@ app_error run_benchmarks(BenchmarkConfig config) {
   }
 
   if (config.run_multithreaded) {
-    err = run_benchmark_parallel_multithreaded();
+    err = run_benchmark_parallel_multithreaded(config);
     if (err != SUCCESS) {
       if (comm_rank == 0)
         fprintf(stderr,
@@ -123,7 +380,7 @@ app_error run_benchmarks(BenchmarkConfig config) {
   }
 
   if (config.run_distributed) {
-    err = run_benchmark_parallel_distributed_fs();
+    err = run_benchmark_parallel_distributed_fs(config);
     if (err != SUCCESS) {
       if (comm_rank == 0)
         fprintf(stderr,
@@ -146,6 +403,7 @@ app_error run_benchmarks(BenchmarkConfig config) {
       return err;
     }
   }
+  */
 
   if (config.run_task_pool) {
     err = run_benchmark_task_pool();
@@ -157,11 +415,47 @@ app_error run_benchmarks(BenchmarkConfig config) {
       return err;
     }
   }
-  */
+
+  if (config.run_fft) {
+    err = run_benchmark_fft();
+    if (err != SUCCESS) {
+      if (comm_rank == 0)
+        fprintf(stderr, "Parallel benchmark (FFT) failed with error: %s\n",
+                get_error_string(err));
+      return err;
+    }
+  }
+
+  if (config.run_fft_distributed) {
+    err = run_benchmark_fft_distributed();
+    if (err != SUCCESS) {
+      if (comm_rank == 0)
+        fprintf(stderr,
+                "Parallel benchmark (Distributed FFT) failed with error: %s\n",
+                get_error_string(err));
+      return err;
+    }
+  }
+
+  if (config.run_planned) {
+    err = run_benchmark_planned(config);
+    if (err != SUCCESS) {
+      if (comm_rank == 0)
+        fprintf(stderr, "Parallel benchmark (Planned) failed with error: %s\n",
+                get_error_string(err));
+      return err;
+    }
+  }
 
   return err;
 }
 
+bool any_mode_selected(BenchmarkConfig config) {
+  return config.run_serial || config.run_multithreaded ||
+         config.run_distributed || config.run_shared || config.run_task_pool ||
+         config.run_fft || config.run_fft_distributed || config.run_planned;
+}
+
 void print_mode(BenchmarkConfig config, int comm_size) {
   if (comm_size == 0) {
     printf("Running with %d MPI processes and %d OpenMP threads per process\n",
@@ -176,7 +470,134 @@ void print_mode(BenchmarkConfig config, int comm_size) {
       printf("Mode: Parallel Shared Filesystem\n");
     if (config.run_task_pool)
       printf("Mode: Parallel Task Pool\n");
+    if (config.run_fft)
+      printf("Mode: Parallel FFT\n");
+    if (config.run_fft_distributed)
+      printf("Mode: Parallel Distributed FFT\n");
+    if (config.run_planned)
+      printf("Mode: Parallel Planned\n");
+  }
+}
+
+// Mode of -transform and -batch: the single mode flag given, or the default
+int get_transform_mode(BenchmarkConfig config, int default_mode) {
+  unsigned int selected[CONVOLUTION_MODES] = {
+      config.run_serial,    config.run_multithreaded, config.run_distributed,
+      config.run_shared,    config.run_task_pool,     config.run_fft,
+      config.run_fft_distributed, config.run_planned};
+  int mode = default_mode;
+  int count = 0;
+  for (int m = 0; m < CONVOLUTION_MODES; m++) {
+    if (selected[m]) {
+      mode = m;
+      count++;
+    }
+  }
+  return count > 1 ? -1 : mode;
+}
+
+// Single-shot or batch transformation, without any of the benchmark setup
+app_error transform(BenchmarkConfig config, int comm_rank) {
+  int mode = get_transform_mode(
+      config, config.batch ? MODE_MULTITHREADED : MODE_DISTRIBUTED);
+  if (mode < 0) {
+    if (comm_rank == 0)
+      fprintf(stderr, "%s takes a single mode flag\n",
+              config.batch ? "-batch" : "-transform");
+    return ERR_INVALID_ARGS;
+  }
+
+  app_error err;
+  if (config.batch) {
+    BatchRequest request = {config.transform_operations,
+                            config.transform_input,
+                            config.transform_output,
+                            mode,
+                            config.queue_depth,
+                            config.omp_threads,
+                            config.recalibrate,
+                            config.taskgraph,
+                            config.tile_rows};
+    err = run_batch(&request);
+  } else {
+    TransformRequest request = {config.transform_operations,
+                                config.transform_input,
+                                config.transform_output,
+                                mode,
+                                config.omp_threads,
+                                config.recalibrate};
+    err = run_transform(&request);
+  }
+  if (err != SUCCESS && comm_rank == 0)
+    fprintf(stderr, "Transform failed with error: %s\n",
+            get_error_string(err));
+  return err;
+}
+
+// First kernel of -kernels, or the default of the caller
+static void get_first_kernel(BenchmarkConfig config, const char *fallback,
+                             char *kernel, size_t length) {
+  snprintf(kernel, length, "%s", fallback);
+  if (config.kernel_list) {
+    size_t len = strcspn(config.kernel_list, ",");
+    if (len >= length)
+      len = length - 1;
+    memcpy(kernel, config.kernel_list, len);
+    kernel[len] = '\0';
+  }
+}
+
+// Scaling sweep of the distributed engine with the first kernel of -kernels
+app_error sweep(BenchmarkConfig config, int comm_rank) {
+  char kernel[64];
+  get_first_kernel(config, DEFAULT_SWEEP_KERNEL, kernel, sizeof(kernel));
+
+  SweepRequest request = {config.sweep_series,       kernel,
+                          config.sweep_size,         config.sweep_threads,
+                          config.omp_threads,        config.sweep_repetitions,
+                          config.seed};
+  app_error err = run_sweep(&request);
+  if (err != SUCCESS && comm_rank == 0)
+    fprintf(stderr, "Sweep failed with error: %s\n", get_error_string(err));
+  return err;
+}
+
+// Rank x thread tuning of the distributed engine with the first kernel of
+// -kernels
+app_error tune(BenchmarkConfig config, int comm_rank) {
+  char kernel[64];
+  get_first_kernel(config, DEFAULT_TUNE_KERNEL, kernel, sizeof(kernel));
+
+  TuneRequest request = {kernel, config.tune_sizes, config.tune_cores,
+                         config.sweep_repetitions, config.seed};
+  app_error err = run_tune(&request);
+  if (err != SUCCESS && comm_rank == 0)
+    fprintf(stderr, "Tuning failed with error: %s\n", get_error_string(err));
+  return err;
+}
+
+// Regression check of the history against a baseline, on rank 0
+app_error compare(BenchmarkConfig config, int comm_rank) {
+  app_error err = SUCCESS;
+  if (comm_rank == 0) {
+    int regressions = 0;
+    err = compare_history(RUN_HISTORY_FILE, config.compare_baseline,
+                          config.compare_candidate, stdout, &regressions);
+    if (err == SUCCESS && regressions > 0)
+      err = ERR_REGRESSION;
+    if (err != SUCCESS)
+      fprintf(stderr, "Comparison: %s\n", get_error_string(err));
   }
+  MPI_Bcast(&err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  return err;
+}
+
+// Reduces and prints the buffer pool statistics. Collective
+static void report_buffer_pool(int comm_rank) {
+  PoolStats stats;
+  pool_reduce_stats(MPI_COMM_WORLD, &stats);
+  if (comm_rank == 0)
+    print_pool_stats(&stats, stdout);
 }
 
 int main(int argc, char **argv) {
@@ -184,12 +605,74 @@ int main(int argc, char **argv) {
   BenchmarkConfig config;
   init_mpi(argc, argv, &comm_rank, &comm_size, &config);
 
+  if (config.transform_operations) {
+    app_error err = transform(config, comm_rank);
+    perf_counters_close();
+    if (err == SUCCESS)
+      report_buffer_pool(comm_rank);
+    pool_release();
+    MPI_Finalize();
+    return err;
+  }
+
+  if (config.compare_baseline) {
+    app_error err = compare(config, comm_rank);
+    perf_counters_close();
+    MPI_Finalize();
+    return err;
+  }
+
+  if (config.sweep_series) {
+    app_error err = sweep(config, comm_rank);
+    perf_counters_close();
+    free_generated_kernels();
+    pool_release();
+    MPI_Finalize();
+    return err;
+  }
+
+  if (config.tune) {
+    app_error err = tune(config, comm_rank);
+    perf_counters_close();
+    free_generated_kernels();
+    pool_release();
+    MPI_Finalize();
+    return err;
+  }
+
   print_mode(config, comm_size);
+  numa_report(MPI_COMM_WORLD, config.bind, stdout);
+
+  // Select the input images and kernels
+  app_error err =
+      init_benchmark_set(config.input_source, config.kernel_list,
+                         config.generate_sizes, config.seed);
+  if (err != SUCCESS) {
+    if (comm_rank == 0)
+      fprintf(stderr, "Failed to select benchmark inputs: %s\n",
+              get_error_string(err));
+    MPI_Finalize();
+    return err;
+  }
+
+  // -generate without a mode only creates the inputs
+  if (!any_mode_selected(config)) {
+    free_benchmark_set();
+    MPI_Finalize();
+    return 0;
+  }
+
+  // Machine peaks for the roofline columns of the results
+  roofline_measure_peaks(config.omp_threads);
 
   // Run all benchmarks
-  app_error err = run_benchmarks(config);
+  err = run_benchmarks(config);
+  perf_counters_close();
+  if (err == SUCCESS)
+    report_buffer_pool(comm_rank);
 
   if (err != SUCCESS) {
+    free_benchmark_set();
     MPI_Finalize();
     return err;
   }
@@ -202,6 +685,7 @@ int main(int argc, char **argv) {
       if (err != SUCCESS) {
         fprintf(stderr, "Verification failed with error: %s\n",
                 get_error_string(err));
+        free_benchmark_set();
         MPI_Finalize();
         return err;
       }
@@ -213,11 +697,13 @@ int main(int argc, char **argv) {
     if (err != SUCCESS) {
       fprintf(stderr, "Failed to write benchmark results: %s\n",
               get_error_string(err));
+      free_benchmark_set();
       MPI_Finalize();
       return err;
     }
   }
 
+  free_benchmark_set();
   MPI_Finalize();
   return 0;
 }
@@ -0,0 +1,193 @@
+#define _DEFAULT_SOURCE
+#include "buffer_pool.h"
+#include "numa.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+/**
+ * A buffer allocated from the system and owned by the pool.
+ */
+typedef struct {
+  void *ptr;
+  size_t capacity;
+  int in_use;
+} PoolBuffer;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static PoolBuffer *buffers = NULL;
+static int num_buffers = 0;
+static int huge_pages = 0;
+static int first_touch_threads = 0;
+
+static long long requests = 0;
+static long long system_allocs = 0;
+static size_t bytes_in_use = 0;
+static size_t bytes_reserved = 0;
+static size_t peak_in_use = 0;
+static size_t peak_reserved = 0;
+
+void pool_set_huge_pages(int enable) { huge_pages = enable; }
+
+void pool_set_first_touch(int threads) { first_touch_threads = threads; }
+
+// Hands out buffer i (pool_lock held)
+static void *take_buffer(int i) {
+  buffers[i].in_use = 1;
+  bytes_in_use += buffers[i].capacity;
+  if (bytes_in_use > peak_in_use)
+    peak_in_use = bytes_in_use;
+  return buffers[i].ptr;
+}
+
+void *pool_alloc(size_t bytes) {
+  size_t capacity =
+      (bytes + POOL_ALIGNMENT - 1) & ~(size_t)(POOL_ALIGNMENT - 1);
+  if (capacity == 0)
+    capacity = POOL_ALIGNMENT;
+
+  // Smallest cached buffer that fits without wasting more than the request
+  pthread_mutex_lock(&pool_lock);
+  requests++;
+  int best = -1;
+  for (int i = 0; i < num_buffers; i++) {
+    size_t c = buffers[i].capacity;
+    if (!buffers[i].in_use && c >= capacity && c / 2 <= capacity &&
+        (best < 0 || c < buffers[best].capacity))
+      best = i;
+  }
+  if (best >= 0) {
+    void *ptr = take_buffer(best);
+    pthread_mutex_unlock(&pool_lock);
+    return ptr;
+  }
+  pthread_mutex_unlock(&pool_lock);
+
+  size_t alignment = POOL_ALIGNMENT;
+  int huge = huge_pages && capacity >= POOL_HUGE_PAGE_SIZE;
+  if (huge) {
+    alignment = POOL_HUGE_PAGE_SIZE;
+    capacity = (capacity + POOL_HUGE_PAGE_SIZE - 1) &
+               ~(size_t)(POOL_HUGE_PAGE_SIZE - 1);
+  }
+
+  void *ptr = NULL;
+  if (posix_memalign(&ptr, alignment, capacity) != 0)
+    return NULL;
+#ifdef MADV_HUGEPAGE
+  if (huge)
+    (void)madvise(ptr, capacity, MADV_HUGEPAGE);
+#endif
+  if (first_touch_threads > 1 && capacity >= POOL_FIRST_TOUCH_MIN)
+    numa_first_touch(ptr, capacity, first_touch_threads);
+
+  pthread_mutex_lock(&pool_lock);
+  PoolBuffer *grown = (PoolBuffer *)realloc(
+      buffers, (num_buffers + 1) * sizeof(PoolBuffer));
+  if (!grown) {
+    pthread_mutex_unlock(&pool_lock);
+    free(ptr);
+    return NULL;
+  }
+  buffers = grown;
+  buffers[num_buffers].ptr = ptr;
+  buffers[num_buffers].capacity = capacity;
+  num_buffers++;
+  system_allocs++;
+  bytes_reserved += capacity;
+  if (bytes_reserved > peak_reserved)
+    peak_reserved = bytes_reserved;
+  ptr = take_buffer(num_buffers - 1);
+  pthread_mutex_unlock(&pool_lock);
+  return ptr;
+}
+
+void pool_free(void *ptr) {
+  if (!ptr)
+    return;
+
+  pthread_mutex_lock(&pool_lock);
+  int index = -1;
+  int cached = 0;
+  for (int i = num_buffers - 1; i >= 0; i--) {
+    if (buffers[i].ptr == ptr)
+      index = i;
+    else if (!buffers[i].in_use)
+      cached++;
+  }
+  if (index < 0) {
+    // Not from the pool
+    pthread_mutex_unlock(&pool_lock);
+    free(ptr);
+    return;
+  }
+
+  bytes_in_use -= buffers[index].capacity;
+  if (cached < POOL_MAX_CACHED) {
+    buffers[index].in_use = 0;
+    ptr = NULL;
+  } else {
+    bytes_reserved -= buffers[index].capacity;
+    buffers[index] = buffers[--num_buffers];
+  }
+  pthread_mutex_unlock(&pool_lock);
+  free(ptr);
+}
+
+void pool_release(void) {
+  pthread_mutex_lock(&pool_lock);
+  int kept = 0;
+  for (int i = 0; i < num_buffers; i++) {
+    if (buffers[i].in_use) {
+      buffers[kept++] = buffers[i];
+    } else {
+      bytes_reserved -= buffers[i].capacity;
+      free(buffers[i].ptr);
+    }
+  }
+  num_buffers = kept;
+  if (num_buffers == 0) {
+    free(buffers);
+    buffers = NULL;
+  }
+  pthread_mutex_unlock(&pool_lock);
+}
+
+void pool_get_stats(PoolStats *stats) {
+  pthread_mutex_lock(&pool_lock);
+  stats->requests = requests;
+  stats->system_allocs = system_allocs;
+  stats->peak_in_use = peak_in_use;
+  stats->peak_reserved = peak_reserved;
+  pthread_mutex_unlock(&pool_lock);
+}
+
+void pool_reduce_stats(MPI_Comm comm, PoolStats *stats) {
+  PoolStats local;
+  pool_get_stats(&local);
+
+  long long counts[2] = {local.requests, local.system_allocs};
+  unsigned long long peaks[2] = {local.peak_in_use, local.peak_reserved};
+  long long total_counts[2];
+  unsigned long long max_peaks[2];
+  MPI_Reduce(counts, total_counts, 2, MPI_LONG_LONG, MPI_SUM, 0, comm);
+  MPI_Reduce(peaks, max_peaks, 2, MPI_UNSIGNED_LONG_LONG, MPI_MAX, 0, comm);
+
+  stats->requests = total_counts[0];
+  stats->system_allocs = total_counts[1];
+  stats->peak_in_use = (size_t)max_peaks[0];
+  stats->peak_reserved = (size_t)max_peaks[1];
+}
+
+void print_pool_stats(const PoolStats *stats, FILE *fp) {
+  double reused = stats->requests > 0
+                      ? 100.0 * (stats->requests - stats->system_allocs) /
+                            stats->requests
+                      : 0.0;
+  fprintf(fp,
+          "Buffer pool: %lld requests, %lld system allocations (%.1f%% "
+          "reused), peak %.1f MiB in use, %.1f MiB reserved\n",
+          stats->requests, stats->system_allocs, reused,
+          stats->peak_in_use / (1024.0 * 1024.0),
+          stats->peak_reserved / (1024.0 * 1024.0));
+}
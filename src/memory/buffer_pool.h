@@ -0,0 +1,91 @@
+#ifndef __BUFFER_POOL_H__
+#define __BUFFER_POOL_H__
+
+#include <mpi.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Alignment of every buffer (one cache line, enough for AVX-512 loads)
+#define POOL_ALIGNMENT 64
+
+// Alignment and minimum size of the buffers backed by transparent huge pages
+#define POOL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// Smallest new buffer whose pages are first touched by the OpenMP team
+#define POOL_FIRST_TOUCH_MIN (1024 * 1024)
+
+// Largest number of released buffers kept for reuse
+#define POOL_MAX_CACHED 16
+
+/**
+ * Allocation statistics of the buffer pool.
+ */
+typedef struct {
+  long long requests;      // pool_alloc() calls
+  long long system_allocs; // Requests that needed a new buffer
+  size_t peak_in_use;      // Largest number of bytes handed out at once
+  size_t peak_reserved;    // Largest number of bytes held (in use + cached)
+} PoolStats;
+
+/**
+ * Backs the buffers of at least POOL_HUGE_PAGE_SIZE bytes allocated from now
+ * on with transparent huge pages (Linux madvise, ignored elsewhere).
+ * @param enable 1 to enable, 0 to disable
+ */
+void pool_set_huge_pages(int enable);
+
+/**
+ * Makes the pool zero every new buffer of at least POOL_FIRST_TOUCH_MIN bytes
+ * with a team of threads, each touching its block of the static partition
+ * (see numa_first_touch()), so that the pages are spread over the NUMA nodes
+ * the way the compute loops read and write them. A reused buffer keeps the
+ * placement it got when it was allocated.
+ * @param threads Size of the team (0 or 1 disables the parallel first touch)
+ */
+void pool_set_first_touch(int threads);
+
+/**
+ * Returns a POOL_ALIGNMENT-aligned buffer of at least the given size, reusing
+ * a released buffer of up to twice the size when one is available, so the
+ * large image buffers of consecutive kernels and files do not go back to the
+ * system (and page-fault again) every time. Thread-safe.
+ * @param bytes Requested size
+ * @return Pointer to the buffer, or NULL if the allocation failed
+ */
+void *pool_alloc(size_t bytes);
+
+/**
+ * Releases a buffer returned by pool_alloc(). It is kept for reuse unless
+ * POOL_MAX_CACHED buffers are already cached. Thread-safe.
+ * @param ptr Buffer to release (NULL is ignored)
+ */
+void pool_free(void *ptr);
+
+/**
+ * Returns every cached buffer to the system. Buffers still in use are not
+ * affected.
+ */
+void pool_release(void);
+
+/**
+ * Returns the statistics of the calling rank.
+ * @param stats Output statistics
+ */
+void pool_get_stats(PoolStats *stats);
+
+/**
+ * Reduces the statistics of the ranks of comm on rank 0: counts are summed,
+ * peaks are the largest of any rank. Collective over comm.
+ * @param comm Communicator of the ranks to reduce over
+ * @param stats Output statistics (only valid on rank 0 of comm)
+ */
+void pool_reduce_stats(MPI_Comm comm, PoolStats *stats);
+
+/**
+ * Prints the statistics on a single line.
+ * @param stats The statistics to print
+ * @param fp File stream to write to
+ */
+void print_pool_stats(const PoolStats *stats, FILE *fp);
+
+#endif
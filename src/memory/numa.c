@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include "numa.h"
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// Largest CPU number taken into account
+#define NUMA_MAX_CPUS 1024
+
+// Length of the report line of one rank
+#define NUMA_REPORT_LENGTH 1024
+
+static const char *POLICY_NAMES[BIND_POLICIES] = {"none", "close", "spread"};
+
+static int cpu_node[NUMA_MAX_CPUS];
+static int node_count = 1;
+
+// CPUs the rank may run on, ordered by node and then by number
+static int rank_cpus[NUMA_MAX_CPUS];
+static int num_rank_cpus = 0;
+
+#ifdef __linux__
+static cpu_set_t rank_mask;
+static int have_rank_mask = 0;
+
+// Assigns the CPUs of a sysfs list such as "0-3,8-11" to the node. Returns 0
+// if the node does not exist or has no CPU
+static int read_node_cpus(int node) {
+  char path[64];
+  snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist",
+           node);
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return 0;
+
+  int found = 0;
+  int lo, hi;
+  while (fscanf(fp, "%d", &lo) == 1) {
+    hi = lo;
+    int c = fgetc(fp);
+    if (c == '-') {
+      if (fscanf(fp, "%d", &hi) != 1)
+        break;
+      c = fgetc(fp);
+    }
+    for (int cpu = lo; cpu <= hi && cpu < NUMA_MAX_CPUS; cpu++)
+      cpu_node[cpu] = node;
+    found = 1;
+    if (c != ',')
+      break;
+  }
+  fclose(fp);
+  return found;
+}
+#endif
+
+void numa_init(void) {
+  memset(cpu_node, 0, sizeof(cpu_node));
+  node_count = 1;
+  num_rank_cpus = 0;
+
+#ifdef __linux__
+  int found = 0;
+  for (int node = 0; node < NUMA_MAX_NODES; node++)
+    found += read_node_cpus(node);
+  if (found > 0)
+    node_count = found;
+
+  have_rank_mask = sched_getaffinity(0, sizeof(rank_mask), &rank_mask) == 0;
+  if (!have_rank_mask)
+    return;
+  for (int node = 0; node < NUMA_MAX_NODES; node++)
+    for (int cpu = 0; cpu < NUMA_MAX_CPUS && cpu < CPU_SETSIZE; cpu++)
+      if (cpu_node[cpu] == node && CPU_ISSET(cpu, &rank_mask))
+        rank_cpus[num_rank_cpus++] = cpu;
+#endif
+}
+
+int numa_node_count(void) { return node_count; }
+
+int numa_node_of_cpu(int cpu) {
+  return cpu >= 0 && cpu < NUMA_MAX_CPUS ? cpu_node[cpu] : 0;
+}
+
+app_error parse_bind_policy(const char *name, bind_policy *policy) {
+  for (int p = 0; p < BIND_POLICIES; p++) {
+    if (strcmp(name, POLICY_NAMES[p]) == 0) {
+      *policy = (bind_policy)p;
+      return SUCCESS;
+    }
+  }
+  return ERR_INVALID_ARGS;
+}
+
+const char *get_bind_policy_name(bind_policy policy) {
+  return policy >= 0 && policy < BIND_POLICIES ? POLICY_NAMES[policy]
+                                               : "unknown";
+}
+
+app_error numa_bind_threads(bind_policy policy) {
+  if (policy == BIND_NONE)
+    return SUCCESS;
+
+#ifdef __linux__
+  if (num_rank_cpus == 0)
+    return ERR_OPENMP;
+
+  int failed = 0;
+#pragma omp parallel reduction(|| : failed)
+  {
+    int t = omp_get_thread_num();
+    int n = omp_get_num_threads();
+
+    // Close fills the CPUs in order; spread skips CPUs so that the team
+    // covers every node of the rank before doubling up on one
+    int slot = t % num_rank_cpus;
+    if (policy == BIND_SPREAD && n <= num_rank_cpus)
+      slot = (int)((long long)t * num_rank_cpus / n);
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(rank_cpus[slot], &mask);
+    failed = sched_setaffinity(0, sizeof(mask), &mask) != 0;
+  }
+  return failed ? ERR_OPENMP : SUCCESS;
+#else
+  return SUCCESS;
+#endif
+}
+
+void numa_unbind_thread(void) {
+#ifdef __linux__
+  if (have_rank_mask)
+    (void)sched_setaffinity(0, sizeof(rank_mask), &rank_mask);
+#endif
+}
+
+void numa_first_touch(void *data, size_t bytes, int threads) {
+  unsigned char *buffer = (unsigned char *)data;
+#pragma omp parallel num_threads(threads)
+  {
+    size_t t = (size_t)omp_get_thread_num();
+    size_t n = (size_t)omp_get_num_threads();
+    size_t begin = bytes / n * t + (t < bytes % n ? t : bytes % n);
+    size_t end = begin + bytes / n + (t < bytes % n ? 1 : 0);
+    memset(buffer + begin, 0, end - begin);
+  }
+}
+
+// Current CPU of the calling thread, -1 if unknown
+static int current_cpu(void) {
+#ifdef __linux__
+  return sched_getcpu();
+#else
+  return -1;
+#endif
+}
+
+void numa_report(MPI_Comm comm, bind_policy policy, FILE *fp) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  char line[NUMA_REPORT_LENGTH];
+  int len = snprintf(line, sizeof(line), "rank %d:", rank);
+  int max_threads = omp_get_max_threads();
+  int *cpus = (int *)malloc(max_threads * sizeof(int));
+  if (cpus) {
+    int threads = 1;
+#pragma omp parallel
+    {
+#pragma omp single
+      threads = omp_get_num_threads();
+      cpus[omp_get_thread_num()] = current_cpu();
+    }
+    for (int t = 0; t < threads && len < NUMA_REPORT_LENGTH; t++)
+      len += snprintf(line + len, sizeof(line) - len, " %d->%d(node %d)", t,
+                      cpus[t], numa_node_of_cpu(cpus[t]));
+    free(cpus);
+  } else {
+    snprintf(line + len, sizeof(line) - len, " unavailable");
+  }
+
+  char *lines = NULL;
+  if (rank == 0)
+    lines = (char *)malloc((size_t)size * NUMA_REPORT_LENGTH);
+  MPI_Gather(line, NUMA_REPORT_LENGTH, MPI_CHAR, lines, NUMA_REPORT_LENGTH,
+             MPI_CHAR, 0, comm);
+
+  if (rank == 0) {
+    fprintf(fp, "NUMA: %d node(s), %d CPU(s) on rank 0, binding: %s\n",
+            node_count, num_rank_cpus, get_bind_policy_name(policy));
+    fprintf(fp, "\tThread -> CPU (node):\n");
+    for (int r = 0; lines && r < size; r++)
+      fprintf(fp, "\t\t%s\n", lines + (size_t)r * NUMA_REPORT_LENGTH);
+    free(lines);
+  }
+}
@@ -0,0 +1,92 @@
+#ifndef __NUMA_H__
+#define __NUMA_H__
+
+#include "../errors/errors.h"
+#include <mpi.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Largest NUMA node id taken into account
+#define NUMA_MAX_NODES 64
+
+/**
+ * Placement of the OpenMP threads of a rank on the CPUs it may run on.
+ */
+typedef enum {
+  BIND_NONE = 0, // Leave the placement to the OpenMP runtime and the OS
+  BIND_CLOSE,    // Consecutive threads on neighbouring CPUs of the same node
+  BIND_SPREAD,   // Threads spaced evenly over the nodes and their CPUs
+  BIND_POLICIES
+} bind_policy;
+
+/**
+ * Reads the NUMA topology (Linux sysfs) and the CPUs the rank may run on.
+ * Must be called before any thread is bound. Without sysfs the machine is
+ * treated as a single node.
+ */
+void numa_init(void);
+
+/**
+ * Returns the number of NUMA nodes with at least one CPU (1 if unknown).
+ */
+int numa_node_count(void);
+
+/**
+ * Returns the NUMA node of a CPU (0 if unknown).
+ * @param cpu CPU number
+ */
+int numa_node_of_cpu(int cpu);
+
+/**
+ * Parses the name of a binding policy ("none", "close" or "spread").
+ * @param name Policy name
+ * @param policy Output policy
+ * @return app_error code:
+ *         - SUCCESS: Name recognised
+ *         - ERR_INVALID_ARGS: Unknown name
+ */
+app_error parse_bind_policy(const char *name, bind_policy *policy);
+
+/**
+ * Returns the name of a binding policy.
+ */
+const char *get_bind_policy_name(bind_policy policy);
+
+/**
+ * Pins every thread of the OpenMP team to one CPU of the rank, so that the
+ * threads that first touch a block of a buffer keep computing on that block
+ * from the same node. The rank's CPU set (e.g. from mpirun --bind-to) is
+ * respected. Linux only; elsewhere the policy is accepted but has no effect.
+ * @param policy Placement of the threads (BIND_NONE does nothing)
+ * @return app_error code:
+ *         - SUCCESS: Threads pinned (or nothing to do)
+ *         - ERR_OPENMP: A thread could not be pinned
+ */
+app_error numa_bind_threads(bind_policy policy);
+
+/**
+ * Lets the calling thread run on every CPU of the rank again. Helper threads
+ * started from a pinned thread call this so that they do not share its CPU.
+ */
+void numa_unbind_thread(void);
+
+/**
+ * Writes zeros over a buffer with the static partition of the compute loops:
+ * thread t of a team of 'threads' touches the t-th contiguous block, so the
+ * pages land on the node of the thread that will later process those rows.
+ * @param data Buffer to touch
+ * @param bytes Size of the buffer
+ * @param threads Size of the team
+ */
+void numa_first_touch(void *data, size_t bytes, int threads);
+
+/**
+ * Prints the topology, the policy and the CPU (and node) of every thread of
+ * every rank of comm on rank 0. Collective over comm.
+ * @param comm Communicator of the ranks to report
+ * @param policy Policy used to bind the threads
+ * @param fp File stream to write to
+ */
+void numa_report(MPI_Comm comm, bind_policy policy, FILE *fp);
+
+#endif
@@ -0,0 +1,492 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "../benchmark/benchmark_run.h"
+#include "../bmp/bmp_generate.h"
+#include "../bmp/bmp_io.h"
+#include "../config/kernel.h"
+#include "../convolution/convolution.h"
+#include "../memory/buffer_pool.h"
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Micro-benchmarks of the building blocks of the engines on synthetic
+ * in-memory images: every routine is timed in isolation, without the
+ * directory walking, image loading and result files of the main executable.
+ * Every row of the output is one routine on one image size in one cache
+ * state, as CSV.
+ */
+
+#define DEFAULT_SIZES "512x512,2048x2048"
+#define DEFAULT_REPETITIONS 10
+#define DEFAULT_KERNEL "gaussblur5"
+#define DEFAULT_FILE "microbench.bmp"
+#define DEFAULT_FLUSH_MB 64
+#define DEFAULT_SEED 1
+
+#define MICROBENCH_CSV_HEADER                                                  \
+  "Benchmark,Width,Height,Kernel,Threads,Ranks,Cache,Repetitions,Min,Median,"  \
+  "Mean,Max,Mpixel/s\n"
+
+typedef enum { CACHE_WARM = 0, CACHE_COLD, CACHE_STATES } cache_state;
+
+static const char *CACHE_NAMES[CACHE_STATES] = {"warm", "cold"};
+
+typedef struct {
+  ImageSize *sizes;
+  int num_sizes;
+  int repetitions;
+  int threads;
+  const char *kernel_name;
+  const char *only;     // Comma-separated benchmarks to run, NULL for all
+  const char *file;     // Scratch BMP of read_BMP and save_BMP
+  const char *output;   // CSV file, NULL for stdout
+  size_t flush_bytes;   // Buffer touched to evict the caches
+  int caches[CACHE_STATES];
+} MicrobenchConfig;
+
+// Buffers of one image size shared by the benchmarks
+typedef struct {
+  Image *source;          // Synthetic input, never modified
+  Image *work;            // Restored from source before every repetition
+  Image *loaded;          // Output of read_BMP
+  unsigned char *encoded; // source as BMP rows
+  int row_padded;
+  Pixel *strip; // Strip of the rank with its halos
+  int local_h;
+  int halo;
+  Kernel kernel;
+  const char *file;
+  int rank;
+  int size;
+} BenchState;
+
+typedef app_error (*bench_function)(BenchState *s);
+typedef void (*prepare_function)(BenchState *s, cache_state cache);
+
+typedef struct {
+  const char *name;
+  prepare_function prepare; // Untimed, before every repetition (or NULL)
+  bench_function run;       // Timed
+  bench_function cleanup;   // Untimed, after every repetition (or NULL)
+  int collective;           // Run by every rank, else by rank 0 only
+} Benchmark;
+
+static unsigned char *flush_buffer = NULL;
+static size_t flush_size = 0;
+static volatile unsigned char flush_sink;
+
+// Overwrites a buffer larger than the caches with every thread, so that the
+// next repetition starts from memory
+static void flush_caches(void) {
+  if (!flush_buffer)
+    return;
+  static unsigned char round = 0;
+  round++;
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < flush_size; i += 64)
+    flush_buffer[i] = (unsigned char)(flush_buffer[i] + round);
+  flush_sink = flush_buffer[flush_size / 2];
+}
+
+// Drops the scratch file from the page cache so that read_BMP hits the disk
+static void drop_file_cache(const char *file) {
+#ifdef __linux__
+  int fd = open(file, O_RDONLY);
+  if (fd < 0)
+    return;
+  (void)fdatasync(fd);
+  (void)posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  close(fd);
+#else
+  (void)file;
+#endif
+}
+
+static void restore_work(BenchState *s, cache_state cache) {
+  (void)cache;
+  size_t bytes = (size_t)s->source->width * s->source->height * sizeof(Pixel);
+  memcpy(s->work->data, s->source->data, bytes);
+}
+
+static void prepare_read(BenchState *s, cache_state cache) {
+  if (cache == CACHE_COLD)
+    drop_file_cache(s->file);
+}
+
+static app_error run_serial(BenchState *s) {
+  return convolve_serial(s->work, s->kernel, NULL);
+}
+
+static app_error run_multithreaded(BenchState *s) {
+  return convolve_parallel_multithreaded(s->work, s->kernel, NULL);
+}
+
+static app_error run_save(BenchState *s) {
+  return save_BMP(s->source, s->file);
+}
+
+static app_error run_read(BenchState *s) {
+  return read_BMP(&s->loaded, s->file);
+}
+
+static app_error cleanup_read(BenchState *s) {
+  free_BMP(s->loaded);
+  s->loaded = NULL;
+  return SUCCESS;
+}
+
+static app_error run_decode(BenchState *s) {
+  int width = s->work->width;
+  int height = s->work->height;
+  for (int y = 0; y < height; y++)
+    decode_BMP_row(s->encoded + (size_t)y * s->row_padded,
+                   s->work->data + (size_t)(height - 1 - y) * width, width);
+  return SUCCESS;
+}
+
+static app_error run_encode(BenchState *s) {
+  int width = s->source->width;
+  int height = s->source->height;
+  for (int y = 0; y < height; y++)
+    encode_BMP_row(s->source->data + (size_t)(height - 1 - y) * width,
+                   s->encoded + (size_t)y * s->row_padded, width);
+  return SUCCESS;
+}
+
+static app_error run_halo_exchange(BenchState *s) {
+  exchange_halos(s->strip, s->source->width, s->local_h, s->halo, s->rank,
+                 s->size);
+  return SUCCESS;
+}
+
+static app_error run_match(BenchState *s) {
+  // Identical images: the whole image is compared
+  return check_images_match(s->work, (Image *)s->source);
+}
+
+static const Benchmark BENCHMARKS[] = {
+    {"convolve_serial", restore_work, run_serial, NULL, 0},
+    {"convolve_parallel_multithreaded", restore_work, run_multithreaded, NULL,
+     0},
+    {"save_BMP", NULL, run_save, NULL, 0},
+    {"read_BMP", prepare_read, run_read, cleanup_read, 0},
+    {"decode_BMP_row", NULL, run_decode, NULL, 0},
+    {"encode_BMP_row", NULL, run_encode, NULL, 0},
+    {"halo_exchange", NULL, run_halo_exchange, NULL, 1},
+    {"check_images_match", restore_work, run_match, NULL, 0},
+};
+static const int NUM_BENCHMARKS = sizeof(BENCHMARKS) / sizeof(BENCHMARKS[0]);
+
+// Whether name is an entry of the comma-separated list (NULL selects all)
+static int is_selected(const char *list, const char *name) {
+  if (!list)
+    return 1;
+  size_t len = strlen(name);
+  for (const char *p = list; *p;) {
+    const char *end = strchr(p, ',');
+    size_t n = end ? (size_t)(end - p) : strlen(p);
+    if (n == len && strncmp(p, name, len) == 0)
+      return 1;
+    if (!end)
+      break;
+    p = end + 1;
+  }
+  return 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Times the repetitions of one benchmark; times is only filled on rank 0.
+// Collective benchmarks report the slowest rank of every repetition
+static app_error time_benchmark(const Benchmark *b, BenchState *s,
+                                cache_state cache, int repetitions,
+                                double *times) {
+  app_error err = SUCCESS;
+
+  // The warm variant runs once untimed to load the caches
+  int first = cache == CACHE_WARM ? -1 : 0;
+  for (int r = first; r < repetitions && err == SUCCESS; r++) {
+    if (b->prepare)
+      b->prepare(s, cache);
+    if (cache == CACHE_COLD)
+      flush_caches();
+    if (b->collective)
+      MPI_Barrier(MPI_COMM_WORLD);
+
+    double start = MPI_Wtime();
+    err = b->run(s);
+    double elapsed = MPI_Wtime() - start;
+
+    if (b->cleanup && err == SUCCESS)
+      b->cleanup(s);
+    if (b->collective)
+      MPI_Reduce(s->rank == 0 ? MPI_IN_PLACE : &elapsed, &elapsed, 1,
+                 MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    if (r >= 0)
+      times[r] = elapsed;
+  }
+  return err;
+}
+
+static void write_result(FILE *out, const Benchmark *b, const BenchState *s,
+                         const MicrobenchConfig *config, cache_state cache,
+                         double *times) {
+  int n = config->repetitions;
+  qsort(times, n, sizeof(double), compare_doubles);
+  double sum = 0.0;
+  for (int r = 0; r < n; r++)
+    sum += times[r];
+  double median =
+      n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+
+  // The halo exchange moves two halos per rank, everything else the image
+  double pixels = b->collective
+                      ? 2.0 * s->halo * s->source->width
+                      : (double)s->source->width * s->source->height;
+  fprintf(out, "%s,%d,%d,%s,%d,%d,%s,%d,%.9f,%.9f,%.9f,%.9f,%.3f\n", b->name,
+          s->source->width, s->source->height, s->kernel.name,
+          config->threads, s->size, CACHE_NAMES[cache], n, times[0], median,
+          sum / n, times[n - 1], median > 0 ? pixels / median / 1e6 : 0.0);
+  fflush(out);
+}
+
+static void free_state(BenchState *s) {
+  if (s->source)
+    free_BMP(s->source);
+  if (s->work)
+    free_BMP(s->work);
+  free(s->encoded);
+  free_pixel(s->strip);
+  memset(s, 0, sizeof(*s));
+}
+
+// Allocates the buffers of one size. Every rank generates the image, so
+// that the halo exchange has a strip to send
+static app_error init_state(BenchState *s, ImageSize size, Kernel kernel,
+                            const char *file) {
+  memset(s, 0, sizeof(*s));
+  MPI_Comm_rank(MPI_COMM_WORLD, &s->rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &s->size);
+  s->kernel = kernel;
+  s->file = file;
+
+  app_error err = generate_image(&s->source, size.width, size.height,
+                                 DEFAULT_SEED);
+  if (err == SUCCESS)
+    err = copy_image(s->source, &s->work);
+  if (err != SUCCESS)
+    return err;
+
+  s->row_padded = (size.width * 3 + 3) & ~3;
+  s->encoded = (unsigned char *)calloc((size_t)s->row_padded, size.height);
+  if (!s->encoded)
+    return ERR_MEM_ALLOC;
+  run_encode(s);
+
+  int start_y;
+  get_chunk_metadata(size.height, s->rank, s->size, &start_y, &s->local_h);
+  s->halo = kernel.size / 2;
+  s->strip = alloc_pixel(size.width, s->local_h + 2 * s->halo);
+  if (!s->strip)
+    return ERR_MEM_ALLOC;
+  memcpy(s->strip + (size_t)s->halo * size.width,
+         s->source->data + (size_t)start_y * size.width,
+         (size_t)s->local_h * size.width * sizeof(Pixel));
+  return SUCCESS;
+}
+
+static app_error run_size(const MicrobenchConfig *config, ImageSize size,
+                          Kernel kernel, FILE *out, double *times) {
+  BenchState s;
+  app_error err = init_state(&s, size, kernel, config->file);
+  int ok = err == SUCCESS;
+  MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+  if (!ok) {
+    free_state(&s);
+    return err != SUCCESS ? err : ERR_MPI;
+  }
+
+  // The neighbour exchange needs strips at least as tall as the halos
+  int min_h = size.height / s.size;
+
+  for (int i = 0; i < NUM_BENCHMARKS && err == SUCCESS; i++) {
+    const Benchmark *b = &BENCHMARKS[i];
+    if (!is_selected(config->only, b->name))
+      continue;
+    if (b->collective && min_h < s.halo) {
+      if (s.rank == 0)
+        fprintf(stderr, "Skipping %s on %dx%d: strips shorter than the halo\n",
+                b->name, size.width, size.height);
+      continue;
+    }
+    // read_BMP needs the scratch file written by save_BMP
+    if (b->run == run_read && s.rank == 0)
+      err = save_BMP(s.source, s.file);
+
+    for (int c = 0; c < CACHE_STATES && err == SUCCESS; c++) {
+      if (!config->caches[c])
+        continue;
+      if (b->collective || s.rank == 0)
+        err = time_benchmark(b, &s, (cache_state)c, config->repetitions,
+                             times);
+      if (s.rank == 0 && err == SUCCESS)
+        write_result(out, b, &s, config, (cache_state)c, times);
+    }
+    MPI_Bcast(&err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  }
+
+  if (s.rank == 0)
+    remove(s.file);
+  free_state(&s);
+  return err;
+}
+
+static void print_usage(const char *prog_name) {
+  printf("Usage: %s [options]\n", prog_name);
+  printf("Options:\n");
+  printf("  -sizes <WxH,...>   Synthetic image sizes (default: %s)\n",
+         DEFAULT_SIZES);
+  printf("  -reps <n>          Timed repetitions per variant (default: %d)\n",
+         DEFAULT_REPETITIONS);
+  printf("  -threads <n>       OpenMP threads (default: %d)\n",
+         DEFAULT_THREAD_COUNT);
+  printf("  -kernel <name>     Kernel of the convolutions and of the halo "
+         "depth (default: %s)\n",
+         DEFAULT_KERNEL);
+  printf("  -only <list>       Comma-separated benchmarks to run (default: "
+         "all):\n");
+  for (int i = 0; i < NUM_BENCHMARKS; i++)
+    printf("                       %s\n", BENCHMARKS[i].name);
+  printf("  -cache <warm|cold|both>  Cache state before every repetition "
+         "(default: both)\n");
+  printf("  -flush_mb <n>      Buffer overwritten to evict the caches "
+         "(default: %d)\n",
+         DEFAULT_FLUSH_MB);
+  printf("  -file <path>       Scratch BMP of read_BMP and save_BMP (default: "
+         "%s)\n",
+         DEFAULT_FILE);
+  printf("  -output <path>     Write the CSV to a file instead of stdout\n");
+  printf("  --help             Show this help message\n");
+}
+
+static void parse_args(int argc, char **argv, MicrobenchConfig *config,
+                       const char **sizes) {
+  memset(config, 0, sizeof(*config));
+  config->repetitions = DEFAULT_REPETITIONS;
+  config->threads = DEFAULT_THREAD_COUNT;
+  config->kernel_name = DEFAULT_KERNEL;
+  config->file = DEFAULT_FILE;
+  config->flush_bytes = (size_t)DEFAULT_FLUSH_MB << 20;
+  config->caches[CACHE_WARM] = config->caches[CACHE_COLD] = 1;
+  *sizes = DEFAULT_SIZES;
+
+  int valid = 1;
+  for (int i = 1; i < argc && valid; i++) {
+    int has_value = i + 1 < argc;
+    if (strcmp(argv[i], "--help") == 0) {
+      print_usage(argv[0]);
+      exit(0);
+    } else if (strcmp(argv[i], "-sizes") == 0 && has_value) {
+      *sizes = argv[++i];
+    } else if (strcmp(argv[i], "-reps") == 0 && has_value) {
+      config->repetitions = atoi(argv[++i]);
+      valid = config->repetitions > 0;
+    } else if (strcmp(argv[i], "-threads") == 0 && has_value) {
+      config->threads = atoi(argv[++i]);
+      valid = config->threads > 0;
+    } else if (strcmp(argv[i], "-kernel") == 0 && has_value) {
+      config->kernel_name = argv[++i];
+    } else if (strcmp(argv[i], "-only") == 0 && has_value) {
+      config->only = argv[++i];
+    } else if (strcmp(argv[i], "-cache") == 0 && has_value) {
+      const char *state = argv[++i];
+      int both = strcmp(state, "both") == 0;
+      config->caches[CACHE_WARM] = both || strcmp(state, "warm") == 0;
+      config->caches[CACHE_COLD] = both || strcmp(state, "cold") == 0;
+      valid = config->caches[CACHE_WARM] || config->caches[CACHE_COLD];
+    } else if (strcmp(argv[i], "-flush_mb") == 0 && has_value) {
+      int mb = atoi(argv[++i]);
+      valid = mb >= 0;
+      config->flush_bytes = (size_t)(mb > 0 ? mb : 0) << 20;
+    } else if (strcmp(argv[i], "-file") == 0 && has_value) {
+      config->file = argv[++i];
+    } else if (strcmp(argv[i], "-output") == 0 && has_value) {
+      config->output = argv[++i];
+    } else {
+      valid = 0;
+    }
+  }
+
+  if (!valid) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0)
+      print_usage(argv[0]);
+    MPI_Finalize();
+    exit(1);
+  }
+}
+
+int main(int argc, char **argv) {
+  MPI_Init(&argc, &argv);
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  MicrobenchConfig config;
+  const char *size_list;
+  parse_args(argc, argv, &config, &size_list);
+  omp_set_num_threads(config.threads);
+
+  Kernel kernel;
+  app_error err = resolve_kernel(config.kernel_name, &kernel);
+  if (err == SUCCESS)
+    err = parse_image_sizes(size_list, &config.sizes, &config.num_sizes);
+
+  double *times = (double *)malloc(config.repetitions * sizeof(double));
+  flush_size = config.flush_bytes;
+  flush_buffer = flush_size ? (unsigned char *)calloc(1, flush_size) : NULL;
+  if (err == SUCCESS && (!times || (flush_size && !flush_buffer)))
+    err = ERR_MEM_ALLOC;
+
+  FILE *out = stdout;
+  if (err == SUCCESS && rank == 0 && config.output) {
+    out = fopen(config.output, "w");
+    if (!out) {
+      out = stdout;
+      err = ERR_FILE_OPEN;
+    }
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+  if (err == SUCCESS && rank == 0)
+    fprintf(out, MICROBENCH_CSV_HEADER);
+  for (int i = 0; i < config.num_sizes && err == SUCCESS; i++)
+    err = run_size(&config, config.sizes[i], kernel, out, times);
+
+  if (err != SUCCESS && rank == 0)
+    fprintf(stderr, "Micro-benchmark failed with error: %s\n",
+            get_error_string(err));
+
+  if (out != stdout)
+    fclose(out);
+  free(times);
+  free(flush_buffer);
+  free(config.sizes);
+  free_generated_kernels();
+  pool_release();
+  MPI_Finalize();
+  return err == SUCCESS ? 0 : 1;
+}
@@ -0,0 +1,448 @@
+#include "overlap.h"
+#include "../convolution/convolution.h"
+#include "../timing/phase_timer.h"
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Tags of the halo rows; tile t of a strip returns with tag TAG_TILE + t
+#define TAG_HALO_UP 0
+#define TAG_HALO_DOWN 1
+#define TAG_TILE 2
+
+static int tile_rows = DEFAULT_OVERLAP_TILE_ROWS;
+
+void set_overlap_tile_rows(int rows) { tile_rows = rows; }
+
+// Times of one rank, reduced with their maximum on rank 0
+enum {
+  TIME_HALO = 0, // Until the halos were in
+  TIME_DONE,     // Until the results were returned
+  TIME_IDLE,     // Waited by the threads of the team, summed
+  TIME_FIELDS
+};
+
+// Counts of one rank, summed on rank 0
+enum {
+  COUNT_POLLS = 0,  // Tests of the pending requests
+  COUNT_COMM_TILES, // Tiles computed by the communication thread
+  COUNT_TILES,      // Tiles of the strip
+  COUNT_FIELDS
+};
+
+/**
+ * Strip of one rank and the queues of its tiles, shared by its team.
+ */
+typedef struct {
+  Pixel *data;    // Strip with its halos
+  Pixel *output;  // Result rows of the strip
+  Kernel kernel;  // Kernel with the broadcast coefficients
+  int width;      // Image width
+  int height;     // Image height
+  int start_y;    // First image row of the strip
+  int local_h;    // Rows of the strip
+  int halo;       // Rows of each halo
+  int rows;       // Rows of a tile
+  int tiles;      // Tiles of the strip
+  int *queue;     // Tiles that read no halo row, then the others
+  int num_inner;  // Tiles of the first part of the queue
+  int next_inner; // Next entry of the first part to claim
+  int next_outer; // Next entry of the second part to claim
+  int *done;      // Whether every tile is computed
+  int halos_ready;
+  int failed;
+  double idle;     // Time the workers waited for the halos, summed
+  double finished; // Time the workers ran out of tiles, summed
+} Strip;
+
+// Tiles of a strip of local_h rows
+static int count_tiles(int local_h, int rows) {
+  return (local_h + rows - 1) / rows;
+}
+
+// Rows of a tile: tile_rows, raised so that the tiles of the tallest strip
+// keep distinct tags
+static int get_tile_rows(int height, int size, MPI_Comm comm) {
+  int rows = tile_rows;
+  int max_local_h = (height + size - 1) / size;
+  int *tag_ub, found;
+  MPI_Comm_get_attr(comm, MPI_TAG_UB, &tag_ub, &found);
+  int max_tiles = found ? *tag_ub - TAG_TILE : 32767 - TAG_TILE;
+  if (count_tiles(max_local_h, rows) > max_tiles)
+    rows = (max_local_h + max_tiles - 1) / max_tiles;
+  return rows;
+}
+
+static app_error init_strip(Strip *s, int width, int height, int rank,
+                            int size, int halo, int rows) {
+  get_chunk_metadata(height, rank, size, &s->start_y, &s->local_h);
+  s->width = width;
+  s->height = height;
+  s->halo = halo;
+  s->rows = rows;
+  s->tiles = count_tiles(s->local_h, rows);
+  s->num_inner = 0;
+  s->next_inner = 0;
+  s->next_outer = 0;
+  s->halos_ready = 0;
+  s->failed = SUCCESS;
+  s->idle = 0.0;
+  s->finished = 0.0;
+
+  s->data = alloc_pixel(width, s->local_h + 2 * halo);
+  // Rank 0 computes its strip, the top of the image, in place
+  s->output = alloc_pixel(width, rank == 0 ? height : s->local_h);
+  s->queue = (int *)malloc((s->tiles > 0 ? s->tiles : 1) * sizeof(int));
+  s->done = (int *)calloc(s->tiles > 0 ? s->tiles : 1, sizeof(int));
+  if (!s->data || !s->output || !s->queue || !s->done)
+    return ERR_MEM_ALLOC;
+
+  // A tile reads the rows [first - halo, first + rows + halo) of the strip
+  int outer = s->tiles;
+  for (int t = 0; t < s->tiles; t++) {
+    int first = t * rows;
+    int last = first + rows < s->local_h ? first + rows : s->local_h;
+    if (first >= halo && last + halo <= s->local_h)
+      s->queue[s->num_inner++] = t;
+    else
+      s->queue[--outer] = t;
+  }
+  return SUCCESS;
+}
+
+static void free_strip(Strip *s) {
+  free_pixel(s->data);
+  free_pixel(s->output);
+  free(s->queue);
+  free(s->done);
+}
+
+// Claims the next tile that reads no halo row, or -1 when none is left
+static int claim_inner(Strip *s) {
+  int i;
+#pragma omp atomic capture
+  i = s->next_inner++;
+  return i < s->num_inner ? s->queue[i] : -1;
+}
+
+// Claims the next tile that reads halo rows, or -1 when none is left
+static int claim_outer(Strip *s) {
+  int i;
+#pragma omp atomic capture
+  i = s->next_outer++;
+  return i < s->tiles - s->num_inner ? s->queue[s->num_inner + i] : -1;
+}
+
+// Computes a tile, or nothing once a tile failed, and marks it done
+static void run_tile(Strip *s, int t) {
+  int failure;
+#pragma omp atomic read
+  failure = s->failed;
+
+  if (!failure) {
+    int first = t * s->rows;
+    int rows = s->local_h - first < s->rows ? s->local_h - first : s->rows;
+    app_error err = convolve_rows_on_thread(
+        s->data, s->width, s->local_h + 2 * s->halo, s->halo + first, rows,
+        s->kernel, s->output + (size_t)first * s->width);
+    if (err) {
+#pragma omp atomic write
+      s->failed = err;
+    }
+  }
+
+  // Publishes the rows of the tile along with the flag
+#pragma omp atomic write seq_cst
+  s->done[t] = 1;
+}
+
+// Work of the threads other than the communication thread
+static void compute_tiles(Strip *s) {
+  int t;
+  while ((t = claim_inner(s)) >= 0)
+    run_tile(s, t);
+
+  double wait_start = omp_get_wtime();
+  int ready = 0;
+  while (!ready) {
+#pragma omp atomic read seq_cst
+    ready = s->halos_ready;
+  }
+  double waited = omp_get_wtime() - wait_start;
+#pragma omp atomic
+  s->idle += waited;
+
+  while ((t = claim_outer(s)) >= 0)
+    run_tile(s, t);
+  double now = omp_get_wtime();
+#pragma omp atomic
+  s->finished += now;
+}
+
+// Computes one tile on the communication thread while its requests are
+// pending, or counts the time since begin as idle when no tile is left
+static void help_or_idle(Strip *s, double begin, double *times,
+                         double *counts) {
+  int ready;
+#pragma omp atomic read seq_cst
+  ready = s->halos_ready;
+  int t = claim_inner(s);
+  if (t < 0 && ready)
+    t = claim_outer(s);
+  if (t >= 0) {
+    run_tile(s, t);
+    counts[COUNT_COMM_TILES] += 1;
+  } else {
+    times[TIME_IDLE] += omp_get_wtime() - begin;
+  }
+}
+
+// Posts the receives of the tiles of the other ranks on rank 0
+static int post_tile_receives(const Strip *s, int size, MPI_Datatype row_type,
+                              MPI_Comm comm, MPI_Request *requests) {
+  int count = 0;
+  for (int r = 1; r < size; r++) {
+    int r_start, r_h;
+    get_chunk_metadata(s->height, r, size, &r_start, &r_h);
+    for (int t = 0; t < count_tiles(r_h, s->rows); t++) {
+      int first = t * s->rows;
+      int rows = r_h - first < s->rows ? r_h - first : s->rows;
+      MPI_Irecv(s->output + (size_t)(r_start + first) * s->width, rows,
+                row_type, r, TAG_TILE + t, comm, &requests[count++]);
+    }
+  }
+  return count;
+}
+
+// Work of the communication thread (the master thread of the team)
+static void communicate(Strip *s, int rank, int size, MPI_Request *requests,
+                        double start, double *times, double *counts) {
+  MPI_Comm comm = get_convolution_comm();
+  MPI_Datatype row_type = create_row_datatype(s->width);
+  int width = s->width;
+
+  // 1. Receives of the returned tiles (sends of the tiles on the other
+  // ranks, posted as they finish) and halo exchange
+  int num_requests = s->tiles;
+  if (rank == 0)
+    num_requests = post_tile_receives(s, size, row_type, comm, requests);
+  else
+    for (int t = 0; t < s->tiles; t++)
+      requests[t] = MPI_REQUEST_NULL;
+
+  MPI_Request halo_requests[4];
+  int num_halo_requests = 0;
+  if (s->halo > s->height / size) {
+    exchange_deep_halos(s->data, width, s->height, s->start_y, s->local_h,
+                        s->halo, rank, size);
+  } else {
+    int top = rank == 0 ? MPI_PROC_NULL : rank - 1;
+    int bottom = rank == size - 1 ? MPI_PROC_NULL : rank + 1;
+    Pixel *strip = s->data + (size_t)s->halo * width;
+    MPI_Irecv(s->data, s->halo, row_type, top, TAG_HALO_DOWN, comm,
+              &halo_requests[0]);
+    MPI_Irecv(strip + (size_t)s->local_h * width, s->halo, row_type, bottom,
+              TAG_HALO_UP, comm, &halo_requests[1]);
+    MPI_Isend(strip, s->halo, row_type, top, TAG_HALO_UP, comm,
+              &halo_requests[2]);
+    MPI_Isend(strip + (size_t)(s->local_h - s->halo) * width, s->halo,
+              row_type, bottom, TAG_HALO_DOWN, comm, &halo_requests[3]);
+    num_halo_requests = 4;
+  }
+
+  // 2. Progress the halos, computing inner tiles meanwhile
+  int flag = 0;
+  while (!flag) {
+    double begin = omp_get_wtime();
+    MPI_Testall(num_halo_requests, halo_requests, &flag, MPI_STATUSES_IGNORE);
+    counts[COUNT_POLLS] += 1;
+    if (!flag)
+      help_or_idle(s, begin, times, counts);
+  }
+  fill_clamped_halos(s->data, width, s->height, s->start_y, s->local_h,
+                     s->halo);
+#pragma omp atomic write seq_cst
+  s->halos_ready = 1;
+  times[TIME_HALO] = omp_get_wtime() - start;
+
+  // 3. Return every tile as it finishes (rank 0: receive them all)
+  int sent = rank == 0 ? s->tiles : 0;
+  flag = 0;
+  while (!flag || sent < s->tiles) {
+    double begin = omp_get_wtime();
+    int progressed = 0;
+    for (int t = 0; rank != 0 && t < s->tiles; t++) {
+      // 0: being computed, 1: done, 2: sent
+      int done;
+#pragma omp atomic read seq_cst
+      done = s->done[t];
+      if (done != 1)
+        continue;
+      int first = t * s->rows;
+      int rows = s->local_h - first < s->rows ? s->local_h - first : s->rows;
+      MPI_Isend(s->output + (size_t)first * width, rows, row_type, 0,
+                TAG_TILE + t, comm, &requests[t]);
+#pragma omp atomic write
+      s->done[t] = 2;
+      sent++;
+      progressed = 1;
+    }
+    MPI_Testall(num_requests, requests, &flag, MPI_STATUSES_IGNORE);
+    counts[COUNT_POLLS] += 1;
+    if (!progressed && (!flag || sent < s->tiles))
+      help_or_idle(s, begin, times, counts);
+  }
+  times[TIME_DONE] = omp_get_wtime() - start;
+  MPI_Type_free(&row_type);
+
+  // 4. Help with the tiles that are left
+  int t;
+  while ((t = claim_inner(s)) >= 0 || (t = claim_outer(s)) >= 0) {
+    run_tile(s, t);
+    counts[COUNT_COMM_TILES] += 1;
+  }
+}
+
+// Prints the halo and result completion, the tiles and polls of the
+// communication threads and the idle time on rank 0
+static void report_overlap(double *times, double *counts, int threads,
+                           MPI_Comm comm) {
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Reduce(rank == 0 ? MPI_IN_PLACE : times, times, TIME_FIELDS, MPI_DOUBLE,
+             MPI_MAX, 0, comm);
+  MPI_Reduce(rank == 0 ? MPI_IN_PLACE : counts, counts, COUNT_FIELDS,
+             MPI_DOUBLE, MPI_SUM, 0, comm);
+  if (rank != 0)
+    return;
+  printf("\tOverlap: halos in after %.6f s, results returned after %.6f s, "
+         "idle %.6f s (slowest rank, %d threads)\n",
+         times[TIME_HALO], times[TIME_DONE], times[TIME_IDLE], threads);
+  printf("\tCommunication threads: %.0f of %.0f tiles computed, %.0f polls\n",
+         counts[COUNT_COMM_TILES], counts[COUNT_TILES], counts[COUNT_POLLS]);
+}
+
+// Scatters the strips into the middle of the strip buffers, as the
+// distributed engine does
+static void scatter_strips(const Image *img, Strip *s, int rank, int size,
+                           MPI_Comm comm) {
+  MPI_Datatype row_type = create_row_datatype(s->width);
+  int *sendcounts = NULL;
+  int *displs = NULL;
+  if (rank == 0) {
+    sendcounts = malloc(size * sizeof(int));
+    displs = malloc(size * sizeof(int));
+    for (int r = 0; r < size; r++)
+      get_chunk_metadata(s->height, r, size, &displs[r], &sendcounts[r]);
+  }
+  MPI_Scatterv(rank == 0 ? img->data : NULL, sendcounts, displs, row_type,
+               s->data + (size_t)s->halo * s->width, s->local_h, row_type, 0,
+               comm);
+  free(sendcounts);
+  free(displs);
+  MPI_Type_free(&row_type);
+}
+
+app_error convolve_distributed_overlap(Image *img, Kernel kernel,
+                                       double *elapsed_time) {
+  int provided;
+  MPI_Query_thread(&provided);
+  if (provided < MPI_THREAD_FUNNELED)
+    return convolve_parallel_distributed_filesystem(img, kernel,
+                                                    elapsed_time);
+
+  double start_time = MPI_Wtime();
+  MPI_Comm comm = get_convolution_comm();
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  // 1. Broadcast Dimensions and the kernel
+  phase_timer_begin(PHASE_BCAST);
+  int dims[3];
+  if (rank == 0) {
+    dims[0] = img->width;
+    dims[1] = img->height;
+    dims[2] = kernel.size;
+  }
+  MPI_Bcast(dims, 3, MPI_INT, 0, comm);
+  int width = dims[0], height = dims[1], k_size = dims[2];
+
+  app_error err = tile_rows < 1 ? ERR_INVALID_ARGS : SUCCESS;
+  Strip strip = {0};
+  double *kernel_data = rank == 0 ? (double *)kernel.data : NULL;
+  MPI_Request *requests = NULL;
+  if (!err) {
+    err = init_strip(&strip, width, height, rank, size, k_size / 2,
+                     get_tile_rows(height, size, comm));
+    if (rank != 0)
+      kernel_data = (double *)malloc((size_t)k_size * k_size * sizeof(double));
+    // Rank 0 receives every tile of the other ranks, which send their own
+    int num_requests = rank == 0
+                           ? count_tiles(height, strip.rows) + size
+                           : strip.tiles;
+    requests = (MPI_Request *)malloc(
+        (num_requests > 0 ? num_requests : 1) * sizeof(MPI_Request));
+    if (!err && (!kernel_data || !requests))
+      err = ERR_MEM_ALLOC;
+  }
+  int any_err = err;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, comm);
+  err = (app_error)any_err;
+  if (!err)
+    MPI_Bcast(kernel_data, k_size * k_size, MPI_DOUBLE, 0, comm);
+  phase_timer_end(PHASE_BCAST);
+
+  double times[TIME_FIELDS] = {0.0};
+  double counts[COUNT_FIELDS] = {0.0};
+  int threads = 1;
+  if (!err) {
+    // 2. Scatter the strips
+    phase_timer_begin(PHASE_SCATTER);
+    scatter_strips(img, &strip, rank, size, comm);
+    phase_timer_end(PHASE_SCATTER);
+
+    // 3. Communication thread and workers
+    Kernel local_kernel = {kernel.name, k_size, kernel_data};
+    strip.kernel = local_kernel;
+    counts[COUNT_TILES] = strip.tiles;
+    double start = omp_get_wtime();
+#pragma omp parallel
+    {
+      if (omp_get_thread_num() == 0) {
+        threads = omp_get_num_threads();
+        communicate(&strip, rank, size, requests, start, times, counts);
+      } else {
+        compute_tiles(&strip);
+      }
+    }
+    double end = omp_get_wtime();
+    times[TIME_IDLE] += strip.idle + (threads - 1) * end - strip.finished;
+    phase_timer_add(PHASE_HALO, times[TIME_HALO]);
+    phase_timer_add(PHASE_COMPUTE, end - start);
+
+    any_err = strip.failed;
+    MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, comm);
+    err = (app_error)any_err;
+  }
+
+  // 4. Cleanup
+  if (rank == 0 && !err) {
+    free_pixel(img->data);
+    img->data = strip.output;
+    strip.output = NULL;
+  }
+  free_strip(&strip);
+  free(requests);
+  if (rank != 0)
+    free(kernel_data);
+
+  double end_time = MPI_Wtime();
+  if (elapsed_time != NULL)
+    *elapsed_time = end_time - start_time;
+
+  if (!err)
+    report_overlap(times, counts, threads, comm);
+  return err;
+}
@@ -0,0 +1,45 @@
+#ifndef __OVERLAP_H__
+#define __OVERLAP_H__
+
+#include "../bmp/bmp_io.h"
+#include "../config/kernel.h"
+#include "../errors/errors.h"
+
+// Default rows of a tile of the work queue of the overlapped engine
+#define DEFAULT_OVERLAP_TILE_ROWS 32
+
+/**
+ * Selects the rows of a tile of the overlapped engine.
+ * @param rows Rows per tile, see DEFAULT_OVERLAP_TILE_ROWS
+ */
+void set_overlap_tile_rows(int rows);
+
+/**
+ * Distributed convolution over the communicator of the distributed engine
+ * (see set_convolution_comm()) that overlaps the communication of every
+ * rank with its computation. Rank 0 scatters the strips as the distributed
+ * engine does. Then, inside one OpenMP team per rank, the master thread is
+ * the communication thread: it exchanges the halos with non-blocking
+ * messages, fills the clamped halos and returns every finished tile of the
+ * strip to rank 0 (rank 0 keeps a receive posted for every tile of the other
+ * ranks), polling the requests and computing a tile itself whenever nothing
+ * is left to progress. The other threads take tiles of the strip from two
+ * lock-free queues (atomic counters): first the tiles that read no halo
+ * row, then, once the halos are in, the tiles next to them. Only the master
+ * thread calls MPI, so MPI_THREAD_FUNNELED suffices; with a lower thread
+ * level the blocking distributed engine runs instead. The results are
+ * identical to the distributed engine.
+ * Rank 0 prints when the halos and the results were complete, the tiles and
+ * polls of the communication threads and the idle time of the teams.
+ * @param img Image on rank 0 (ignored on the other ranks)
+ * @param kernel The convolution kernel (only read on rank 0)
+ * @param elapsed_time Output: elapsed time of the whole operation
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: Convolution completed, result in img on rank 0
+ *         - ERR_INVALID_ARGS: The tile rows are not positive
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error convolve_distributed_overlap(Image *img, Kernel kernel,
+                                       double *elapsed_time);
+
+#endif
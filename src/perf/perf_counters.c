@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include "perf_counters.h"
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// One file descriptor per (thread, event); -1 when not opened
+static int *counter_fds = NULL;
+static int counter_threads = 0;
+static int counter_available[COUNTER_COUNT];
+static int counters_enabled = 0;
+
+// Totals of the last start/stop interval on this rank
+static long long rank_totals[COUNTER_COUNT];
+
+#ifdef __linux__
+static void describe_event(perf_counter counter, struct perf_event_attr *attr) {
+  memset(attr, 0, sizeof(*attr));
+  attr->size = sizeof(*attr);
+  attr->disabled = 1;
+  attr->exclude_kernel = 1;
+  attr->exclude_hv = 1;
+  attr->read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+  switch (counter) {
+  case COUNTER_CYCLES:
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->config = PERF_COUNT_HW_CPU_CYCLES;
+    break;
+  case COUNTER_INSTRUCTIONS:
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+    break;
+  case COUNTER_L1D_MISSES:
+    attr->type = PERF_TYPE_HW_CACHE;
+    attr->config = PERF_COUNT_HW_CACHE_L1D |
+                   (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    break;
+  case COUNTER_LLC_MISSES:
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->config = PERF_COUNT_HW_CACHE_MISSES;
+    break;
+  case COUNTER_BRANCH_MISSES:
+    attr->type = PERF_TYPE_HARDWARE;
+    attr->config = PERF_COUNT_HW_BRANCH_MISSES;
+    break;
+  default:
+    break;
+  }
+}
+
+static int open_event(perf_counter counter) {
+  struct perf_event_attr attr;
+  describe_event(counter, &attr);
+  // pid = 0, cpu = -1: count the calling thread on any CPU
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+#endif
+
+app_error perf_counters_init(void) {
+  app_error err = SUCCESS;
+  for (int c = 0; c < COUNTER_COUNT; c++)
+    counter_available[c] = 0;
+
+#ifdef __linux__
+  counter_threads = omp_get_max_threads();
+  counter_fds = (int *)malloc(counter_threads * COUNTER_COUNT * sizeof(int));
+  if (!counter_fds)
+    err = ERR_MEM_ALLOC;
+
+  for (int c = 0; !err && c < COUNTER_COUNT; c++)
+    counter_available[c] = 1;
+
+  // Every thread opens its own counters so that they follow that thread
+  if (!err) {
+#pragma omp parallel
+    {
+      int t = omp_get_thread_num();
+      for (int c = 0; c < COUNTER_COUNT; c++) {
+        int fd = open_event((perf_counter)c);
+        counter_fds[t * COUNTER_COUNT + c] = fd;
+        if (fd < 0) {
+#pragma omp atomic write
+          counter_available[c] = 0;
+        }
+      }
+    }
+  }
+#endif
+
+  // All ranks must agree on the enabled events, otherwise the reductions
+  // would not match up. A rank that failed to allocate takes part with no
+  // event, which disables the counters everywhere
+  MPI_Allreduce(MPI_IN_PLACE, counter_available, COUNTER_COUNT, MPI_INT,
+                MPI_MIN, MPI_COMM_WORLD);
+
+  int any_available = 0;
+  for (int c = 0; c < COUNTER_COUNT; c++)
+    any_available |= counter_available[c];
+
+  if (!any_available) {
+    perf_counters_close();
+    return err ? err : ERR_PERF;
+  }
+
+  counters_enabled = 1;
+  return SUCCESS;
+}
+
+int perf_counters_enabled(void) { return counters_enabled; }
+
+void perf_counters_start(void) {
+#ifdef __linux__
+  if (!counters_enabled)
+    return;
+  for (int i = 0; i < counter_threads * COUNTER_COUNT; i++) {
+    if (counter_fds[i] < 0 || !counter_available[i % COUNTER_COUNT])
+      continue;
+    ioctl(counter_fds[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter_fds[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+#endif
+}
+
+void perf_counters_stop(void) {
+#ifdef __linux__
+  if (!counters_enabled)
+    return;
+
+  for (int c = 0; c < COUNTER_COUNT; c++)
+    rank_totals[c] = 0;
+
+  for (int i = 0; i < counter_threads * COUNTER_COUNT; i++) {
+    if (counter_fds[i] < 0 || !counter_available[i % COUNTER_COUNT])
+      continue;
+    ioctl(counter_fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    // value, time enabled, time running
+    unsigned long long buf[3];
+    if (read(counter_fds[i], buf, sizeof(buf)) != (ssize_t)sizeof(buf))
+      continue;
+
+    // Scale up if the kernel had to multiplex the event
+    double value = (double)buf[0];
+    if (buf[2] > 0 && buf[2] < buf[1])
+      value *= (double)buf[1] / (double)buf[2];
+    rank_totals[i % COUNTER_COUNT] += (long long)value;
+  }
+#endif
+}
+
+void perf_counters_reduce(MPI_Comm comm, PerfCounts *counts) {
+  for (int c = 0; c < COUNTER_COUNT; c++)
+    counts->values[c] = -1;
+
+  if (!counters_enabled)
+    return;
+
+  long long sum[COUNTER_COUNT];
+  MPI_Reduce(rank_totals, sum, COUNTER_COUNT, MPI_LONG_LONG, MPI_SUM, 0, comm);
+
+  for (int c = 0; c < COUNTER_COUNT; c++)
+    counts->values[c] = counter_available[c] ? sum[c] : -1;
+}
+
+void perf_counters_close(void) {
+#ifdef __linux__
+  if (counter_fds) {
+    for (int i = 0; i < counter_threads * COUNTER_COUNT; i++) {
+      if (counter_fds[i] >= 0)
+        close(counter_fds[i]);
+    }
+    free(counter_fds);
+    counter_fds = NULL;
+  }
+#endif
+  counter_threads = 0;
+  counters_enabled = 0;
+}
+
+const char *get_counter_name(perf_counter counter) {
+  switch (counter) {
+  case COUNTER_CYCLES:
+    return "Cycles";
+  case COUNTER_INSTRUCTIONS:
+    return "Instructions";
+  case COUNTER_L1D_MISSES:
+    return "L1D Misses";
+  case COUNTER_LLC_MISSES:
+    return "LLC Misses";
+  case COUNTER_BRANCH_MISSES:
+    return "Branch Misses";
+  default:
+    return "Unknown";
+  }
+}
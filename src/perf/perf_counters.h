@@ -0,0 +1,78 @@
+#ifndef __PERF_COUNTERS_H__
+#define __PERF_COUNTERS_H__
+
+#include "../errors/errors.h"
+#include <mpi.h>
+
+/**
+ * Hardware events collected around every kernel run.
+ */
+typedef enum {
+  COUNTER_CYCLES = 0,
+  COUNTER_INSTRUCTIONS,
+  COUNTER_L1D_MISSES,
+  COUNTER_LLC_MISSES,
+  COUNTER_BRANCH_MISSES,
+  COUNTER_COUNT
+} perf_counter;
+
+/**
+ * Counter totals summed over all OpenMP threads and all participating ranks.
+ * A value of -1 means the event could not be opened on this machine.
+ */
+typedef struct {
+  long long values[COUNTER_COUNT];
+} PerfCounts;
+
+/**
+ * Opens one set of counters per OpenMP thread (Linux perf_event_open).
+ * Must be called after the OpenMP thread count has been set. Collective over
+ * MPI_COMM_WORLD, also when it fails. Events the CPU or kernel does not
+ * support on any rank are skipped. Only the totals of the threads and ranks
+ * are reported; the threads are counted separately so that every event
+ * follows its thread.
+ * @return app_error code:
+ *         - SUCCESS: At least one event is being counted
+ *         - ERR_PERF: perf_event_open is unavailable or not permitted
+ *         - ERR_MEM_ALLOC: Memory allocation failed (the counters are
+ *           disabled on every rank)
+ */
+app_error perf_counters_init(void);
+
+/**
+ * Returns non-zero if perf_counters_init succeeded.
+ */
+int perf_counters_enabled(void);
+
+/**
+ * Resets and enables the counters of every thread. No-op when disabled.
+ */
+void perf_counters_start(void);
+
+/**
+ * Disables the counters and sums them over the threads of this rank.
+ * No-op when disabled.
+ */
+void perf_counters_stop(void);
+
+/**
+ * Sums the per-rank totals of the last start/stop interval on rank 0 of comm.
+ * Collective over comm when the counters are enabled.
+ * @param comm Communicator of the ranks that took part in the run
+ * @param counts Output totals (only valid on rank 0 of comm)
+ */
+void perf_counters_reduce(MPI_Comm comm, PerfCounts *counts);
+
+/**
+ * Closes every counter opened by perf_counters_init.
+ */
+void perf_counters_close(void);
+
+/**
+ * Returns the human readable name of a counter.
+ * @param counter The counter
+ * @return Counter name
+ */
+const char *get_counter_name(perf_counter counter);
+
+#endif
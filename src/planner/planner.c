@@ -0,0 +1,325 @@
+#define _DEFAULT_SOURCE
+#include "planner.h"
+#include "../bmp/bmp_generate.h"
+#include "../config/files.h"
+#include "../convolution/fft_convolution.h"
+#include "../convolution/specialized.h"
+#include "../file_utils/file_utils.h"
+#include "../timing/phase_timer.h"
+#include <math.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Size of the synthetic calibration image and number of timed runs (the
+// fastest one is kept)
+#define CALIBRATION_SIZE 256
+#define CALIBRATION_REPETITIONS 3
+
+// Kernel size used to calibrate the algorithms that support any size
+#define CALIBRATION_KERNEL_SIZE 15
+
+#define HOST_NAME_LENGTH 256
+
+// Seconds per unit of work of every algorithm (see work_units), and of the
+// unrolled algorithm on integer kernels, which accumulates in integers
+static double algorithm_cost[ALGO_COUNT];
+static double unrolled_integer_cost;
+static int last_choice = ALGO_UNPLANNED;
+
+static const char *ALGORITHM_NAMES[ALGO_COUNT] = {
+    "direct", "unrolled", "separable", "running_sum", "fft"};
+
+const char *get_algorithm_name(conv_algorithm algorithm) {
+  if (algorithm < 0 || algorithm >= ALGO_COUNT)
+    return "unknown";
+  return ALGORITHM_NAMES[algorithm];
+}
+
+strip_function get_algorithm_function(conv_algorithm algorithm) {
+  switch (algorithm) {
+  case ALGO_UNROLLED:
+    return convolve_rows_unrolled;
+  case ALGO_SEPARABLE:
+    return convolve_rows_separable;
+  case ALGO_RUNNING_SUM:
+    return convolve_rows_running_sum;
+  case ALGO_FFT:
+    return fft_convolve_rows;
+  default:
+    return convolve_rows_sparse;
+  }
+}
+
+void analyze_kernel(Kernel kernel, KernelProperties *props) {
+  int taps = kernel.size * kernel.size;
+  props->size = kernel.size;
+  props->nonzeros = 0;
+  props->integer = is_integer_kernel(kernel);
+  props->constant = 1;
+  for (int i = 0; i < taps; i++) {
+    double value = kernel.data[i];
+    if (value != 0.0)
+      props->nonzeros++;
+    if (value != kernel.data[0])
+      props->constant = 0;
+  }
+  props->separable = factor_separable_kernel(kernel, NULL, NULL);
+}
+
+static int is_applicable(conv_algorithm algorithm,
+                         const KernelProperties *props) {
+  switch (algorithm) {
+  case ALGO_UNROLLED:
+    return props->size == 3 || props->size == 5;
+  case ALGO_SEPARABLE:
+    return props->separable && props->size > 1;
+  case ALGO_RUNNING_SUM:
+    return props->constant;
+  case ALGO_FFT:
+    return props->size > 1;
+  default:
+    return 1;
+  }
+}
+
+// Units of work of an algorithm on a whole image: multiply-adds per pixel for
+// the spatial algorithms, butterflies of the four transforms per tile (two
+// forward, two inverse) for the FFT
+static double work_units(conv_algorithm algorithm,
+                         const KernelProperties *props, int width,
+                         int height) {
+  double pixels = (double)width * height;
+  switch (algorithm) {
+  case ALGO_UNROLLED:
+    return pixels * props->size * props->size;
+  case ALGO_SEPARABLE:
+    return pixels * 2 * props->size;
+  case ALGO_RUNNING_SUM:
+    return pixels;
+  case ALGO_FFT: {
+    int n = fft_transform_size(props->size);
+    int tile = n - (props->size - 1);
+    double tiles = (double)((width + tile - 1) / tile) *
+                   ((height + tile - 1) / tile);
+    return tiles * 4.0 * n * n * log2(n);
+  }
+  default:
+    return pixels * (props->nonzeros > 0 ? props->nonzeros : 1);
+  }
+}
+
+// Seconds per unit of work of an algorithm on a kernel
+static double unit_cost(conv_algorithm algorithm,
+                        const KernelProperties *props) {
+  if (algorithm == ALGO_UNROLLED && props->integer)
+    return unrolled_integer_cost;
+  return algorithm_cost[algorithm];
+}
+
+// Times one algorithm on the calibration image and returns its cost per unit
+static double calibrate_algorithm(conv_algorithm algorithm, const Image *img,
+                                  Pixel *output, Kernel kernel) {
+  KernelProperties props;
+  analyze_kernel(kernel, &props);
+  strip_function compute = get_algorithm_function(algorithm);
+
+  double best = -1.0;
+  for (int rep = 0; rep < CALIBRATION_REPETITIONS; rep++) {
+    double start = MPI_Wtime();
+    app_error err = compute(img->data, img->width, img->height, 0,
+                            img->height, kernel, output);
+    double elapsed = MPI_Wtime() - start;
+    if (err)
+      return -1.0;
+    if (best < 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best / work_units(algorithm, &props, img->width, img->height);
+}
+
+static app_error measure_calibration(void) {
+  Image *img;
+  app_error err =
+      generate_image(&img, CALIBRATION_SIZE, CALIBRATION_SIZE, 1);
+  if (err)
+    return err;
+  Pixel *output = alloc_pixel(CALIBRATION_SIZE, CALIBRATION_SIZE);
+  if (!output) {
+    free_BMP(img);
+    return ERR_MEM_ALLOC;
+  }
+
+  char name[32];
+  Kernel gaussian, box;
+  snprintf(name, sizeof(name), "gaussblur%d", CALIBRATION_KERNEL_SIZE);
+  err = resolve_kernel(name, &gaussian);
+  snprintf(name, sizeof(name), "boxblur%d", CALIBRATION_KERNEL_SIZE);
+  if (!err)
+    err = resolve_kernel(name, &box);
+
+  if (!err) {
+    // The spatial algorithms on the kernels they would be chosen for
+    algorithm_cost[ALGO_DIRECT] =
+        calibrate_algorithm(ALGO_DIRECT, img, output, GAUSSIAN5_KERNEL);
+    algorithm_cost[ALGO_UNROLLED] =
+        calibrate_algorithm(ALGO_UNROLLED, img, output, GAUSSIAN5_KERNEL);
+    // The same taps scaled to integers (1 to 36)
+    double integer_taps[25];
+    for (int i = 0; i < 25; i++)
+      integer_taps[i] = GAUSSIAN5_KERNEL.data[i] * 256.0;
+    Kernel integer_kernel = {GAUSSIAN5_KERNEL.name, 5, integer_taps};
+    unrolled_integer_cost =
+        calibrate_algorithm(ALGO_UNROLLED, img, output, integer_kernel);
+    algorithm_cost[ALGO_SEPARABLE] =
+        calibrate_algorithm(ALGO_SEPARABLE, img, output, gaussian);
+    algorithm_cost[ALGO_RUNNING_SUM] =
+        calibrate_algorithm(ALGO_RUNNING_SUM, img, output, box);
+    algorithm_cost[ALGO_FFT] =
+        calibrate_algorithm(ALGO_FFT, img, output, gaussian);
+    for (int a = 0; a < ALGO_COUNT; a++)
+      if (algorithm_cost[a] < 0)
+        err = ERR_MEM_ALLOC;
+    if (unrolled_integer_cost < 0)
+      err = ERR_MEM_ALLOC;
+  }
+
+  free_pixel(output);
+  free_BMP(img);
+  return err;
+}
+
+static int load_calibration(const char *host, int threads) {
+  FILE *fp = fopen(CALIBRATION_CSV_FILE, "r");
+  if (!fp)
+    return 0;
+
+  int found = 0;
+  char line[1024];
+  while (fgets(line, sizeof(line), fp)) {
+    char line_host[HOST_NAME_LENGTH];
+    int line_threads;
+    double cost[ALGO_COUNT];
+    double integer_cost;
+    if (sscanf(line, "%255[^,],%d,%lf,%lf,%lf,%lf,%lf,%lf", line_host,
+               &line_threads, &cost[ALGO_DIRECT], &cost[ALGO_UNROLLED],
+               &cost[ALGO_SEPARABLE], &cost[ALGO_RUNNING_SUM],
+               &cost[ALGO_FFT], &integer_cost) != 3 + ALGO_COUNT)
+      continue;
+
+    // The last entry of this host and thread count wins
+    if (strcmp(line_host, host) == 0 && line_threads == threads) {
+      memcpy(algorithm_cost, cost, sizeof(algorithm_cost));
+      unrolled_integer_cost = integer_cost;
+      found = 1;
+    }
+  }
+
+  fclose(fp);
+  return found;
+}
+
+static app_error save_calibration(const char *host, int threads) {
+  app_error err =
+      init_benchmark_csv(CALIBRATION_CSV_FILE, CALIBRATION_CSV_HEADER);
+  if (err)
+    return err;
+
+  FILE *fp = fopen(CALIBRATION_CSV_FILE, "a");
+  if (!fp)
+    return ERR_FILE_OPEN;
+  fprintf(fp, "%s,%d", host, threads);
+  for (int a = 0; a < ALGO_COUNT; a++)
+    fprintf(fp, ",%.6e", algorithm_cost[a]);
+  fprintf(fp, ",%.6e\n", unrolled_integer_cost);
+  fclose(fp);
+  return SUCCESS;
+}
+
+app_error planner_init(int threads, int recalibrate) {
+  char host[HOST_NAME_LENGTH];
+  if (gethostname(host, sizeof(host)) != 0)
+    snprintf(host, sizeof(host), "unknown");
+  host[sizeof(host) - 1] = '\0';
+  // Commas would break the cache file
+  for (char *c = host; *c; c++)
+    if (*c == ',')
+      *c = '_';
+
+  if (!recalibrate && load_calibration(host, threads)) {
+    printf("Planner calibration loaded from %s\n", CALIBRATION_CSV_FILE);
+  } else {
+    printf("Calibrating convolution algorithms (%d threads)...\n", threads);
+    app_error err = measure_calibration();
+    if (err)
+      return err;
+    // A missing cache only costs a new calibration next time
+    if (save_calibration(host, threads) != SUCCESS)
+      fprintf(stderr, "Warning: Could not write %s\n", CALIBRATION_CSV_FILE);
+  }
+
+  for (int a = 0; a < ALGO_COUNT; a++)
+    printf("\t%-12s %.3e s/unit\n", get_algorithm_name(a), algorithm_cost[a]);
+  printf("\t%-12s %.3e s/unit (integer kernels)\n",
+         get_algorithm_name(ALGO_UNROLLED), unrolled_integer_cost);
+  return SUCCESS;
+}
+
+conv_algorithm plan_convolution(Kernel kernel, int width, int height) {
+  KernelProperties props;
+  analyze_kernel(kernel, &props);
+
+  conv_algorithm best = ALGO_DIRECT;
+  double best_time = -1.0;
+  for (int a = 0; a < ALGO_COUNT; a++) {
+    if (!is_applicable(a, &props))
+      continue;
+    double estimate =
+        unit_cost(a, &props) * work_units(a, &props, width, height);
+    if (best_time < 0 || estimate < best_time) {
+      best = a;
+      best_time = estimate;
+    }
+  }
+
+  last_choice = best;
+  return best;
+}
+
+void planner_clear_choice(void) { last_choice = ALGO_UNPLANNED; }
+
+int planner_get_choice(void) { return last_choice; }
+
+app_error convolve_planned(Image *img, Kernel kernel, double *elapsed_time) {
+  double start_time = MPI_Wtime();
+  phase_timer_begin(PHASE_COMPUTE);
+
+  conv_algorithm algorithm = plan_convolution(kernel, img->width, img->height);
+  strip_function compute = get_algorithm_function(algorithm);
+
+  Pixel *output = alloc_pixel(img->width, img->height);
+  if (!output) {
+    phase_timer_end(PHASE_COMPUTE);
+    return ERR_MEM_ALLOC;
+  }
+
+  app_error err = compute(img->data, img->width, img->height, 0, img->height,
+                          kernel, output);
+  if (err) {
+    free_pixel(output);
+    phase_timer_end(PHASE_COMPUTE);
+    return err;
+  }
+
+  free_pixel(img->data);
+  img->data = output;
+
+  phase_timer_end(PHASE_COMPUTE);
+  double end_time = MPI_Wtime();
+  if (elapsed_time != NULL)
+    *elapsed_time = end_time - start_time;
+
+  return SUCCESS;
+}
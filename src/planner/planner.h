@@ -0,0 +1,102 @@
+#ifndef __PLANNER_H__
+#define __PLANNER_H__
+
+#include "../bmp/bmp_io.h"
+#include "../config/kernel.h"
+#include "../convolution/convolution.h"
+#include "../errors/errors.h"
+
+// Largest per-channel difference of the planned mode from the direct engines
+// (separable, running-sum and FFT sum in a different order)
+#define PLANNED_TOLERANCE 1
+
+// Returned by planner_get_choice() when no plan was made
+#define ALGO_UNPLANNED -1
+
+/**
+ * Convolution algorithms the planner chooses from.
+ */
+typedef enum {
+  ALGO_DIRECT,      // Direct sum over the non-zero taps
+  ALGO_UNROLLED,    // Unrolled 3x3 / 5x5, integer arithmetic if possible
+  ALGO_SEPARABLE,   // Two 1D passes for rank-1 kernels
+  ALGO_RUNNING_SUM, // Incremental window sums for constant kernels
+  ALGO_FFT,         // Overlap-save FFT tiles
+  ALGO_COUNT
+} conv_algorithm;
+
+/**
+ * Properties of a kernel that decide which algorithms apply and what they
+ * cost.
+ */
+typedef struct {
+  int size;
+  int nonzeros;  // Number of non-zero taps
+  int integer;   // All taps are integers (see is_integer_kernel())
+  int constant;  // All taps are equal
+  int separable; // Rank-1 (outer product of two vectors)
+} KernelProperties;
+
+/**
+ * Computes the properties of a kernel.
+ * @param kernel The kernel to analyze
+ * @param props Output properties
+ */
+void analyze_kernel(Kernel kernel, KernelProperties *props);
+
+/**
+ * Loads the calibration table of this host and thread count from the cache
+ * file, or measures it with a short run of every algorithm on a synthetic
+ * image and appends it to the cache. Rank-local.
+ * @param threads Number of OpenMP threads the algorithms run with
+ * @param recalibrate Measure even if the cache has an entry
+ * @return app_error code:
+ *         - SUCCESS: Calibration available
+ *         - ERR_MEM_ALLOC: Memory allocation failed during the measurement
+ */
+app_error planner_init(int threads, int recalibrate);
+
+/**
+ * Chooses the algorithm with the lowest estimated time for a kernel and an
+ * image: the work of each applicable algorithm (taps, passes, transforms)
+ * times its calibrated cost per unit of work. The choice is recorded for
+ * planner_get_choice().
+ * @param kernel The kernel to apply
+ * @param width Image width
+ * @param height Image height
+ * @return The chosen algorithm
+ */
+conv_algorithm plan_convolution(Kernel kernel, int width, int height);
+
+/**
+ * Returns the strip computation of an algorithm (see strip_function).
+ */
+strip_function get_algorithm_function(conv_algorithm algorithm);
+
+/**
+ * Returns a string description of an algorithm, e.g. "separable".
+ */
+const char *get_algorithm_name(conv_algorithm algorithm);
+
+/**
+ * Forgets the last recorded choice.
+ */
+void planner_clear_choice(void);
+
+/**
+ * Returns the algorithm chosen by the last plan_convolution() since
+ * planner_clear_choice(), or ALGO_UNPLANNED.
+ */
+int planner_get_choice(void);
+
+/**
+ * Plans and applies a convolution on rank 0 with the chosen algorithm
+ * (parallelized with OpenMP).
+ * @param img Pointer to the Image structure to modify
+ * @param kernel The convolution kernel to apply
+ * @param elapsed_time Output: elapsed time, planning included
+ * @return app_error code
+ */
+app_error convolve_planned(Image *img, Kernel kernel, double *elapsed_time);
+
+#endif
@@ -0,0 +1,153 @@
+#include "roofline.h"
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Triad arrays must be much larger than the last-level cache
+#define STREAM_ELEMENTS (1L << 23)
+#define STREAM_REPETITIONS 5
+
+// Independent accumulator chains to hide the latency of the FP units
+#define FMA_LANES 64
+#define FMA_ITERATIONS 4000000L
+#define FMA_REPETITIONS 3
+
+// Bytes touched per pixel: one read and one write of a 24-bit pixel
+#define BYTES_PER_PIXEL 6.0
+#define CHANNELS 3
+
+static MachinePeak single_thread_peak; // rank 0, one thread
+static MachinePeak rank_peak;          // rank 0, all threads
+static MachinePeak total_peak;         // all ranks, all threads
+
+// Written with the sum of the multiply-add chains to keep them alive
+static volatile double fma_sink;
+
+static double measure_bandwidth(int threads) {
+  double *a = (double *)malloc(STREAM_ELEMENTS * sizeof(double));
+  double *b = (double *)malloc(STREAM_ELEMENTS * sizeof(double));
+  double *c = (double *)malloc(STREAM_ELEMENTS * sizeof(double));
+  if (!a || !b || !c) {
+    fprintf(stderr, "Error: Memory allocation failed for bandwidth test\n");
+    free(a);
+    free(b);
+    free(c);
+    return 0.0;
+  }
+
+  // First touch with the same static partitioning as the triad
+#pragma omp parallel for schedule(static) num_threads(threads)
+  for (long i = 0; i < STREAM_ELEMENTS; i++) {
+    a[i] = 0.0;
+    b[i] = 1.0;
+    c[i] = 2.0;
+  }
+
+  double best = 0.0;
+  for (int rep = 0; rep < STREAM_REPETITIONS; rep++) {
+    double start = MPI_Wtime();
+#pragma omp parallel for schedule(static) num_threads(threads)
+    for (long i = 0; i < STREAM_ELEMENTS; i++)
+      a[i] = b[i] + 3.0 * c[i];
+    double elapsed = MPI_Wtime() - start;
+
+    double rate = 3.0 * STREAM_ELEMENTS * sizeof(double) / elapsed / 1e9;
+    if (rate > best)
+      best = rate;
+  }
+
+  free(a);
+  free(b);
+  free(c);
+  return best;
+}
+
+// Multiply-add chains compiled with the project flags, so the result is the
+// peak reachable by code built the same way as the convolution engines
+static double measure_gflops(int threads) {
+  double best = 0.0;
+  double sink = 0.0;
+
+  for (int rep = 0; rep < FMA_REPETITIONS; rep++) {
+    double start = MPI_Wtime();
+#pragma omp parallel num_threads(threads) reduction(+ : sink)
+    {
+      double acc[FMA_LANES];
+      for (int i = 0; i < FMA_LANES; i++)
+        acc[i] = 1.0 + i * 1e-3 + omp_get_thread_num() * 1e-6;
+
+      for (long it = 0; it < FMA_ITERATIONS; it++) {
+#pragma omp simd
+        for (int i = 0; i < FMA_LANES; i++)
+          acc[i] = acc[i] * 0.999999 + 1e-6;
+      }
+
+      for (int i = 0; i < FMA_LANES; i++)
+        sink += acc[i];
+    }
+    double elapsed = MPI_Wtime() - start;
+
+    double rate = 2.0 * FMA_LANES * FMA_ITERATIONS * threads / elapsed / 1e9;
+    if (rate > best)
+      best = rate;
+  }
+
+  // Keep the loop from being optimized away
+  fma_sink = sink;
+  return best;
+}
+
+void roofline_measure_peaks(int threads) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  // Every rank at once, so that ranks sharing a node also share its bandwidth
+  MPI_Barrier(MPI_COMM_WORLD);
+  rank_peak.bandwidth = measure_bandwidth(threads);
+  rank_peak.gflops = measure_gflops(threads);
+
+  MPI_Reduce(&rank_peak.bandwidth, &total_peak.bandwidth, 1, MPI_DOUBLE,
+             MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&rank_peak.gflops, &total_peak.gflops, 1, MPI_DOUBLE, MPI_SUM, 0,
+             MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    single_thread_peak.bandwidth = measure_bandwidth(1);
+    single_thread_peak.gflops = measure_gflops(1);
+
+    printf("Machine peak (1 thread): %.2f GB/s, %.2f GFLOP/s\n",
+           single_thread_peak.bandwidth, single_thread_peak.gflops);
+    printf("Machine peak (%d threads): %.2f GB/s, %.2f GFLOP/s\n", threads,
+           rank_peak.bandwidth, rank_peak.gflops);
+    printf("Machine peak (all ranks): %.2f GB/s, %.2f GFLOP/s\n",
+           total_peak.bandwidth, total_peak.gflops);
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+}
+
+void roofline_get_peak(int ranks, int threads, MachinePeak *peak) {
+  if (ranks > 1)
+    *peak = total_peak;
+  else if (threads > 1)
+    *peak = rank_peak;
+  else
+    *peak = single_thread_peak;
+}
+
+void compute_kernel_throughput(long long pixel_count, int kernel_size,
+                               double time, const MachinePeak *peak,
+                               KernelThroughput *out) {
+  double flops = 2.0 * CHANNELS * kernel_size * kernel_size * pixel_count;
+  double bytes = BYTES_PER_PIXEL * pixel_count;
+
+  out->intensity = flops / bytes;
+  out->mpixels_per_sec = time > 0 ? pixel_count / time / 1e6 : 0.0;
+  out->gflops = time > 0 ? flops / time / 1e9 : 0.0;
+  out->bandwidth = time > 0 ? bytes / time / 1e9 : 0.0;
+
+  double memory_roof = out->intensity * peak->bandwidth;
+  out->memory_bound = memory_roof < peak->gflops;
+  out->attainable = out->memory_bound ? memory_roof : peak->gflops;
+  out->efficiency = out->attainable > 0 ? out->gflops / out->attainable : 0.0;
+}
@@ -0,0 +1,56 @@
+#ifndef __ROOFLINE_H__
+#define __ROOFLINE_H__
+
+/**
+ * Peak memory bandwidth and floating point rate of the machine.
+ */
+typedef struct {
+  double bandwidth; // GB/s
+  double gflops;    // GFLOP/s
+} MachinePeak;
+
+/**
+ * Throughput metrics of one kernel run, placed on the roofline.
+ */
+typedef struct {
+  double mpixels_per_sec;
+  double gflops;
+  double bandwidth;  // Effective GB/s (compulsory image traffic only)
+  double intensity;  // FLOP per byte of compulsory traffic
+  double attainable; // Roofline bound in GFLOP/s at this intensity
+  double efficiency; // Achieved GFLOP/s / attainable GFLOP/s
+  int memory_bound;  // 1 if left of the ridge point
+} KernelThroughput;
+
+/**
+ * Measures the peaks with built-in micro-benchmarks (a STREAM-style triad and
+ * an FMA loop). Collective over MPI_COMM_WORLD: every rank measures its
+ * multi-threaded peak concurrently and the results are summed, rank 0 also
+ * measures the single-threaded peak.
+ * @param threads OpenMP threads per rank
+ */
+void roofline_measure_peaks(int threads);
+
+/**
+ * Returns the peak that applies to a run.
+ * @param ranks Number of ranks that took part in the run
+ * @param threads Number of threads per rank (1 for the serial mode)
+ * @param peak Output peak
+ */
+void roofline_get_peak(int ranks, int threads, MachinePeak *peak);
+
+/**
+ * Computes throughput metrics for a convolution run.
+ * FLOPs are counted as one multiply and one add per kernel tap and channel,
+ * traffic as one read and one write of every pixel.
+ * @param pixel_count Number of pixels in the image
+ * @param kernel_size Size of the kernel
+ * @param time Elapsed time of the run in seconds
+ * @param peak Peak of the resources used by the run
+ * @param out Output metrics
+ */
+void compute_kernel_throughput(long long pixel_count, int kernel_size,
+                               double time, const MachinePeak *peak,
+                               KernelThroughput *out);
+
+#endif
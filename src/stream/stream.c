@@ -0,0 +1,416 @@
+#include "stream.h"
+#include "../convolution/convolution.h"
+#include "../timing/phase_timer.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tag of the band and strip messages. The bands from rank 0 to a rank are
+// sent and received in file order, so the MPI ordering rules match them.
+#define STREAM_TAG 0
+
+// Image rows [lo, hi) of band b. The file stores the rows bottom-up, so the
+// first band holds the bottom of the image.
+static void get_band_rows(int height, int band_rows, int b, int *lo,
+                          int *hi) {
+  long long file_end = (long long)(b + 1) * band_rows;
+  *lo = file_end < height ? height - (int)file_end : 0;
+  *hi = height - b * band_rows;
+}
+
+// Image rows [lo, hi) a rank needs: its strip and the halo rows inside the
+// image
+static void get_needed_rows(int height, int rank, int size, int halo, int *lo,
+                            int *hi) {
+  int start_y, local_h;
+  get_chunk_metadata(height, rank, size, &start_y, &local_h);
+  *lo = start_y - halo > 0 ? start_y - halo : 0;
+  *hi = start_y + local_h + halo < height ? start_y + local_h + halo : height;
+}
+
+// Bands of the file holding the rows [lo, hi) of the image: [first, last]
+static void get_band_range(int height, int band_rows, int lo, int hi,
+                           int *first, int *last) {
+  *first = (height - hi) / band_rows;
+  *last = (height - lo - 1) / band_rows;
+}
+
+// Rank 0: reads the bands, decodes them into the ring of band buffers and
+// sends the rows of every band to the ranks that need them. A buffer is
+// reused once the sends of the band it held have completed. Rank 0's own
+// rows are copied into its strip. A short read leaves the rest of the rows
+// undefined but still sends them, so that no rank waits forever.
+static app_error send_bands(FILE *f, int width, int height, int halo,
+                            int band_rows, MPI_Datatype row_type,
+                            unsigned char *row, Pixel *bands,
+                            MPI_Request *requests, Pixel *local_data,
+                            MPI_Comm comm) {
+  int size;
+  MPI_Comm_size(comm, &size);
+  int row_padded = (width * 3 + 3) & (~3);
+  int band_count = (height + band_rows - 1) / band_rows;
+  app_error err = SUCCESS;
+
+  for (int i = 0; i < STREAM_BANDS_IN_FLIGHT * size; i++)
+    requests[i] = MPI_REQUEST_NULL;
+
+  for (int b = 0; b < band_count; b++) {
+    int slot = b % STREAM_BANDS_IN_FLIGHT;
+    Pixel *band = bands + (size_t)slot * band_rows * width;
+    MPI_Request *pending = requests + (size_t)slot * size;
+
+    phase_timer_begin(PHASE_SCATTER);
+    MPI_Waitall(size, pending, MPI_STATUSES_IGNORE);
+    phase_timer_end(PHASE_SCATTER);
+
+    int lo, hi;
+    get_band_rows(height, band_rows, b, &lo, &hi);
+    phase_timer_begin(PHASE_READ);
+    for (int y = hi - 1; y >= lo; y--) {
+      if (fread(row, sizeof(unsigned char), row_padded, f) !=
+          (size_t)row_padded)
+        err = ERR_FILE_READ;
+      decode_BMP_row(row, band + (size_t)(y - lo) * width, width);
+    }
+    phase_timer_end(PHASE_READ);
+
+    phase_timer_begin(PHASE_SCATTER);
+    for (int r = 0; r < size; r++) {
+      int need_lo, need_hi;
+      get_needed_rows(height, r, size, halo, &need_lo, &need_hi);
+      int from = lo > need_lo ? lo : need_lo;
+      int to = hi < need_hi ? hi : need_hi;
+      if (to <= from)
+        continue;
+
+      // Rank 0 owns the first strip, which starts at row 0
+      const Pixel *rows = band + (size_t)(from - lo) * width;
+      if (r == 0)
+        memcpy(local_data + (size_t)(from + halo) * width, rows,
+               (size_t)(to - from) * width * sizeof(Pixel));
+      else
+        MPI_Isend(rows, to - from, row_type, r, STREAM_TAG, comm,
+                  &pending[r]);
+    }
+    phase_timer_end(PHASE_SCATTER);
+  }
+
+  phase_timer_begin(PHASE_SCATTER);
+  MPI_Waitall(STREAM_BANDS_IN_FLIGHT * size, requests, MPI_STATUSES_IGNORE);
+  phase_timer_end(PHASE_SCATTER);
+  return err;
+}
+
+// Other ranks: receives the rows of every band that holds part of the strip
+// or its halos straight into the strip buffer
+static void receive_bands(int width, int height, int halo, int band_rows,
+                          int start_y, MPI_Datatype row_type,
+                          MPI_Request *requests, Pixel *local_data,
+                          MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  int need_lo, need_hi, first, last;
+  get_needed_rows(height, rank, size, halo, &need_lo, &need_hi);
+  get_band_range(height, band_rows, need_lo, need_hi, &first, &last);
+
+  phase_timer_begin(PHASE_SCATTER);
+  for (int b = first; b <= last; b++) {
+    int lo, hi;
+    get_band_rows(height, band_rows, b, &lo, &hi);
+    int from = lo > need_lo ? lo : need_lo;
+    int to = hi < need_hi ? hi : need_hi;
+    MPI_Irecv(local_data + (size_t)(from - start_y + halo) * width, to - from,
+              row_type, 0, STREAM_TAG, comm, &requests[b - first]);
+  }
+  MPI_Waitall(last - first + 1, requests, MPI_STATUSES_IGNORE);
+  phase_timer_end(PHASE_SCATTER);
+}
+
+/**
+ * A piece of the output: rows [lo, hi) of the strip of a rank.
+ */
+typedef struct {
+  int rank;
+  int lo;
+  int hi;
+} StripPiece;
+
+// Steps through the output in file order: the strips from the last rank to
+// rank 0, each from its bottom row up in pieces of at most band_rows rows.
+// Start from {size, 0, 0}; returns 0 after the last piece.
+static int next_piece(int height, int size, int band_rows, StripPiece *piece) {
+  int start_y, local_h;
+  if (piece->rank < size)
+    get_chunk_metadata(height, piece->rank, size, &start_y, &local_h);
+  if (piece->rank == size || piece->lo == start_y) {
+    if (--piece->rank < 0)
+      return 0;
+    get_chunk_metadata(height, piece->rank, size, &start_y, &local_h);
+    piece->hi = start_y + local_h;
+  } else {
+    piece->hi = piece->lo;
+  }
+  piece->lo = piece->hi - band_rows > start_y ? piece->hi - band_rows : start_y;
+  return 1;
+}
+
+// Other ranks: sends the strip to rank 0 in the pieces and order it writes
+// them in
+static void send_strip(const Pixel *local_output, int width, int local_h,
+                       int band_rows, MPI_Datatype row_type,
+                       MPI_Request *requests, MPI_Comm comm) {
+  int count = 0;
+  phase_timer_begin(PHASE_GATHER);
+  for (int hi = local_h; hi > 0; hi -= band_rows) {
+    int lo = hi - band_rows > 0 ? hi - band_rows : 0;
+    MPI_Isend(local_output + (size_t)lo * width, hi - lo, row_type, 0,
+              STREAM_TAG, comm, &requests[count++]);
+  }
+  MPI_Waitall(count, requests, MPI_STATUSES_IGNORE);
+  phase_timer_end(PHASE_GATHER);
+}
+
+// Posts the receive of a piece into a band buffer (rank 0's own rows need
+// none)
+static void post_piece(const StripPiece *piece, Pixel *band,
+                       MPI_Datatype row_type, MPI_Request *request,
+                       MPI_Comm comm) {
+  if (piece->rank == 0)
+    *request = MPI_REQUEST_NULL;
+  else
+    MPI_Irecv(band, piece->hi - piece->lo, row_type, piece->rank, STREAM_TAG,
+              comm, request);
+}
+
+// Rank 0: receives the pieces of the other strips in file order through the
+// ring of band buffers, with the receives of the next bands already posted,
+// and encodes and appends every piece to the output as soon as it arrives.
+// Its own strip, at the top of the image, comes last. A failed write still
+// drains every receive.
+static app_error write_strips(FILE *out, int width, int height, int band_rows,
+                              const Pixel *local_output,
+                              MPI_Datatype row_type, unsigned char *row,
+                              Pixel *bands, MPI_Request *requests,
+                              MPI_Comm comm) {
+  int size;
+  MPI_Comm_size(comm, &size);
+  int row_padded = (width * 3 + 3) & (~3);
+  app_error err = SUCCESS;
+
+  StripPiece posted = {size, 0, 0};
+  StripPiece written = {size, 0, 0};
+  int more = 1;
+  phase_timer_begin(PHASE_GATHER);
+  for (int i = 0; i < STREAM_BANDS_IN_FLIGHT; i++) {
+    more = next_piece(height, size, band_rows, &posted);
+    if (!more)
+      break;
+    post_piece(&posted, bands + (size_t)i * band_rows * width, row_type,
+               &requests[i], comm);
+  }
+  phase_timer_end(PHASE_GATHER);
+
+  // The padding bytes stay zero
+  memset(row, 0, row_padded);
+  for (int i = 0; next_piece(height, size, band_rows, &written); i++) {
+    int slot = i % STREAM_BANDS_IN_FLIGHT;
+    Pixel *band = bands + (size_t)slot * band_rows * width;
+
+    phase_timer_begin(PHASE_GATHER);
+    MPI_Wait(&requests[slot], MPI_STATUS_IGNORE);
+    phase_timer_end(PHASE_GATHER);
+
+    // Rank 0 owns the first strip, which starts at row 0
+    const Pixel *rows =
+        written.rank == 0 ? local_output + (size_t)written.lo * width : band;
+    phase_timer_begin(PHASE_WRITE);
+    for (int y = written.hi - 1; y >= written.lo; y--) {
+      encode_BMP_row(rows + (size_t)(y - written.lo) * width, row, width);
+      if (fwrite(row, sizeof(unsigned char), row_padded, out) !=
+          (size_t)row_padded)
+        err = ERR_FILE_WRITE;
+    }
+    phase_timer_end(PHASE_WRITE);
+
+    phase_timer_begin(PHASE_GATHER);
+    if (more && (more = next_piece(height, size, band_rows, &posted)))
+      post_piece(&posted, band, row_type, &requests[slot], comm);
+    phase_timer_end(PHASE_GATHER);
+  }
+  return err;
+}
+
+app_error run_stream_convolution(const StreamRequest *request,
+                                 int *image_width, int *image_height,
+                                 double *elapsed_time) {
+  double start_time = MPI_Wtime();
+  MPI_Comm comm = get_convolution_comm();
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  // 1. Header on rank 0, then dimensions, band size and kernel everywhere
+  FILE *f = NULL;
+  int width = 0, height = 0;
+  app_error err = SUCCESS;
+  if (rank == 0) {
+    phase_timer_begin(PHASE_READ);
+    err = request->band_rows > 0
+              ? open_BMP(&f, request->input, &width, &height)
+              : ERR_INVALID_ARGS;
+    phase_timer_end(PHASE_READ);
+    if (!err && height < size) {
+      fprintf(stderr, "Image has fewer rows (%d) than ranks (%d)\n", height,
+              size);
+      fclose(f);
+      err = ERR_INVALID_ARGS;
+    }
+  }
+
+  phase_timer_begin(PHASE_BCAST);
+  int info[5] = {err, width, height, request->kernel.size,
+                 request->band_rows};
+  MPI_Bcast(info, 5, MPI_INT, 0, comm);
+  err = (app_error)info[0];
+  width = info[1];
+  height = info[2];
+  int k_size = info[3];
+  int band_rows = info[4];
+  if (err) {
+    phase_timer_end(PHASE_BCAST);
+    return err;
+  }
+
+  double *local_kernel_data = NULL;
+  if (rank == 0)
+    local_kernel_data = (double *)request->kernel.data;
+  else
+    local_kernel_data = (double *)malloc(k_size * k_size * sizeof(double));
+  int setup_err = local_kernel_data ? SUCCESS : ERR_MEM_ALLOC;
+  MPI_Allreduce(MPI_IN_PLACE, &setup_err, 1, MPI_INT, MPI_MAX, comm);
+  if (setup_err) {
+    phase_timer_end(PHASE_BCAST);
+    if (rank == 0)
+      fclose(f);
+    return (app_error)setup_err;
+  }
+  MPI_Bcast(local_kernel_data, k_size * k_size, MPI_DOUBLE, 0, comm);
+  phase_timer_end(PHASE_BCAST);
+
+  // 2. Buffers and output, set up before the first transfer so that a
+  // failure leaves no rank waiting: the strip with its halos on every rank,
+  // the ring of bands (used for the input, then for the output) and the
+  // output file on rank 0, and the requests of the bands of every rank
+  int halo = k_size / 2;
+  int start_y, local_h;
+  get_chunk_metadata(height, rank, size, &start_y, &local_h);
+  Pixel *local_data = alloc_pixel(width, local_h + 2 * halo);
+  Pixel *local_output = alloc_pixel(width, local_h);
+
+  int request_count = STREAM_BANDS_IN_FLIGHT * size;
+  unsigned char *row = NULL;
+  Pixel *bands = NULL;
+  FILE *out = NULL;
+  setup_err = SUCCESS;
+  if (rank == 0) {
+    row = (unsigned char *)malloc((width * 3 + 3) & (~3));
+    bands = alloc_pixel(width, STREAM_BANDS_IN_FLIGHT * band_rows);
+    phase_timer_begin(PHASE_WRITE);
+    out = fopen(request->output, "wb");
+    if (!out) {
+      fprintf(stderr, "Error: Could not create file %s\n", request->output);
+      setup_err = ERR_FILE_OPEN;
+    } else {
+      setup_err = write_BMP_header(out, width, height);
+    }
+    phase_timer_end(PHASE_WRITE);
+  } else {
+    int need_lo, need_hi, first, last;
+    get_needed_rows(height, rank, size, halo, &need_lo, &need_hi);
+    get_band_range(height, band_rows, need_lo, need_hi, &first, &last);
+    int pieces = (local_h + band_rows - 1) / band_rows;
+    request_count = last - first + 1 > pieces ? last - first + 1 : pieces;
+  }
+  MPI_Request *requests =
+      (MPI_Request *)malloc(request_count * sizeof(MPI_Request));
+
+  if (!local_data || !local_output || !requests ||
+      (rank == 0 && (!row || !bands)))
+    setup_err = ERR_MEM_ALLOC;
+  MPI_Allreduce(MPI_IN_PLACE, &setup_err, 1, MPI_INT, MPI_MAX, comm);
+  err = (app_error)setup_err;
+
+  if (!err) {
+    MPI_Datatype row_type = create_row_datatype(width);
+
+    // 3. Stream the input into the strips
+    if (rank == 0)
+      err = send_bands(f, width, height, halo, band_rows, row_type, row,
+                       bands, requests, local_data, comm);
+    else
+      receive_bands(width, height, halo, band_rows, start_y, row_type,
+                    requests, local_data, comm);
+
+    phase_timer_begin(PHASE_HALO);
+    fill_clamped_halos(local_data, width, height, start_y, local_h, halo);
+    phase_timer_end(PHASE_HALO);
+
+    // 4. Compute the strip with the engine of the distributed mode
+    phase_timer_begin(PHASE_COMPUTE);
+    Kernel local_kernel = {request->kernel.name, k_size, local_kernel_data};
+    strip_function compute_strip = get_accumulation_precision() ==
+                                           PRECISION_FLOAT
+                                       ? convolve_rows_direct_float
+                                       : convolve_rows_direct;
+    app_error compute_err =
+        compute_strip(local_data, width, local_h + 2 * halo, halo, local_h,
+                      local_kernel, local_output);
+    phase_timer_end(PHASE_COMPUTE);
+    if (!err)
+      err = compute_err;
+
+    // 5. Stream the strips into the output
+    if (rank == 0) {
+      app_error write_err =
+          write_strips(out, width, height, band_rows, local_output, row_type,
+                       row, bands, requests, comm);
+      phase_timer_begin(PHASE_WRITE);
+      if (fclose(out) != 0 && !write_err)
+        write_err = ERR_FILE_WRITE;
+      phase_timer_end(PHASE_WRITE);
+      out = NULL;
+      if (!err)
+        err = write_err;
+    } else {
+      send_strip(local_output, width, local_h, band_rows, row_type, requests,
+                 comm);
+    }
+    MPI_Type_free(&row_type);
+
+    int any_err = err;
+    MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, comm);
+    err = (app_error)any_err;
+  }
+
+  // 6. Cleanup
+  if (rank == 0) {
+    fclose(f);
+    if (out)
+      fclose(out);
+    free(row);
+    free_pixel(bands);
+  } else {
+    free(local_kernel_data);
+  }
+  free(requests);
+  free_pixel(local_data);
+  free_pixel(local_output);
+
+  *image_width = width;
+  *image_height = height;
+  if (elapsed_time != NULL)
+    *elapsed_time = MPI_Wtime() - start_time;
+  return err;
+}
@@ -0,0 +1,58 @@
+#ifndef __STREAM_H__
+#define __STREAM_H__
+
+#include "../bmp/bmp_io.h"
+#include "../config/kernel.h"
+#include "../errors/errors.h"
+
+// Default rows of a band read, decoded and sent by rank 0 at a time
+#define DEFAULT_STREAM_BAND_ROWS 64
+
+// Bands rank 0 keeps in memory while their sends or receives are in flight
+#define STREAM_BANDS_IN_FLIGHT 4
+
+/**
+ * A distributed convolution that streams its input from the file and its
+ * output to the file.
+ */
+typedef struct {
+  const char *input;  // Input BMP, read by rank 0
+  const char *output; // Output BMP, written by rank 0
+  Kernel kernel;      // The kernel (only read on rank 0)
+  int band_rows;      // Rows per band, see DEFAULT_STREAM_BAND_ROWS
+} StreamRequest;
+
+/**
+ * Distributed convolution over the communicator of the distributed engine
+ * (see set_convolution_comm()) without the whole image on any rank.
+ * Rank 0 reads the BMP in bands of band_rows rows, in file order (bottom of
+ * the image first), decodes every band and forwards the rows of each band to
+ * every rank whose strip or halos contain them with non-blocking sends, so
+ * the ranks that own the bottom of the image start computing while rank 0
+ * still reads the top. Every rank then computes its strip. The strips come
+ * back in the same file order, in pieces of band_rows rows: rank 0 keeps the
+ * receives of the next pieces posted and encodes and appends every piece to
+ * the output as soon as it arrives, while the later strips are still being
+ * computed or sent. Rank 0 holds at most STREAM_BANDS_IN_FLIGHT bands in
+ * either direction besides its own strip.
+ * The elapsed time covers the read and the write as well, since they overlap
+ * the transfers.
+ * @param request The convolution to run
+ * @param image_width Output: image width
+ * @param image_height Output: image height
+ * @param elapsed_time Output: elapsed time of the whole operation
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: Output written
+ *         - ERR_FILE_OPEN: Could not open the input or create the output
+ *         - ERR_BMP_HEADER: Input is not a 24-bit BMP
+ *         - ERR_FILE_READ: The input ended early
+ *         - ERR_FILE_WRITE: Writing the output failed
+ *         - ERR_INVALID_ARGS: band_rows is not positive, or the image has
+ *           fewer rows than ranks
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error run_stream_convolution(const StreamRequest *request,
+                                 int *image_width, int *image_height,
+                                 double *elapsed_time);
+
+#endif
@@ -0,0 +1,371 @@
+#include "sweep.h"
+#include "../bmp/bmp_generate.h"
+#include "../config/files.h"
+#include "../convolution/convolution.h"
+#include "../file_utils/file_utils.h"
+#include <limits.h>
+#include <math.h>
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Largest number of thread counts in a sweep
+#define SWEEP_MAX_COUNTS 32
+
+// One configuration of a series and its analysis (filled on rank 0)
+typedef struct {
+  int series;
+  int ranks;
+  int threads;
+  int width;
+  int height;
+  double time;       // Median over the repetitions
+  double speedup;    // Scaled by the work for the weak series
+  double efficiency; // Speedup per processing element of the base
+  double karp_flatt; // Experimental serial fraction, NAN for the base
+  double model;      // Speedup predicted by the fit of the series
+} SweepPoint;
+
+app_error parse_sweep_series(const char *name, int *series) {
+  if (strcmp(name, "strong") == 0)
+    *series = SWEEP_STRONG;
+  else if (strcmp(name, "weak") == 0)
+    *series = SWEEP_WEAK;
+  else if (strcmp(name, "both") == 0)
+    *series = SWEEP_STRONG | SWEEP_WEAK;
+  else
+    return ERR_INVALID_ARGS;
+  return SUCCESS;
+}
+
+static const char *get_series_name(int series) {
+  return series == SWEEP_STRONG ? "strong" : "weak";
+}
+
+static int compare_ints(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+// Thread counts of the sweep in increasing order: the list, or the powers of
+// two up to max_threads followed by max_threads itself
+static app_error get_thread_counts(const SweepRequest *request, int *counts,
+                                   int *num_counts) {
+  *num_counts = 0;
+  if (!request->thread_list) {
+    for (int t = 1; t < request->max_threads; t *= 2)
+      counts[(*num_counts)++] = t;
+    counts[(*num_counts)++] = request->max_threads;
+    return SUCCESS;
+  }
+
+  const char *cursor = request->thread_list;
+  while (*cursor && *num_counts < SWEEP_MAX_COUNTS) {
+    char *end;
+    long count = strtol(cursor, &end, 10);
+    if (end == cursor || count <= 0 || count > INT_MAX ||
+        (*end != ',' && *end != '\0'))
+      return ERR_INVALID_ARGS;
+    counts[(*num_counts)++] = (int)count;
+    cursor = *end ? end + 1 : end;
+  }
+  if (*cursor != '\0' || *num_counts == 0)
+    return ERR_INVALID_ARGS;
+  qsort(counts, *num_counts, sizeof(int), compare_ints);
+  return SUCCESS;
+}
+
+// Rank counts of the sweep: 1, 2, 4, ... and the world size
+static int get_rank_counts(int world_size, int *counts) {
+  int num_counts = 0;
+  for (int p = 1; p < world_size; p *= 2)
+    counts[num_counts++] = p;
+  counts[num_counts++] = world_size;
+  return num_counts;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+app_error time_distributed_configuration(int member, int threads,
+                                         Kernel kernel, int width, int height,
+                                         unsigned long long seed,
+                                         int repetitions, double *time) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  MPI_Comm sub;
+  MPI_Comm_split(MPI_COMM_WORLD, member ? 0 : MPI_UNDEFINED, rank, &sub);
+
+  app_error err = SUCCESS;
+  if (sub != MPI_COMM_NULL) {
+    Image *source = NULL;
+    Image *work = NULL;
+    double *times = (double *)malloc(repetitions * sizeof(double));
+    if (!times)
+      err = ERR_MEM_ALLOC;
+    if (rank == 0 && !err) {
+      err = generate_image(&source, width, height, seed);
+      if (!err)
+        err = copy_image(source, &work);
+    }
+    int any_err = err;
+    MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, sub);
+    err = (app_error)any_err;
+
+    int saved_threads = omp_get_max_threads();
+    omp_set_num_threads(threads);
+    set_convolution_comm(sub);
+    size_t bytes = (size_t)width * height * sizeof(Pixel);
+
+    for (int r = 0; r < repetitions && !err; r++) {
+      if (rank == 0)
+        memcpy(work->data, source->data, bytes);
+      MPI_Barrier(sub);
+      err = convolve_parallel_distributed_filesystem(work, kernel, &times[r]);
+
+      any_err = err;
+      MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, sub);
+      err = (app_error)any_err;
+    }
+
+    if (rank == 0 && !err) {
+      int n = repetitions;
+      qsort(times, n, sizeof(double), compare_doubles);
+      *time = n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+    }
+
+    set_convolution_comm(MPI_COMM_NULL);
+    omp_set_num_threads(saved_threads);
+    if (source)
+      free_BMP(source);
+    if (work)
+      free_BMP(work);
+    free(times);
+    MPI_Comm_free(&sub);
+  }
+  MPI_Bcast(&err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  return err;
+}
+
+// Speedup, efficiency and Karp-Flatt fraction of every point against the
+// first one (the fewest processing elements), then a least-squares fit of
+// the serial fraction: Amdahl 1/S = f + (1 - f)/n for the strong series,
+// Gustafson S = n - a (n - 1) for the weak one. Returns the fitted fraction
+static double analyze_series(SweepPoint *points, int num_points) {
+  const SweepPoint *base = &points[0];
+  double base_pes = (double)base->ranks * base->threads;
+  double sxy = 0.0, sxx = 0.0;
+
+  for (int i = 0; i < num_points; i++) {
+    SweepPoint *p = &points[i];
+    double n = p->ranks * p->threads / base_pes;
+    p->speedup = base->time / p->time;
+    if (p->series == SWEEP_WEAK)
+      p->speedup *= n;
+    p->efficiency = p->speedup / n;
+    p->karp_flatt = NAN;
+    if (n > 1.0) {
+      p->karp_flatt = (1.0 / p->speedup - 1.0 / n) / (1.0 - 1.0 / n);
+      double x = p->series == SWEEP_STRONG ? 1.0 - 1.0 / n : n - 1.0;
+      double y = p->series == SWEEP_STRONG ? 1.0 / p->speedup - 1.0 / n
+                                           : n - p->speedup;
+      sxy += x * y;
+      sxx += x * x;
+    }
+  }
+
+  double fraction = sxx > 0.0 ? sxy / sxx : 0.0;
+  fraction = fraction < 0.0 ? 0.0 : (fraction > 1.0 ? 1.0 : fraction);
+  for (int i = 0; i < num_points; i++) {
+    SweepPoint *p = &points[i];
+    double n = p->ranks * p->threads / base_pes;
+    p->model = p->series == SWEEP_STRONG
+                   ? 1.0 / (fraction + (1.0 - fraction) / n)
+                   : n - fraction * (n - 1.0);
+  }
+  return fraction;
+}
+
+static void print_series(const SweepPoint *points, int num_points,
+                         double fraction, const char *kernel, FILE *fp) {
+  int series = points[0].series;
+  if (series == SWEEP_STRONG)
+    fprintf(fp, "\nStrong scaling (%s, %dx%d):\n", kernel, points[0].width,
+            points[0].height);
+  else
+    fprintf(fp, "\nWeak scaling (%s, %dx%d per processing element):\n", kernel,
+            points[0].width,
+            points[0].height / (points[0].ranks * points[0].threads));
+  fprintf(fp, "\t%5s %7s %5s %10s %8s %10s %10s %8s\n", "Ranks", "Threads",
+          "PEs", "Time (s)", "Speedup", "Efficiency", "Karp-Flatt", "Model");
+
+  const SweepPoint *fastest = &points[0];
+  const SweepPoint *inefficient = NULL;
+  for (int i = 0; i < num_points; i++) {
+    const SweepPoint *p = &points[i];
+    int pes = p->ranks * p->threads;
+    fprintf(fp, "\t%5d %7d %5d %10.6f %8.2f %9.1f%% ", p->ranks, p->threads,
+            pes, p->time, p->speedup, 100.0 * p->efficiency);
+    if (isnan(p->karp_flatt))
+      fprintf(fp, "%10s", "-");
+    else
+      fprintf(fp, "%10.4f", p->karp_flatt);
+    fprintf(fp, " %8.2f\n", p->model);
+
+    if (p->time < fastest->time)
+      fastest = p;
+    if (p->efficiency < SWEEP_EFFICIENCY_THRESHOLD &&
+        (!inefficient || pes < inefficient->ranks * inefficient->threads))
+      inefficient = p;
+  }
+
+  if (series == SWEEP_STRONG) {
+    fprintf(fp, "\tAmdahl fit: serial fraction %.4f", fraction);
+    if (fraction > 0.0)
+      fprintf(fp, ", speedup limit %.1f", 1.0 / fraction);
+    fprintf(fp, "\n\tFastest: %d ranks x %d threads\n", fastest->ranks,
+            fastest->threads);
+  } else {
+    fprintf(fp, "\tGustafson fit: serial fraction %.4f\n", fraction);
+  }
+  if (inefficient)
+    fprintf(fp, "\tEfficiency falls below %.0f%% at %d PEs (%d ranks x %d "
+                "threads)\n",
+            100.0 * SWEEP_EFFICIENCY_THRESHOLD,
+            inefficient->ranks * inefficient->threads, inefficient->ranks,
+            inefficient->threads);
+  else
+    fprintf(fp, "\tEfficiency stays above %.0f%% at every point\n",
+            100.0 * SWEEP_EFFICIENCY_THRESHOLD);
+}
+
+static void write_series(FILE *fp, const SweepPoint *points, int num_points,
+                         double fraction, const char *kernel) {
+  for (int i = 0; i < num_points; i++) {
+    const SweepPoint *p = &points[i];
+    fprintf(fp, "%s,%s,%d,%d,%d,%d,%d,%.6f,%.4f,%.4f,",
+            get_series_name(p->series), kernel, p->width, p->height, p->ranks,
+            p->threads, p->ranks * p->threads, p->time, p->speedup,
+            p->efficiency);
+    if (!isnan(p->karp_flatt))
+      fprintf(fp, "%.6f", p->karp_flatt);
+    fprintf(fp, ",%s,%.6f,%.4f\n",
+            p->series == SWEEP_STRONG ? "amdahl" : "gustafson", fraction,
+            p->model);
+  }
+}
+
+// Creates the results file of the sweep, named after the start time
+static app_error open_sweep_file(FILE **fp, char *path) {
+  app_error err = create_directory(SWEEP_FOLDER);
+  if (err)
+    return err;
+
+  char stamp[32];
+  time_t now = time(NULL);
+  strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime(&now));
+  if (snprintf(path, PATH_MAX, "%s/sweep_%s.csv", SWEEP_FOLDER, stamp) >=
+      PATH_MAX)
+    return ERR_PATH_TOO_LONG;
+
+  *fp = fopen(path, "w");
+  if (!*fp)
+    return ERR_FILE_OPEN;
+  fprintf(*fp, "%s\n", SWEEP_CSV_HEADER);
+  return SUCCESS;
+}
+
+app_error run_sweep(const SweepRequest *request) {
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  int thread_counts[SWEEP_MAX_COUNTS];
+  int rank_counts[SWEEP_MAX_COUNTS];
+  int num_threads = 0;
+  int num_ranks = get_rank_counts(size, rank_counts);
+
+  Kernel kernel;
+  ImageSize *sizes = NULL;
+  int num_sizes = 0;
+  app_error err = resolve_kernel(request->kernel, &kernel);
+  if (!err)
+    err = parse_image_sizes(request->size, &sizes, &num_sizes);
+  if (!err && num_sizes != 1)
+    err = ERR_INVALID_ARGS;
+  if (!err)
+    err = get_thread_counts(request, thread_counts, &num_threads);
+  if (!err && request->repetitions < 1)
+    err = ERR_INVALID_ARGS;
+
+  // The largest weak-scaling image must still fit the int dimensions
+  long long max_pes = (long long)rank_counts[num_ranks - 1] *
+                      (num_threads > 0 ? thread_counts[num_threads - 1] : 1);
+  if (!err && (request->series & SWEEP_WEAK) &&
+      (long long)sizes[0].height * max_pes > INT_MAX)
+    err = ERR_INVALID_ARGS;
+
+  int points_per_series = num_ranks * num_threads;
+  SweepPoint *points =
+      (SweepPoint *)calloc(2 * points_per_series + 1, sizeof(SweepPoint));
+  if (!err && !points)
+    err = ERR_MEM_ALLOC;
+
+  FILE *fp = NULL;
+  char path[PATH_MAX];
+  if (!err && rank == 0)
+    err = open_sweep_file(&fp, path);
+
+  int any_err = err;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  err = (app_error)any_err;
+
+  if (!err && rank == 0)
+    printf("Scaling sweep of the distributed engine: %d ranks, %d "
+           "repetition(s) per configuration\n",
+           size, request->repetitions);
+
+  int num_points = 0;
+  for (int series = SWEEP_STRONG; series <= SWEEP_WEAK && !err; series <<= 1) {
+    if (!(request->series & series))
+      continue;
+
+    SweepPoint *first = &points[num_points];
+    for (int i = 0; i < num_ranks && !err; i++) {
+      for (int j = 0; j < num_threads && !err; j++) {
+        SweepPoint *p = &points[num_points++];
+        p->series = series;
+        p->ranks = rank_counts[i];
+        p->threads = thread_counts[j];
+        p->width = sizes[0].width;
+        p->height = sizes[0].height;
+        if (series == SWEEP_WEAK)
+          p->height *= p->ranks * p->threads;
+        err = time_distributed_configuration(
+            rank < p->ranks, p->threads, kernel, p->width, p->height,
+            request->seed, request->repetitions, &p->time);
+      }
+    }
+
+    if (!err && rank == 0) {
+      double fraction = analyze_series(first, points_per_series);
+      print_series(first, points_per_series, fraction, kernel.name, stdout);
+      write_series(fp, first, points_per_series, fraction, kernel.name);
+    }
+  }
+
+  if (fp) {
+    fclose(fp);
+    if (!err)
+      printf("\nSweep results written to %s\n", path);
+  }
+  free(points);
+  free(sizes);
+  return err;
+}
@@ -0,0 +1,92 @@
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+#include "../config/kernel.h"
+#include "../errors/errors.h"
+
+// Series of a scaling sweep (bit mask)
+#define SWEEP_STRONG 1
+#define SWEEP_WEAK 2
+
+// Default image of a strong-scaling sweep, and of one processing element
+// (one rank with one thread) of a weak-scaling sweep
+#define DEFAULT_SWEEP_SIZE "2048x2048"
+
+// Default timed repetitions of every configuration (the median is kept)
+#define DEFAULT_SWEEP_REPETITIONS 3
+
+// Kernel of the sweep when -kernels is not given
+#define DEFAULT_SWEEP_KERNEL "gaussblur5"
+
+// Parallel efficiency below which more ranks and threads stop paying off
+#define SWEEP_EFFICIENCY_THRESHOLD 0.5
+
+/**
+ * A scaling sweep of the distributed engine over rank and thread counts.
+ */
+typedef struct {
+  int series;              // SWEEP_STRONG and/or SWEEP_WEAK
+  const char *kernel;      // Kernel name (see resolve_kernel())
+  const char *size;        // "WxH", see DEFAULT_SWEEP_SIZE
+  const char *thread_list; // Thread counts "1,2,4" (NULL: powers of two)
+  int max_threads;         // Largest thread count when thread_list is NULL
+  int repetitions;         // Timed runs per configuration
+  unsigned long long seed; // Seed of the synthetic images
+} SweepRequest;
+
+/**
+ * Parses the series of a sweep: "strong", "weak" or "both".
+ * @param name Series name
+ * @param series Output: SWEEP_STRONG and/or SWEEP_WEAK
+ * @return app_error code:
+ *         - SUCCESS: Name parsed
+ *         - ERR_INVALID_ARGS: Unknown name
+ */
+app_error parse_sweep_series(const char *name, int *series);
+
+/**
+ * Times the distributed engine on the ranks of MPI_COMM_WORLD that pass
+ * member, through a sub-communicator, with threads OpenMP threads each, on a
+ * synthetic image generated in memory. The others wait. World rank 0 must be
+ * a member. Collective over MPI_COMM_WORLD.
+ * @param member Non-zero if the caller takes part in the configuration
+ * @param threads OpenMP threads of every member
+ * @param kernel The convolution kernel
+ * @param width Image width
+ * @param height Image height
+ * @param seed Seed of the synthetic image
+ * @param repetitions Timed runs (at least one)
+ * @param time Output: median time of the runs, set on rank 0 only
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: Configuration timed
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error time_distributed_configuration(int member, int threads,
+                                         Kernel kernel, int width, int height,
+                                         unsigned long long seed,
+                                         int repetitions, double *time);
+
+/**
+ * Runs strong- and/or weak-scaling series of the distributed engine on
+ * synthetic images generated in memory. Every configuration uses the first
+ * p ranks of MPI_COMM_WORLD (p = 1, 2, 4, ... and the world size) through a
+ * sub-communicator, with every thread count of the list; the others wait.
+ * The strong series keeps the image fixed, the weak series scales its height
+ * with ranks x threads so the work per processing element stays constant.
+ * Rank 0 computes the speedup against the smallest configuration, the
+ * parallel efficiency, the Karp-Flatt serial fraction of every point and an
+ * Amdahl (strong) or Gustafson (weak) fit over the series, prints them and
+ * writes every point of the sweep to one CSV file in SWEEP_FOLDER.
+ * Collective over MPI_COMM_WORLD.
+ * @param request The sweep to run
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: Sweep completed
+ *         - ERR_INVALID_ARGS: Unknown kernel, bad size or thread list, or a
+ *           weak-scaling image too large
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ *         - ERR_DIR_CREATE: The sweep folder could not be created
+ *         - ERR_FILE_OPEN: The results file could not be created
+ */
+app_error run_sweep(const SweepRequest *request);
+
+#endif
@@ -0,0 +1,184 @@
+#include "taskgraph.h"
+#include "../convolution/convolution.h"
+#include <omp.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Buffers and tile bookkeeping of one job.
+ */
+typedef struct {
+  Pixel *buffers[2]; // Outputs of the even and of the odd stages
+  double *done;      // Finish time of every stage and tile, also the
+                     // dependency object of its task
+  double busy;       // Compute time of the tiles
+  int tile_rows;
+  int tiles;
+} JobState;
+
+// Tiles are at least as tall as the largest halo of the chain, so that a
+// tile only reads its own rows and those of its two neighbours
+static int get_job_tile_rows(const TaskGraphJob *job, int tile_rows) {
+  for (int s = 0; s < job->count; s++)
+    if (job->kernels[s].size / 2 > tile_rows)
+      tile_rows = job->kernels[s].size / 2;
+  return tile_rows;
+}
+
+static app_error init_job_state(const TaskGraphJob *job, int tile_rows,
+                                JobState *state) {
+  int width = job->source->width;
+  int height = job->source->height;
+  state->tile_rows = get_job_tile_rows(job, tile_rows);
+  state->tiles = (height + state->tile_rows - 1) / state->tile_rows;
+  state->busy = 0.0;
+  state->buffers[0] = alloc_pixel(width, height);
+  state->buffers[1] = job->count > 1 ? alloc_pixel(width, height) : NULL;
+  state->done =
+      (double *)calloc((size_t)job->count * state->tiles, sizeof(double));
+  if (!state->buffers[0] || (job->count > 1 && !state->buffers[1]) ||
+      !state->done)
+    return ERR_MEM_ALLOC;
+  return SUCCESS;
+}
+
+static void free_job_state(JobState *state) {
+  free_pixel(state->buffers[0]);
+  free_pixel(state->buffers[1]);
+  free(state->done);
+}
+
+// Computes one stage of one tile, or nothing once a tile failed. Stage s
+// reads the buffer of stage s - 1 (the source for the first stage) and
+// writes its own
+static void run_tile(const TaskGraphJob *job, JobState *state, int stage,
+                     int tile, double start_time, int *failed) {
+  int failure;
+#pragma omp atomic read
+  failure = *failed;
+
+  double begin = omp_get_wtime();
+  if (!failure) {
+    const Image *src = job->source;
+    int first = tile * state->tile_rows;
+    int rows = src->height - first < state->tile_rows ? src->height - first
+                                                      : state->tile_rows;
+    const Pixel *input =
+        stage == 0 ? src->data : state->buffers[(stage - 1) % 2];
+    Pixel *output = state->buffers[stage % 2] + (size_t)first * src->width;
+    app_error err = convolve_rows_on_thread(input, src->width, src->height,
+                                            first, rows, job->kernels[stage],
+                                            output);
+    if (err) {
+#pragma omp atomic write
+      *failed = err;
+    }
+  }
+  double end = omp_get_wtime();
+
+  state->done[(size_t)stage * state->tiles + tile] = end - start_time;
+#pragma omp atomic
+  state->busy += end - begin;
+}
+
+// Creates one task per job, stage and tile. Called by one thread of the team
+static void create_tasks(const TaskGraphJob *jobs, JobState *states,
+                         int num_jobs, double start_time, int *failed) {
+  for (int j = 0; j < num_jobs; j++) {
+    const TaskGraphJob *job = &jobs[j];
+    JobState *state = &states[j];
+    for (int s = 0; s < job->count; s++) {
+      for (int t = 0; t < state->tiles; t++) {
+        // Dependency objects of the tile and of its neighbours in the
+        // previous stage
+        size_t slot = (size_t)s * state->tiles + t;
+        if (s == 0) {
+#pragma omp task depend(out : state->done[slot])
+          run_tile(job, state, s, t, start_time, failed);
+        } else {
+          size_t mid = slot - state->tiles;
+          size_t lo = t > 0 ? mid - 1 : mid;
+          size_t hi = t + 1 < state->tiles ? mid + 1 : mid;
+#pragma omp task depend(in : state->done[lo], state->done[mid],               \
+                            state->done[hi]) depend(out : state->done[slot])
+          run_tile(job, state, s, t, start_time, failed);
+        }
+      }
+    }
+  }
+}
+
+app_error run_task_graph(TaskGraphJob *jobs, int num_jobs, int tile_rows,
+                         TaskGraphStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  if (tile_rows < 1)
+    return ERR_INVALID_ARGS;
+  for (int j = 0; j < num_jobs; j++) {
+    jobs[j].output = NULL;
+    if (jobs[j].count < 1)
+      return ERR_INVALID_ARGS;
+  }
+
+  JobState *states =
+      (JobState *)calloc(num_jobs > 0 ? num_jobs : 1, sizeof(JobState));
+  if (!states)
+    return ERR_MEM_ALLOC;
+  app_error err = SUCCESS;
+  for (int j = 0; j < num_jobs && !err; j++)
+    err = init_job_state(&jobs[j], tile_rows, &states[j]);
+
+  int failed = SUCCESS;
+  double start_time = omp_get_wtime();
+  if (!err) {
+#pragma omp parallel
+    {
+#pragma omp single
+      {
+        stats->threads = omp_get_num_threads();
+        create_tasks(jobs, states, num_jobs, start_time, &failed);
+      }
+    }
+    err = (app_error)failed;
+  }
+  stats->wall_time = omp_get_wtime() - start_time;
+
+  for (int j = 0; j < num_jobs && !err; j++) {
+    TaskGraphJob *job = &jobs[j];
+    JobState *state = &states[j];
+    int last = (job->count - 1) % 2;
+    job->output = alloc_image(state->buffers[last], job->source->width,
+                              job->source->height);
+    if (!job->output) {
+      err = ERR_MEM_ALLOC;
+      break;
+    }
+    state->buffers[last] = NULL;
+
+    const double *done = &state->done[(size_t)(job->count - 1) * state->tiles];
+    job->finish_time = 0.0;
+    for (int t = 0; t < state->tiles; t++)
+      if (done[t] > job->finish_time)
+        job->finish_time = done[t];
+    job->busy_time = state->busy;
+    stats->tiles += (long long)job->count * state->tiles;
+    stats->busy_time += state->busy;
+  }
+
+  for (int j = 0; j < num_jobs; j++) {
+    free_job_state(&states[j]);
+    if (err && jobs[j].output) {
+      free_BMP(jobs[j].output);
+      jobs[j].output = NULL;
+    }
+  }
+  free(states);
+  return err;
+}
+
+void print_task_graph_stats(const TaskGraphStats *stats, FILE *fp) {
+  double capacity = stats->wall_time * stats->threads;
+  fprintf(fp, "Task graph: %lld tiles on %d threads in %.6f s, busy %.6f s "
+              "(%.1f%% utilisation)\n",
+          stats->tiles, stats->threads, stats->wall_time, stats->busy_time,
+          capacity > 0 ? 100.0 * stats->busy_time / capacity : 0.0);
+}
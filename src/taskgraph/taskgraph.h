@@ -0,0 +1,64 @@
+#ifndef __TASKGRAPH_H__
+#define __TASKGRAPH_H__
+
+#include "../bmp/bmp_io.h"
+#include "../config/kernel.h"
+#include "../errors/errors.h"
+#include <stdio.h>
+
+// Default rows of a tile (raised to the largest halo of a chain)
+#define DEFAULT_TASKGRAPH_TILE_ROWS 32
+
+/**
+ * One image and the chain of kernels the task graph applies to it.
+ */
+typedef struct {
+  const Image *source;   // Input of the first stage (left unchanged)
+  const Kernel *kernels; // Chain of kernels, applied in order
+  int count;             // Stages of the chain (at least one)
+  Image *output;         // Output: result of the last stage (free_BMP())
+  double busy_time;      // Output: compute time of the tiles of the job
+  double finish_time;    // Output: time until the last tile was done
+} TaskGraphJob;
+
+/**
+ * Statistics of one execution of the task graph.
+ */
+typedef struct {
+  long long tiles;  // Tile tasks executed
+  int threads;      // Threads of the team
+  double wall_time; // Elapsed time of the graph
+  double busy_time; // Compute time of every tile, summed
+} TaskGraphStats;
+
+/**
+ * Applies the chain of every job to its image with one OpenMP team and one
+ * task per tile of tile_rows rows and stage. Stage s of tile t depends on
+ * stage s - 1 of tiles t - 1, t and t + 1 (tiles are at least as tall as
+ * the halo of every kernel of the chain), so a stage starts on a tile as
+ * soon as the rows it reads are done, and the tiles of every job, stage and
+ * kernel share the team without a barrier in between. Every job needs two
+ * buffers of its image (one for a single kernel): the stages alternate
+ * between them, which the dependencies make safe. The results are identical
+ * to the multithreaded engine.
+ * @param jobs The jobs, their outputs are set on success
+ * @param num_jobs Number of jobs
+ * @param tile_rows Rows of a tile, see DEFAULT_TASKGRAPH_TILE_ROWS
+ * @param stats Output: statistics of the execution
+ * @return app_error code:
+ *         - SUCCESS: Every output computed
+ *         - ERR_INVALID_ARGS: tile_rows is not positive or a job is empty
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error run_task_graph(TaskGraphJob *jobs, int num_jobs, int tile_rows,
+                         TaskGraphStats *stats);
+
+/**
+ * Prints the wall time, tile count and utilisation of the team of a task
+ * graph execution.
+ * @param stats Statistics of the execution
+ * @param fp File stream to write to
+ */
+void print_task_graph_stats(const TaskGraphStats *stats, FILE *fp);
+
+#endif
@@ -0,0 +1,310 @@
+#include "temporal.h"
+#include "../convolution/convolution.h"
+#include "../timing/phase_timer.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int kernel_iterations = DEFAULT_KERNEL_ITERATIONS;
+static int halo_depth = DEFAULT_HALO_DEPTH;
+static BlockingStats blocking_stats;
+
+void set_kernel_iterations(int iterations) { kernel_iterations = iterations; }
+
+int get_kernel_iterations(void) { return kernel_iterations; }
+
+void set_halo_depth(int depth) { halo_depth = depth; }
+
+int get_halo_depth(void) { return halo_depth; }
+
+// Halo of the kernels [first, last) of a chain: the sum of their halos
+static int get_group_halo(const Kernel *chain, int first, int last) {
+  int halo = 0;
+  for (int j = first; j < last; j++)
+    halo += chain[j].size / 2;
+  return halo;
+}
+
+// Output rows [*out_lo, *out_hi) of a kernel of half size h applied to the
+// valid rows [lo, hi); the image edges are valid up to the border
+static void get_output_rows(int lo, int hi, int h, int height, int *out_lo,
+                            int *out_hi) {
+  *out_lo = lo == 0 ? 0 : lo + h;
+  *out_hi = hi == height ? height : hi - h;
+}
+
+// Rows the kernels [first, last) of a group compute on the strip
+// [start_y, start_y + local_h), halos included
+static long long get_group_rows(const Kernel *chain, int first, int last,
+                                int height, int start_y, int local_h) {
+  int halo = get_group_halo(chain, first, last);
+  int lo = start_y - halo > 0 ? start_y - halo : 0;
+  int hi = start_y + local_h + halo < height ? start_y + local_h + halo
+                                             : height;
+  long long rows = 0;
+  for (int j = first; j < last; j++) {
+    int out_lo, out_hi;
+    get_output_rows(lo, hi, chain[j].size / 2, height, &out_lo, &out_hi);
+    rows += out_hi > out_lo ? out_hi - out_lo : 0;
+    lo = out_lo;
+    hi = out_hi;
+  }
+  return rows;
+}
+
+// Adds the exchanges and the rows of every rank of a successful chain
+static void record_blocking(const Kernel *chain, int count, int depth,
+                            int height, int size, int max_halo) {
+  for (int a = 0; a < count; a += depth) {
+    int b = a + depth < count ? a + depth : count;
+    for (int r = 0; r < size; r++) {
+      int start_y, local_h;
+      get_chunk_metadata(height, r, size, &start_y, &local_h);
+      blocking_stats.computed +=
+          get_group_rows(chain, a, b, height, start_y, local_h);
+    }
+    blocking_stats.exchanges++;
+  }
+  if (max_halo > blocking_stats.max_halo)
+    blocking_stats.max_halo = max_halo;
+  blocking_stats.needed += (long long)count * height;
+}
+
+void blocking_stats_reset(void) {
+  BlockingStats empty = {0, 0, 0, 0};
+  blocking_stats = empty;
+}
+
+void get_blocking_stats(BlockingStats *stats) { *stats = blocking_stats; }
+
+void print_blocking_stats(const BlockingStats *stats, FILE *fp) {
+  if (stats->exchanges == 0)
+    return;
+  fprintf(fp,
+          "\tTemporal blocking: %d halo exchange(s) of up to %d rows, %.1f%% "
+          "of the rows computed redundantly\n",
+          stats->exchanges, stats->max_halo,
+          stats->needed > 0
+              ? 100.0 * (stats->computed - stats->needed) / stats->needed
+              : 0.0);
+}
+
+// Broadcasts the sizes and coefficients of the chain. On success, chain
+// holds the kernels with the coefficients in *coefficients on every rank
+static app_error broadcast_chain(const Kernel *kernels, int count,
+                                 MPI_Comm comm, Kernel *chain,
+                                 double **coefficients) {
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  int *sizes = (int *)malloc(count * sizeof(int));
+  app_error err = sizes ? SUCCESS : ERR_MEM_ALLOC;
+  for (int j = 0; !err && j < count; j++)
+    sizes[j] = rank == 0 ? kernels[j].size : 0;
+  if (!err)
+    MPI_Bcast(sizes, count, MPI_INT, 0, comm);
+
+  size_t total = 0;
+  for (int j = 0; !err && j < count; j++)
+    total += (size_t)sizes[j] * sizes[j];
+  *coefficients = err ? NULL : (double *)malloc(total * sizeof(double));
+  if (!err && !*coefficients)
+    err = ERR_MEM_ALLOC;
+
+  int any_err = err;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, comm);
+  err = (app_error)any_err;
+  if (err) {
+    free(sizes);
+    return err;
+  }
+
+  double *data = *coefficients;
+  for (int j = 0; j < count; j++) {
+    size_t taps = (size_t)sizes[j] * sizes[j];
+    if (rank == 0)
+      for (size_t i = 0; i < taps; i++)
+        data[i] = kernels[j].data[i];
+    chain[j].name = kernels[j].name;
+    chain[j].size = sizes[j];
+    chain[j].data = data;
+    data += taps;
+  }
+  MPI_Bcast(*coefficients, (int)total, MPI_DOUBLE, 0, comm);
+  free(sizes);
+  return SUCCESS;
+}
+
+app_error convolve_distributed_chain(Image *img, const Kernel *kernels,
+                                     int count, int depth,
+                                     double *elapsed_time) {
+  if (count < 1 || depth < 0)
+    return ERR_INVALID_ARGS;
+  if (depth == 0 || depth > count)
+    depth = count;
+
+  double start_time = MPI_Wtime();
+  MPI_Comm comm = get_convolution_comm();
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  // 1. Broadcast Dimensions and the chain
+  phase_timer_begin(PHASE_BCAST);
+  int dims[2];
+  if (rank == 0) {
+    dims[0] = img->width;
+    dims[1] = img->height;
+  }
+  MPI_Bcast(dims, 2, MPI_INT, 0, comm);
+  int width = dims[0], height = dims[1];
+
+  Kernel *chain = (Kernel *)malloc(count * sizeof(Kernel));
+  int chain_err = chain ? SUCCESS : ERR_MEM_ALLOC;
+  MPI_Allreduce(MPI_IN_PLACE, &chain_err, 1, MPI_INT, MPI_MAX, comm);
+  double *coefficients = NULL;
+  app_error err = (app_error)chain_err;
+  if (!err)
+    err = broadcast_chain(kernels, count, comm, chain, &coefficients);
+  phase_timer_end(PHASE_BCAST);
+  if (err) {
+    free(chain);
+    return err;
+  }
+
+  // 2. Allocate two buffers holding the strip and the deepest halos. Image
+  // row r sits at row r - (start_y - max_halo) of either buffer
+  int start_y, local_h;
+  get_chunk_metadata(height, rank, size, &start_y, &local_h);
+  int max_halo = 0;
+  for (int a = 0; a < count; a += depth) {
+    int b = a + depth < count ? a + depth : count;
+    int halo = get_group_halo(chain, a, b);
+    if (halo > max_halo)
+      max_halo = halo;
+  }
+  Pixel *current = alloc_pixel(width, local_h + 2 * max_halo);
+  Pixel *next = alloc_pixel(width, local_h + 2 * max_halo);
+  int any_err = (!current || !next) ? ERR_MEM_ALLOC : SUCCESS;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, comm);
+  err = (app_error)any_err;
+
+  MPI_Datatype row_type = create_row_datatype(width);
+  int origin = start_y - max_halo;
+  if (!err) {
+    // 3. Scatter the strips
+    phase_timer_begin(PHASE_SCATTER);
+    int *sendcounts = NULL;
+    int *displs = NULL;
+    if (rank == 0) {
+      sendcounts = malloc(size * sizeof(int));
+      displs = malloc(size * sizeof(int));
+      for (int r = 0; r < size; r++)
+        get_chunk_metadata(height, r, size, &displs[r], &sendcounts[r]);
+    }
+    MPI_Scatterv(rank == 0 ? img->data : NULL, sendcounts, displs, row_type,
+                 current + (size_t)max_halo * width, local_h, row_type, 0,
+                 comm);
+    free(sendcounts);
+    free(displs);
+    phase_timer_end(PHASE_SCATTER);
+  }
+
+  strip_function compute_strip = convolve_rows_direct;
+  if (get_accumulation_precision() == PRECISION_FLOAT)
+    compute_strip = convolve_rows_direct_float;
+
+  // 4. One halo exchange per group, then its kernels without communication
+  for (int a = 0; !err && a < count; a += depth) {
+    int b = a + depth < count ? a + depth : count;
+    int halo = get_group_halo(chain, a, b);
+
+    phase_timer_begin(PHASE_HALO);
+    Pixel *base = current + (size_t)(max_halo - halo) * width;
+    if (halo <= height / size)
+      exchange_halos(base, width, local_h, halo, rank, size);
+    else
+      exchange_deep_halos(base, width, height, start_y, local_h, halo, rank,
+                          size);
+    phase_timer_end(PHASE_HALO);
+
+    // Valid image rows [lo, hi); the buffer ends clamp like the image edges
+    phase_timer_begin(PHASE_COMPUTE);
+    int lo = start_y - halo > 0 ? start_y - halo : 0;
+    int hi = start_y + local_h + halo < height ? start_y + local_h + halo
+                                               : height;
+    for (int j = a; !err && j < b; j++) {
+      int out_lo, out_hi;
+      get_output_rows(lo, hi, chain[j].size / 2, height, &out_lo, &out_hi);
+      if (out_hi > out_lo)
+        err = compute_strip(current + (size_t)(lo - origin) * width, width,
+                            hi - lo, out_lo - lo, out_hi - out_lo, chain[j],
+                            next + (size_t)(out_lo - origin) * width);
+      Pixel *swap = current;
+      current = next;
+      next = swap;
+      lo = out_lo;
+      hi = out_hi;
+    }
+    phase_timer_end(PHASE_COMPUTE);
+
+    any_err = err;
+    MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, comm);
+    err = (app_error)any_err;
+  }
+
+  // 5. Gather Results
+  if (!err) {
+    phase_timer_begin(PHASE_GATHER);
+    int *recvcounts = NULL;
+    int *rdispls = NULL;
+    if (rank == 0) {
+      recvcounts = malloc(size * sizeof(int));
+      rdispls = malloc(size * sizeof(int));
+      for (int r = 0; r < size; r++)
+        get_chunk_metadata(height, r, size, &rdispls[r], &recvcounts[r]);
+    }
+    MPI_Gatherv(current + (size_t)max_halo * width, local_h, row_type,
+                rank == 0 ? img->data : NULL, recvcounts, rdispls, row_type, 0,
+                comm);
+    free(recvcounts);
+    free(rdispls);
+    phase_timer_end(PHASE_GATHER);
+  }
+
+  if (!err)
+    record_blocking(chain, count, depth, height, size, max_halo);
+
+  // 6. Cleanup
+  MPI_Type_free(&row_type);
+  free_pixel(current);
+  free_pixel(next);
+  free(coefficients);
+  free(chain);
+
+  double end_time = MPI_Wtime();
+  if (elapsed_time != NULL)
+    *elapsed_time = end_time - start_time;
+
+  return err;
+}
+
+app_error convolve_distributed_iterated(Image *img, Kernel kernel,
+                                        double *elapsed_time) {
+  int count = kernel_iterations;
+  if (count < 1)
+    return ERR_INVALID_ARGS;
+  Kernel *chain = (Kernel *)malloc(count * sizeof(Kernel));
+  int err = chain ? SUCCESS : ERR_MEM_ALLOC;
+  MPI_Allreduce(MPI_IN_PLACE, &err, 1, MPI_INT, MPI_MAX,
+                get_convolution_comm());
+  if (err) {
+    free(chain);
+    return (app_error)err;
+  }
+  for (int j = 0; j < count; j++)
+    chain[j] = kernel;
+  err = convolve_distributed_chain(img, chain, count, halo_depth,
+                                   elapsed_time);
+  free(chain);
+  return (app_error)err;
+}
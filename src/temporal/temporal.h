@@ -0,0 +1,111 @@
+#ifndef __TEMPORAL_H__
+#define __TEMPORAL_H__
+
+#include "../bmp/bmp_io.h"
+#include "../config/kernel.h"
+#include "../errors/errors.h"
+#include <stdio.h>
+
+// Times every kernel of a run is applied when none is given
+#define DEFAULT_KERNEL_ITERATIONS 1
+
+// Kernels applied between two halo exchanges when none is given (0: all of
+// them after a single exchange)
+#define DEFAULT_HALO_DEPTH 0
+
+/**
+ * Halo exchanges and computed rows of the temporally blocked convolutions
+ * since the last blocking_stats_reset(), identical on all ranks.
+ */
+typedef struct {
+  int exchanges;      // Halo exchanges
+  int max_halo;       // Rows of the deepest halo exchanged
+  long long computed; // Rows computed by all ranks, halos included
+  long long needed;   // Rows of the outputs of every kernel applied
+} BlockingStats;
+
+/**
+ * Selects how many times the benchmark and -transform apply every kernel
+ * (or every chain) in a row.
+ * @param iterations Applications, see DEFAULT_KERNEL_ITERATIONS
+ */
+void set_kernel_iterations(int iterations);
+
+/**
+ * Returns how many times every kernel is applied.
+ */
+int get_kernel_iterations(void);
+
+/**
+ * Selects the kernels the distributed engine applies between two halo
+ * exchanges when it runs a chain or an iterated kernel.
+ * @param depth Kernels per exchange, see DEFAULT_HALO_DEPTH
+ */
+void set_halo_depth(int depth);
+
+/**
+ * Returns the kernels applied between two halo exchanges.
+ */
+int get_halo_depth(void);
+
+/**
+ * Distributed convolution of a chain of kernels with temporal blocking, over
+ * the communicator of the distributed engine (see set_convolution_comm()).
+ * Rank 0 scatters the strips once. The chain is then cut into groups of
+ * depth kernels. Before every group the ranks exchange halos as deep as the
+ * halos of the whole group, then apply its kernels to their strip without
+ * communicating: every kernel is also computed on the halo rows the next
+ * ones still need, so the valid rows shrink by one halo per kernel and
+ * cover the strip again at the end of the group. Rows beyond the image are
+ * never computed, so the image edges are clamped exactly as by the serial
+ * engine after every kernel. Rank 0 finally gathers the result. A depth of
+ * one exchanges before every kernel; deeper groups trade redundant compute
+ * on the halos for fewer messages. The exchanges and rows are added to the
+ * blocking statistics (see get_blocking_stats()).
+ * @param img Image on rank 0 (ignored on the other ranks)
+ * @param kernels Chain of kernels, applied in order (the coefficients are
+ * only read on rank 0; count must be identical on all ranks)
+ * @param count Kernels of the chain (at least one)
+ * @param depth Kernels per halo exchange (0 or more than count: all)
+ * @param elapsed_time Output: elapsed time of the whole operation
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: Convolution completed, result in img on rank 0
+ *         - ERR_INVALID_ARGS: Empty chain or negative depth
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error convolve_distributed_chain(Image *img, const Kernel *kernels,
+                                     int count, int depth,
+                                     double *elapsed_time);
+
+/**
+ * Applies kernel get_kernel_iterations() times with
+ * convolve_distributed_chain() and get_halo_depth().
+ * @param img Image on rank 0 (ignored on the other ranks)
+ * @param kernel The convolution kernel (only read on rank 0)
+ * @param elapsed_time Output: elapsed time of the whole operation
+ * @return app_error code, see convolve_distributed_chain()
+ */
+app_error convolve_distributed_iterated(Image *img, Kernel kernel,
+                                        double *elapsed_time);
+
+/**
+ * Clears the blocking statistics.
+ */
+void blocking_stats_reset(void);
+
+/**
+ * Returns the blocking statistics accumulated since blocking_stats_reset().
+ * Rank-local, no communication: every rank computes the rows of all ranks.
+ * @param stats Output statistics
+ */
+void get_blocking_stats(BlockingStats *stats);
+
+/**
+ * Prints the exchanges, the deepest halo and the share of rows computed
+ * redundantly. Prints nothing if no halo was exchanged.
+ * @param stats The statistics
+ * @param fp File stream to write to
+ */
+void print_blocking_stats(const BlockingStats *stats, FILE *fp);
+
+#endif
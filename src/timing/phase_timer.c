@@ -0,0 +1,71 @@
+#include "phase_timer.h"
+
+// Accumulated time and start stamp of each phase on this rank
+static double phase_totals[PHASE_COUNT];
+static double phase_starts[PHASE_COUNT];
+
+void phase_timer_reset(void) {
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    phase_totals[p] = 0.0;
+    phase_starts[p] = 0.0;
+  }
+}
+
+void phase_timer_begin(timing_phase phase) {
+  phase_starts[phase] = MPI_Wtime();
+}
+
+void phase_timer_end(timing_phase phase) {
+  phase_totals[phase] += MPI_Wtime() - phase_starts[phase];
+}
+
+void phase_timer_add(timing_phase phase, double seconds) {
+  phase_totals[phase] += seconds;
+}
+
+double phase_timer_get(timing_phase phase) { return phase_totals[phase]; }
+
+void phase_timer_reduce(MPI_Comm comm, PhaseStats *stats) {
+  int size;
+  MPI_Comm_size(comm, &size);
+
+  double sum[PHASE_COUNT];
+  MPI_Reduce(phase_totals, stats->min, PHASE_COUNT, MPI_DOUBLE, MPI_MIN, 0,
+             comm);
+  MPI_Reduce(phase_totals, stats->max, PHASE_COUNT, MPI_DOUBLE, MPI_MAX, 0,
+             comm);
+  MPI_Reduce(phase_totals, sum, PHASE_COUNT, MPI_DOUBLE, MPI_SUM, 0, comm);
+
+  for (int p = 0; p < PHASE_COUNT; p++)
+    stats->avg[p] = sum[p] / size;
+}
+
+const char *get_phase_name(timing_phase phase) {
+  switch (phase) {
+  case PHASE_READ:
+    return "Read";
+  case PHASE_BCAST:
+    return "Bcast";
+  case PHASE_SCATTER:
+    return "Scatter";
+  case PHASE_HALO:
+    return "Halo";
+  case PHASE_COMPUTE:
+    return "Compute";
+  case PHASE_GATHER:
+    return "Gather";
+  case PHASE_WRITE:
+    return "Write";
+  default:
+    return "Unknown";
+  }
+}
+
+void print_phase_stats(const PhaseStats *stats, FILE *fp) {
+  for (int p = 0; p < PHASE_COUNT; p++) {
+    if (stats->max[p] <= 0.0)
+      continue;
+    fprintf(fp, "\t\t%-8s avg %.6f s | max %.6f s\n",
+            get_phase_name((timing_phase)p), stats->avg[p], stats->max[p]);
+  }
+}
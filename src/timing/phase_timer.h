@@ -0,0 +1,86 @@
+#ifndef __PHASE_TIMER_H__
+#define __PHASE_TIMER_H__
+
+#include <mpi.h>
+#include <stdio.h>
+
+/**
+ * The phases a single kernel run is broken down into.
+ * Phases that do not apply to an engine (e.g. halo exchange in serial mode)
+ * simply stay at zero.
+ */
+typedef enum {
+  PHASE_READ = 0,
+  PHASE_BCAST,
+  PHASE_SCATTER,
+  PHASE_HALO,
+  PHASE_COMPUTE,
+  PHASE_GATHER,
+  PHASE_WRITE,
+  PHASE_COUNT
+} timing_phase;
+
+/**
+ * Per-phase times reduced across the ranks that took part in a run.
+ */
+typedef struct {
+  double min[PHASE_COUNT];
+  double max[PHASE_COUNT];
+  double avg[PHASE_COUNT];
+} PhaseStats;
+
+/**
+ * Clears the per-rank phase accumulators.
+ */
+void phase_timer_reset(void);
+
+/**
+ * Starts timing a phase on the calling rank.
+ * Must be called outside of OpenMP parallel regions.
+ * @param phase The phase to start
+ */
+void phase_timer_begin(timing_phase phase);
+
+/**
+ * Stops timing a phase and adds the elapsed time to its accumulator.
+ * @param phase The phase to stop
+ */
+void phase_timer_end(timing_phase phase);
+
+/**
+ * Adds an externally measured duration to a phase accumulator.
+ * @param phase The phase to add to
+ * @param seconds Duration in seconds
+ */
+void phase_timer_add(timing_phase phase, double seconds);
+
+/**
+ * Returns the time accumulated so far for a phase on the calling rank.
+ * @param phase The phase to query
+ * @return Accumulated time in seconds
+ */
+double phase_timer_get(timing_phase phase);
+
+/**
+ * Reduces the per-rank accumulators to min/max/avg on rank 0 of comm.
+ * Collective over comm.
+ * @param comm Communicator of the ranks that took part in the run
+ * @param stats Output statistics (only valid on rank 0 of comm)
+ */
+void phase_timer_reduce(MPI_Comm comm, PhaseStats *stats);
+
+/**
+ * Returns the human readable name of a phase (used for CSV headers and logs).
+ * @param phase The phase
+ * @return Phase name
+ */
+const char *get_phase_name(timing_phase phase);
+
+/**
+ * Prints the average and maximum time of every non-zero phase.
+ * @param stats The reduced statistics
+ * @param fp File stream to write to
+ */
+void print_phase_stats(const PhaseStats *stats, FILE *fp);
+
+#endif
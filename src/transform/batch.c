@@ -0,0 +1,417 @@
+#include "batch.h"
+#include "../bmp/bmp_io.h"
+#include "../config/files.h"
+#include "../config/inputs.h"
+#include "../file_utils/file_utils.h"
+#include "../memory/numa.h"
+#include "../planner/planner.h"
+#include "../taskgraph/taskgraph.h"
+#include "transform.h"
+#include <limits.h>
+#include <mpi.h>
+#include <omp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Bounded FIFO of decoded images between two pipeline stages.
+ */
+typedef struct {
+  Image **images;
+  int *files; // Input index of every queued image
+  int capacity;
+  int head;
+  int count;
+  int closed;  // The producer is done, pop() drains the queue
+  int aborted; // A stage failed, push() and pop() give up at once
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+} ImageQueue;
+
+static app_error queue_init(ImageQueue *q, int capacity) {
+  q->images = (Image **)malloc(capacity * sizeof(Image *));
+  q->files = (int *)malloc(capacity * sizeof(int));
+  if (!q->images || !q->files) {
+    free(q->images);
+    free(q->files);
+    return ERR_MEM_ALLOC;
+  }
+  q->capacity = capacity;
+  q->head = 0;
+  q->count = 0;
+  q->closed = 0;
+  q->aborted = 0;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->changed, NULL);
+  return SUCCESS;
+}
+
+// Frees the queue and the images left in it after an abort
+static void queue_destroy(ImageQueue *q) {
+  for (int i = 0; i < q->count; i++)
+    free_BMP(q->images[(q->head + i) % q->capacity]);
+  free(q->images);
+  free(q->files);
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->changed);
+}
+
+// Blocks while the queue is full. Returns 0 if the image was not queued
+static int queue_push(ImageQueue *q, Image *img, int file) {
+  pthread_mutex_lock(&q->lock);
+  while (q->count == q->capacity && !q->aborted)
+    pthread_cond_wait(&q->changed, &q->lock);
+  int queued = !q->aborted && !q->closed;
+  if (queued) {
+    int tail = (q->head + q->count) % q->capacity;
+    q->images[tail] = img;
+    q->files[tail] = file;
+    q->count++;
+    pthread_cond_broadcast(&q->changed);
+  }
+  pthread_mutex_unlock(&q->lock);
+  return queued;
+}
+
+// Takes the head of the queue, if any. Called with the lock held
+static int queue_take(ImageQueue *q, Image **img, int *file) {
+  int popped = q->count > 0 && !q->aborted;
+  if (popped) {
+    *img = q->images[q->head];
+    *file = q->files[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    pthread_cond_broadcast(&q->changed);
+  }
+  return popped;
+}
+
+// Blocks while the queue is empty. Returns 0 once it is closed and drained
+static int queue_pop(ImageQueue *q, Image **img, int *file) {
+  pthread_mutex_lock(&q->lock);
+  while (q->count == 0 && !q->closed && !q->aborted)
+    pthread_cond_wait(&q->changed, &q->lock);
+  int popped = queue_take(q, img, file);
+  pthread_mutex_unlock(&q->lock);
+  return popped;
+}
+
+// Returns 0 at once if the queue is empty
+static int queue_try_pop(ImageQueue *q, Image **img, int *file) {
+  pthread_mutex_lock(&q->lock);
+  int popped = queue_take(q, img, file);
+  pthread_mutex_unlock(&q->lock);
+  return popped;
+}
+
+static void queue_close(ImageQueue *q) {
+  pthread_mutex_lock(&q->lock);
+  q->closed = 1;
+  pthread_cond_broadcast(&q->changed);
+  pthread_mutex_unlock(&q->lock);
+}
+
+static void queue_abort(ImageQueue *q) {
+  pthread_mutex_lock(&q->lock);
+  q->aborted = 1;
+  pthread_cond_broadcast(&q->changed);
+  pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * State shared by the stages of the pipeline of one rank.
+ */
+typedef struct {
+  const BatchRequest *request;
+  const InputFile *inputs;
+  int num_inputs;
+  int rank;
+  int size;
+  ImageQueue decoded;   // Reader -> compute
+  ImageQueue convolved; // Compute -> writer
+  pthread_mutex_t error_lock;
+  app_error err;     // First failure of any stage
+  double read_time;  // Busy time of the reader thread
+  double write_time; // Busy time of the writer thread
+  long long pixels;  // Pixels written
+  long long images;  // Images written
+} Pipeline;
+
+// Records the first failure and stops every stage
+static void pipeline_fail(Pipeline *p, app_error err) {
+  pthread_mutex_lock(&p->error_lock);
+  if (!p->err)
+    p->err = err;
+  pthread_mutex_unlock(&p->error_lock);
+  queue_abort(&p->decoded);
+  queue_abort(&p->convolved);
+}
+
+// Stage 1: reads and decodes the files of this rank, in order. The stage
+// threads do not call MPI, so they time themselves with omp_get_wtime(), and
+// they leave the CPU of the pinned compute thread they were started from
+static void *reader_thread(void *arg) {
+  Pipeline *p = (Pipeline *)arg;
+  numa_unbind_thread();
+  for (int f = p->rank; f < p->num_inputs; f += p->size) {
+    double start = omp_get_wtime();
+    Image *img = NULL;
+    app_error err = read_BMP(&img, p->inputs[f].path);
+    p->read_time += omp_get_wtime() - start;
+    if (err) {
+      pipeline_fail(p, err);
+      break;
+    }
+    if (!queue_push(&p->decoded, img, f)) {
+      free_BMP(img);
+      break;
+    }
+  }
+  queue_close(&p->decoded);
+  return NULL;
+}
+
+// Stage 3: encodes and writes the convolved images
+static void *writer_thread(void *arg) {
+  Pipeline *p = (Pipeline *)arg;
+  numa_unbind_thread();
+  Image *img;
+  int f;
+  while (queue_pop(&p->convolved, &img, &f)) {
+    char path[PATH_MAX];
+    double start = omp_get_wtime();
+    app_error err = ERR_PATH_TOO_LONG;
+    if (snprintf(path, PATH_MAX, "%s/%s", p->request->output_dir,
+                 p->inputs[f].name) < PATH_MAX)
+      err = save_BMP(img, path);
+    p->write_time += omp_get_wtime() - start;
+    p->pixels += (long long)img->width * img->height;
+    p->images++;
+    free_BMP(img);
+    if (err) {
+      pipeline_fail(p, err);
+      break;
+    }
+  }
+  return NULL;
+}
+
+// Stage 2 runs on the calling thread, so the engines keep their OpenMP teams
+// and phase timers. Returns the busy time of the stage
+static double compute_stage(Pipeline *p, convolve_function cv_fn,
+                            const Kernel *kernels, int count) {
+  double busy = 0.0;
+  Image *img;
+  int f;
+  while (queue_pop(&p->decoded, &img, &f)) {
+    double start = omp_get_wtime();
+    app_error err = SUCCESS;
+    for (int k = 0; !err && k < count; k++)
+      err = cv_fn(img, kernels[k], NULL);
+    busy += omp_get_wtime() - start;
+    if (err) {
+      free_BMP(img);
+      pipeline_fail(p, err);
+      break;
+    }
+    if (!queue_push(&p->convolved, img, f)) {
+      free_BMP(img);
+      break;
+    }
+  }
+  queue_close(&p->convolved);
+  return busy;
+}
+
+// Stage 2 with the task graph: takes the image at the head of the queue with
+// every other decoded image already waiting, and runs their chains as one
+// graph. Returns the busy time of the stage
+static double compute_stage_graph(Pipeline *p, const Kernel *kernels,
+                                  int count) {
+  int capacity = p->request->queue_depth;
+  Image **images = (Image **)malloc(capacity * sizeof(Image *));
+  int *files = (int *)malloc(capacity * sizeof(int));
+  TaskGraphJob *jobs = (TaskGraphJob *)malloc(capacity * sizeof(TaskGraphJob));
+  if (!images || !files || !jobs)
+    pipeline_fail(p, ERR_MEM_ALLOC);
+
+  double busy = 0.0;
+  int stopped = !images || !files || !jobs;
+  while (!stopped && queue_pop(&p->decoded, &images[0], &files[0])) {
+    int n = 1;
+    while (n < capacity && queue_try_pop(&p->decoded, &images[n], &files[n]))
+      n++;
+    for (int i = 0; i < n; i++) {
+      jobs[i].source = images[i];
+      jobs[i].kernels = kernels;
+      jobs[i].count = count;
+    }
+
+    TaskGraphStats stats;
+    app_error err = run_task_graph(jobs, n, p->request->tile_rows, &stats);
+    busy += stats.wall_time;
+    for (int i = 0; i < n; i++)
+      free_BMP(images[i]);
+    if (err) {
+      pipeline_fail(p, err);
+      break;
+    }
+
+    for (int i = 0; i < n; i++) {
+      if (!stopped && !queue_push(&p->convolved, jobs[i].output, files[i]))
+        stopped = 1;
+      if (stopped)
+        free_BMP(jobs[i].output);
+    }
+  }
+  queue_close(&p->convolved);
+
+  free(images);
+  free(files);
+  free(jobs);
+  return busy;
+}
+
+static app_error run_pipeline(Pipeline *p, convolve_function cv_fn,
+                              const Kernel *kernels, int count,
+                              double *compute_time) {
+  *compute_time = 0.0;
+  app_error err = queue_init(&p->decoded, p->request->queue_depth);
+  if (err)
+    return err;
+  err = queue_init(&p->convolved, p->request->queue_depth);
+  if (err) {
+    queue_destroy(&p->decoded);
+    return err;
+  }
+  pthread_mutex_init(&p->error_lock, NULL);
+
+  pthread_t reader, writer;
+  if (pthread_create(&reader, NULL, reader_thread, p) != 0) {
+    err = ERR_UNKNOWN;
+  } else {
+    if (pthread_create(&writer, NULL, writer_thread, p) != 0) {
+      pipeline_fail(p, ERR_UNKNOWN);
+    } else {
+      *compute_time = p->request->taskgraph
+                          ? compute_stage_graph(p, kernels, count)
+                          : compute_stage(p, cv_fn, kernels, count);
+      pthread_join(writer, NULL);
+    }
+    pthread_join(reader, NULL);
+    err = p->err;
+  }
+
+  pthread_mutex_destroy(&p->error_lock);
+  queue_destroy(&p->decoded);
+  queue_destroy(&p->convolved);
+  return err;
+}
+
+// Sets up the planner on rank 0 first, so that the other ranks find its
+// calibration in the cache instead of measuring their own
+static app_error init_planner_ranks(const BatchRequest *request, int rank) {
+  app_error err = SUCCESS;
+  if (rank == 0)
+    err = planner_init(request->omp_threads, request->recalibrate);
+  MPI_Barrier(MPI_COMM_WORLD);
+  if (rank != 0)
+    err = planner_init(request->omp_threads, 0);
+  return err;
+}
+
+static void print_batch_stats(const double *times, const long long *counts) {
+  double wall = times[0];
+  double slowest = times[1];
+  for (int s = 2; s < 4; s++)
+    if (times[s] > slowest)
+      slowest = times[s];
+
+  printf("Batch: %lld images, %.1f Mpixel in %.6f s (%.2f images/s, %.2f "
+         "Mpixel/s)\n",
+         counts[0], counts[1] / 1e6, wall, wall > 0 ? counts[0] / wall : 0.0,
+         wall > 0 ? counts[1] / 1e6 / wall : 0.0);
+  printf("\t\tRead     busy %.6f s\n", times[1]);
+  printf("\t\tCompute  busy %.6f s\n", times[2]);
+  printf("\t\tWrite    busy %.6f s\n", times[3]);
+  printf("\t\tSlowest stage %.6f s (%.1f%% of the wall time, stages sum to "
+         "%.6f s)\n",
+         slowest, wall > 0 ? 100.0 * slowest / wall : 0.0,
+         times[1] + times[2] + times[3]);
+}
+
+app_error run_batch(const BatchRequest *request) {
+  double start_time = MPI_Wtime();
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  Kernel kernels[MAX_TRANSFORM_KERNELS];
+  int count = 0;
+  InputFile *inputs = NULL;
+  int num_inputs = 0;
+
+  // Every rank convolves whole images on its own
+  convolve_function cv_fn = get_transform_function(request->mode);
+  app_error err = SUCCESS;
+  if (!cv_fn || request->mode == MODE_DISTRIBUTED ||
+      request->mode == MODE_FFT_DISTRIBUTED ||
+      request->mode == MODE_TASK_POOL || request->queue_depth < 1) {
+    if (rank == 0)
+      fprintf(stderr, "-batch takes a rank-local mode and a queue depth of at "
+                      "least 1\n");
+    err = ERR_INVALID_ARGS;
+  } else if (request->taskgraph && (request->mode != MODE_MULTITHREADED ||
+                                    request->tile_rows < 1)) {
+    if (rank == 0)
+      fprintf(stderr, "-batch -taskgraph takes the multithreaded mode and at "
+                      "least one row per tile\n");
+    err = ERR_INVALID_ARGS;
+  }
+  if (!err)
+    err = parse_transform_operations(request->operations, kernels, &count);
+  // The inputs are sorted, so every rank builds the same list
+  if (!err)
+    err = discover_inputs(request->input, &inputs, &num_inputs);
+  if (!err && rank == 0)
+    err = create_directory(request->output_dir);
+
+  int any_err = err;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  err = (app_error)any_err;
+
+  if (!err && request->mode == MODE_PLANNED)
+    err = init_planner_ranks(request, rank);
+
+  Pipeline p;
+  memset(&p, 0, sizeof(p));
+  p.request = request;
+  p.inputs = inputs;
+  p.num_inputs = num_inputs;
+  p.rank = rank;
+  p.size = size;
+  double compute_time = 0.0;
+  if (!err)
+    err = run_pipeline(&p, cv_fn, kernels, count, &compute_time);
+  double times[4] = {MPI_Wtime() - start_time, p.read_time, compute_time,
+                     p.write_time};
+  long long counts[2] = {p.images, p.pixels};
+
+  any_err = err;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  err = (app_error)any_err;
+
+  // Slowest rank for the times, totals for the counts
+  MPI_Reduce(rank == 0 ? MPI_IN_PLACE : times, times, 4, MPI_DOUBLE, MPI_MAX,
+             0, MPI_COMM_WORLD);
+  MPI_Reduce(rank == 0 ? MPI_IN_PLACE : counts, counts, 2, MPI_LONG_LONG,
+             MPI_SUM, 0, MPI_COMM_WORLD);
+  if (rank == 0 && !err)
+    print_batch_stats(times, counts);
+
+  free(inputs);
+  free_generated_kernels();
+  return err;
+}
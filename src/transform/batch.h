@@ -0,0 +1,52 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "../errors/errors.h"
+
+// Default number of decoded images waiting between two pipeline stages
+#define DEFAULT_BATCH_QUEUE_DEPTH 2
+
+/**
+ * A batch transformation: the same operation chain applied to every image of
+ * an input source.
+ */
+typedef struct {
+  const char *operations; // Comma-separated kernel names, applied in order
+  const char *input;      // Directory, glob, BMP or manifest (see inputs.h)
+  const char *output_dir; // Outputs keep the input file names
+  int mode;               // Rank-local convolution mode (MODE_*)
+  int queue_depth;        // Images buffered between two stages
+  int omp_threads;        // OpenMP threads (planner calibration key)
+  int recalibrate;        // Ignore the planner calibration cache
+  int taskgraph;          // Run the waiting images as one task graph
+  int tile_rows;          // Rows of a tile of the task graph
+} BatchRequest;
+
+/**
+ * Transforms every image of an input source with a three-stage pipeline per
+ * rank: a reader thread decodes image N+1 while the calling thread convolves
+ * image N (with OpenMP) and a writer thread encodes and writes image N-1.
+ * The stages are connected by bounded queues, so at most 2 * queue_depth + 3
+ * images are in memory per rank, and the throughput approaches that of the
+ * slowest stage instead of the sum of the stages.
+ * With taskgraph, the compute stage takes every decoded image waiting in
+ * its queue at once and runs their chains as one task graph (see
+ * run_task_graph()), so the tiles of several images and of consecutive
+ * kernels of the chain overlap; this needs the multithreaded mode.
+ * Collective over MPI_COMM_WORLD: the files are dealt round-robin to the
+ * ranks, which run their pipelines independently. Only the rank-local modes
+ * (serial, multithreaded, FFT, planned) are accepted; the task pool spreads
+ * its tiles over all ranks.
+ * @param request The batch to run
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: Every output written
+ *         - ERR_INVALID_ARGS: Unknown operation, unsupported mode, tile_rows
+ *           not positive with taskgraph, or no inputs
+ *         - ERR_DIR_CREATE: Output directory could not be created
+ *         - ERR_FILE_OPEN: An input could not be opened or output created
+ *         - ERR_BMP_HEADER: An input is not a 24-bit BMP
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error run_batch(const BatchRequest *request);
+
+#endif
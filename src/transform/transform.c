@@ -0,0 +1,258 @@
+#include "transform.h"
+#include "../bmp/bmp_io.h"
+#include "../bmp/mpi_bmp_io.h"
+#include "../config/files.h"
+#include "../convolution/convolution.h"
+#include "../convolution/fft_convolution.h"
+#include "../planner/planner.h"
+#include "../temporal/temporal.h"
+#include "../timing/phase_timer.h"
+#include "../workpool/work_pool.h"
+#include <limits.h>
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+app_error parse_transform_operations(const char *operations, Kernel *kernels,
+                                     int *count) {
+  char buffer[PATH_MAX];
+  if (snprintf(buffer, sizeof(buffer), "%s", operations) >= PATH_MAX)
+    return ERR_PATH_TOO_LONG;
+
+  *count = 0;
+  for (char *name = strtok(buffer, ","); name; name = strtok(NULL, ",")) {
+    if (*count == MAX_TRANSFORM_KERNELS)
+      return ERR_INVALID_ARGS;
+    app_error err = resolve_kernel(name, &kernels[*count]);
+    if (err) {
+      int rank;
+      MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+      if (rank == 0)
+        fprintf(stderr, "Unknown operation: %s\n", name);
+      return err;
+    }
+    (*count)++;
+  }
+  return *count > 0 ? SUCCESS : ERR_INVALID_ARGS;
+}
+
+convolve_function get_transform_function(int mode) {
+  switch (mode) {
+  case MODE_SERIAL:
+    return convolve_serial;
+  case MODE_MULTITHREADED:
+    return convolve_parallel_multithreaded;
+  case MODE_DISTRIBUTED:
+    return convolve_parallel_distributed_filesystem;
+  case MODE_TASK_POOL:
+    return convolve_work_pool;
+  case MODE_FFT:
+    return convolve_fft;
+  case MODE_FFT_DISTRIBUTED:
+    return convolve_fft_distributed;
+  case MODE_PLANNED:
+    return convolve_planned;
+  default:
+    return NULL;
+  }
+}
+
+// Modes in which every rank takes part in the convolution
+static int is_collective_mode(int mode) {
+  return mode == MODE_DISTRIBUTED || mode == MODE_FFT_DISTRIBUTED ||
+         mode == MODE_SHARED || mode == MODE_TASK_POOL;
+}
+
+// Rank 0 reads and writes the image; the distributed engines scatter it
+static app_error transform_on_root(const TransformRequest *request,
+                                   const Kernel *kernels, int count) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int collective = is_collective_mode(request->mode);
+  convolve_function cv_fn = get_transform_function(request->mode);
+
+  Image *img = NULL;
+  app_error err = SUCCESS;
+  if (rank == 0) {
+    phase_timer_begin(PHASE_READ);
+    err = read_BMP(&img, request->input);
+    phase_timer_end(PHASE_READ);
+  }
+  if (collective) {
+    int read_err = err;
+    MPI_Bcast(&read_err, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    err = (app_error)read_err;
+  }
+  if (err || (rank != 0 && !collective))
+    return err;
+
+  // The distributed engine runs the whole chain on one scatter, with a halo
+  // exchange every -halo_depth kernels
+  if (request->mode == MODE_DISTRIBUTED)
+    err = convolve_distributed_chain(img, kernels, count, get_halo_depth(),
+                                     NULL);
+  else
+    for (int k = 0; !err && k < count; k++)
+      err = cv_fn(img, kernels[k], NULL);
+
+  if (rank == 0) {
+    if (!err) {
+      phase_timer_begin(PHASE_WRITE);
+      err = save_BMP(img, request->output);
+      phase_timer_end(PHASE_WRITE);
+    }
+    free_BMP(img);
+  }
+  return err;
+}
+
+// Every rank reads its strip with the halos of the whole chain, applies the
+// chain locally (the valid rows shrink by one halo per kernel) and writes its
+// strip. Pixel data never travels between ranks.
+static app_error transform_shared_filesystem(const TransformRequest *request,
+                                             const Kernel *kernels,
+                                             int count) {
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  int width, height;
+  phase_timer_begin(PHASE_READ);
+  app_error err = mpi_read_BMP_dimensions(request->input, &width, &height);
+  if (err) {
+    phase_timer_end(PHASE_READ);
+    return err;
+  }
+  if (height < size) {
+    phase_timer_end(PHASE_READ);
+    if (rank == 0)
+      fprintf(stderr, "Image has fewer rows (%d) than ranks (%d)\n", height,
+              size);
+    return ERR_INVALID_ARGS;
+  }
+
+  int start_y, local_h;
+  get_chunk_metadata(height, rank, size, &start_y, &local_h);
+
+  int halo = 0;
+  for (int k = 0; k < count; k++)
+    halo += kernels[k].size / 2;
+
+  // Rows of the image held by the local buffer: [src_lo, src_hi)
+  int src_lo = start_y - halo > 0 ? start_y - halo : 0;
+  int src_hi =
+      start_y + local_h + halo < height ? start_y + local_h + halo : height;
+
+  Image *strip = NULL;
+  err = mpi_read_BMP_chunk(&strip, request->input, src_lo, src_hi - src_lo,
+                           NULL, NULL);
+  phase_timer_end(PHASE_READ);
+
+  phase_timer_begin(PHASE_COMPUTE);
+  for (int k = 0; !err && k < count; k++) {
+    // Rows still needed by the kernels after this one
+    halo -= kernels[k].size / 2;
+    int out_lo = start_y - halo > 0 ? start_y - halo : 0;
+    int out_hi =
+        start_y + local_h + halo < height ? start_y + local_h + halo : height;
+
+    // Source rows outside the buffer are only clamped at the image edges,
+    // where the buffer ends at the edge as well
+    Pixel *out = alloc_pixel(width, out_hi - out_lo);
+    if (!out) {
+      err = ERR_MEM_ALLOC;
+      break;
+    }
+    err = convolve_rows_direct(strip->data, width, src_hi - src_lo,
+                               out_lo - src_lo, out_hi - out_lo, kernels[k],
+                               out);
+    free_pixel(strip->data);
+    strip->data = out;
+    strip->height = out_hi - out_lo;
+    src_lo = out_lo;
+    src_hi = out_hi;
+  }
+  phase_timer_end(PHASE_COMPUTE);
+
+  // Opening the output is collective, so every rank must know about failures
+  int any_err = err;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  err = (app_error)any_err;
+  if (!err) {
+    phase_timer_begin(PHASE_WRITE);
+    err = mpi_write_BMP_chunk(strip, request->output, start_y, width, height);
+    phase_timer_end(PHASE_WRITE);
+  }
+
+  if (strip)
+    free_BMP(strip);
+  return err;
+}
+
+app_error run_transform(const TransformRequest *request) {
+  double start_time = MPI_Wtime();
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  phase_timer_reset();
+  blocking_stats_reset();
+
+  Kernel kernels[MAX_TRANSFORM_KERNELS];
+  int count = 0;
+  app_error err =
+      parse_transform_operations(request->operations, kernels, &count);
+  if (!err && request->mode != MODE_SHARED &&
+      !get_transform_function(request->mode))
+    err = ERR_INVALID_ARGS;
+
+  // The chain repeated -iterations times
+  int iterations = get_kernel_iterations();
+  Kernel *chain = NULL;
+  if (!err && iterations < 1)
+    err = ERR_INVALID_ARGS;
+  if (!err) {
+    chain = (Kernel *)malloc((size_t)count * iterations * sizeof(Kernel));
+    if (!chain)
+      err = ERR_MEM_ALLOC;
+    for (int i = 0; !err && i < iterations; i++)
+      for (int k = 0; k < count; k++)
+        chain[i * count + k] = kernels[k];
+  }
+
+  if (!err && request->mode == MODE_PLANNED && rank == 0) {
+    err = planner_init(request->omp_threads, request->recalibrate);
+  }
+
+  if (!err) {
+    if (request->mode == MODE_SHARED)
+      err = transform_shared_filesystem(request, chain, count * iterations);
+    else
+      err = transform_on_root(request, chain, count * iterations);
+  }
+  free(chain);
+  double elapsed = MPI_Wtime() - start_time;
+
+  int any_err = err;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  err = (app_error)any_err;
+
+  // The root-only modes leave the other ranks out of the phase breakdown
+  PhaseStats stats;
+  if (!err && is_collective_mode(request->mode))
+    phase_timer_reduce(MPI_COMM_WORLD, &stats);
+  else if (!err && rank == 0)
+    phase_timer_reduce(MPI_COMM_SELF, &stats);
+
+  if (rank == 0 && !err) {
+    printf("%s -> %s (%s, %s): %.6f s\n", request->input, request->output,
+           request->operations, IMPLEMENTATION_FOLDERS[request->mode],
+           elapsed);
+    BlockingStats blocking;
+    get_blocking_stats(&blocking);
+    print_blocking_stats(&blocking, stdout);
+    print_phase_stats(&stats, stdout);
+  }
+
+  free_generated_kernels();
+  return err;
+}
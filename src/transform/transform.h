@@ -0,0 +1,66 @@
+#ifndef __TRANSFORM_H__
+#define __TRANSFORM_H__
+
+#include "../benchmark/kernel_run.h"
+#include "../config/kernel.h"
+#include "../errors/errors.h"
+
+/**
+ * A single image transformation: a chain of kernels applied to one input file
+ * with one convolution mode.
+ */
+typedef struct {
+  const char *operations; // Comma-separated kernel names, applied in order
+  const char *input;      // Input BMP
+  const char *output;     // Output BMP
+  int mode;               // Convolution mode (MODE_*)
+  int omp_threads;        // OpenMP threads (planner calibration key)
+  int recalibrate;        // Ignore the planner calibration cache
+} TransformRequest;
+
+// Longest operation chain accepted by run_transform()
+#define MAX_TRANSFORM_KERNELS 16
+
+/**
+ * Resolves every kernel of a comma-separated operation chain.
+ * @param operations Kernel names, e.g. "gaussblur5,sharpen"
+ * @param kernels Output: at least MAX_TRANSFORM_KERNELS kernels
+ * @param count Output: number of kernels in the chain
+ * @return app_error code:
+ *         - SUCCESS: Every operation resolved
+ *         - ERR_INVALID_ARGS: Unknown, empty or too long chain
+ *         - ERR_PATH_TOO_LONG: Chain does not fit in a path buffer
+ */
+app_error parse_transform_operations(const char *operations, Kernel *kernels,
+                                     int *count);
+
+/**
+ * Returns the engine that convolves a whole image for a mode, or NULL for the
+ * shared filesystem mode (which transforms strips, see run_transform()) and
+ * unknown modes.
+ */
+convolve_function get_transform_function(int mode);
+
+/**
+ * Applies an operation chain to one file and prints the wall time of every
+ * phase. None of the benchmark scaffolding (input discovery, output
+ * directories, machine peaks, CSV files) is involved.
+ * The chain is repeated get_kernel_iterations() times.
+ * Collective over MPI_COMM_WORLD. The root-only modes read, convolve and
+ * write on rank 0; the distributed modes read on rank 0 and scatter (the
+ * distributed mode scatters once for the whole chain and exchanges halos
+ * every get_halo_depth() kernels, see convolve_distributed_chain()); the
+ * shared filesystem mode reads every strip and its halos with MPI-IO on the
+ * rank that owns it, applies the whole chain locally and writes the strip
+ * back with MPI-IO, so no pixel data is sent between ranks.
+ * @param request The transformation to run
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: Output written
+ *         - ERR_INVALID_ARGS: Unknown operation or mode
+ *         - ERR_FILE_OPEN: Input could not be opened or output created
+ *         - ERR_BMP_HEADER: Input is not a 24-bit BMP
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error run_transform(const TransformRequest *request);
+
+#endif
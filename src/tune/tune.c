@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include "tune.h"
+#include "../bmp/bmp_generate.h"
+#include "../config/files.h"
+#include "../file_utils/file_utils.h"
+#include "../memory/numa.h"
+#include "../sweep/sweep.h"
+#include <math.h>
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Largest CPU number read from sysfs
+#define TUNE_MAX_CPUS 1024
+
+// Largest number of candidate splits
+#define TUNE_MAX_CANDIDATES 32
+
+#define HOST_NAME_LENGTH 256
+
+// Hardware of a node, reduced to the smallest node of MPI_COMM_WORLD
+typedef struct {
+  int nodes;          // Nodes with at least one rank
+  int ranks_per_node; // Ranks launched on a node
+  int cpus;           // Online logical CPUs
+  int cores;          // Physical cores (or the cores of the request)
+  int sockets;        // Processor packages
+  int numa_nodes;     // NUMA nodes with CPUs
+  int bound_cpus;     // CPUs every rank may run on
+} Topology;
+
+// One split of the cores of a node
+typedef struct {
+  int ranks_per_node;
+  int threads;
+} Candidate;
+
+#ifdef __linux__
+// Reads an id of the topology directory of a CPU, -1 if the CPU is offline
+// or missing
+static int read_topology_id(int cpu, const char *name) {
+  char path[96];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s",
+           cpu, name);
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return -1;
+  int id;
+  if (fscanf(fp, "%d", &id) != 1)
+    id = -1;
+  fclose(fp);
+  return id;
+}
+#endif
+
+// Counts the CPUs, cores and sockets of the node of the caller. Without
+// sysfs every online CPU counts as a core of a single socket
+static void detect_node(Topology *topo) {
+  topo->cpus = 0;
+  topo->cores = 0;
+  topo->sockets = 0;
+
+#ifdef __linux__
+  static int packages[TUNE_MAX_CPUS];
+  static int cores[TUNE_MAX_CPUS];
+  for (int cpu = 0; cpu < TUNE_MAX_CPUS; cpu++) {
+    int package = read_topology_id(cpu, "physical_package_id");
+    int core = read_topology_id(cpu, "core_id");
+    if (package < 0 || core < 0)
+      continue;
+    topo->cpus++;
+
+    int new_package = 1, new_core = 1;
+    for (int i = 0; i < topo->cores; i++) {
+      if (packages[i] == package) {
+        new_package = 0;
+        if (cores[i] == core)
+          new_core = 0;
+      }
+    }
+    topo->sockets += new_package;
+    if (new_core) {
+      packages[topo->cores] = package;
+      cores[topo->cores++] = core;
+    }
+  }
+#endif
+
+  if (topo->cpus == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    topo->cpus = online > 0 ? (int)online : 1;
+    topo->cores = topo->cpus;
+    topo->sockets = 1;
+  }
+  topo->numa_nodes = numa_node_count();
+  topo->bound_cpus = omp_get_num_procs();
+}
+
+// Detects the topology of every node and keeps the smallest, so that every
+// candidate fits every node. Returns the rank of the caller on its node
+static int detect_topology(int cores, Topology *topo) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  MPI_Comm node;
+  MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank,
+                      MPI_INFO_NULL, &node);
+  int local_rank;
+  MPI_Comm_rank(node, &local_rank);
+  MPI_Comm_size(node, &topo->ranks_per_node);
+  MPI_Comm_free(&node);
+
+  detect_node(topo);
+  if (cores > 0)
+    topo->cores = cores;
+
+  int leader = local_rank == 0;
+  MPI_Allreduce(&leader, &topo->nodes, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  int counts[6] = {topo->ranks_per_node, topo->cpus,       topo->cores,
+                   topo->sockets,        topo->numa_nodes, topo->bound_cpus};
+  MPI_Allreduce(MPI_IN_PLACE, counts, 6, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+  topo->ranks_per_node = counts[0];
+  topo->cpus = counts[1];
+  topo->cores = counts[2];
+  topo->sockets = counts[3];
+  topo->numa_nodes = counts[4];
+  topo->bound_cpus = counts[5];
+  return local_rank;
+}
+
+static int compare_ints(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+// Ranks per node of the candidates in increasing order: the powers of two,
+// one per socket, one per NUMA node and one per core, up to the ranks
+// launched per node. Every rank gets an equal share of the cores as threads
+static int get_candidates(const Topology *topo, Candidate *candidates) {
+  int limit = topo->ranks_per_node < topo->cores ? topo->ranks_per_node
+                                                 : topo->cores;
+  int counts[TUNE_MAX_CANDIDATES];
+  int num_counts = 0;
+  for (int q = 1; q < limit && num_counts < TUNE_MAX_CANDIDATES - 3; q *= 2)
+    counts[num_counts++] = q;
+  counts[num_counts++] = limit;
+  if (topo->sockets <= limit)
+    counts[num_counts++] = topo->sockets;
+  if (topo->numa_nodes <= limit)
+    counts[num_counts++] = topo->numa_nodes;
+  qsort(counts, num_counts, sizeof(int), compare_ints);
+
+  int num_candidates = 0;
+  for (int i = 0; i < num_counts; i++) {
+    if (i > 0 && counts[i] == counts[i - 1])
+      continue;
+    candidates[num_candidates].ranks_per_node = counts[i];
+    candidates[num_candidates++].threads = topo->cores / counts[i];
+  }
+  return num_candidates;
+}
+
+static int compare_sizes(const void *a, const void *b) {
+  const ImageSize *x = (const ImageSize *)a;
+  const ImageSize *y = (const ImageSize *)b;
+  long long px = (long long)x->width * x->height;
+  long long py = (long long)y->width * y->height;
+  return (px > py) - (px < py);
+}
+
+static void print_topology(const Topology *topo, FILE *fp) {
+  fprintf(fp, "Topology: %d node(s), each with %d rank(s), %d CPU(s), %d "
+              "core(s), %d socket(s) and %d NUMA node(s)\n",
+          topo->nodes, topo->ranks_per_node, topo->cpus, topo->cores,
+          topo->sockets, topo->numa_nodes);
+  if (topo->bound_cpus < topo->cores)
+    fprintf(fp, "Warning: every rank may only run on %d CPU(s), so the "
+                "threads of the splits with fewer ranks share them; launch "
+                "with --bind-to none\n",
+            topo->bound_cpus);
+}
+
+// Prints the candidates of one class and returns the fastest one
+static int print_class(const Topology *topo, const ImageSize *size,
+                       const Candidate *candidates, int num_candidates,
+                       const double *times, FILE *fp) {
+  fprintf(fp, "\nClass %dx%d:\n", size->width, size->height);
+  fprintf(fp, "\t%5s %8s %7s %10s %8s\n", "Ranks", "Per node", "Threads",
+          "Time (s)", "Speedup");
+  int best = 0;
+  for (int c = 0; c < num_candidates; c++) {
+    const Candidate *p = &candidates[c];
+    fprintf(fp, "\t%5d %8d %7d %10.6f %8.2f\n", p->ranks_per_node * topo->nodes,
+            p->ranks_per_node, p->threads, times[c], times[0] / times[c]);
+    if (times[c] < times[best])
+      best = c;
+  }
+
+  const Candidate *p = &candidates[best];
+  fprintf(fp, "\tBest: %d ranks x %d threads (mpirun -n %d",
+          p->ranks_per_node * topo->nodes, p->threads,
+          p->ranks_per_node * topo->nodes);
+  if (topo->nodes > 1)
+    fprintf(fp, " --map-by ppr:%d:node", p->ranks_per_node);
+  fprintf(fp, " ... -threads %d)\n", p->threads);
+  return best;
+}
+
+// Prints the pixel range of every class (the images closest to its size on
+// a logarithmic scale) and its fastest split
+static void print_summary(const Topology *topo, const ImageSize *sizes,
+                          int num_sizes, const Candidate *candidates,
+                          const int *best, FILE *fp) {
+  fprintf(fp, "\nFastest split per image-size class:\n");
+  double lower = 0.0;
+  for (int s = 0; s < num_sizes; s++) {
+    double pixels = (double)sizes[s].width * sizes[s].height;
+    const Candidate *p = &candidates[best[s]];
+    fprintf(fp, "\t%dx%d (%.0f to ", sizes[s].width, sizes[s].height, lower);
+    if (s + 1 < num_sizes) {
+      double next = (double)sizes[s + 1].width * sizes[s + 1].height;
+      lower = ceil(sqrt(pixels * next));
+      fprintf(fp, "%.0f px", lower - 1.0);
+    } else {
+      fprintf(fp, "any px");
+    }
+    fprintf(fp, "): %d ranks x %d threads\n", p->ranks_per_node * topo->nodes,
+            p->threads);
+  }
+}
+
+// Appends the fastest split of every class to the tuning file
+static app_error save_tuning(const Topology *topo, const char *kernel,
+                             const ImageSize *sizes, int num_sizes,
+                             const Candidate *candidates, const int *best,
+                             const double *times, int num_candidates) {
+  char host[HOST_NAME_LENGTH];
+  if (gethostname(host, sizeof(host)) != 0)
+    snprintf(host, sizeof(host), "unknown");
+  host[sizeof(host) - 1] = '\0';
+  // Commas would break the file
+  for (char *c = host; *c; c++)
+    if (*c == ',')
+      *c = '_';
+
+  app_error err = init_benchmark_csv(TUNING_CSV_FILE, TUNING_CSV_HEADER);
+  if (err)
+    return err;
+  FILE *fp = fopen(TUNING_CSV_FILE, "a");
+  if (!fp)
+    return ERR_FILE_OPEN;
+  for (int s = 0; s < num_sizes; s++) {
+    const Candidate *p = &candidates[best[s]];
+    fprintf(fp, "%s,%d,%d,%d,%d,%s,%d,%d,%d,%d,%d,%.6f\n", host, topo->nodes,
+            topo->cores, topo->sockets, topo->numa_nodes, kernel,
+            sizes[s].width, sizes[s].height, p->ranks_per_node * topo->nodes,
+            p->ranks_per_node, p->threads,
+            times[s * num_candidates + best[s]]);
+  }
+  fclose(fp);
+  return SUCCESS;
+}
+
+app_error run_tune(const TuneRequest *request) {
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  Topology topo;
+  int local_rank = detect_topology(request->cores, &topo);
+  Candidate candidates[TUNE_MAX_CANDIDATES];
+  int num_candidates = get_candidates(&topo, candidates);
+
+  Kernel kernel;
+  ImageSize *sizes = NULL;
+  int num_sizes = 0;
+  app_error err = resolve_kernel(request->kernel, &kernel);
+  if (!err)
+    err = parse_image_sizes(request->sizes, &sizes, &num_sizes);
+  if (!err && (request->repetitions < 1 || request->cores < 0))
+    err = ERR_INVALID_ARGS;
+  if (!err)
+    qsort(sizes, num_sizes, sizeof(ImageSize), compare_sizes);
+
+  double *times =
+      (double *)malloc((size_t)num_sizes * num_candidates * sizeof(double));
+  int *best = (int *)malloc((num_sizes > 0 ? num_sizes : 1) * sizeof(int));
+  if (!err && (!times || !best))
+    err = ERR_MEM_ALLOC;
+
+  int any_err = err;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+  err = (app_error)any_err;
+
+  if (!err && rank == 0) {
+    printf("Rank x thread tuning of the distributed engine (%s, %d "
+           "repetition(s) per configuration)\n",
+           kernel.name, request->repetitions);
+    print_topology(&topo, stdout);
+  }
+
+  for (int s = 0; s < num_sizes && !err; s++) {
+    double *class_times = &times[s * num_candidates];
+    for (int c = 0; c < num_candidates && !err; c++)
+      err = time_distributed_configuration(
+          local_rank < candidates[c].ranks_per_node, candidates[c].threads,
+          kernel, sizes[s].width, sizes[s].height, request->seed,
+          request->repetitions, &class_times[c]);
+    if (!err && rank == 0)
+      best[s] = print_class(&topo, &sizes[s], candidates, num_candidates,
+                            class_times, stdout);
+  }
+
+  if (!err && rank == 0) {
+    print_summary(&topo, sizes, num_sizes, candidates, best, stdout);
+    // The splits are printed, a missing file only loses the record
+    if (save_tuning(&topo, kernel.name, sizes, num_sizes, candidates, best,
+                    times, num_candidates) == SUCCESS)
+      printf("\nTuning written to %s\n", TUNING_CSV_FILE);
+    else
+      fprintf(stderr, "Warning: Could not write %s\n", TUNING_CSV_FILE);
+  }
+
+  free(times);
+  free(best);
+  free(sizes);
+  return err;
+}
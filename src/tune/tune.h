@@ -0,0 +1,44 @@
+#ifndef __TUNE_H__
+#define __TUNE_H__
+
+#include "../errors/errors.h"
+
+// Representative images of the image-size classes of the tuning
+#define DEFAULT_TUNE_SIZES "512x512,2048x2048"
+
+// Kernel of the tuning when -kernels is not given
+#define DEFAULT_TUNE_KERNEL "gaussblur5"
+
+/**
+ * A search of the split of every node between MPI ranks and OpenMP threads.
+ */
+typedef struct {
+  const char *kernel;      // Kernel name (see resolve_kernel())
+  const char *sizes;       // Representative images "WxH,..." of the classes
+  int cores;               // Cores per node to split (0: detected)
+  int repetitions;         // Timed runs per configuration
+  unsigned long long seed; // Seed of the synthetic images
+} TuneRequest;
+
+/**
+ * Detects the topology of the nodes of MPI_COMM_WORLD (ranks launched, CPUs,
+ * physical cores, sockets and NUMA nodes per node, from Linux sysfs) and
+ * times the distributed engine with every candidate split of the cores of a
+ * node: 1, 2, 4, ... ranks per node, one per socket, one per NUMA node and
+ * one per core (as far as launched), each with cores / ranks threads. Every
+ * candidate runs on a sub-communicator of the first ranks of every node, on
+ * a synthetic image of every size of the request. Each size stands for the
+ * class of the images closest to it in pixel count. Rank 0 prints every
+ * candidate, the fastest split of every class with its launch line, and
+ * appends the fastest splits to TUNING_CSV_FILE.
+ * Collective over MPI_COMM_WORLD.
+ * @param request The tuning to run
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: Tuning completed
+ *         - ERR_INVALID_ARGS: Unknown kernel, bad sizes, negative cores or
+ *           repetitions below one
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error run_tune(const TuneRequest *request);
+
+#endif
@@ -0,0 +1,245 @@
+#include "work_pool.h"
+#include "../convolution/convolution.h"
+#include "../timing/phase_timer.h"
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int chunk_rows = DEFAULT_WORK_POOL_CHUNK_ROWS;
+
+void set_work_pool_chunk_rows(int rows) { chunk_rows = rows; }
+
+int get_work_pool_chunk_rows(void) { return chunk_rows; }
+
+/**
+ * Claims of one rank, gathered on rank 0 once the pool is drained.
+ */
+typedef enum {
+  CLAIM_CHUNKS = 0, // Chunks computed
+  CLAIM_COUNT,      // Claims issued (the last one finds the pool empty)
+  CLAIM_TIME,       // Time spent in the claims
+  CLAIM_MAX,        // Slowest claim
+  CLAIM_FIELDS
+} claim_field;
+
+/**
+ * RMA windows of the pool, all exposed by rank 0.
+ */
+typedef struct {
+  MPI_Win counter; // Index of the next chunk to claim
+  MPI_Win input;   // Image, read with MPI_Get
+  MPI_Win output;  // Result, written with MPI_Put
+  int *next;       // Memory of the counter window
+} PoolWindows;
+
+static void create_windows(Pixel *input, Pixel *output, int width, int height,
+                           MPI_Comm comm, PoolWindows *windows) {
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Aint counter_bytes = rank == 0 ? (MPI_Aint)sizeof(int) : 0;
+  MPI_Aint image_bytes =
+      rank == 0 ? (MPI_Aint)width * height * (MPI_Aint)sizeof(Pixel) : 0;
+
+  MPI_Win_allocate(counter_bytes, sizeof(int), MPI_INFO_NULL, comm,
+                   &windows->next, &windows->counter);
+  MPI_Win_create(rank == 0 ? input : NULL, image_bytes, sizeof(Pixel),
+                 MPI_INFO_NULL, comm, &windows->input);
+  MPI_Win_create(rank == 0 ? output : NULL, image_bytes, sizeof(Pixel),
+                 MPI_INFO_NULL, comm, &windows->output);
+
+  // The counter must be zero before the first claim of any rank
+  if (rank == 0) {
+    MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, windows->counter);
+    *windows->next = 0;
+    MPI_Win_unlock(0, windows->counter);
+  }
+  MPI_Barrier(comm);
+}
+
+static void free_windows(PoolWindows *windows) {
+  MPI_Win_free(&windows->output);
+  MPI_Win_free(&windows->input);
+  MPI_Win_free(&windows->counter);
+}
+
+// Claims and computes chunks until the pool is empty or a chunk failed. The
+// source buffer holds a chunk and its halos, the destination buffer a chunk
+static app_error drain_pool(const PoolWindows *windows, int width, int height,
+                            Kernel kernel, MPI_Datatype row_type, Pixel *src,
+                            Pixel *dst, double *claims) {
+  strip_function compute_strip = convolve_rows_direct;
+  if (get_accumulation_precision() == PRECISION_FLOAT)
+    compute_strip = convolve_rows_direct_float;
+  int num_chunks = (height + chunk_rows - 1) / chunk_rows;
+  int halo = kernel.size / 2;
+  const int one = 1;
+
+  for (;;) {
+    double claim_start = MPI_Wtime();
+    int chunk;
+    MPI_Fetch_and_op(&one, &chunk, MPI_INT, 0, 0, MPI_SUM, windows->counter);
+    MPI_Win_flush(0, windows->counter);
+    double latency = MPI_Wtime() - claim_start;
+    claims[CLAIM_COUNT] += 1;
+    claims[CLAIM_TIME] += latency;
+    if (latency > claims[CLAIM_MAX])
+      claims[CLAIM_MAX] = latency;
+    if (chunk >= num_chunks)
+      return SUCCESS;
+
+    // Rows of the chunk, and rows of the image fetched for it: [lo, hi)
+    int first = chunk * chunk_rows;
+    int rows = height - first < chunk_rows ? height - first : chunk_rows;
+    int lo = first - halo > 0 ? first - halo : 0;
+    int hi = first + rows + halo < height ? first + rows + halo : height;
+
+    phase_timer_begin(PHASE_SCATTER);
+    MPI_Get(src, hi - lo, row_type, 0, (MPI_Aint)lo * width, hi - lo, row_type,
+            windows->input);
+    MPI_Win_flush(0, windows->input);
+    phase_timer_end(PHASE_SCATTER);
+
+    phase_timer_begin(PHASE_COMPUTE);
+    app_error err =
+        compute_strip(src, width, hi - lo, first - lo, rows, kernel, dst);
+    phase_timer_end(PHASE_COMPUTE);
+    if (err)
+      return err;
+
+    phase_timer_begin(PHASE_GATHER);
+    MPI_Put(dst, rows, row_type, 0, (MPI_Aint)first * width, rows, row_type,
+            windows->output);
+    MPI_Win_flush(0, windows->output);
+    phase_timer_end(PHASE_GATHER);
+    claims[CLAIM_CHUNKS] += 1;
+  }
+}
+
+// Prints the chunks of every rank and the claim latency on rank 0
+static void report_claims(const double *claims, int num_chunks,
+                          MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  double *all = NULL;
+  if (rank == 0) {
+    all = (double *)malloc((size_t)size * CLAIM_FIELDS * sizeof(double));
+    if (!all)
+      fprintf(stderr, "\tWarning: could not gather the work pool claims\n");
+  }
+  int gathered = rank != 0 || all != NULL;
+  MPI_Bcast(&gathered, 1, MPI_INT, 0, comm);
+  if (!gathered)
+    return;
+  MPI_Gather(claims, CLAIM_FIELDS, MPI_DOUBLE, all, CLAIM_FIELDS, MPI_DOUBLE,
+             0, comm);
+  if (rank != 0)
+    return;
+
+  double count = 0.0, time = 0.0, slowest = 0.0;
+  for (int r = 0; r < size; r++) {
+    const double *c = &all[(size_t)r * CLAIM_FIELDS];
+    count += c[CLAIM_COUNT];
+    time += c[CLAIM_TIME];
+    if (c[CLAIM_MAX] > slowest)
+      slowest = c[CLAIM_MAX];
+  }
+  printf("\tWork pool: %d chunks of %d rows, claim latency avg %.2f us, max "
+         "%.2f us\n",
+         num_chunks, chunk_rows, count > 0 ? 1e6 * time / count : 0.0,
+         1e6 * slowest);
+  printf("\tChunks per rank:");
+  for (int r = 0; r < size; r++)
+    printf(" %.0f", all[(size_t)r * CLAIM_FIELDS + CLAIM_CHUNKS]);
+  printf("\n");
+  free(all);
+}
+
+app_error convolve_work_pool(Image *img, Kernel kernel, double *elapsed_time) {
+  double start_time = MPI_Wtime();
+  MPI_Comm comm = get_convolution_comm();
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+
+  // 1. Broadcast Dimensions
+  phase_timer_begin(PHASE_BCAST);
+  int dims[3];
+  if (rank == 0) {
+    dims[0] = img->width;
+    dims[1] = img->height;
+    dims[2] = kernel.size;
+  }
+  MPI_Bcast(dims, 3, MPI_INT, 0, comm);
+  int width = dims[0], height = dims[1], k_size = dims[2];
+  int halo = k_size / 2;
+
+  // 2. Allocate the chunk buffers (and the result on rank 0)
+  app_error err = chunk_rows < 1 ? ERR_INVALID_ARGS : SUCCESS;
+  int rows = chunk_rows < height ? chunk_rows : height;
+  int src_rows = rows + 2 * halo < height ? rows + 2 * halo : height;
+  double *kernel_data = rank == 0 ? (double *)kernel.data : NULL;
+  Pixel *src = NULL, *dst = NULL, *output = NULL;
+  if (!err) {
+    if (rank != 0)
+      kernel_data = (double *)malloc((size_t)k_size * k_size * sizeof(double));
+    src = alloc_pixel(width, src_rows);
+    dst = alloc_pixel(width, rows);
+    if (rank == 0)
+      output = alloc_pixel(width, height);
+    if (!kernel_data || !src || !dst || (rank == 0 && !output))
+      err = ERR_MEM_ALLOC;
+  }
+  int any_err = err;
+  MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, comm);
+  err = (app_error)any_err;
+  if (!err)
+    MPI_Bcast(kernel_data, k_size * k_size, MPI_DOUBLE, 0, comm);
+  phase_timer_end(PHASE_BCAST);
+
+  // 3. Drain the pool in passive-target epochs on every window
+  double claims[CLAIM_FIELDS] = {0.0};
+  if (!err) {
+    PoolWindows windows;
+    create_windows(rank == 0 ? img->data : NULL, output, width, height, comm,
+                   &windows);
+    MPI_Datatype row_type = create_row_datatype(width);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, windows.counter);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, windows.input);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, windows.output);
+
+    Kernel local_kernel = {kernel.name, k_size, kernel_data};
+    err = drain_pool(&windows, width, height, local_kernel, row_type, src, dst,
+                     claims);
+
+    MPI_Win_unlock_all(windows.output);
+    MPI_Win_unlock_all(windows.input);
+    MPI_Win_unlock_all(windows.counter);
+    MPI_Type_free(&row_type);
+    // Every put has reached rank 0 once the windows are freed
+    free_windows(&windows);
+
+    any_err = err;
+    MPI_Allreduce(MPI_IN_PLACE, &any_err, 1, MPI_INT, MPI_MAX, comm);
+    err = (app_error)any_err;
+  }
+
+  // 4. Cleanup
+  if (rank == 0 && !err) {
+    free_pixel(img->data);
+    img->data = output;
+    output = NULL;
+  }
+  free_pixel(output);
+  free_pixel(src);
+  free_pixel(dst);
+  if (rank != 0)
+    free(kernel_data);
+
+  double end_time = MPI_Wtime();
+  if (elapsed_time != NULL)
+    *elapsed_time = end_time - start_time;
+
+  if (!err)
+    report_claims(claims, (height + chunk_rows - 1) / chunk_rows, comm);
+  return err;
+}
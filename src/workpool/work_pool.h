@@ -0,0 +1,44 @@
+#ifndef __WORK_POOL_H__
+#define __WORK_POOL_H__
+
+#include "../bmp/bmp_io.h"
+#include "../config/kernel.h"
+#include "../errors/errors.h"
+
+// Default rows of a chunk claimed from the work pool
+#define DEFAULT_WORK_POOL_CHUNK_ROWS 16
+
+/**
+ * Selects the rows of a chunk of the work pool engine.
+ * @param rows Rows per chunk, see DEFAULT_WORK_POOL_CHUNK_ROWS
+ */
+void set_work_pool_chunk_rows(int rows);
+
+/**
+ * Returns the rows of a chunk of the work pool engine.
+ */
+int get_work_pool_chunk_rows(void);
+
+/**
+ * Distributed convolution over the communicator of the distributed engine
+ * (see set_convolution_comm()) without a master: the image is cut into
+ * chunks of rows and every rank, rank 0 included, claims the next chunk
+ * with MPI_Fetch_and_op on a counter in an RMA window of rank 0, fetches the
+ * rows of the chunk and its halos with MPI_Get from the window that exposes
+ * the image of rank 0, computes it and puts the result with MPI_Put into
+ * the output window of rank 0, until no chunk is left. The windows are
+ * accessed in passive-target epochs, so no rank serves the requests of the
+ * others and faster ranks simply claim more chunks.
+ * Rank 0 prints the chunks computed by every rank and the latency of a
+ * claim (average and maximum over every claim of every rank).
+ * @param img Image on rank 0 (ignored on the other ranks)
+ * @param kernel The convolution kernel (only read on rank 0)
+ * @param elapsed_time Output: elapsed time of the whole operation
+ * @return app_error code (identical on all ranks):
+ *         - SUCCESS: Convolution completed, result in img on rank 0
+ *         - ERR_INVALID_ARGS: The chunk rows are not positive
+ *         - ERR_MEM_ALLOC: Memory allocation failed
+ */
+app_error convolve_work_pool(Image *img, Kernel kernel, double *elapsed_time);
+
+#endif